@@ -79,6 +79,7 @@ static NSTimeInterval launchStartedAt;
     SetCurrentAppContext([MainAppContext new]);
 
     launchStartedAt = CACurrentMediaTime();
+    [OWSStartupTimeline.sharedTimeline markEvent:@"app.didFinishLaunching"];
 
     BOOL isLoggingEnabled;
 #ifdef DEBUG
@@ -564,16 +565,39 @@ static NSTimeInterval launchStartedAt;
                 // and continue cleaning in the background.
                 [[OWSDisappearingMessagesJob sharedJob] startIfNecessary];
 
+                // Finish deleting any threads whose deletion was interrupted.
+                [[OWSThreadDeletionJob sharedJob] startIfNecessary];
+
+                // Spend a little time on the current orphaned data cleanup cycle.
+                [[OWSIncrementalOrphanedDataCleaner sharedCleaner] startIfNecessary];
+
+                // Build the unread counts on first launch, and rebuild them if they've drifted from the unread view.
+                // The inbox summaries include the unread counts, so they're built afterwards.
+                [[OWSPrimaryStorage sharedManager].newDatabaseConnection
+                    readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+                        [OWSUnreadCounter repairIfNecessaryWithTransaction:transaction];
+                        [OWSInboxSummary buildIfNecessaryWithTransaction:transaction];
+                    }];
+
                 [self enableBackgroundRefreshIfNecessary];
 
-                // Mark all "attempting out" messages as "unsent", i.e. any messages that were not successfully
-                // sent before the app exited should be marked as failures.
-                [[[OWSFailedMessagesJob alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]] run];
-                // Mark all "incomplete" calls as missed, e.g. any incoming or outgoing calls that were not
-                // connected, failed or hung up before the app existed should be marked as missed.
-                [[[OWSIncompleteCallsJob alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]] run];
-                [[[OWSFailedAttachmentDownloadsJob alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]]
-                    run];
+                // The indexes these jobs use can still be building once storage is ready, so they wait for them.
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [[OWSPrimaryStorage sharedManager] runWhenAllExtensionsAreReady:^{
+                        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                            // Mark all "attempting out" messages as "unsent", i.e. any messages that were not
+                            // successfully sent before the app exited should be marked as failures.
+                            [[[OWSFailedMessagesJob alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]]
+                                run];
+                            // Mark all "incomplete" calls as missed, e.g. any incoming or outgoing calls that were
+                            // not connected, failed or hung up before the app existed should be marked as missed.
+                            [[[OWSIncompleteCallsJob alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]]
+                                run];
+                            [[[OWSFailedAttachmentDownloadsJob alloc]
+                                initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]] run];
+                        });
+                    }];
+                });
 
                 [AppStoreRating setupRatingLibrary];
             });
@@ -1038,6 +1062,7 @@ static NSTimeInterval launchStartedAt;
     // Note that this does much more than set a flag;
     // it will also run all deferred blocks.
     [AppReadiness setAppIsReady];
+    [OWSStartupTimeline.sharedTimeline markEvent:@"app.ready"];
 
     if ([TSAccountManager isRegistered]) {
         DDLogInfo(@"localNumber: %@", [TSAccountManager localUID]);
@@ -1124,6 +1149,7 @@ static NSTimeInterval launchStartedAt;
 
     NSTimeInterval startupDuration = CACurrentMediaTime() - launchStartedAt;
     DDLogInfo(@"%@ Presenting app %.2f seconds after launch started.", self.logTag, startupDuration);
+    [OWSStartupTimeline.sharedTimeline markEvent:@"app.rootViewControllerPresented"];
 
     if ([TSAccountManager isRegistered]) {
         HomeViewController *homeView = [HomeViewController new];
@@ -14,6 +14,7 @@
 #import "OWSQuotedMessageView.h"
 #import "Relay-Swift.h"
 #import <RelayMessaging/UIView+OWS.h>
+#import <RelayServiceKit/OWSThumbnailService.h>
 
 @import WebKit;
 @import URLEmbeddedView;
@@ -598,6 +599,47 @@ NS_ASSUME_NONNULL_BEGIN
     return cellMedia;
 }
 
+// Stills are drawn from a downsampled thumbnail which is decoded off the main thread.
+- (void)tryToLoadThumbnailIntoImageView:(UIImageView *)imageView
+{
+    OWSAssertDebug(self.attachmentStream);
+
+    if (self.viewItem.didCellMediaFailToLoad) {
+        return;
+    }
+
+    TSAttachmentStream *attachmentStream = self.attachmentStream;
+    UIImage *_Nullable cachedImage =
+        [OWSThumbnailService.sharedService cachedThumbnailForAttachment:attachmentStream
+                                                          thumbnailSize:OWSThumbnailSizeLarge];
+    if (cachedImage) {
+        DDLogVerbose(@"%@ cell media cache hit", self.logTag);
+        imageView.image = cachedImage;
+        return;
+    }
+
+    __weak OWSMessageBubbleView *weakSelf = self;
+    [OWSThumbnailService.sharedService
+        thumbnailForAttachment:attachmentStream
+                 thumbnailSize:OWSThumbnailSizeLarge
+                      priority:OWSThumbnailPriorityVisible
+                    completion:^(UIImage *_Nullable image) {
+                        OWSMessageBubbleView *strongSelf = weakSelf;
+                        if (!strongSelf || strongSelf.bodyMediaView != imageView
+                            || strongSelf.attachmentStream != attachmentStream) {
+                            // The cell was reused while we were loading.
+                            return;
+                        }
+                        if (image) {
+                            imageView.image = image;
+                        } else {
+                            DDLogError(@"%@ Failed to load cell media: %@", [strongSelf logTag], [attachmentStream mediaURL]);
+                            strongSelf.viewItem.didCellMediaFailToLoad = YES;
+                            [strongSelf showAttachmentErrorViewWithMediaView:imageView];
+                        }
+                    }];
+}
+
 - (CGFloat)textViewVSpacing
 {
     return 2.f;
@@ -760,19 +802,8 @@ NS_ASSUME_NONNULL_BEGIN
         if (stillImageView.image) {
             return;
         }
-        // Don't cache large still images.
-        //
-        // TODO: Don't use full size images in the message cells.
-        const NSUInteger kMaxCachableSize = 1024 * 1024;
-        BOOL shouldSkipCache =
-            [OWSFileSystem fileSizeOfPath:strongSelf.attachmentStream.filePath].unsignedIntegerValue < kMaxCachableSize;
-        stillImageView.image = [strongSelf tryToLoadCellMedia:^{
-            OWSCAssertDebug([strongSelf.attachmentStream isImage]);
-            return strongSelf.attachmentStream.image;
-        }
-                                                    mediaView:stillImageView
-                                                     cacheKey:strongSelf.attachmentStream.uniqueId
-                                              shouldSkipCache:shouldSkipCache];
+        OWSCAssertDebug([strongSelf.attachmentStream isImage]);
+        [strongSelf tryToLoadThumbnailIntoImageView:stillImageView];
     };
     self.unloadCellContentBlock = ^{
         OWSMessageBubbleView *strongSelf = weakSelf;
@@ -781,6 +812,8 @@ NS_ASSUME_NONNULL_BEGIN
         }
         OWSCAssertDebug(strongSelf.bodyMediaView == stillImageView);
         stillImageView.image = nil;
+        [OWSThumbnailService.sharedService updatePriority:OWSThumbnailPriorityPrefetch
+                                          forAttachmentId:strongSelf.attachmentStream.uniqueId];
     };
 
     return stillImageView;
@@ -889,14 +922,8 @@ NS_ASSUME_NONNULL_BEGIN
         if (stillImageView.image) {
             return;
         }
-        stillImageView.image = [strongSelf tryToLoadCellMedia:^{
-            OWSCAssertDebug([strongSelf.attachmentStream isVideo]);
-
-            return strongSelf.attachmentStream.image;
-        }
-                                                    mediaView:stillImageView
-                                                     cacheKey:strongSelf.attachmentStream.uniqueId
-                                              shouldSkipCache:NO];
+        OWSCAssertDebug([strongSelf.attachmentStream isVideo]);
+        [strongSelf tryToLoadThumbnailIntoImageView:stillImageView];
     };
     self.unloadCellContentBlock = ^{
         OWSMessageBubbleView *strongSelf = weakSelf;
@@ -905,6 +932,8 @@ NS_ASSUME_NONNULL_BEGIN
         }
         OWSCAssertDebug(strongSelf.bodyMediaView == stillImageView);
         stillImageView.image = nil;
+        [OWSThumbnailService.sharedService updatePriority:OWSThumbnailPriorityPrefetch
+                                          forAttachmentId:strongSelf.attachmentStream.uniqueId];
     };
 
     return stillImageView;
@@ -217,8 +217,21 @@ NS_ASSUME_NONNULL_BEGIN
     if (self.hasQuotedAttachment) {
         UIView *_Nullable quotedAttachmentView = nil;
         UIImage *_Nullable thumbnailImage = [self tryToLoadThumbnailImage];
-        if (thumbnailImage) {
-            quotedAttachmentView = [self imageViewForImage:thumbnailImage];
+        TSAttachmentStream *_Nullable thumbnailAttachmentStream
+            = (self.hasQuotedAttachmentThumbnailImage ? self.quotedMessage.thumbnailAttachmentStream : nil);
+        if (thumbnailImage || thumbnailAttachmentStream) {
+            UIImageView *thumbnailImageView = [self imageViewForImage:thumbnailImage];
+            if (!thumbnailImage) {
+                // Loaded off the main thread, as it may have to be generated.
+                __weak UIImageView *weakThumbnailImageView = thumbnailImageView;
+                [OWSThumbnailService.sharedService thumbnailForAttachment:thumbnailAttachmentStream
+                                                            thumbnailSize:OWSThumbnailSizeSmall
+                                                                 priority:OWSThumbnailPriorityVisible
+                                                               completion:^(UIImage *_Nullable image) {
+                                                                   weakThumbnailImageView.image = image;
+                                                               }];
+            }
+            quotedAttachmentView = thumbnailImageView;
             quotedAttachmentView.clipsToBounds = YES;
             quotedAttachmentView.backgroundColor = [UIColor whiteColor];
 
@@ -306,10 +319,9 @@ NS_ASSUME_NONNULL_BEGIN
     return image;
 }
 
-- (UIImageView *)imageViewForImage:(UIImage *)image
+// The image may be nil if it's yet to be loaded.
+- (UIImageView *)imageViewForImage:(nullable UIImage *)image
 {
-    OWSAssertDebug(image);
-
     UIImageView *imageView = [UIImageView new];
     imageView.image = image;
     // We need to specify a contentMode since the size of the image
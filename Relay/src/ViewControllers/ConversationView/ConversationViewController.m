@@ -3522,8 +3522,7 @@ typedef enum : NSUInteger {
 
     __block NSUInteger numberOfUnreadMessages;
     [self.uiDatabaseConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
-        numberOfUnreadMessages =
-            [[transaction ext:TSUnreadDatabaseViewExtensionName] numberOfItemsInGroup:self.thread.uniqueId];
+        numberOfUnreadMessages = [self.thread unreadMessageCountWithTransaction:transaction];
     }];
     self.hasUnreadMessages = numberOfUnreadMessages > 0;
 }
@@ -48,6 +48,9 @@ class ConversationSearchViewController: UITableViewController {
 
     private var hasThemeChanged = false
 
+    // The search index can still be building once storage is ready.
+    private var isSearchIndexReady = false
+
     // MARK: View Lifecycle
 
     override func viewDidLoad() {
@@ -56,6 +59,15 @@ class ConversationSearchViewController: UITableViewController {
         tableView.rowHeight = UITableViewAutomaticDimension
         tableView.estimatedRowHeight = 60
 
+        OWSPrimaryStorage.shared().runWhenExtensionIsReady(FullTextSearchFinder.databaseExtensionName()) { [weak self] in
+            guard let strongSelf = self else {
+                return
+            }
+
+            strongSelf.isSearchIndexReady = true
+            strongSelf.updateSearchResults(searchText: strongSelf.searchText)
+        }
+
         tableView.register(EmptySearchResultCell.self, forCellReuseIdentifier: EmptySearchResultCell.reuseIdentifier)
         tableView.register(HomeViewCell.self, forCellReuseIdentifier: HomeViewCell.cellReuseIdentifier())
         tableView.register(ContactTableViewCell.self, forCellReuseIdentifier: ContactTableViewCell.reuseIdentifier())
@@ -339,6 +351,11 @@ class ConversationSearchViewController: UITableViewController {
             return
         }
 
+        guard isSearchIndexReady else {
+            Logger.info("\(logTag) waiting for the search index.")
+            return
+        }
+
         self.uiDatabaseConnection.read { transaction in
             self.searchResultSet = self.searcher.results(searchText: searchText, transaction: transaction, contactsManager: self.contactsManager)
         }
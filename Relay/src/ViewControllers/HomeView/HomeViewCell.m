@@ -202,6 +202,10 @@ NS_ASSUME_NONNULL_BEGIN
                                              selector:@selector(otherUsersProfileDidChange:)
                                                  name:kNSNotificationName_OtherUsersProfileDidChange
                                                object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(avatarsDidChange:)
+                                                 name:ThreadAvatarService.avatarsDidChangeNotification
+                                               object:nil];
     [self updateNameLabel];
     [self updateAvatarView];
 
@@ -333,7 +337,38 @@ NS_ASSUME_NONNULL_BEGIN
         return;
     }
 
-    self.avatarView.image = [ThreadManager.sharedManager imageWithThreadId:thread.threadRecord.uniqueId];
+    // Drawn from the thread in memory, with the rendered avatar delivered later if it isn't already cached.
+    ThreadAvatarService *avatarService = ThreadAvatarService.shared;
+    TSThread *threadRecord = thread.threadRecord;
+    NSString *fingerprint = [avatarService fingerprintForThread:threadRecord];
+    __weak HomeViewCell *weakSelf = self;
+    self.avatarView.image = [avatarService avatarForThread:threadRecord
+                                                  diameter:self.avatarSize
+                                                completion:^(UIImage *image) {
+                                                    HomeViewCell *_Nullable strongSelf = weakSelf;
+                                                    TSThread *_Nullable currentThread = strongSelf.thread.threadRecord;
+                                                    // The cell may have been reused or its avatar changed since.
+                                                    if (!currentThread ||
+                                                        ![[avatarService fingerprintForThread:currentThread]
+                                                            isEqualToString:fingerprint]) {
+                                                        return;
+                                                    }
+                                                    strongSelf.avatarView.image = image;
+                                                }];
+}
+
+- (void)avatarsDidChange:(NSNotification *)notification
+{
+    OWSAssertIsOnMainThread();
+
+    // Without a recipientId, every avatar drawn from a recipient has changed.
+    NSString *_Nullable recipientId = notification.userInfo[@"recipientId"];
+    TSThread *_Nullable threadRecord = self.thread.threadRecord;
+    if (recipientId && !(threadRecord.isOneOnOne && [threadRecord.otherParticipantId isEqualToString:recipientId])) {
+        return;
+    }
+
+    [self updateAvatarView];
 }
 
 - (NSAttributedString *)attributedSnippetForThread:(ThreadViewModel *)thread
@@ -8,6 +8,8 @@
 #import "HomeViewCell.h"
 #import "OWSNavigationController.h"
 #import "OWSPrimaryStorage.h"
+#import "OWSStartupTimeline.h"
+#import "OWSThreadDeletionJob.h"
 #import "PushManager.h"
 #import "RegistrationUtils.h"
 #import "Relay-Swift.h"
@@ -88,6 +90,10 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
 @property (nonatomic, readonly) UIView *deregisteredView;
 @property (nonatomic, readonly) UIView *outageView;
 @property (nonatomic, readonly) UIView *archiveReminderView;
+@property (nonatomic, readonly) ReminderView *migrationProgressView;
+
+// Of the migration running after launch, if any.
+@property (nonatomic, nullable) NSNumber *migrationProgress;
 
 @property (nonatomic) TSThread *lastThread;
 
@@ -179,6 +185,10 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
                                              selector:@selector(themeDidChange:)
                                                  name:ThemeDidChangeNotification
                                                object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(databaseMigrationProgressDidChange:)
+                                                 name:OWSDatabaseMigrationProgressNotification
+                                               object:nil];
 }
 
 - (void)dealloc
@@ -209,6 +219,23 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
     [self updateReminderViews];
 }
 
+- (void)databaseMigrationProgressDidChange:(NSNotification *)notification
+{
+    OWSAssertIsOnMainThread();
+
+    NSNumber *_Nullable progress = notification.userInfo[OWSDatabaseMigrationProgressKey];
+    if (progress.doubleValue >= 1) {
+        progress = nil;
+    }
+    BOOL wasVisible = self.migrationProgress != nil;
+    self.migrationProgress = progress;
+
+    [self updateReminderViews];
+    if (wasVisible != (progress != nil)) {
+        [self reloadTableViewData];
+    }
+}
+
 #pragma mark - Theme
 
 - (void)themeDidChange:(id)notification
@@ -278,6 +305,10 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
     _archiveReminderView = archiveReminderView;
     [reminderStackView addArrangedSubview:archiveReminderView];
 
+    ReminderView *migrationProgressView = [ReminderView explanationWithText:@""];
+    _migrationProgressView = migrationProgressView;
+    [reminderStackView addArrangedSubview:migrationProgressView];
+
     self.tableView = [[UITableView alloc] initWithFrame:CGRectZero style:UITableViewStylePlain];
     self.tableView.delegate = self;
     self.tableView.dataSource = self;
@@ -319,8 +350,18 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
     // to re-render this.
     self.deregisteredView.hidden = !TSAccountManager.sharedInstance.isDeregistered;
     self.outageView.hidden = !OutageDetection.sharedManager.hasOutage;
+    self.migrationProgressView.hidden = self.migrationProgress == nil;
+    if (self.migrationProgress) {
+        self.migrationProgressView.text = [NSString
+            stringWithFormat:NSLocalizedString(@"INBOX_VIEW_DATABASE_MIGRATION_PROGRESS_FORMAT",
+                                 @"Label telling the user that the database is being updated in the background. "
+                                 @"Embeds {{the percentage done}}."),
+            [NSNumberFormatter localizedStringFromNumber:self.migrationProgress
+                                             numberStyle:NSNumberFormatterPercentStyle]];
+    }
 
-    self.hasVisibleReminders = !self.archiveReminderView.isHidden || !self.deregisteredView.isHidden || !self.outageView.isHidden;
+    self.hasVisibleReminders = !self.archiveReminderView.isHidden || !self.deregisteredView.isHidden
+        || !self.outageView.isHidden || !self.migrationProgressView.isHidden;
 }
 
 - (void)viewDidLoad
@@ -418,6 +459,11 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
 
     [self applyDefaultBackButton];
 
+    if (![OWSStartupTimeline.sharedTimeline timeOfEvent:@"inbox.firstAppearance"]) {
+        [OWSStartupTimeline.sharedTimeline markEvent:@"inbox.firstAppearance"];
+        [OWSStartupTimeline.sharedTimeline logTimeline];
+    }
+
     if (self.hasThemeChanged) {
         [self.tableView reloadData];
         self.hasThemeChanged = NO;
@@ -1147,11 +1193,8 @@ NSString *const kArchivedConversationsReuseIdentifier = @"kArchivedConversations
 
 - (void)deleteThread:(TSThread *)thread
 {
-dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-                                           [self.editingDbConnection asyncReadWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
-                                               [thread removeWithTransaction:transaction];
-                                           }];
-                                       });
+    // The thread leaves the inbox right away; its messages are removed in the background.
+    [[OWSThreadDeletionJob sharedJob] deleteThread:thread progress:nil completion:nil];
     [self checkIfEmptyView];
 }
 
@@ -35,6 +35,12 @@ typedef NS_OPTIONS(NSInteger, MediaGalleryOption) {
 // If viewItem is non-null, long press will show a menu controller.
 - (instancetype)initWithGalleryItemBox:(GalleryItemBox *)galleryItemBox
                               viewItem:(ConversationViewItem *_Nullable)viewItem;
+
+// prefetchedImage, if non-null, is an already decoded rendition of the attachment
+// which is used instead of loading the image from disk.
+- (instancetype)initWithGalleryItemBox:(GalleryItemBox *)galleryItemBox
+                              viewItem:(ConversationViewItem *_Nullable)viewItem
+                       prefetchedImage:(UIImage *_Nullable)prefetchedImage;
 #pragma mark - Actions
 
 - (void)didPressShare:(id)sender;
@@ -63,6 +63,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (instancetype)initWithGalleryItemBox:(GalleryItemBox *)galleryItemBox
                               viewItem:(ConversationViewItem *_Nullable)viewItem
+{
+    return [self initWithGalleryItemBox:galleryItemBox viewItem:viewItem prefetchedImage:nil];
+}
+
+- (instancetype)initWithGalleryItemBox:(GalleryItemBox *)galleryItemBox
+                              viewItem:(ConversationViewItem *_Nullable)viewItem
+                       prefetchedImage:(UIImage *_Nullable)prefetchedImage
 {
     self = [super initWithNibName:nil bundle:nil];
     if (!self) {
@@ -72,7 +79,7 @@ NS_ASSUME_NONNULL_BEGIN
     _galleryItemBox = galleryItemBox;
     _viewItem = viewItem;
     // We cache the image data in case the attachment stream is deleted.
-    _image = galleryItemBox.attachmentStream.image;
+    _image = prefetchedImage ?: galleryItemBox.attachmentStream.image;
 
     return self;
 }
@@ -0,0 +1,225 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+import Foundation
+
+// Keeps a sliding window of gallery media warm around the user's position.
+//
+// Thumbnails (for the tile view) and screen-sized decoded images (for the page view) are
+// prefetched `prefetchDistance` items ahead of the visible items in the direction of travel, and
+// `retainDistance` items behind them. Work which this prefetcher requested for items which leave
+// the window is cancelled, and decoded images outside the window, or over the memory budget, are
+// evicted.
+class MediaGalleryPrefetcher: NSObject {
+
+    private class DecodeRequest {
+        var isCancelled = false
+    }
+
+    struct Configuration {
+        var prefetchDistance: Int = 12
+        var retainDistance: Int = 4
+        var memoryBudgetBytes: Int = 96 * 1024 * 1024
+    }
+
+    var configuration: Configuration {
+        didSet {
+            trimToMemoryBudget()
+        }
+    }
+
+    private let decodeQueue = DispatchQueue(label: "org.whispersystems.gallery.prefetch", qos: .utility)
+
+    // These properties should only be accessed on the main thread.
+    private var decodedImages: [String: UIImage] = [:]
+    private var decodedImageCosts: [String: Int] = [:]
+    private var pendingDecodes: [String: DecodeRequest] = [:]
+    private var prefetchedThumbnailIds = Set<String>()
+    // Only the prefetcher's own requests, so that cancelling them leaves visible cells' requests alone.
+    private var thumbnailRequestIds: [String: UUID] = [:]
+    private var windowItemIds: [String] = []
+
+    init(configuration: Configuration = Configuration()) {
+        self.configuration = configuration
+
+        super.init()
+
+        NotificationCenter.default.addObserver(self,
+                                               selector: #selector(didReceiveMemoryWarning),
+                                               name: NSNotification.Name.UIApplicationDidReceiveMemoryWarning,
+                                               object: nil)
+    }
+
+    deinit {
+        NotificationCenter.default.removeObserver(self)
+        pendingDecodes.values.forEach { $0.isCancelled = true }
+        thumbnailRequestIds.values.forEach { OWSThumbnailService.shared().cancelRequest($0) }
+    }
+
+    // MARK: - Window
+
+    // `items` must be in gallery order, and `visibleRange` the indices of the items on screen. `direction` is .after
+    // when moving toward newer media, .before when moving toward older media, and .around when the direction is
+    // unknown.
+    func updateWindow(items: [MediaGalleryItem], visibleRange: ClosedRange<Int>, direction: GalleryDirection, includeFullSizeImages: Bool) {
+        AssertIsOnMainThread()
+
+        guard items.count > 0 else {
+            return
+        }
+
+        let window = windowRange(count: items.count, visibleRange: visibleRange, direction: direction)
+        // Nearest first, so the items the user will reach soonest are queued first.
+        let distance: (Int) -> Int = { index in
+            return index < visibleRange.lowerBound ? visibleRange.lowerBound - index : max(0, index - visibleRange.upperBound)
+        }
+        let orderedIndices = window.sorted { distance($0) < distance($1) }
+        let windowItems = orderedIndices.map { items[$0] }
+        let windowIds = Set(windowItems.map { $0.attachmentStream.uniqueId })
+
+        // Cancel stale work.
+        for attachmentId in prefetchedThumbnailIds.subtracting(windowIds) {
+            if let requestId = thumbnailRequestIds.removeValue(forKey: attachmentId) {
+                OWSThumbnailService.shared().cancelRequest(requestId)
+            }
+        }
+        prefetchedThumbnailIds = prefetchedThumbnailIds.intersection(windowIds)
+        for (attachmentId, request) in pendingDecodes where !windowIds.contains(attachmentId) {
+            request.isCancelled = true
+            pendingDecodes.removeValue(forKey: attachmentId)
+        }
+        for attachmentId in decodedImages.keys where !windowIds.contains(attachmentId) {
+            evictImage(attachmentId: attachmentId)
+        }
+        windowItemIds = windowItems.map { $0.attachmentStream.uniqueId }
+
+        for item in windowItems {
+            let attachmentStream = item.attachmentStream
+            let attachmentId = attachmentStream.uniqueId
+
+            if !prefetchedThumbnailIds.contains(attachmentId) {
+                prefetchedThumbnailIds.insert(attachmentId)
+                let requestId = OWSThumbnailService.shared().thumbnail(attachment: attachmentStream, size: .medium, priority: .prefetch) { [weak self] _ in
+                    self?.thumbnailRequestIds.removeValue(forKey: attachmentId)
+                }
+                thumbnailRequestIds[attachmentId] = requestId
+            }
+
+            if includeFullSizeImages && item.isImage && decodedImages[attachmentId] == nil && pendingDecodes[attachmentId] == nil {
+                enqueueDecode(attachmentStream: attachmentStream)
+            }
+        }
+    }
+
+    // Always covers the visible items, however many there are.
+    func windowRange(count: Int, visibleRange: ClosedRange<Int>, direction: GalleryDirection) -> [Int] {
+        let ahead = configuration.prefetchDistance
+        let behind = configuration.retainDistance
+        let first = visibleRange.lowerBound
+        let last = visibleRange.upperBound
+        let range: ClosedRange<Int> = {
+            switch direction {
+            case .after:
+                return (first - behind)...(last + ahead)
+            case .before:
+                return (first - ahead)...(last + behind)
+            case .around:
+                return (first - ahead / 2)...(last + ahead / 2)
+            }
+        }()
+        return Array(range.clamped(to: 0...(count - 1)))
+    }
+
+    // MARK: - Decoded Images
+
+    func decodedImage(for item: MediaGalleryItem) -> UIImage? {
+        AssertIsOnMainThread()
+
+        return decodedImages[item.attachmentStream.uniqueId]
+    }
+
+    private func enqueueDecode(attachmentStream: TSAttachmentStream) {
+        let attachmentId = attachmentStream.uniqueId
+        let nativeSize = UIScreen.main.nativeBounds.size
+        // Leave some headroom for zooming without holding full-resolution camera images in memory.
+        let maxPixelSize = max(nativeSize.width, nativeSize.height) * 2
+
+        let request = DecodeRequest()
+        pendingDecodes[attachmentId] = request
+        decodeQueue.async { [weak self] in
+            // Skip the decode entirely if the user has already moved on.
+            guard !request.isCancelled else {
+                return
+            }
+            let image = attachmentStream.decodedThumbnail(withMaxPixelSize: maxPixelSize)
+            DispatchQueue.main.async {
+                guard let strongSelf = self else {
+                    return
+                }
+                guard !request.isCancelled, strongSelf.pendingDecodes[attachmentId] === request else {
+                    return
+                }
+                strongSelf.pendingDecodes.removeValue(forKey: attachmentId)
+                guard let image = image else {
+                    Logger.warn("\(strongSelf.logTag) failed to decode attachment: \(attachmentId)")
+                    return
+                }
+                strongSelf.store(image: image, attachmentId: attachmentId)
+            }
+        }
+    }
+
+    private func store(image: UIImage, attachmentId: String) {
+        let cost: Int = {
+            guard let cgImage = image.cgImage else {
+                return Int(image.size.width * image.size.height * image.scale * image.scale * 4)
+            }
+            return cgImage.bytesPerRow * cgImage.height
+        }()
+        decodedImages[attachmentId] = image
+        decodedImageCosts[attachmentId] = cost
+        trimToMemoryBudget()
+    }
+
+    private func evictImage(attachmentId: String) {
+        decodedImages.removeValue(forKey: attachmentId)
+        decodedImageCosts.removeValue(forKey: attachmentId)
+    }
+
+    var decodedImageBytes: Int {
+        return decodedImageCosts.values.reduce(0, +)
+    }
+
+    // Evicts the images farthest from the focused item until we're within budget.
+    private func trimToMemoryBudget() {
+        var totalCost = decodedImageBytes
+        guard totalCost > configuration.memoryBudgetBytes else {
+            return
+        }
+        for attachmentId in windowItemIds.reversed() {
+            guard totalCost > configuration.memoryBudgetBytes else {
+                break
+            }
+            guard let cost = decodedImageCosts[attachmentId] else {
+                continue
+            }
+            evictImage(attachmentId: attachmentId)
+            totalCost -= cost
+        }
+    }
+
+    func evictAll() {
+        AssertIsOnMainThread()
+
+        pendingDecodes.values.forEach { $0.isCancelled = true }
+        pendingDecodes.removeAll()
+        decodedImages.removeAll()
+        decodedImageCosts.removeAll()
+    }
+
+    @objc func didReceiveMemoryWarning() {
+        Logger.info("\(logTag) in \(#function)")
+        evictAll()
+    }
+}
@@ -34,7 +34,7 @@ public struct MediaGalleryItem: Equatable, Hashable {
     }
 
     var thumbnailImage: UIImage {
-        guard let image = attachmentStream.thumbnailImage() else {
+        guard let image = OWSThumbnailService.shared().thumbnail(attachment: attachmentStream, size: .medium) else {
             owsFailDebug("\(logTag) in \(#function) unexpectedly unable to build attachment thumbnail")
             return UIImage()
         }
@@ -168,6 +168,8 @@ protocol MediaGalleryDataSource: class {
     var sections: [GalleryDate: [MediaGalleryItem]] { get }
     var sectionDates: [GalleryDate] { get }
 
+    var prefetcher: MediaGalleryPrefetcher { get }
+
     func ensureGalleryItemsLoaded(_ direction: GalleryDirection, item: MediaGalleryItem, amount: UInt, completion: ((IndexSet, [IndexPath]) -> Void)?)
 
     func galleryItem(before currentItem: MediaGalleryItem) -> MediaGalleryItem?
@@ -277,17 +279,24 @@ class MediaGalleryViewController: OWSNavigationController, MediaGalleryDataSourc
 
     @objc
     public func presentDetailView(fromViewController: UIViewController, mediaMessage: TSMessage, replacingView: UIView) {
-        var galleryItem: MediaGalleryItem?
-        uiDatabaseConnection.read { transaction in
-            galleryItem = self.buildGalleryItem(message: mediaMessage, transaction: transaction)!
-        }
+        runWhenGalleryIsReady {
+            var galleryItem: MediaGalleryItem?
+            self.uiDatabaseConnection.read { transaction in
+                galleryItem = self.buildGalleryItem(message: mediaMessage, transaction: transaction)!
+            }
 
-        guard let initialDetailItem = galleryItem else {
-            owsFailDebug("\(logTag) in \(#function) unexpectedly failed to build initialDetailItem.")
-            return
+            guard let initialDetailItem = galleryItem else {
+                owsFailDebug("\(self.logTag) in \(#function) unexpectedly failed to build initialDetailItem.")
+                return
+            }
+
+            self.presentDetailView(fromViewController: fromViewController, initialDetailItem: initialDetailItem, replacingView: replacingView)
         }
+    }
 
-        presentDetailView(fromViewController: fromViewController, initialDetailItem: initialDetailItem, replacingView: replacingView)
+    // The gallery's index can still be registering just after launch.  Calls `block` immediately once it's ready.
+    private func runWhenGalleryIsReady(_ block: @escaping () -> Void) {
+        OWSPrimaryStorage.shared().runWhenExtensionIsReady(OWSMediaGalleryFinder.databaseExtensionName(), block: block)
     }
 
     public func presentDetailView(fromViewController: UIViewController, initialDetailItem: MediaGalleryItem, replacingView: UIView) {
@@ -398,19 +407,21 @@ class MediaGalleryViewController: OWSNavigationController, MediaGalleryDataSourc
 
     @objc
     func pushTileView(fromNavController: OWSNavigationController) {
-        var mostRecentItem: MediaGalleryItem?
-        self.uiDatabaseConnection.read { transaction in
-            if let message = self.mediaGalleryFinder.mostRecentMediaMessage(transaction: transaction) {
-                mostRecentItem = self.buildGalleryItem(message: message, transaction: transaction)
+        runWhenGalleryIsReady {
+            var mostRecentItem: MediaGalleryItem?
+            self.uiDatabaseConnection.read { transaction in
+                if let message = self.mediaGalleryFinder.mostRecentMediaMessage(transaction: transaction) {
+                    mostRecentItem = self.buildGalleryItem(message: message, transaction: transaction)
+                }
             }
-        }
 
-        if let mostRecentItem = mostRecentItem {
-            mediaTileViewController.focusedItem = mostRecentItem
-            ensureGalleryItemsLoaded(.around, item: mostRecentItem, amount: 100)
+            if let mostRecentItem = mostRecentItem {
+                self.mediaTileViewController.focusedItem = mostRecentItem
+                self.ensureGalleryItemsLoaded(.around, item: mostRecentItem, amount: 100)
+            }
+            self.fromNavController = fromNavController
+            fromNavController.pushViewController(self.mediaTileViewController, animated: true)
         }
-        self.fromNavController = fromNavController
-        fromNavController.pushViewController(mediaTileViewController, animated: true)
     }
 
     func showAllMedia(focusedItem: MediaGalleryItem) {
@@ -606,6 +617,8 @@ class MediaGalleryViewController: OWSNavigationController, MediaGalleryDataSourc
         return vc
     }()
 
+    lazy var prefetcher: MediaGalleryPrefetcher = MediaGalleryPrefetcher()
+
     var galleryItems: [MediaGalleryItem] = []
     var sections: [GalleryDate: [MediaGalleryItem]] = [:]
     var sectionDates: [GalleryDate] = []
@@ -112,6 +112,7 @@ class MediaPageViewController: UIPageViewController, UIPageViewControllerDataSou
         }
         self.initialPage = initialPage
         self.setViewControllers([initialPage], direction: .forward, animated: false, completion: nil)
+        self.updatePrefetchWindow(previousItem: nil)
     }
 
     @available(*, unavailable, message: "Unimplemented")
@@ -409,10 +410,52 @@ class MediaPageViewController: UIPageViewController, UIPageViewControllerDataSou
                 previousPage.zoomOut(animated: false)
                 previousPage.stopAnyVideo()
                 updateFooterBarButtonItems(isPlayingVideo: false)
+                updatePrefetchWindow(previousItem: previousPage.galleryItem)
             }
         }
     }
 
+    // MARK: Prefetching
+
+    private func updatePrefetchWindow(previousItem: MediaGalleryItem?) {
+        guard let mediaGalleryDataSource = self.mediaGalleryDataSource else {
+            owsFailDebug("\(logTag) in \(#function) mediaGalleryDataSource was unexpectedly nil")
+            return
+        }
+        guard let currentItem = self.currentItem else {
+            return
+        }
+
+        let prefetcher = mediaGalleryDataSource.prefetcher
+        var galleryItems = mediaGalleryDataSource.galleryItems
+        guard var currentIndex = galleryItems.index(of: currentItem) else {
+            owsFailDebug("\(logTag) in \(#function) currentIndex was unexpectedly nil")
+            return
+        }
+
+        var direction: GalleryDirection = .around
+        if let previousItem = previousItem, let previousIndex = galleryItems.index(of: previousItem) {
+            direction = previousIndex < currentIndex ? .after : .before
+        }
+
+        // Make sure the items we're about to prefetch have been fetched from the database.
+        if direction != .around {
+            let amount = UInt(prefetcher.configuration.prefetchDistance)
+            mediaGalleryDataSource.ensureGalleryItemsLoaded(direction, item: currentItem, amount: amount, completion: nil)
+            galleryItems = mediaGalleryDataSource.galleryItems
+            currentIndex = galleryItems.index(of: currentItem) ?? currentIndex
+        }
+
+        prefetcher.updateWindow(items: galleryItems, visibleRange: currentIndex...currentIndex, direction: direction, includeFullSizeImages: true)
+
+        // Each page holds its decoded image, so don't keep pages outside the window around.
+        let windowIndices = prefetcher.windowRange(count: galleryItems.count, visibleRange: currentIndex...currentIndex, direction: direction)
+        let windowItems = Set(windowIndices.map { galleryItems[$0] })
+        for item in cachedPages.keys where !windowItems.contains(item) && item != currentItem {
+            cachedPages.removeValue(forKey: item)
+        }
+    }
+
     // MARK: UIPageViewControllerDataSource
 
     public func pageViewController(_ pageViewController: UIPageViewController, viewControllerBefore viewController: UIViewController) -> UIViewController? {
@@ -491,7 +534,8 @@ class MediaPageViewController: UIPageViewController, UIPageViewControllerDataSou
             return nil
         }
 
-        let viewController = MediaDetailViewController(galleryItemBox: GalleryItemBox(galleryItem), viewItem: viewItem)
+        let prefetchedImage = self.mediaGalleryDataSource?.prefetcher.decodedImage(for: galleryItem)
+        let viewController = MediaDetailViewController(galleryItemBox: GalleryItemBox(galleryItem), viewItem: viewItem, prefetchedImage: prefetchedImage)
         viewController.delegate = self
 
         cachedPages[galleryItem] = viewController
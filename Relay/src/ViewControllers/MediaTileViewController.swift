@@ -146,6 +146,7 @@ public class MediaTileViewController: UICollectionViewController, MediaGalleryDa
 
     override public func scrollViewDidScroll(_ scrollView: UIScrollView) {
         self.autoLoadMoreIfNecessary()
+        self.updatePrefetchWindow()
     }
 
     override public func scrollViewWillBeginDragging(_ scrollView: UIScrollView) {
@@ -613,6 +614,62 @@ public class MediaTileViewController: UICollectionViewController, MediaGalleryDa
 
     var isFetchingMoreData: Bool = false
 
+    // MARK: Prefetching
+
+    private var lastPrefetchContentOffsetY: CGFloat = 0
+    private var lastPrefetchEdgeItem: MediaGalleryItem?
+
+    // Keeps thumbnails warm for the rows just past the visible edge in the direction of scrolling.
+    private func updatePrefetchWindow() {
+        guard let collectionView = self.collectionView else {
+            owsFailDebug("\(logTag) in \(#function) collectionView was unexpectedly nil")
+            return
+        }
+
+        guard let mediaGalleryDataSource = self.mediaGalleryDataSource else {
+            owsFailDebug("\(logTag) in \(#function) mediaGalleryDataSource was unexpectedly nil")
+            return
+        }
+
+        let contentOffsetY = collectionView.contentOffset.y
+        // Newer media is at the bottom.
+        let direction: GalleryDirection = contentOffsetY >= lastPrefetchContentOffsetY ? .after : .before
+        lastPrefetchContentOffsetY = contentOffsetY
+
+        let visibleItems = collectionView.indexPathsForVisibleItems.sorted().compactMap { indexPath -> MediaGalleryItem? in
+            switch indexPath.section {
+            case kLoadOlderSectionIdx, loadNewerSectionIdx:
+                return nil
+            default:
+                return galleryItem(at: indexPath)
+            }
+        }
+        guard let edgeItem = direction == .after ? visibleItems.last : visibleItems.first else {
+            return
+        }
+
+        // Only recompute the window once a new row comes into view.
+        guard edgeItem != lastPrefetchEdgeItem else {
+            return
+        }
+        lastPrefetchEdgeItem = edgeItem
+
+        let galleryItems = mediaGalleryDataSource.galleryItems
+        guard let firstVisibleItem = visibleItems.first,
+            let lastVisibleItem = visibleItems.last,
+            let firstVisibleIndex = galleryItems.index(of: firstVisibleItem),
+            let lastVisibleIndex = galleryItems.index(of: lastVisibleItem),
+            firstVisibleIndex <= lastVisibleIndex else {
+            return
+        }
+
+        // The window covers the whole visible grid, so the visible cells' thumbnails are never cancelled.
+        mediaGalleryDataSource.prefetcher.updateWindow(items: galleryItems,
+                                                       visibleRange: firstVisibleIndex...lastVisibleIndex,
+                                                       direction: direction,
+                                                       includeFullSizeImages: false)
+    }
+
     let kLoadOlderSectionIdx = 0
     var loadNewerSectionIdx: Int {
         return galleryDates.count + 1
@@ -919,7 +976,18 @@ private class MediaGalleryCell: UICollectionViewCell {
 
     public func configure(item: MediaGalleryItem) {
         self.item = item
-        self.imageView.image = item.thumbnailImage
+        let attachmentStream = item.attachmentStream
+        if let image = OWSThumbnailService.shared().cachedThumbnail(attachment: attachmentStream, size: .medium) {
+            self.imageView.image = image
+        } else {
+            // Decode off the main thread; the cell may have been reused by the time we're done.
+            OWSThumbnailService.shared().thumbnail(attachment: attachmentStream, size: .medium, priority: .visible) { [weak self] image in
+                guard let strongSelf = self, strongSelf.item == item else {
+                    return
+                }
+                strongSelf.imageView.image = image
+            }
+        }
         if item.isVideo {
             self.contentTypeBadgeView.isHidden = false
             self.contentTypeBadgeView.image = MediaGalleryCell.videoBadgeImage
@@ -935,6 +1003,9 @@ private class MediaGalleryCell: UICollectionViewCell {
     override public func prepareForReuse() {
         super.prepareForReuse()
 
+        if let item = self.item {
+            OWSThumbnailService.shared().updatePriority(.prefetch, attachmentId: item.attachmentStream.uniqueId)
+        }
         self.item = nil
         self.imageView.image = nil
         self.contentTypeBadgeView.isHidden = true
@@ -0,0 +1,136 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+import Foundation
+
+// Plays no more than `maxSounds` notification sounds in any `window`.
+struct NotificationSoundRateLimiter {
+
+    let window: TimeInterval
+    let maxSounds: Int
+
+    // Never holds more than maxSounds timestamps, oldest first.
+    private var soundDates = [Date]()
+
+    init(window: TimeInterval = 5, maxSounds: Int = 2) {
+        self.window = window
+        self.maxSounds = maxSounds
+    }
+
+    // Records the sound if it may be played.
+    mutating func shouldPlaySound(at now: Date) -> Bool {
+        let windowStart = now.addingTimeInterval(-window)
+        if let firstRecentIndex = soundDates.index(where: { $0 > windowStart }) {
+            soundDates.removeSubrange(0..<firstRecentIndex)
+        } else {
+            soundDates.removeAll()
+        }
+
+        guard soundDates.count < maxSounds else {
+            return false
+        }
+        soundDates.append(now)
+        return true
+    }
+}
+
+// Collapses the messages which arrive in a thread within `window` of its first into a single notification, e.g.
+// while working through the backlog after reconnecting.
+//
+// The aggregator is passive and has no clock of its own: messages are added with the time they arrived, and
+// deliveries are taken with the time of the flush, so that its owner decides when to flush, and a test can
+// drive it with any clock it likes.  It isn't thread safe; NotificationsManager only uses it on the main thread.
+struct NotificationAggregator {
+
+    struct Delivery {
+        let threadId: String
+        // The last message which arrived in the window.
+        let messageId: String
+        // How many messages arrived in the window.
+        let messageCount: Int
+        let shouldPlaySound: Bool
+        // Whether an earlier notification for the thread is still showing, and should be replaced by this one.
+        let replacesPrevious: Bool
+    }
+
+    private struct PendingThread {
+        let windowEnd: Date
+        var messageId: String
+        var messageCount: Int
+    }
+
+    let window: TimeInterval
+    private var soundRateLimiter: NotificationSoundRateLimiter
+    private var pendingThreads = [String: PendingThread]()
+    // Threads whose notification hasn't been cleared since it was delivered.
+    private var deliveredThreadIds = Set<String>()
+
+    init(window: TimeInterval = 2, soundRateLimiter: NotificationSoundRateLimiter = NotificationSoundRateLimiter()) {
+        self.window = window
+        self.soundRateLimiter = soundRateLimiter
+    }
+
+    var hasPendingMessages: Bool {
+        return !pendingThreads.isEmpty
+    }
+
+    // When the next window closes, if any are open.
+    var nextFlushDate: Date? {
+        return pendingThreads.values.map { $0.windowEnd }.min()
+    }
+
+    mutating func add(messageId: String, threadId: String, at now: Date) {
+        if var pendingThread = pendingThreads[threadId] {
+            pendingThread.messageId = messageId
+            pendingThread.messageCount += 1
+            pendingThreads[threadId] = pendingThread
+        } else {
+            pendingThreads[threadId] = PendingThread(windowEnd: now.addingTimeInterval(window),
+                                                     messageId: messageId,
+                                                     messageCount: 1)
+        }
+    }
+
+    // Takes the deliveries for the windows which have closed by `now`, oldest first.  At most one of a flush's
+    // deliveries plays a sound.
+    mutating func flush(at now: Date) -> [Delivery] {
+        let closedThreads = pendingThreads.filter { $0.value.windowEnd <= now }
+            .sorted { $0.value.windowEnd < $1.value.windowEnd }
+        guard !closedThreads.isEmpty else {
+            return []
+        }
+
+        var deliveries = [Delivery]()
+        var hasPlayedSound = false
+        for (threadId, pendingThread) in closedThreads {
+            pendingThreads.removeValue(forKey: threadId)
+
+            let shouldPlaySound = !hasPlayedSound && soundRateLimiter.shouldPlaySound(at: now)
+            hasPlayedSound = hasPlayedSound || shouldPlaySound
+            let replacesPrevious = deliveredThreadIds.contains(threadId)
+            deliveredThreadIds.insert(threadId)
+
+            deliveries.append(Delivery(threadId: threadId,
+                                       messageId: pendingThread.messageId,
+                                       messageCount: pendingThread.messageCount,
+                                       shouldPlaySound: shouldPlaySound,
+                                       replacesPrevious: replacesPrevious))
+        }
+        return deliveries
+    }
+
+    // e.g. once the thread has been read.
+    mutating func clearDelivered(threadId: String) {
+        deliveredThreadIds.remove(threadId)
+    }
+
+    mutating func clearAllDelivered() {
+        deliveredThreadIds.removeAll()
+    }
+
+    // For notifications which aren't aggregated, so that they share the limit.
+    mutating func shouldPlaySound(at now: Date) -> Bool {
+        return soundRateLimiter.shouldPlaySound(at: now)
+    }
+}
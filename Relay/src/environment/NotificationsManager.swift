@@ -18,81 +18,209 @@ class NotificationsManager: NSObject, NotificationsProtocol, OWSCallNotification
     private var currentNotifications = [String : UILocalNotification]()
     private lazy var prefs = Environment.current()?.preferences
     private lazy var notificationPreviewType = self.prefs?.notificationPreviewType()
-    private var notificationHistory = [Date]()
     var audioPlayer: OWSAudioPlayer?
     
+    // Guards the aggregator, whose sound rate limit is shared by every kind of notification.
+    private let aggregatorLock = NSLock()
+    private var aggregator = NotificationAggregator()
+    // Only used on the main thread.
+    private var isFlushScheduled = false
+    // The message notification showing for each thread, which the next one for the thread replaces.
+    private var threadNotifications = [String : UILocalNotification]()
+    private lazy var dbConnection: YapDatabaseConnection = OWSPrimaryStorage.shared().newDatabaseConnection()
+    
     override init() {
         super.init()
         SwiftSingletons.register(self)
     }
     
     // MARK: - Message notifications
+    
+    // Called from within the transaction which saves the message, perhaps hundreds of times in a row while
+    // catching up after reconnecting.  Only the ids are taken here; the messages which arrive in a thread
+    // together are collapsed into a single notification by the aggregator, and what it shows is read once
+    // the notification is due, in a transaction of its own.
     func notifyUser(for incomingMessage: TSIncomingMessage, in thread: TSThread, contactsManager: ContactsManagerProtocol, transaction: YapDatabaseReadTransaction) {
-        // While batch processing, some of the necessary changes have not been commited.
-        let rawMessageText = incomingMessage.previewText(with: transaction)
+        guard !thread.isMuted else {
+            return
+        }
         
-        // iOS strips anything that looks like a printf formatting character from
-        // the notification body, so if we want to dispay a literal "%" in a notification
-        // it must be escaped.
-        // see https://developer.apple.com/documentation/uikit/uilocalnotification/1616646-alertbody
-        // for more details.
-        let messageText = DisplayableText.filterNotificationText(rawMessageText) ?? ""
-
-        DispatchMainThreadSafe {
-            guard !thread.isMuted else {
-                return
+        let messageId = incomingMessage.uniqueId
+        let threadId = thread.uniqueId
+        let enqueue = {
+            self.enqueueMessage(messageId: messageId, threadId: threadId)
+        }
+        if let transaction = transaction as? YapDatabaseReadWriteTransaction {
+            transaction.addCompletionQueue(nil) {
+                enqueue()
             }
-            
-            let shouldPlaySound = self.shouldPlaySoundForNotification()
-            let senderName = contactsManager.displayName(forRecipientId: incomingMessage.authorId) ?? ""
-            
-            if UIApplication.shared.applicationState != .active && messageText.count > 0 {
-                let notification = UILocalNotification()
-                if shouldPlaySound {
-                    let sound = OWSSounds.notificationSound(for: thread)
-                    notification.soundName = OWSSounds.filename(for: sound)
+        } else {
+            DispatchMainThreadSafe(enqueue)
+        }
+    }
+    
+    private func enqueueMessage(messageId: String, threadId: String) {
+        AssertIsOnMainThread()
+        
+        aggregatorLock.lock()
+        aggregator.add(messageId: messageId, threadId: threadId, at: Date())
+        aggregatorLock.unlock()
+        
+        scheduleFlushIfNecessary()
+    }
+    
+    private func scheduleFlushIfNecessary() {
+        AssertIsOnMainThread()
+        
+        guard !isFlushScheduled else {
+            return
+        }
+        aggregatorLock.lock()
+        let nextFlushDate = aggregator.nextFlushDate
+        aggregatorLock.unlock()
+        guard let flushDate = nextFlushDate else {
+            return
+        }
+        
+        isFlushScheduled = true
+        DispatchQueue.main.asyncAfter(deadline: .now() + max(0, flushDate.timeIntervalSinceNow)) {
+            self.isFlushScheduled = false
+            self.flushMessageNotifications()
+            self.scheduleFlushIfNecessary()
+        }
+    }
+    
+    private struct MessageNotificationContent {
+        let delivery: NotificationAggregator.Delivery
+        let thread: TSThread
+        let authorId: String
+        let messageText: String
+        let messageCount: Int
+        let isNoLongerVerified: Bool
+    }
+    
+    private func flushMessageNotifications() {
+        AssertIsOnMainThread()
+        
+        aggregatorLock.lock()
+        let deliveries = aggregator.flush(at: Date())
+        aggregatorLock.unlock()
+        guard deliveries.count > 0 else {
+            return
+        }
+        
+        var contents = [MessageNotificationContent]()
+        dbConnection.asyncRead({ transaction in
+            for delivery in deliveries {
+                guard let thread = TSThread.fetch(uniqueId: delivery.threadId, transaction: transaction),
+                    let message = TSIncomingMessage.fetch(uniqueId: delivery.messageId, transaction: transaction) else {
+                        // e.g. the message was deleted, or has disappeared, since it arrived.
+                        continue
                 }
-                switch self.notificationPreviewType {
-                case .namePreview?:
-                    do {
-                        // Don't reply from lockscreen if anyone in this conversation is
-                        // "no longer verified".
-                        var isNoLongerVerified = false
-                        for recipientId in thread.participantIds {
-                            if OWSIdentityManager.shared().verificationState(forRecipientId: recipientId, transaction: transaction) == .noLongerVerified {
-                                isNoLongerVerified = true
-                                break
-                            }
-                        }
-                        notification.category = (isNoLongerVerified ? Signal_Full_New_Message_Category_No_Longer_Verified :Signal_Full_New_Message_Category )
-                        notification.userInfo = [ Signal_Thread_UserInfo_Key : thread.uniqueId,
-                                                  Signal_Message_UserInfo_Key : incomingMessage.uniqueId ]
-                        if senderName == thread.displayName() {
-                            notification.alertBody = "\(senderName): \(messageText)"
-                        } else {
-                            notification.alertBody = String(format: NSLocalizedString("APN_MESSAGE_IN_GROUP_DETAILED", comment: ""), senderName, thread.displayName(), messageText)
-                        }
-                    }
-                case .nameNoPreview?:
-                    do {
-                        notification.userInfo = [ Signal_Thread_UserInfo_Key : thread.uniqueId ]
-                        notification.alertBody = String(format: NSLocalizedString("APN_MESSAGE_FROM", comment: ""), senderName)
-                    }
-                default:
-                    do {
-                        Logger.warn("unknown notification preview type: \(String(describing: self.notificationPreviewType))")
-                        notification.alertBody = NSLocalizedString("APN_Message", comment: "")
+                guard !thread.isMuted else {
+                    continue
+                }
+                
+                // iOS strips anything that looks like a printf formatting character from
+                // the notification body, so if we want to dispay a literal "%" in a notification
+                // it must be escaped.
+                // see https://developer.apple.com/documentation/uikit/uilocalnotification/1616646-alertbody
+                // for more details.
+                let messageText = DisplayableText.filterNotificationText(message.previewText(with: transaction)) ?? ""
+                
+                // Don't reply from lockscreen if anyone in this conversation is
+                // "no longer verified".
+                var isNoLongerVerified = false
+                for recipientId in thread.participantIds {
+                    if OWSIdentityManager.shared().verificationState(forRecipientId: recipientId, transaction: transaction) == .noLongerVerified {
+                        isNoLongerVerified = true
+                        break
                     }
                 }
-                PushManager.shared().present(notification, checkForCancel: true)
-            } else {
-                if shouldPlaySound && ((self.prefs?.soundInForeground())!) {
-                    let sound = OWSSounds.notificationSound(for: thread)
-                    let soundId = OWSSounds.systemSoundID(for: sound, quiet: true)
-                    AudioServicesPlayAlertSound(soundId)
+                
+                // Counts any messages from earlier windows which are still unread, since this notification
+                // replaces theirs.
+                let unreadCount = Int(OWSInboxSummary.summary(thread: thread, transaction: transaction).unreadCount)
+                
+                contents.append(MessageNotificationContent(delivery: delivery,
+                                                           thread: thread,
+                                                           authorId: message.authorId,
+                                                           messageText: messageText,
+                                                           messageCount: max(delivery.messageCount, unreadCount),
+                                                           isNoLongerVerified: isNoLongerVerified))
+            }
+        }, completionBlock: {
+            for content in contents {
+                self.presentMessageNotification(content)
+            }
+        })
+    }
+    
+    private func presentMessageNotification(_ content: MessageNotificationContent) {
+        AssertIsOnMainThread()
+        
+        let thread = content.thread
+        let messageText = content.messageText
+        let shouldPlaySound = content.delivery.shouldPlaySound
+        
+        guard UIApplication.shared.applicationState != .active else {
+            if shouldPlaySound && ((self.prefs?.soundInForeground())!) {
+                let sound = OWSSounds.notificationSound(for: thread)
+                let soundId = OWSSounds.systemSoundID(for: sound, quiet: true)
+                AudioServicesPlayAlertSound(soundId)
+            }
+            return
+        }
+        guard messageText.count > 0 else {
+            return
+        }
+        
+        let contactsManager = TextSecureKitEnv.shared().contactsManager
+        let senderName = contactsManager.displayName(forRecipientId: content.authorId) ?? ""
+        
+        let notification = UILocalNotification()
+        if shouldPlaySound {
+            let sound = OWSSounds.notificationSound(for: thread)
+            notification.soundName = OWSSounds.filename(for: sound)
+        }
+        var alertBody: String
+        switch self.notificationPreviewType {
+        case .namePreview?:
+            do {
+                notification.category = (content.isNoLongerVerified ? Signal_Full_New_Message_Category_No_Longer_Verified :Signal_Full_New_Message_Category )
+                notification.userInfo = [ Signal_Thread_UserInfo_Key : thread.uniqueId,
+                                          Signal_Message_UserInfo_Key : content.delivery.messageId ]
+                if senderName == thread.displayName() {
+                    alertBody = "\(senderName): \(messageText)"
+                } else {
+                    alertBody = String(format: NSLocalizedString("APN_MESSAGE_IN_GROUP_DETAILED", comment: ""), senderName, thread.displayName(), messageText)
                 }
             }
+        case .nameNoPreview?:
+            do {
+                notification.userInfo = [ Signal_Thread_UserInfo_Key : thread.uniqueId ]
+                alertBody = String(format: NSLocalizedString("APN_MESSAGE_FROM", comment: ""), senderName)
+            }
+        default:
+            do {
+                Logger.warn("unknown notification preview type: \(String(describing: self.notificationPreviewType))")
+                alertBody = NSLocalizedString("APN_Message", comment: "")
+            }
+        }
+        if content.messageCount > 1 {
+            alertBody = String(format: NSLocalizedString("APN_MESSAGES_SUMMARY_FORMAT",
+                                                         comment: "Body of a notification for several messages in a thread. Embeds {{the last message's notification}} and {{the number of new messages}}."),
+                               alertBody,
+                               content.messageCount)
+        }
+        notification.alertBody = alertBody
+        
+        // Replace the thread's notification rather than stacking another on top of it.
+        if content.delivery.replacesPrevious, let previousNotification = self.threadNotifications[thread.uniqueId] {
+            UIApplication.shared.cancelLocalNotification(previousNotification)
         }
+        self.threadNotifications[thread.uniqueId] = notification
+        PushManager.shared().present(notification, checkForCancel: true)
     }
     
     func notifyUser(for error: TSErrorMessage, thread: TSThread, transaction: YapDatabaseReadWriteTransaction) {
@@ -306,7 +434,27 @@ class NotificationsManager: NSObject, NotificationsProtocol, OWSCallNotification
     
     @objc
     public func clearAllNotifications() {
-        self.currentNotifications.removeAll()
+        DispatchMainThreadSafe {
+            self.currentNotifications.removeAll()
+            self.threadNotifications.removeAll()
+            
+            self.aggregatorLock.lock()
+            self.aggregator.clearAllDelivered()
+            self.aggregatorLock.unlock()
+        }
+    }
+    
+    // Called once the thread's notifications have been cancelled, e.g. because it's been read, so that the
+    // thread's next notification is presented as a new one.
+    @objc(clearNotificationsWithThreadId:)
+    public func clearNotifications(threadId: String) {
+        DispatchMainThreadSafe {
+            self.threadNotifications.removeValue(forKey: threadId)
+            
+            self.aggregatorLock.lock()
+            self.aggregator.clearDelivered(threadId: threadId)
+            self.aggregatorLock.unlock()
+        }
     }
     
     @objc
@@ -319,40 +467,14 @@ class NotificationsManager: NSObject, NotificationsProtocol, OWSCallNotification
     }
     
     private func shouldPlaySoundForNotification() -> Bool {
-        let lockQueue = DispatchQueue(label: "\(self.logTag)")
-        var returnVal: Bool = false
-        lockQueue.sync {
-            // Play no more than 2 notification sounds in a given
-            // five-second window.
-            let kNotificationWindowSeconds: CGFloat = 5.0
-            let kMaxNotificationRate: Int = 2
-            
-            // Cull obsolete notification timestamps from the thread's notification history.
-            while notificationHistory.count > 0 {
-                let notificationTimestamp: Date? = notificationHistory[0]
-                let notificationAgeSeconds = CGFloat(fabs(Float(notificationTimestamp?.timeIntervalSinceNow ?? 0.0)))
-                if notificationAgeSeconds > kNotificationWindowSeconds {
-                    notificationHistory.remove(at: 0)
-                } else {
-                    break
-                }
-            }
-            
-            // Ignore notifications if necessary.
-            let shouldPlaySound: Bool = notificationHistory.count < kMaxNotificationRate
-            
-            if shouldPlaySound {
-                // Add new notification timestamp to the thread's notification history.
-                let newNotificationTimestamp = Date()
-                notificationHistory.append(newNotificationTimestamp)
-                
-                returnVal = true
-            } else {
-                Logger.debug("Skipping sound for notification")
-                returnVal = false
-            }
+        aggregatorLock.lock()
+        defer { aggregatorLock.unlock() }
+        
+        let shouldPlaySound = aggregator.shouldPlaySound(at: Date())
+        if !shouldPlaySound {
+            Logger.debug("Skipping sound for notification")
         }
-        return returnVal
+        return shouldPlaySound
     }
     
     private func present(_ notification: UILocalNotification, identifier: String) {
@@ -245,6 +245,7 @@ NS_ASSUME_NONNULL_BEGIN
     [SignalApp clearAllNotifications];
     [OWSPrimaryStorage.sharedManager.dbReadWriteConnection asyncReadWriteWithBlock:^(YapDatabaseReadWriteTransaction * _Nonnull transaction) {
         [transaction removeAllObjectsInAllCollections];
+        [OWSRecipientIdentityCache.sharedCache didRemoveAllRecipientIdentitiesWithTransaction:transaction];
     }];
 }
 
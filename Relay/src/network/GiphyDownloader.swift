@@ -25,9 +25,6 @@ class GiphyAssetSegment {
     public let index: UInt
     public let segmentStart: UInt
     public let segmentLength: UInt
-    // The amount of the segment that is overlap.  
-    // The overlap lies in the _first_ n bytes of the segment data.
-    public let redundantLength: UInt
 
     // This state should only be accessed on the main thread.
     public var state: GiphyAssetSegmentState = .waiting {
@@ -45,14 +42,10 @@ class GiphyAssetSegment {
     // This state should only be accessed on the main thread.
     public weak var task: URLSessionDataTask?
 
-    init(index: UInt,
-         segmentStart: UInt,
-         segmentLength: UInt,
-         redundantLength: UInt) {
-        self.index = index
-        self.segmentStart = segmentStart
-        self.segmentLength = segmentLength
-        self.redundantLength = redundantLength
+    init(segment: OWSDownloadSegment) {
+        self.index = UInt(segment.index)
+        self.segmentStart = UInt(segment.start)
+        self.segmentLength = UInt(segment.length)
     }
 
     public func totalDataSize() -> UInt {
@@ -78,16 +71,7 @@ class GiphyAssetSegment {
             return false
         }
 
-        // In some cases the last two segments will overlap.
-        // In that case, we only want to append the non-overlapping
-        // tail of the segment data.
-        let bytesToIgnore = Int(redundantLength)
-        if bytesToIgnore > 0 {
-            let subdata = segmentData.subdata(in: bytesToIgnore..<Int(segmentLength))
-            assetData.append(subdata)
-        } else {
-            assetData.append(segmentData)
-        }
+        assetData.append(segmentData)
         return true
     }
 }
@@ -150,58 +134,19 @@ enum GiphyAssetRequestState: UInt {
         super.init()
     }
 
-    private func segmentSize() -> UInt {
+    private func createSegments() {
         AssertIsOnMainThread(file: #function)
 
-        let contentLength = UInt(self.contentLength)
+        let contentLength = UInt64(self.contentLength)
         guard contentLength > 0 else {
             owsFailDebug("\(TAG) rendition missing contentLength")
             requestDidFail()
-            return 0
-        }
-
-        let k1MB: UInt = 1024 * 1024
-        let k500KB: UInt = 500 * 1024
-        let k100KB: UInt = 100 * 1024
-        let k50KB: UInt = 50 * 1024
-        let k10KB: UInt = 10 * 1024
-        let k1KB: UInt = 1 * 1024
-        for segmentSize in [k1MB, k500KB, k100KB, k50KB, k10KB, k1KB ] {
-            if contentLength >= segmentSize {
-                return segmentSize
-            }
-        }
-        return contentLength
-    }
-
-    private func createSegments() {
-        AssertIsOnMainThread(file: #function)
-
-        let segmentLength = segmentSize()
-        guard segmentLength > 0 else {
             return
         }
-        let contentLength = UInt(self.contentLength)
-
-        var nextSegmentStart: UInt = 0
-        var index: UInt = 0
-        while nextSegmentStart < contentLength {
-            var segmentStart: UInt = nextSegmentStart
-            var redundantLength: UInt = 0
-            // The last segment may overlap the penultimate segment
-            // in order to keep the segment sizes uniform.
-            if segmentStart + segmentLength > contentLength {
-                redundantLength = segmentStart + segmentLength - contentLength
-                segmentStart = contentLength - segmentLength
-            }
-            let assetSegment = GiphyAssetSegment(index: index,
-                                                 segmentStart: segmentStart,
-                                                 segmentLength: segmentLength,
-                                                 redundantLength: redundantLength)
-            segments.append(assetSegment)
-            nextSegmentStart = segmentStart + segmentLength
-            index += 1
-        }
+
+        let segmentLength = OWSSegmentedDownloader.segmentLength(forContentLength: contentLength)
+        segments = OWSSegmentedDownloader.segments(forContentLength: contentLength,
+                                                   segmentLength: segmentLength).map { GiphyAssetSegment(segment: $0) }
     }
 
     private func firstSegmentWithState(state: GiphyAssetSegmentState) -> GiphyAssetSegment? {
@@ -491,6 +491,7 @@ NSString *const PushManagerUserInfoKeysCallBackSignalRecipientId = @"PushManager
                 }
             }];
         [self.currentNotifications removeObjectsInArray:toDelete];
+        [self.notificationsManager clearNotificationsWithThreadId:threadId];
     });
 }
 
@@ -381,6 +381,9 @@ typedef void (^DebugLogUploadFailure)(DebugLogUploader *uploader, NSError *error
     };
 
     // Phase 1. Make a local copy of all of the log files.
+    //
+    // Log messages are buffered and only formatted as they're written, so write out any pending ones first.
+    [DDLog flushLog];
     NSDateFormatter *dateFormatter = [NSDateFormatter new];
     [dateFormatter setLocale:[NSLocale currentLocale]];
     [dateFormatter setDateFormat:@"yyyy.MM.dd hh.mm.ss"];
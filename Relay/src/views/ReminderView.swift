@@ -13,7 +13,7 @@ class ReminderView: UIView {
 
     var tapAction: Action?
 
-    var text: String? {
+    @objc var text: String? {
         get {
             return label.text
         }
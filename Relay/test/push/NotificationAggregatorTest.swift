@@ -0,0 +1,114 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+import XCTest
+@testable import Signal
+
+class NotificationAggregatorTest: XCTestCase {
+
+    let startDate = Date(timeIntervalSince1970: 1_000_000)
+
+    // Drives the aggregator with a simulated clock which ticks every `tick` seconds, flushing as
+    // NotificationsManager does, and returns everything it delivers.  Each arrival is (seconds since start,
+    // thread id).  Windows which close at a tick are flushed before the messages which arrive at it are added.
+    func simulate(arrivals: [(TimeInterval, String)],
+                  aggregator: NotificationAggregator = NotificationAggregator(),
+                  tick: TimeInterval = 0.125) -> [NotificationAggregator.Delivery] {
+        var aggregator = aggregator
+        var deliveries = [NotificationAggregator.Delivery]()
+        let sortedArrivals = arrivals.sorted { $0.0 < $1.0 }
+        var nextArrivalIndex = 0
+        var step = 0
+        while nextArrivalIndex < sortedArrivals.count || aggregator.hasPendingMessages {
+            let now = TimeInterval(step) * tick
+            deliveries += aggregator.flush(at: startDate.addingTimeInterval(now))
+            while nextArrivalIndex < sortedArrivals.count && sortedArrivals[nextArrivalIndex].0 <= now {
+                let (_, threadId) = sortedArrivals[nextArrivalIndex]
+                aggregator.add(messageId: "message-\(nextArrivalIndex)",
+                               threadId: threadId,
+                               at: startDate.addingTimeInterval(now))
+                nextArrivalIndex += 1
+            }
+            step += 1
+        }
+        return deliveries
+    }
+
+    func testSingleMessage() {
+        let deliveries = simulate(arrivals: [(0, "thread-1")])
+
+        XCTAssertEqual(deliveries.count, 1)
+        XCTAssertEqual(deliveries.first?.messageId, "message-0")
+        XCTAssertEqual(deliveries.first?.messageCount, 1)
+        XCTAssertEqual(deliveries.first?.shouldPlaySound, true)
+        XCTAssertEqual(deliveries.first?.replacesPrevious, false)
+    }
+
+    func testBurstInOneThreadIsCollapsed() {
+        // 200 messages in one thread within a second, as when draining the backlog after reconnecting.
+        let arrivals = (0..<200).map { (TimeInterval($0) * 0.005, "thread-1") }
+        let deliveries = simulate(arrivals: arrivals)
+
+        XCTAssertEqual(deliveries.count, 1)
+        XCTAssertEqual(deliveries.first?.messageId, "message-199")
+        XCTAssertEqual(deliveries.first?.messageCount, 200)
+    }
+
+    func testLaterWindowsReplaceTheThreadsNotification() {
+        // A message a second for ten seconds, in windows of two seconds.
+        let arrivals = (0..<10).map { (TimeInterval($0), "thread-1") }
+        let deliveries = simulate(arrivals: arrivals)
+
+        XCTAssertEqual(deliveries.count, 5)
+        XCTAssertEqual(deliveries.map { $0.messageCount }.reduce(0, +), 10)
+        XCTAssertEqual(deliveries.filter { $0.replacesPrevious }.count, 4)
+    }
+
+    func testClearingTheThreadStopsReplacement() {
+        var aggregator = NotificationAggregator()
+        aggregator.add(messageId: "message-1", threadId: "thread-1", at: startDate)
+        XCTAssertEqual(aggregator.flush(at: startDate.addingTimeInterval(2)).first?.replacesPrevious, false)
+
+        aggregator.clearDelivered(threadId: "thread-1")
+        aggregator.add(messageId: "message-2", threadId: "thread-1", at: startDate.addingTimeInterval(3))
+        XCTAssertEqual(aggregator.flush(at: startDate.addingTimeInterval(5)).first?.replacesPrevious, false)
+    }
+
+    func testSoundsAreRateLimited() {
+        // One message in each of 20 threads, half a second apart.
+        let arrivals = (0..<20).map { (TimeInterval($0) * 0.5, "thread-\($0)") }
+        let deliveries = simulate(arrivals: arrivals)
+
+        XCTAssertEqual(deliveries.count, 20)
+        // 2 sounds in any 5 seconds, over the 9.5 seconds in which the windows close.
+        XCTAssertEqual(deliveries.filter { $0.shouldPlaySound }.count, 4)
+    }
+
+    func testRateLimiterWindowSlides() {
+        var rateLimiter = NotificationSoundRateLimiter(window: 5, maxSounds: 2)
+
+        XCTAssertTrue(rateLimiter.shouldPlaySound(at: startDate))
+        XCTAssertTrue(rateLimiter.shouldPlaySound(at: startDate.addingTimeInterval(1)))
+        XCTAssertFalse(rateLimiter.shouldPlaySound(at: startDate.addingTimeInterval(2)))
+        XCTAssertFalse(rateLimiter.shouldPlaySound(at: startDate.addingTimeInterval(4.9)))
+        // The first sound has left the window, but the second hasn't.
+        XCTAssertTrue(rateLimiter.shouldPlaySound(at: startDate.addingTimeInterval(5.5)))
+        XCTAssertFalse(rateLimiter.shouldPlaySound(at: startDate.addingTimeInterval(5.9)))
+        XCTAssertTrue(rateLimiter.shouldPlaySound(at: startDate.addingTimeInterval(6.5)))
+    }
+
+    func testBacklogAfterReconnecting() {
+        // 1,000 messages spread over 50 threads, arriving within three seconds.
+        var arrivals = [(TimeInterval, String)]()
+        for i in 0..<1000 {
+            arrivals.append((TimeInterval(i) * 0.003, "thread-\(i % 50)"))
+        }
+        let deliveries = simulate(arrivals: arrivals)
+
+        XCTAssertEqual(deliveries.map { $0.messageCount }.reduce(0, +), 1000)
+        XCTAssertLessThanOrEqual(deliveries.count, 100)
+        XCTAssertLessThanOrEqual(deliveries.filter { $0.shouldPlaySound }.count, 2)
+        NSLog("\(self.logTag) backlog of \(arrivals.count) messages in 50 threads: \(deliveries.count) notifications, \(deliveries.filter { $0.shouldPlaySound }.count) sounds (previously \(arrivals.count) notifications).")
+    }
+}
@@ -0,0 +1,336 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+@import SignalCoreKit;
+@import RelayServiceKit;
+@import RelayMessaging;
+@import YapDatabase;
+
+NS_ASSUME_NONNULL_BEGIN
+
+static NSString *OWSTestMigrationId = @"test";
+
+// Increments each number in its collections, so that a record migrated more than once is caught.
+@interface OWSTestBatchedMigration : OWSBatchedDatabaseMigration
+
+@property (nonatomic) NSArray<NSString *> *collections;
+@property (nonatomic) BOOL requiresStart;
+
+@end
+
+@implementation OWSTestBatchedMigration
+
++ (NSString *)migrationId
+{
+    return OWSTestMigrationId;
+}
+
++ (MTLPropertyStorage)storageBehaviorForPropertyWithKey:(NSString *)propertyKey
+{
+    if ([propertyKey isEqualToString:@"collections"] || [propertyKey isEqualToString:@"requiresStart"]) {
+        return MTLPropertyStorageNone;
+    } else {
+        return [super storageBehaviorForPropertyWithKey:propertyKey];
+    }
+}
+
+- (NSArray<NSString *> *)collectionsToMigrate
+{
+    return self.collections;
+}
+
+- (void)migrateObject:(id)object
+                  key:(NSString *)key
+           collection:(NSString *)collection
+          transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [transaction setObject:@([object integerValue] + 1) forKey:key inCollection:collection];
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSBatchedDatabaseMigrationTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+@property (nonatomic) NSArray<NSString *> *collections;
+
+@end
+
+@implementation OWSBatchedDatabaseMigrationTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    // A fresh migration id and collections for each test.
+    NSString *testId = [NSUUID UUID].UUIDString;
+    OWSTestMigrationId = [@"test-" stringByAppendingString:testId];
+    self.collections = @[
+        [@"OWSBatchedDatabaseMigrationTest-1-" stringByAppendingString:testId],
+        [@"OWSBatchedDatabaseMigrationTest-2-" stringByAppendingString:testId],
+    ];
+    self.dbConnection = [OWSPrimaryStorage.sharedManager newDatabaseConnection];
+}
+
+- (void)tearDown
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSString *collection in self.collections) {
+            [transaction removeAllObjectsInCollection:collection];
+        }
+    }];
+
+    [super tearDown];
+}
+
+- (OWSTestBatchedMigration *)newMigration
+{
+    OWSTestBatchedMigration *migration =
+        [[OWSTestBatchedMigration alloc] initWithPrimaryStorage:OWSPrimaryStorage.sharedManager];
+    migration.collections = self.collections;
+    return migration;
+}
+
+- (void)populateCollectionsWithRecordCount:(NSUInteger)recordCount
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSString *collection in self.collections) {
+            for (NSUInteger i = 0; i < recordCount; i++) {
+                [transaction setObject:@(0) forKey:[NSUUID UUID].UUIDString inCollection:collection];
+            }
+        }
+    }];
+}
+
+// Returns whether the migration is complete.
+- (BOOL)runNextBatch:(OWSBatchedDatabaseMigration *)migration
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"batch"];
+    __block BOOL isComplete = NO;
+    [migration runNextBatchWithCompletion:^(BOOL isBatchComplete) {
+        isComplete = isBatchComplete;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    return isComplete;
+}
+
+- (BOOL)isComplete
+{
+    return [OWSDatabaseMigration fetchObjectWithUniqueID:OWSTestMigrationId] != nil;
+}
+
+- (void)assertEveryRecordMigratedOnce
+{
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        for (NSString *collection in self.collections) {
+            [transaction enumerateKeysAndObjectsInCollection:collection
+                                                  usingBlock:^(NSString *key, id object, BOOL *stop) {
+                                                      XCTAssertEqualObjects(object, @(1));
+                                                  }];
+        }
+    }];
+}
+
+#pragma mark - Tests
+
+- (void)testRunsToCompletion
+{
+    [self populateCollectionsWithRecordCount:250];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    migration.batchSize = 100;
+    migration.batchTimeBudget = DBL_MAX;
+    NSUInteger batchCount = 0;
+    while (![self runNextBatch:migration]) {
+        XCTAssertFalse(self.isComplete);
+        batchCount++;
+    }
+
+    XCTAssertTrue(self.isComplete);
+    // Three batches for each collection, and none for the end of each.
+    XCTAssertEqual(batchCount, 6);
+    [self assertEveryRecordMigratedOnce];
+}
+
+- (void)testResumesAfterBeingKilled
+{
+    [self populateCollectionsWithRecordCount:1000];
+
+    // Killed part way through the first collection, and again part way through the second.
+    for (NSUInteger batchCount = 0; batchCount < 3; batchCount++) {
+        OWSTestBatchedMigration *migration = [self newMigration];
+        migration.batchSize = 300;
+        for (NSUInteger i = 0; i < 2; i++) {
+            XCTAssertFalse([self runNextBatch:migration]);
+        }
+    }
+    XCTAssertFalse(self.isComplete);
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        XCTAssertTrue([[self newMigration] isStartedWithTransaction:transaction]);
+    }];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    while (![self runNextBatch:migration]) {
+    }
+
+    XCTAssertTrue(self.isComplete);
+    [self assertEveryRecordMigratedOnce];
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        XCTAssertFalse([[self newMigration] isStartedWithTransaction:transaction]);
+    }];
+}
+
+- (void)testBatchesAreTimeBudgeted
+{
+    [self populateCollectionsWithRecordCount:100];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    // Every batch is over budget after its first record.
+    migration.batchTimeBudget = 0;
+    NSUInteger batchCount = 0;
+    while (![self runNextBatch:migration]) {
+        batchCount++;
+    }
+
+    XCTAssertEqual(batchCount, 200);
+    [self assertEveryRecordMigratedOnce];
+}
+
+- (void)testVersionGating
+{
+    OWSTestBatchedMigration *migration = [self newMigration];
+
+    // Not needed, so skipped.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [migration markAsCompleteUnlessStartedWithTransaction:transaction];
+    }];
+    XCTAssertTrue(self.isComplete);
+
+    // Once complete, it isn't started again.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [migration markAsStartedWithTransaction:transaction];
+        XCTAssertFalse([migration isStartedWithTransaction:transaction]);
+    }];
+}
+
+- (void)testStartedMigrationIsNotSkipped
+{
+    [self populateCollectionsWithRecordCount:10];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [migration markAsStartedWithTransaction:transaction];
+    }];
+
+    // e.g. relaunched after being killed, once the app version has been recorded.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [migration markAsCompleteUnlessStartedWithTransaction:transaction];
+    }];
+    XCTAssertFalse(self.isComplete);
+
+    while (![self runNextBatch:migration]) {
+    }
+    XCTAssertTrue(self.isComplete);
+    [self assertEveryRecordMigratedOnce];
+}
+
+// e.g. run by a backup import, which doesn't go through VersionMigrations.
+- (void)testMigrationWhichRequiresStartIsSkippedUnlessStarted
+{
+    [self populateCollectionsWithRecordCount:10];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    migration.requiresStart = YES;
+    XCTAssertTrue([self runNextBatch:migration]);
+    XCTAssertTrue(self.isComplete);
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        for (NSString *collection in self.collections) {
+            [transaction enumerateKeysAndObjectsInCollection:collection
+                                                  usingBlock:^(NSString *key, id object, BOOL *stop) {
+                                                      XCTAssertEqual([object integerValue], 0);
+                                                  }];
+        }
+    }];
+}
+
+- (void)testMigrationWhichRequiresStartRunsOnceStarted
+{
+    [self populateCollectionsWithRecordCount:10];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    migration.requiresStart = YES;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [migration markAsStartedWithTransaction:transaction];
+    }];
+
+    while (![self runNextBatch:migration]) {
+    }
+    XCTAssertTrue(self.isComplete);
+    [self assertEveryRecordMigratedOnce];
+}
+
+#pragma mark - Benchmark
+
+// This takes minutes, so it only runs when asked for.
+- (BOOL)shouldRunLargeBenchmarks
+{
+    return NSProcessInfo.processInfo.environment[@"OWS_RUN_LARGE_BENCHMARKS"] != nil;
+}
+
+// Lightweight records stand in for interactions: saving real ones fires every database view and hook, which
+// would measure those rather than the migration.
+- (void)testBenchmarkMillionRecords
+{
+    if (!self.shouldRunLargeBenchmarks) {
+        return;
+    }
+
+    const NSUInteger recordCount = 1000 * 1000;
+    self.collections = @[ self.collections.firstObject ];
+    [self populateCollectionsWithRecordCount:recordCount];
+
+    OWSTestBatchedMigration *migration = [self newMigration];
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime longestBatch = 0;
+    NSUInteger batchCount = 0;
+    BOOL isComplete = NO;
+    while (!isComplete) {
+        CFAbsoluteTime batchStartTime = CFAbsoluteTimeGetCurrent();
+        isComplete = [self runNextBatch:migration];
+        longestBatch = MAX(longestBatch, CFAbsoluteTimeGetCurrent() - batchStartTime);
+        batchCount++;
+    }
+    CFAbsoluteTime batchedDuration = CFAbsoluteTimeGetCurrent() - startTime;
+    [self assertEveryRecordMigratedOnce];
+
+    // As before, in a single transaction which locks out every other write until it's done.
+    startTime = CFAbsoluteTimeGetCurrent();
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        NSString *collection = self.collections.firstObject;
+        for (NSString *key in [transaction allKeysInCollection:collection]) {
+            id object = [transaction objectForKey:key inCollection:collection];
+            [transaction setObject:@([object integerValue] + 1) forKey:key inCollection:collection];
+        }
+    }];
+    CFAbsoluteTime singleTransactionDuration = CFAbsoluteTimeGetCurrent() - startTime;
+
+    NSLog(@"%@ migrated %lu records in %.2fs over %lu batches, the longest taking %.3fs; in a single transaction "
+          @"%.2fs.",
+        self.logTag,
+        (unsigned long)recordCount,
+        batchedDuration,
+        (unsigned long)batchCount,
+        longestBatch,
+        singleTransactionDuration);
+    XCTAssertGreaterThanOrEqual(batchCount, recordCount / migration.batchSize);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,242 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSRingBufferLogger.h"
+#import <CocoaLumberjack/DDFileLogger.h>
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSCountingLogFormatter : NSObject <DDLogFormatter>
+
+@property (atomic) NSUInteger formatCount;
+
+@end
+
+@implementation OWSCountingLogFormatter
+
+- (nullable NSString *)formatLogMessage:(DDLogMessage *)logMessage
+{
+    self.formatCount++;
+    return [@"formatted: " stringByAppendingString:logMessage.message];
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSRingBufferLoggerTest : XCTestCase
+
+@property (nonatomic) NSString *logsDirectory;
+
+@end
+
+@implementation OWSRingBufferLoggerTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.logsDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.logsDirectory error:nil];
+
+    [super tearDown];
+}
+
+- (DDLogMessage *)messageWithString:(NSString *)string
+{
+    return [[DDLogMessage alloc] initWithMessage:string
+                                           level:DDLogLevelInfo
+                                            flag:DDLogFlagInfo
+                                         context:0
+                                            file:@"OWSRingBufferLoggerTest.m"
+                                        function:nil
+                                            line:0
+                                             tag:nil
+                                         options:0
+                                       timestamp:[NSDate new]];
+}
+
+- (OWSRingBufferLogger *)newLoggerWithCapacity:(NSUInteger)capacity
+{
+    OWSRingBufferLogger *logger =
+        [[OWSRingBufferLogger alloc] initWithLogsDirectory:self.logsDirectory capacity:capacity];
+    // Only write when the test asks.
+    logger.flushInterval = 1000;
+    return logger;
+}
+
+// Lines from all log files, oldest first.
+- (NSArray<NSString *> *)linesForLogger:(OWSRingBufferLogger *)logger
+{
+    NSMutableArray<NSString *> *lines = [NSMutableArray new];
+    for (NSString *filePath in logger.logFilePaths.reverseObjectEnumerator) {
+        NSString *contents = [NSString stringWithContentsOfFile:filePath encoding:NSUTF8StringEncoding error:nil];
+        for (NSString *line in [contents componentsSeparatedByString:@"\n"]) {
+            if (line.length > 0) {
+                [lines addObject:line];
+            }
+        }
+    }
+    return lines;
+}
+
+- (void)testWritesMessagesInOrder
+{
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:1024];
+    NSMutableArray<NSString *> *expectedLines = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 500; i++) {
+        NSString *string = [NSString stringWithFormat:@"message %lu", (unsigned long)i];
+        [logger logMessage:[self messageWithString:string]];
+        [expectedLines addObject:string];
+    }
+    [logger flush];
+
+    XCTAssertEqualObjects([self linesForLogger:logger], expectedLines);
+}
+
+- (void)testFormatsOnlyWhenWritten
+{
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:1024];
+    OWSCountingLogFormatter *formatter = [OWSCountingLogFormatter new];
+    logger.logFormatter = formatter;
+
+    for (NSUInteger i = 0; i < 10; i++) {
+        [logger logMessage:[self messageWithString:@"message"]];
+    }
+    XCTAssertEqual(formatter.formatCount, 0);
+
+    [logger flush];
+    XCTAssertEqual(formatter.formatCount, 10);
+    XCTAssertEqualObjects([self linesForLogger:logger].firstObject, @"formatted: message");
+}
+
+- (void)testAccountsForDroppedMessages
+{
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:8];
+    NSUInteger messageCount = 10000;
+    for (NSUInteger i = 0; i < messageCount; i++) {
+        [logger logMessage:[self messageWithString:@"message"]];
+    }
+    [logger flush];
+
+    // Every message is either written or counted as dropped.
+    NSUInteger writtenCount = 0;
+    NSUInteger droppedCount = 0;
+    for (NSString *line in [self linesForLogger:logger]) {
+        if ([line isEqualToString:@"message"]) {
+            writtenCount++;
+            continue;
+        }
+        NSScanner *scanner = [NSScanner scannerWithString:line];
+        [scanner scanUpToString:@"dropped " intoString:NULL];
+        NSInteger count = 0;
+        XCTAssertTrue([scanner scanString:@"dropped " intoString:NULL] && [scanner scanInteger:&count]);
+        droppedCount += (NSUInteger)count;
+    }
+    XCTAssertEqual(writtenCount + droppedCount, messageCount);
+    XCTAssertGreaterThan(writtenCount, 0);
+}
+
+- (void)testRotatesBySize
+{
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:1024];
+    logger.maximumFileSize = 1024;
+    logger.maximumNumberOfLogFiles = 3;
+
+    NSString *string = [@"" stringByPaddingToLength:99 withString:@"x" startingAtIndex:0];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [logger logMessage:[self messageWithString:string]];
+        // Each flush is a separate batch.
+        [logger flush];
+    }
+
+    NSArray<NSString *> *filePaths = logger.logFilePaths;
+    XCTAssertEqual(filePaths.count, 3);
+    for (NSString *filePath in filePaths) {
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
+        XCTAssertLessThanOrEqual(attributes.fileSize, 1024);
+    }
+    // The newest messages are kept.
+    XCTAssertEqual([self linesForLogger:logger].count, 30);
+}
+
+- (void)testFlushWithTimeout
+{
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:1024];
+    [logger logMessage:[self messageWithString:@"last words"]];
+    [logger flushWithTimeout:1];
+
+    XCTAssertEqualObjects([self linesForLogger:logger], @[ @"last words" ]);
+}
+
+- (void)testWriteForCrash
+{
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:1024];
+    logger.logFormatter = [OWSCountingLogFormatter new];
+    [logger logMessage:[self messageWithString:@"written"]];
+    [logger flush];
+    [logger logMessage:[self messageWithString:@"sending to +15551234567 at 10.0.0.1 with id c0ffee12"]];
+    NSString *longString = [@"" stringByPaddingToLength:1000 withString:@"x" startingAtIndex:0];
+    [logger logMessage:[self messageWithString:longString]];
+
+    OWSRingBufferLoggerWriteForCrash(logger);
+
+    // Only unwritten messages, unformatted, masked and truncated.
+    NSArray<NSString *> *lines = [self linesForLogger:logger];
+    XCTAssertEqual(lines.count, 4);
+    XCTAssertEqualObjects(lines[0], @"formatted: written");
+    XCTAssertEqualObjects(lines[2], @"sending to +*********** at **.*.*.* with id ********");
+    XCTAssertEqual(lines[3].length, 255);
+}
+
+#pragma mark - Benchmarks
+
+- (NSArray<DDLogMessage *> *)benchmarkMessages
+{
+    NSMutableArray<DDLogMessage *> *messages = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [messages addObject:[self messageWithString:[NSString stringWithFormat:@"[OWSMessageReceiver "
+                                                                               @"processEnvelope:] envelope %lu",
+                                                              (unsigned long)i]]];
+    }
+    return messages;
+}
+
+// The cost paid on the logging queue for each message.
+- (void)testLogMessagePerformance
+{
+    NSArray<DDLogMessage *> *messages = self.benchmarkMessages;
+    OWSRingBufferLogger *logger = [self newLoggerWithCapacity:messages.count];
+    logger.logFormatter = [DDLogFileFormatterDefault new];
+    [self measureBlock:^{
+        for (DDLogMessage *message in messages) {
+            [logger logMessage:message];
+        }
+        [logger flush];
+    }];
+}
+
+- (void)testFileLoggerPerformance
+{
+    NSArray<DDLogMessage *> *messages = self.benchmarkMessages;
+    DDLogFileManagerDefault *logFileManager =
+        [[DDLogFileManagerDefault alloc] initWithLogsDirectory:self.logsDirectory defaultFileProtectionLevel:@""];
+    DDFileLogger *logger = [[DDFileLogger alloc] initWithLogFileManager:logFileManager];
+    logger.logFormatter = [DDLogFileFormatterDefault new];
+    [self measureBlock:^{
+        for (DDLogMessage *message in messages) {
+            [logger logMessage:message];
+        }
+        [logger flush];
+    }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -2,11 +2,67 @@
 //  Copyright (c) 2017 Open Whisper Systems. All rights reserved.
 //
 
+#import "OWSLogScrubber.h"
 #import "OWSScrubbingLogFormatter.h"
 #import <XCTest/XCTest.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
+// The regular expressions the formatter used to apply, kept as the reference for equivalence and benchmarks.
+static NSString *OWSLegacyScrubString(NSString *logString)
+{
+    NSRegularExpression *phoneRegex =
+        [NSRegularExpression regularExpressionWithPattern:@"\\+\\d{7,12}(\\d{3})"
+                                                  options:NSRegularExpressionCaseInsensitive
+                                                    error:nil];
+    logString = [phoneRegex stringByReplacingMatchesInString:logString
+                                                     options:0
+                                                       range:NSMakeRange(0, [logString length])
+                                                withTemplate:@"[ REDACTED_PHONE_NUMBER:xxx$1 ]"];
+
+    NSRegularExpression *dataRegex =
+        [NSRegularExpression regularExpressionWithPattern:@"<([\\da-f]{2})[\\da-f]{6}( [\\da-f]{8})*>"
+                                                  options:NSRegularExpressionCaseInsensitive
+                                                    error:nil];
+    return [dataRegex stringByReplacingMatchesInString:logString
+                                               options:0
+                                                 range:NSMakeRange(0, [logString length])
+                                          withTemplate:@"[ REDACTED_DATA:$1... ]"];
+}
+
+// Replaces "secret" with "******".
+@interface OWSTestSecretScrubbingRule : NSObject <OWSLogScrubbingRule>
+
+@end
+
+@implementation OWSTestSecretScrubbingRule
+
+- (BOOL)canStartMatchWithCharacter:(unichar)character
+{
+    return character == 's';
+}
+
+- (NSUInteger)matchLengthAtIndex:(NSUInteger)index inBuffer:(CFStringInlineBuffer *)buffer length:(NSUInteger)length
+{
+    NSString *secret = @"secret";
+    if (index + secret.length > length) {
+        return 0;
+    }
+    for (NSUInteger i = 0; i < secret.length; i++) {
+        if (CFStringGetCharacterFromInlineBuffer(buffer, (CFIndex)(index + i)) != [secret characterAtIndex:i]) {
+            return 0;
+        }
+    }
+    return secret.length;
+}
+
+- (void)appendReplacementForMatch:(NSRange)range inString:(NSString *)string toString:(NSMutableString *)result
+{
+    [result appendString:@"******"];
+}
+
+@end
+
 @interface OWSScrubbingLogFormatterTest : XCTestCase
 
 @end
@@ -85,6 +141,121 @@ NS_ASSUME_NONNULL_BEGIN
     XCTAssertNotEqual(NSNotFound, redactedRange.location, "Shouldn't touch non phone string.");
 }
 
+- (NSArray<NSString *> *)corpus
+{
+    return @[
+        @"",
+        @"Some unfiltered string",
+        @"[OWSMessageManager handleEnvelope:] envelope: source: +13331231234.1, timestamp: 1533152012231",
+        @"+123456789",
+        @"+1234567890",
+        @"+123456789012345",
+        @"+1234567890123456789 trailing digits",
+        @"++13331231234+13331231234",
+        @"phone at end +4113331231234",
+        @"Arabic-Indic digits: +\u0661\u0662\u0663\u0664\u0665\u0666\u0667\u0668\u0669\u0660\u0661",
+        @"<01234567>",
+        @"<0123456>",
+        @"<012345678>",
+        @"<01234567 89ABCDEF 0a1b2c3d>",
+        @"<01234567 89abcdef 0123>",
+        @"<01234567 89abcdef",
+        @"<<01234567>>",
+        @"nested <+13331231234> and <01234567 +13331231234>",
+        @"data <deadbeef cafebabe> then phone +13331231234 then data <00112233>",
+        @"unicode \u00e9\u4e2d\u6587 emoji \U0001F600 +13331231234 <abcdef01>",
+        @"WebSocket didReceiveMessage: <OWSWebSocketMessage: 0x7f8e1c00 request: PUT /api/v1/message>",
+    ];
+}
+
+- (void)testScrubberMatchesLegacyFormatter
+{
+    OWSLogScrubber *scrubber = [OWSLogScrubber defaultScrubber];
+    for (NSString *input in self.corpus) {
+        XCTAssertEqualObjects([scrubber scrubString:input], OWSLegacyScrubString(input), @"input: %@", input);
+    }
+}
+
+- (void)testScrubberMatchesLegacyFormatterOnRandomInput
+{
+    // Favor the characters the rules care about.
+    NSString *alphabet = @"+<> 0123456789abcdefABCDEFxyz";
+    OWSLogScrubber *scrubber = [OWSLogScrubber defaultScrubber];
+    for (NSUInteger iteration = 0; iteration < 2000; iteration++) {
+        NSMutableString *input = [NSMutableString new];
+        NSUInteger length = arc4random_uniform(80);
+        for (NSUInteger i = 0; i < length; i++) {
+            unichar character = [alphabet characterAtIndex:arc4random_uniform((uint32_t)alphabet.length)];
+            [input appendString:[NSString stringWithCharacters:&character length:1]];
+        }
+        XCTAssertEqualObjects([scrubber scrubString:input], OWSLegacyScrubString(input), @"input: %@", input);
+    }
+}
+
+- (void)testUnmatchedStringIsReturnedAsIs
+{
+    NSString *input = [NSString stringWithFormat:@"Some unfiltered string %d", 1];
+    XCTAssertEqual([[OWSLogScrubber defaultScrubber] scrubString:input], input);
+}
+
+- (void)testCustomRules
+{
+    OWSLogScrubber *scrubber = [[OWSLogScrubber alloc] initWithRules:@[
+        [OWSTestSecretScrubbingRule new],
+        [OWSPhoneNumberScrubbingRule new],
+    ]];
+
+    XCTAssertEqualObjects([scrubber scrubString:@"my secret is +13331231234 <01234567>"],
+        @"my ****** is [ REDACTED_PHONE_NUMBER:xxx234 ] <01234567>");
+
+    OWSScrubbingLogFormatter *formatter = [[OWSScrubbingLogFormatter alloc] initWithScrubber:scrubber];
+    NSString *actual = [formatter formatLogMessage:[self messageWithString:@"a secret"]];
+    XCTAssertTrue([actual hasSuffix:@"a ******"]);
+}
+
+#pragma mark - Benchmarks
+
+- (NSArray<NSString *> *)benchmarkCorpus
+{
+    // Mostly lines with nothing to scrub, as in real logs.
+    NSArray<NSString *> *lines = @[
+        @"[OWSMessageReceiver processEnvelope:] Processing envelope with timestamp: 1533152012231",
+        @"[TSSocketManager webSocket:didReceiveMessage:] Got message with verb: PUT and path: /api/v1/message",
+        @"[OWSBatchMessageProcessor processJobs:] Processed 12 jobs in 0.0123s",
+        @"[OWSMessageSender sendMessageToService:] Sending message to recipient: +13331231234.1",
+        @"[OWSDispatch] Finished decrypting envelope, plaintext length: 1024",
+        @"[TSAttachmentStream] digest: <01234567 89abcdef 01234567 89abcdef>",
+        @"[ConversationViewController viewDidAppear:] thread: 0f6e9a5c-3a1b-4f0e-9d61-56d8c0a0f0b1",
+        @"[OWSReadReceiptManager] Marking 34 messages as read",
+    ];
+    NSMutableArray<NSString *> *corpus = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [corpus addObjectsFromArray:lines];
+    }
+    return corpus;
+}
+
+- (void)testLegacyScrubbingPerformance
+{
+    NSArray<NSString *> *corpus = self.benchmarkCorpus;
+    [self measureBlock:^{
+        for (NSString *line in corpus) {
+            OWSLegacyScrubString(line);
+        }
+    }];
+}
+
+- (void)testScrubberPerformance
+{
+    NSArray<NSString *> *corpus = self.benchmarkCorpus;
+    OWSLogScrubber *scrubber = [OWSLogScrubber defaultScrubber];
+    [self measureBlock:^{
+        for (NSString *line in corpus) {
+            [scrubber scrubString:line];
+        }
+    }];
+}
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -0,0 +1,86 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+import XCTest
+@testable import Signal
+@testable import RelayMessaging
+
+class ThreadAvatarServiceTest: XCTestCase {
+
+    let avatarService = ThreadAvatarService.shared
+    let dbConnection = OWSPrimaryStorage.shared().newDatabaseConnection()
+
+    func imageOfSize(_ size: CGSize) -> UIImage {
+        UIGraphicsBeginImageContextWithOptions(size, true, 1)
+        defer { UIGraphicsEndImageContext() }
+        UIColor.red.setFill()
+        UIRectFill(CGRect(origin: .zero, size: size))
+        return UIGraphicsGetImageFromCurrentImageContext()!
+    }
+
+    func newThread() -> TSThread {
+        var thread: TSThread!
+        dbConnection.readWrite { transaction in
+            thread = TSThread.getOrCreateThread(withId: UUID().uuidString.lowercased(), transaction: transaction)
+        }
+        return thread
+    }
+
+    func testFingerprintIgnoresUnrelatedChanges() {
+        let thread = newThread()
+        let fingerprint = avatarService.fingerprint(thread: thread)
+
+        dbConnection.readWrite { transaction in
+            thread.title = "Book club"
+            thread.save(with: transaction)
+        }
+        XCTAssertEqual(fingerprint, avatarService.fingerprint(thread: thread))
+    }
+
+    func testFingerprintFollowsImage() {
+        let thread = newThread()
+        let fingerprint = avatarService.fingerprint(thread: thread)
+
+        dbConnection.readWrite { transaction in
+            thread.update(self.imageOfSize(CGSize(width: 10, height: 10)), transaction: transaction)
+        }
+        let firstImageFingerprint = avatarService.fingerprint(thread: thread)
+        XCTAssertNotEqual(fingerprint, firstImageFingerprint)
+
+        dbConnection.readWrite { transaction in
+            thread.update(self.imageOfSize(CGSize(width: 20, height: 20)), transaction: transaction)
+        }
+        XCTAssertNotEqual(firstImageFingerprint, avatarService.fingerprint(thread: thread))
+
+        // The stored copy matches the one in memory.
+        var latestThread: TSThread?
+        dbConnection.read { transaction in
+            latestThread = TSThread.fetch(uniqueId: thread.uniqueId, transaction: transaction)
+        }
+        XCTAssertEqual(avatarService.fingerprint(thread: thread), avatarService.fingerprint(thread: latestThread!))
+    }
+
+    func testAvatarIsRenderedAtDiameterInTheBackground() {
+        let thread = newThread()
+        dbConnection.readWrite { transaction in
+            thread.update(self.imageOfSize(CGSize(width: 400, height: 300)), transaction: transaction)
+        }
+
+        let expectation = self.expectation(description: "rendered")
+        var rendered: UIImage?
+        let placeholder = avatarService.avatar(thread: thread, diameter: 48) { image in
+            rendered = image
+            expectation.fulfill()
+        }
+        XCTAssertNotEqual(placeholder, thread.image)
+        waitForExpectations(timeout: 5)
+
+        XCTAssertEqual(rendered?.size, CGSize(width: 48, height: 48))
+        // Once rendered, the avatar is returned at once.
+        let cached = avatarService.avatar(thread: thread, diameter: 48) { _ in
+            XCTFail("Unexpected completion.")
+        }
+        XCTAssertEqual(cached, rendered)
+    }
+}
@@ -21,6 +21,7 @@ FOUNDATION_EXPORT const unsigned char RelayMessagingVersionString[];
 #import <RelayMessaging/OWSAudioPlayer.h>
 #import <RelayMessaging/OWSContactAvatarBuilder.h>
 #import <RelayMessaging/OWSContactOffersInteraction.h>
+#import <RelayMessaging/OWSBatchedDatabaseMigration.h>
 #import <RelayMessaging/OWSDatabaseMigration.h>
 #import <RelayMessaging/OWSFormat.h>
 #import <RelayMessaging/OWSGroupAvatarBuilder.h>
@@ -32,7 +32,10 @@ NS_ASSUME_NONNULL_BEGIN
 // This property should be set IFF we are quoting an attachment message.
 @property (nonatomic, readonly, nullable) NSString *contentType;
 @property (nonatomic, readonly, nullable) NSString *sourceFilename;
+// Only set if the thumbnail was at hand when the model was built; otherwise views load it from
+// `thumbnailAttachmentStream`, as the model may be built on the main thread.
 @property (nonatomic, readonly, nullable) UIImage *thumbnailImage;
+@property (nonatomic, readonly, nullable) TSAttachmentStream *thumbnailAttachmentStream;
 
 // Convenience initializer for building an outgoing quoted reply preview, before it's sent
 - (instancetype)initWithTimestamp:(uint64_t)timestamp
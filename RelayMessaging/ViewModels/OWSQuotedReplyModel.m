@@ -21,10 +21,11 @@
                           authorId:authorId
                          messageId:messageId
                               body:body
-                    thumbnailImage:attachmentStream.thumbnailImage
+                    thumbnailImage:[OWSQuotedReplyModel cachedThumbnailImageForAttachmentStream:attachmentStream]
                        contentType:attachmentStream.contentType
                     sourceFilename:attachmentStream.sourceFilename
                   attachmentStream:attachmentStream
+         thumbnailAttachmentStream:attachmentStream
         thumbnailAttachmentPointer:nil
            thumbnailDownloadFailed:NO];
 }
@@ -43,6 +44,7 @@
                        contentType:nil
                     sourceFilename:nil
                   attachmentStream:nil
+         thumbnailAttachmentStream:nil
         thumbnailAttachmentPointer:nil
            thumbnailDownloadFailed:NO];
 }
@@ -55,15 +57,15 @@
 
     BOOL thumbnailDownloadFailed = NO;
     UIImage *_Nullable thumbnailImage;
+    TSAttachmentStream *_Nullable thumbnailAttachmentStream;
     TSAttachmentPointer *attachmentPointer;
     if (attachmentInfo.thumbnailAttachmentStreamId) {
         TSAttachment *attachment =
             [TSAttachment fetchObjectWithUniqueID:attachmentInfo.thumbnailAttachmentStreamId transaction:transaction];
 
-        TSAttachmentStream *attachmentStream;
         if ([attachment isKindOfClass:[TSAttachmentStream class]]) {
-            attachmentStream = (TSAttachmentStream *)attachment;
-            thumbnailImage = attachmentStream.image;
+            thumbnailAttachmentStream = (TSAttachmentStream *)attachment;
+            thumbnailImage = [OWSQuotedReplyModel cachedThumbnailImageForAttachmentStream:thumbnailAttachmentStream];
         }
     } else if (attachmentInfo.thumbnailAttachmentPointerId) {
         // download failed, or hasn't completed yet.
@@ -86,6 +88,7 @@
                        contentType:attachmentInfo.contentType
                     sourceFilename:attachmentInfo.sourceFilename
                   attachmentStream:nil
+         thumbnailAttachmentStream:thumbnailAttachmentStream
         thumbnailAttachmentPointer:attachmentPointer
            thumbnailDownloadFailed:thumbnailDownloadFailed];
 }
@@ -98,6 +101,7 @@
                       contentType:(nullable NSString *)contentType
                    sourceFilename:(nullable NSString *)sourceFilename
                  attachmentStream:(nullable TSAttachmentStream *)attachmentStream
+        thumbnailAttachmentStream:(nullable TSAttachmentStream *)thumbnailAttachmentStream
        thumbnailAttachmentPointer:(nullable TSAttachmentPointer *)thumbnailAttachmentPointer
           thumbnailDownloadFailed:(BOOL)thumbnailDownloadFailed
 {
@@ -114,12 +118,23 @@
     _contentType = contentType;
     _sourceFilename = sourceFilename;
     _attachmentStream = attachmentStream;
+    _thumbnailAttachmentStream = thumbnailAttachmentStream;
     _thumbnailAttachmentPointer = thumbnailAttachmentPointer;
     _thumbnailDownloadFailed = thumbnailDownloadFailed;
 
     return self;
 }
 
+// Loading the thumbnail may mean generating it, which is left to the view.
++ (nullable UIImage *)cachedThumbnailImageForAttachmentStream:(nullable TSAttachmentStream *)attachmentStream
+{
+    if (!attachmentStream) {
+        return nil;
+    }
+    return [OWSThumbnailService.sharedService cachedThumbnailForAttachment:attachmentStream
+                                                             thumbnailSize:OWSThumbnailSizeSmall];
+}
+
 - (TSQuotedMessage *)buildQuotedMessage
 {
     NSArray *attachments = self.attachmentStream ? @[ self.attachmentStream ] : @[];
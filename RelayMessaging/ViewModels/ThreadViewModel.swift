@@ -21,11 +21,14 @@ public class ThreadViewModel: NSObject {
     public init(thread: TSThread, transaction: YapDatabaseReadTransaction) {
         self.threadRecord = thread
         self.lastMessageDate = thread.lastMessageDate()
-        self.title = thread.displayName()
         self.isMuted = thread.isMuted
-        self.lastMessageText = thread.lastMessageText(transaction: transaction)
-        self.lastMessageForInbox = thread.lastInteractionForInbox(transaction: transaction)
-        self.unreadCount = thread.unreadMessageCount(transaction: transaction)
+
+        // One small record, rather than the thread's interactions and the unread view.
+        let summary = OWSInboxSummary.summary(thread: thread, transaction: transaction)
+        self.title = thread.displayName()
+        self.lastMessageText = summary.previewText
+        self.lastMessageForInbox = summary.lastInteraction(transaction: transaction)
+        self.unreadCount = summary.unreadCount
         self.hasUnreadMessages = unreadCount > 0
     }
 
@@ -185,8 +185,8 @@ const CGFloat kContactCellAvatarTextMargin = 12;
                                         }];
     self.nameLabel.attributedText = attributedText;
     
-    self.avatarView.image =
-    [ThreadManager.sharedManager imageWithThreadId:thread.uniqueId];
+    // The thread is already in memory, so there's no need to read it again while scrolling.
+    self.avatarView.image = [ThreadAvatarService.shared imageForThread:thread];
 
     if (self.accessoryMessage) {
         self.accessoryLabel.text = self.accessoryMessage;
@@ -121,9 +121,68 @@ import RelayServiceKit
             self.save(recipient: recipient)
         }
         self.avatarCache.setObject(image!, forKey: cacheKey!)
+        self.recordAvatarDigest(recipient: recipient)
         return image
     }
     
+    // MARK: - Avatar digests
+    
+    // Digests of what each recipient's cached avatar was drawn from, so that only changes to those invalidate it,
+    // rather than every change to the recipient.
+    private var avatarDigests = [String: String]()
+    // The data each fetched gravatar was decoded from.
+    private let gravatarData = NSMapTable<UIImage, NSData>(keyOptions: [.weakMemory, .objectPointerPersonality],
+                                                           valueOptions: .strongMemory)
+    private let avatarDigestQueue = DispatchQueue(label: "contactsManagerAvatarDigestQueue")
+    
+    // Images are compared by their pixel size rather than their pixels, which would mean decoding them, so this is
+    // cheap enough to take whenever an avatar is drawn.  Synced recipients only gain or lose an image, or change
+    // their gravatar hash.
+    private class func avatarDigest(recipient: RelayRecipient) -> String {
+        let imageSizes = [recipient.avatarImage, recipient.gravatarImage, recipient.defaultImage].map { image -> String in
+            guard let image = image else {
+                return "-"
+            }
+            return "\(image.size.width * image.scale)x\(image.size.height * image.scale)"
+        }
+        return ([recipient.gravatarHash ?? "-"] + imageSizes).joined(separator: ":")
+    }
+    
+    private func recordAvatarDigest(recipient: RelayRecipient) {
+        let digest = FLContactsManager.avatarDigest(recipient: recipient)
+        avatarDigestQueue.async {
+            self.avatarDigests[recipient.uniqueId] = digest
+        }
+    }
+    
+    // Returns true if the recipient's cached avatar was drawn from something which has since changed.  The recipient
+    // is nil if it's been removed.
+    private func avatarDidChange(recipientId: String, recipient: RelayRecipient?) -> Bool {
+        return avatarDigestQueue.sync {
+            guard let oldDigest = self.avatarDigests[recipientId] else {
+                // Nothing has been drawn from the recipient yet.
+                return false
+            }
+            guard oldDigest != recipient.map({ FLContactsManager.avatarDigest(recipient: $0) }) else {
+                return false
+            }
+            // Recorded again once the avatar is next drawn.
+            self.avatarDigests[recipientId] = nil
+            return true
+        }
+    }
+    
+    // Returns true unless the cached image is a gravatar decoded from the same data.
+    private func gravatarDidChange(cachedImage: UIImage?, gravatarImage: UIImage, data: Data) -> Bool {
+        return avatarDigestQueue.sync {
+            self.gravatarData.setObject(data as NSData, forKey: gravatarImage)
+            guard let cachedImage = cachedImage, let cachedData = self.gravatarData.object(forKey: cachedImage) else {
+                return true
+            }
+            return cachedData as Data != data
+        }
+    }
+    
     private let serialLookupQueue = DispatchQueue(label: "contactsManagerLookupQueue")
     
     private lazy var readConnection: OWSDatabaseConnection = {
@@ -154,11 +213,11 @@ import RelayServiceKit
         super.init()
         
         NotificationCenter.default.addObserver(self,
-                                               selector: #selector(self.processRecipientsBlob),
+                                               selector: #selector(self.processRecipientsBlob(notification:)),
                                                name: NSNotification.Name(rawValue: FLCCSMUsersUpdated),
                                                object: nil)
         NotificationCenter.default.addObserver(self,
-                                               selector: #selector(self.processTagsBlob),
+                                               selector: #selector(self.processTagsBlob(notification:)),
                                                name: NSNotification.Name(rawValue: FLCCSMTagsUpdated),
                                                object: nil)
         NotificationCenter.default.addObserver(self,
@@ -465,8 +524,7 @@ import RelayServiceKit
     
     @objc public func refreshCCSMRecipients() {
         DispatchQueue.global(qos: .background).async {
-            self.recipientCache.removeAllObjects()
-            self.tagCache.removeAllObjects()
+            // Cached entries are invalidated per key in yapDatabaseModified as the delta is applied.
             CCSMCommManager.refreshCCSMData()
             self.validateNonOrgRecipients()
         }
@@ -510,16 +568,36 @@ import RelayServiceKit
 //    }
     
     // MARK: - Recipient management
-    @objc public func processRecipientsBlob() {
-        let recipientsBlob: NSDictionary = CCSMStorage.sharedInstance().getUsers()! as NSDictionary
+    @objc public func processRecipientsBlob(notification: Notification) {
+        let syncDate = notification.userInfo?[FLCCSMSyncDateKey] as? Date
+        let removedIds = notification.userInfo?[FLCCSMRemovedRecordIdsKey] as? [String] ?? []
+        let recipientsBlob: NSDictionary
+        let isFullSync: Bool
+        if let changes = notification.userInfo?[FLCCSMChangedRecordsKey] as? NSDictionary {
+            recipientsBlob = changes
+            isFullSync = false
+        } else {
+            recipientsBlob = CCSMStorage.sharedInstance().getUsers()! as NSDictionary
+            isFullSync = true
+        }
         DispatchQueue.global(qos: .background).async {
-            for recipientDict in recipientsBlob.allValues {
-                self.readWriteConnection.asyncReadWrite({ (transaction) in
+            // Apply the whole batch and advance the cursor in one transaction so an
+            // interrupted sync is simply repeated from the previous cursor.
+            self.readWriteConnection.asyncReadWrite({ (transaction) in
+                for recipientDict in recipientsBlob.allValues {
                     if let recipient: RelayRecipient = RelayRecipient.getOrCreateRecipient(withUserDictionary: recipientDict as! NSDictionary, transaction: transaction) {
                         self.save(recipient: recipient, with: transaction)
                     }
-                })
-            }
+                }
+                for recipientId in removedIds where recipientId != TSAccountManager.localUID() {
+                    if let recipient = RelayRecipient.fetch(uniqueId: recipientId, transaction: transaction) {
+                        self.remove(recipient: recipient, with: transaction)
+                    }
+                }
+                if let syncDate = syncDate {
+                    CCSMStorage.sharedInstance().setUsersSyncDate(syncDate, isFullSync: isFullSync, transaction: transaction)
+                }
+            })
         }
     }
 
@@ -546,25 +624,46 @@ import RelayServiceKit
     
     @objc public func remove(recipient: RelayRecipient, with transaction: YapDatabaseReadWriteTransaction) {
         if let aTag = recipient.flTag {
-            aTag.remove(with: transaction)
+            self.remove(tag: aTag, with: transaction)
         }
+        self.recipientCache.removeObject(forKey: recipient.uniqueId as NSString)
         recipient.remove(with: transaction)
     }
     
     // MARK: - Tag management
-    @objc public func processTagsBlob() {
-        let tagsBlob: NSDictionary = CCSMStorage.sharedInstance().getTags()! as NSDictionary
+    @objc public func processTagsBlob(notification: Notification) {
+        let syncDate = notification.userInfo?[FLCCSMSyncDateKey] as? Date
+        let removedIds = notification.userInfo?[FLCCSMRemovedRecordIdsKey] as? [String] ?? []
+        let tagsBlob: NSDictionary
+        let isFullSync: Bool
+        if let changes = notification.userInfo?[FLCCSMChangedRecordsKey] as? NSDictionary {
+            tagsBlob = changes
+            isFullSync = false
+        } else {
+            tagsBlob = CCSMStorage.sharedInstance().getTags()! as NSDictionary
+            isFullSync = true
+        }
         DispatchQueue.global(qos: .background).async {
-            for tagDict in tagsBlob.allValues {
-                self.readWriteConnection.asyncReadWrite({ (transaction) in
-                    let aTag:FLTag = FLTag.getOrCreateTag(with: tagDict as! [AnyHashable : Any], transaction: transaction)!
+            self.readWriteConnection.asyncReadWrite({ (transaction) in
+                for tagDict in tagsBlob.allValues {
+                    guard let aTag: FLTag = FLTag.getOrCreateTag(with: tagDict as! [AnyHashable : Any], transaction: transaction) else {
+                        continue
+                    }
                     if aTag.recipientIds?.count == 0 {
                         self.remove(tag: aTag, with: transaction)
                     } else {
                         self.save(tag: aTag, with: transaction)
                     }
-                })
-            }
+                }
+                for tagId in removedIds {
+                    if let aTag = FLTag.fetch(uniqueId: tagId, transaction: transaction) {
+                        self.remove(tag: aTag, with: transaction)
+                    }
+                }
+                if let syncDate = syncDate {
+                    CCSMStorage.sharedInstance().setTagsSyncDate(syncDate, isFullSync: isFullSync, transaction: transaction)
+                }
+            })
         }
     }
 
@@ -596,6 +695,7 @@ import RelayServiceKit
         self.recipientCache.removeAllObjects()
         RelayRecipient.removeAllObjectsInCollection()
         FLTag.removeAllObjectsInCollection()
+        CCSMStorage.sharedInstance().resetSyncDates()
     }
     
     @objc public func supportsContactEditing() -> Bool {
@@ -672,7 +772,14 @@ import RelayServiceKit
                 return
             }
             let cacheKey = "gravatar:\(recipientId)" as NSString
+            let didChange = self.gravatarDidChange(cachedImage: self.avatarCache.object(forKey: cacheKey),
+                                                   gravatarImage: gravatarImage,
+                                                   data: gravarData)
             self.avatarCache.setObject(gravatarImage, forKey: cacheKey)
+            // Fetched again whenever the avatar isn't cached, which usually finds the same gravatar.
+            if didChange {
+                self.postRecipientAvatarUpdated(recipientId: recipientId)
+            }
             
 //            self.readWriteConnection.asyncReadWrite({ (transaction) in
 //                recipient.applyChange(toSelfAndLatestCopy: transaction, change: { (obj) in
@@ -686,6 +793,12 @@ import RelayServiceKit
         }
     }
     
+    private func postRecipientAvatarUpdated(recipientId: String) {
+        NotificationCenter.default.postNotificationNameAsync(NSNotification.Name(rawValue: FLRecipientAvatarUpdatedNotification),
+                                                             object: self,
+                                                             userInfo: ["recipientId" : recipientId ])
+    }
+    
     // MARK: - db modifications
     @objc func yapDatabaseModified(notification: Notification?) {
         
@@ -702,9 +815,21 @@ import RelayServiceKit
             if changedRecipientIds.count > 0 {
                 let allThreads = TSThread.allObjectsInCollection() as! [TSThread]
                 var threadsToTouch = [TSThread]()
+                var changedRecipients = [String: RelayRecipient]()
+                self.readConnection.read { (transaction) in
+                    for changedId in changedRecipientIds {
+                        changedRecipients[changedId] = RelayRecipient.fetch(uniqueId: changedId, transaction: transaction)
+                    }
+                }
                 for changedId in changedRecipientIds {
                     // Remove cached recipient
                     self.recipientCache.removeObject(forKey: changedId as NSString)
+                    // ...and its avatar, if what it's drawn from has changed.
+                    if self.avatarDidChange(recipientId: changedId, recipient: changedRecipients[changedId]) {
+                        self.avatarCache.removeObject(forKey: "avatar:\(changedId)" as NSString)
+                        self.avatarCache.removeObject(forKey: "gravatar:\(changedId)" as NSString)
+                        self.postRecipientAvatarUpdated(recipientId: changedId)
+                    }
                     // Touch any threads which contain the recipient
                     for thread in allThreads {
                         if thread.participantIds.contains(changedId) {
@@ -6,6 +6,8 @@
 #import "Environment.h"
 #import "SignalApp.h"
 #import "LockInteractionController.h"
+#import "OWS110ReindexMessages.h"
+#import "OWS111ClearThreadImages.h"
 #import "OWSDatabaseMigrationRunner.h"
 #import "SignalKeyingStorage.h"
 #import "OWSNavigationController.h"
@@ -38,7 +40,11 @@ NS_ASSUME_NONNULL_BEGIN
     OWSAssertDebug([Environment current]);
     OWSAssertDebug(completion);
 
-    NSString *previousVersion = AppVersion.sharedInstance.lastAppVersion;
+    // The app extensions also update lastAppVersion when they launch, without running migrations, so the version
+    // the main app last finished launching with is the one migrations are decided by.  Installs which predate it
+    // fall back to the last launched version.
+    NSString *_Nullable previousVersion
+        = AppVersion.sharedInstance.lastCompletedLaunchMainAppVersion ?: AppVersion.sharedInstance.lastAppVersion;
     NSString *currentVersion = AppVersion.sharedInstance.currentAppVersion;
 
     DDLogInfo(@"%@ Checking migrations. currentVersion: %@, lastRanVersion: %@",
@@ -46,6 +52,16 @@ NS_ASSUME_NONNULL_BEGIN
         currentVersion,
         previousVersion);
 
+    // Migrations are left to the main app: app extensions don't register every database extension, and can't
+    // spare the memory or time for a long migration.
+    if (!CurrentAppContext().isMainApp) {
+        DDLogInfo(@"%@ Not running migrations in app extension.", self.logTag);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion();
+        });
+        return;
+    }
+
     if (!previousVersion) {
         DDLogInfo(@"No previous version found. Probably first launch since install - nothing to migrate.");
         OWSDatabaseMigrationRunner *runner =
@@ -57,38 +73,26 @@ NS_ASSUME_NONNULL_BEGIN
         return;
     }
     
-    // Message touch to reindex due to search bugs
-    if ([self isVersion:previousVersion lessThan:@"2.0.4"]) {
-        DDLogInfo(@"Touching messages in database.");
-        [OWSPrimaryStorage.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction * _Nonnull transaction) {
-            [transaction enumerateKeysAndObjectsInCollection:[TSIncomingMessage collection]
-                                                  usingBlock:^(NSString *key, id object, BOOL *stop) {
-                                                      if ([object isKindOfClass:[TSIncomingMessage class]]) {
-                                                          TSIncomingMessage *message = (TSIncomingMessage *)object;
-                                                          [message touchWithTransaction:transaction];
-                                                      }
-                                                  }];
-            [transaction enumerateKeysAndObjectsInCollection:[TSOutgoingMessage collection]
-                                                  usingBlock:^(NSString *key, id object, BOOL *stop) {
-                                                      if ([object isKindOfClass:[TSIncomingMessage class]]) {
-                                                          TSOutgoingMessage *message = (TSOutgoingMessage *)object;
-                                                          [message touchWithTransaction:transaction];
-                                                      }
-                                                  }];
+    // The migrations for bugs in particular versions are only started when upgrading from them.  They're run in
+    // batches by OWSDatabaseMigrationRunner, which carries on with any which were interrupted.
+    OWSPrimaryStorage *primaryStorage = [OWSPrimaryStorage sharedManager];
+    NSDictionary<NSString *, OWSBatchedDatabaseMigration *> *versionMigrations = @{
+        // Message touch to reindex due to search bugs
+        @"2.0.4" : [[OWS110ReindexMessages alloc] initWithPrimaryStorage:primaryStorage],
+        // Wiping thread images due to assignment bug in 2.0.0
+        @"2.0.1" : [[OWS111ClearThreadImages alloc] initWithPrimaryStorage:primaryStorage],
+    };
+    [OWSPrimaryStorage.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [versionMigrations enumerateKeysAndObjectsUsingBlock:^(
+            NSString *fixedVersion, OWSBatchedDatabaseMigration *migration, BOOL *stop) {
+            if ([self isVersion:previousVersion lessThan:fixedVersion]) {
+                [migration markAsStartedWithTransaction:transaction];
+            } else {
+                [migration markAsCompleteUnlessStartedWithTransaction:transaction];
+            }
         }];
-    }
+    }];
 
-    if ([self isVersion:previousVersion lessThan:@"2.0.1"]) {
-        DDLogInfo(@"Wiping thread images due to assignment bug in 2.0.0");
-        for (TSThread *thread in [TSThread allObjectsInCollection]) {
-            if (thread.image != nil) {
-                DDLogInfo(@"Found one!");
-                thread.image = nil;
-                [thread save];
-            }
-        }
-    }
-    
     if ([self isVersion:previousVersion lessThan:@"2.0.0"]) {
         DDLogError(@"Migrating from version 1.x.x.  Wiping database");
         // Not translating these as so few are affected.
@@ -0,0 +1,14 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSBatchedDatabaseMigration.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Touches every message so that the search index is rebuilt, for databases from before 2.0.4.
+@interface OWS110ReindexMessages : OWSBatchedDatabaseMigration
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,51 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWS110ReindexMessages.h"
+#import <RelayServiceKit/TSMessage.h>
+#import <YapDatabase/YapDatabaseTransaction.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Increment a similar constant for every future DBMigration
+static NSString *const OWS110ReindexMessagesMigrationId = @"110";
+
+@implementation OWS110ReindexMessages
+
++ (NSString *)migrationId
+{
+    return OWS110ReindexMessagesMigrationId;
+}
+
+// Search is incomplete until this is done, but messages can still be read and sent.
+- (BOOL)canRunAfterLaunch
+{
+    return YES;
+}
+
+// Only needed when upgrading from the versions with the bug, which VersionMigrations decides.
+- (BOOL)requiresStart
+{
+    return YES;
+}
+
+- (NSArray<NSString *> *)collectionsToMigrate
+{
+    return @[ TSMessage.collection ];
+}
+
+- (void)migrateObject:(id)object
+                  key:(NSString *)key
+           collection:(NSString *)collection
+          transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (![object isKindOfClass:[TSMessage class]]) {
+        return;
+    }
+    [(TSMessage *)object touchWithTransaction:transaction];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
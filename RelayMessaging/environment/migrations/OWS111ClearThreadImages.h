@@ -0,0 +1,14 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSBatchedDatabaseMigration.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Clears the thread images assigned to the wrong threads by 2.0.0, for databases from before 2.0.1.
+@interface OWS111ClearThreadImages : OWSBatchedDatabaseMigration
+
+@end
+
+NS_ASSUME_NONNULL_END
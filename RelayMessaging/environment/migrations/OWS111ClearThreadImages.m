@@ -0,0 +1,51 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWS111ClearThreadImages.h"
+#import <RelayServiceKit/TSThread.h>
+#import <YapDatabase/YapDatabaseTransaction.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Increment a similar constant for every future DBMigration
+static NSString *const OWS111ClearThreadImagesMigrationId = @"111";
+
+@implementation OWS111ClearThreadImages
+
++ (NSString *)migrationId
+{
+    return OWS111ClearThreadImagesMigrationId;
+}
+
+// Only needed when upgrading from the versions with the bug, which VersionMigrations decides.
+- (BOOL)requiresStart
+{
+    return YES;
+}
+
+- (NSArray<NSString *> *)collectionsToMigrate
+{
+    return @[ TSThread.collection ];
+}
+
+- (void)migrateObject:(id)object
+                  key:(NSString *)key
+           collection:(NSString *)collection
+          transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (![object isKindOfClass:[TSThread class]]) {
+        return;
+    }
+    TSThread *thread = (TSThread *)object;
+    if (thread.image == nil) {
+        return;
+    }
+    DDLogInfo(@"%@ Clearing image of thread: %@", self.logTag, thread.uniqueId);
+    thread.image = nil;
+    [thread saveWithTransaction:transaction];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
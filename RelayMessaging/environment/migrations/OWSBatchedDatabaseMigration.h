@@ -0,0 +1,62 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSDatabaseMigration.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class YapDatabaseReadTransaction;
+@class YapDatabaseReadWriteTransaction;
+
+typedef void (^OWSBatchedDatabaseMigrationBatchCompletion)(BOOL isComplete);
+
+// Base class for migrations which visit every record of one or more collections, however large.
+//
+// The records are migrated in batches, each in its own transaction and bounded by both a count and a time
+// budget, so that the database is never locked for long.  Each batch writes a checkpoint in the same
+// transaction, so a migration which is interrupted, e.g. because the app was killed, carries on from the last
+// batch which completed on the next launch, and no record is migrated twice.  Progress is posted with
+// OWSDatabaseMigrationProgressNotification after each batch.
+//
+// The keys of each collection are read once per launch, and visited in sorted order so that the checkpoint can
+// be the last key migrated.  Records added after that are assumed to need no migration.
+@interface OWSBatchedDatabaseMigration : OWSDatabaseMigration
+
+// The most records migrated per batch.  500 by default.
+@property (nonatomic) NSUInteger batchSize;
+// A batch stops early once it's taken this long.  0.1s by default.
+@property (nonatomic) NSTimeInterval batchTimeBudget;
+
+#pragma mark - Subclasses
+
+// Migrated in order.
+- (NSArray<NSString *> *)collectionsToMigrate;
+
+- (void)migrateObject:(id)object
+                  key:(NSString *)key
+           collection:(NSString *)collection
+          transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+// For migrations which are only needed when upgrading from particular versions.  They do nothing but mark
+// themselves as complete unless they've been started with -markAsStartedWithTransaction:, however the runner
+// came to run them, e.g. after a backup import.  NO by default.
+- (BOOL)requiresStart;
+
+#pragma mark - Running
+
+// Migrates the next batch.  Once there are no more the migration is marked as complete, in the same transaction
+// as its last checkpoint is removed.  The completion is called on a background queue.
+- (void)runNextBatchWithCompletion:(OWSBatchedDatabaseMigrationBatchCompletion)completion;
+
+// Whether a checkpoint has been written, i.e. the migration has been started but not completed.
+- (BOOL)isStartedWithTransaction:(YapDatabaseReadTransaction *)transaction;
+
+// For migrations which are only needed when upgrading from particular versions.  Once started, a migration is
+// carried on with even if a later launch wouldn't have started it.
+- (void)markAsStartedWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+- (void)markAsCompleteUnlessStartedWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,306 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSBatchedDatabaseMigration.h"
+#import <RelayServiceKit/OWSPrimaryStorage.h>
+#import <YapDatabase/YapDatabaseConnection.h>
+#import <YapDatabase/YapDatabaseTransaction.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Keyed by migration id.
+static NSString *const OWSBatchedDatabaseMigrationCheckpointCollection = @"OWSBatchedDatabaseMigrationCheckpoint";
+static NSString *const OWSBatchedDatabaseMigrationCollectionIndexKey = @"collectionIndex";
+// Absent until the first batch of the collection has been migrated.
+static NSString *const OWSBatchedDatabaseMigrationLastKeyKey = @"lastKey";
+
+@interface OWSBatchedDatabaseMigration ()
+
+// Where the migration has got to this launch.  Keys are nil until they've been read from the checkpoint's
+// collection.
+@property (nonatomic) NSUInteger collectionIndex;
+@property (nonatomic, nullable) NSArray<NSString *> *keys;
+@property (nonatomic) NSUInteger nextKeyIndex;
+
+@property (nonatomic, nullable) YapDatabaseConnection *dbConnection;
+
+@end
+
+#pragma mark -
+
+@implementation OWSBatchedDatabaseMigration
+
+- (instancetype)initWithPrimaryStorage:(OWSPrimaryStorage *)primaryStorage
+{
+    self = [super initWithPrimaryStorage:primaryStorage];
+    if (!self) {
+        return self;
+    }
+
+    _batchSize = 500;
+    _batchTimeBudget = 0.1;
+
+    return self;
+}
+
++ (MTLPropertyStorage)storageBehaviorForPropertyWithKey:(NSString *)propertyKey
+{
+    // Only the fact that the migration is complete is saved.
+    static NSSet<NSString *> *transientKeys;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        transientKeys = [NSSet setWithArray:@[
+            @"batchSize",
+            @"batchTimeBudget",
+            @"collectionIndex",
+            @"keys",
+            @"nextKeyIndex",
+            @"dbConnection",
+        ]];
+    });
+    if ([transientKeys containsObject:propertyKey]) {
+        return MTLPropertyStorageNone;
+    } else {
+        return [super storageBehaviorForPropertyWithKey:propertyKey];
+    }
+}
+
+- (YapDatabaseConnection *)dbConnection
+{
+    if (!_dbConnection) {
+        _dbConnection = self.primaryStorage.newDatabaseConnection;
+    }
+    return _dbConnection;
+}
+
+#pragma mark - Subclasses
+
+- (NSArray<NSString *> *)collectionsToMigrate
+{
+    OWSAbstractMethod();
+
+    return @[];
+}
+
+- (void)migrateObject:(id)object
+                  key:(NSString *)key
+           collection:(NSString *)collection
+          transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAbstractMethod();
+}
+
+- (BOOL)requiresStart
+{
+    return NO;
+}
+
+#pragma mark - Checkpoints
+
+- (nullable NSDictionary *)checkpointWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [transaction objectForKey:self.uniqueId inCollection:OWSBatchedDatabaseMigrationCheckpointCollection];
+}
+
+- (void)saveCheckpointWithCollectionIndex:(NSUInteger)collectionIndex
+                                  lastKey:(nullable NSString *)lastKey
+                              transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    NSMutableDictionary *checkpoint = [NSMutableDictionary new];
+    checkpoint[OWSBatchedDatabaseMigrationCollectionIndexKey] = @(collectionIndex);
+    checkpoint[OWSBatchedDatabaseMigrationLastKeyKey] = lastKey;
+    [transaction setObject:checkpoint forKey:self.uniqueId inCollection:OWSBatchedDatabaseMigrationCheckpointCollection];
+}
+
+- (BOOL)isStartedWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [self checkpointWithTransaction:transaction] != nil;
+}
+
+- (BOOL)isCompleteWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [OWSDatabaseMigration fetchObjectWithUniqueID:self.uniqueId transaction:transaction] != nil;
+}
+
+- (void)markAsStartedWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if ([self isStartedWithTransaction:transaction] || [self isCompleteWithTransaction:transaction]) {
+        return;
+    }
+    [self saveCheckpointWithCollectionIndex:0 lastKey:nil transaction:transaction];
+}
+
+- (void)markAsCompleteUnlessStartedWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if ([self isStartedWithTransaction:transaction] || [self isCompleteWithTransaction:transaction]) {
+        return;
+    }
+    DDLogInfo(@"%@ Skipping migration which isn't needed: %@", self.logTag, self.uniqueId);
+    [self saveWithTransaction:transaction];
+}
+
+#pragma mark - Running
+
+- (void)runUpWithCompletion:(OWSDatabaseMigrationCompletion)completion
+{
+    OWSAssertDebug(completion);
+
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    [self runBatchesWithCompletion:^{
+        DDLogInfo(@"%@ Completed migration %@ in %.2fs.",
+            self.logTag,
+            self.uniqueId,
+            CFAbsoluteTimeGetCurrent() - startTime);
+        completion();
+    }];
+}
+
+- (void)runBatchesWithCompletion:(OWSDatabaseMigrationCompletion)completion
+{
+    [self runNextBatchWithCompletion:^(BOOL isComplete) {
+        if (isComplete) {
+            completion();
+        } else {
+            [self runBatchesWithCompletion:completion];
+        }
+    }];
+}
+
+- (void)runNextBatchWithCompletion:(OWSBatchedDatabaseMigrationBatchCompletion)completion
+{
+    OWSAssertDebug(completion);
+
+    dispatch_queue_t completionQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+    if (!self.keys) {
+        // Reading the keys of a large collection takes a while, so it isn't done while holding the write lock.
+        [self.dbConnection asyncReadWithBlock:^(YapDatabaseReadTransaction *transaction) {
+            [self loadKeysWithTransaction:transaction];
+        }
+            completionQueue:completionQueue
+            completionBlock:^{
+                [self runNextBatchWithCompletion:completion];
+            }];
+        return;
+    }
+
+    __block BOOL isComplete = NO;
+    __block CGFloat progress = 0;
+    [self.dbConnection asyncReadWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        isComplete = [self migrateBatchWithTransaction:transaction];
+        progress = (isComplete ? 1 : self.progress);
+    }
+        completionQueue:completionQueue
+        completionBlock:^{
+            [self postProgress:progress];
+            completion(isComplete);
+        }];
+}
+
+- (void)loadKeysWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    NSDictionary *_Nullable checkpoint = [self checkpointWithTransaction:transaction];
+    NSUInteger collectionIndex = [checkpoint[OWSBatchedDatabaseMigrationCollectionIndexKey] unsignedIntegerValue];
+    NSString *_Nullable lastKey = checkpoint[OWSBatchedDatabaseMigrationLastKeyKey];
+
+    NSArray<NSString *> *collections = self.collectionsToMigrate;
+    self.collectionIndex = collectionIndex;
+    // The next batch skips a migration which wasn't started.
+    if (collectionIndex >= collections.count || (self.requiresStart && !checkpoint)) {
+        self.keys = @[];
+        self.nextKeyIndex = 0;
+        return;
+    }
+
+    NSString *collection = collections[collectionIndex];
+    NSArray<NSString *> *keys =
+        [[transaction allKeysInCollection:collection] sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger nextKeyIndex = 0;
+    if (lastKey) {
+        // The index of the first key after the last one migrated.
+        nextKeyIndex = [keys indexOfObject:lastKey
+                             inSortedRange:NSMakeRange(0, keys.count)
+                                   options:NSBinarySearchingInsertionIndex | NSBinarySearchingLastEqual
+                           usingComparator:^NSComparisonResult(NSString *left, NSString *right) {
+                               return [left compare:right];
+                           }];
+    }
+    DDLogInfo(@"%@ Migration %@ has %lu of %lu records left in: %@.",
+        self.logTag,
+        self.uniqueId,
+        (unsigned long)(keys.count - nextKeyIndex),
+        (unsigned long)keys.count,
+        collection);
+
+    self.keys = keys;
+    self.nextKeyIndex = nextKeyIndex;
+}
+
+// Returns YES once every collection has been migrated and the migration has been marked as complete.
+- (BOOL)migrateBatchWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(self.keys);
+
+    if (self.requiresStart && ![self isStartedWithTransaction:transaction]) {
+        DDLogInfo(@"%@ Skipping migration which wasn't started: %@", self.logTag, self.uniqueId);
+        self.keys = nil;
+        [self saveWithTransaction:transaction];
+        return YES;
+    }
+
+    NSArray<NSString *> *collections = self.collectionsToMigrate;
+    if (self.collectionIndex >= collections.count) {
+        [transaction removeObjectForKey:self.uniqueId inCollection:OWSBatchedDatabaseMigrationCheckpointCollection];
+        self.keys = nil;
+        [self saveWithTransaction:transaction];
+        return YES;
+    }
+
+    NSString *collection = collections[self.collectionIndex];
+    NSArray<NSString *> *keys = self.keys;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    NSUInteger batchCount = 0;
+    NSString *_Nullable lastKey = nil;
+    while (self.nextKeyIndex < keys.count && batchCount < self.batchSize) {
+        // Always make some progress, however short the budget.
+        if (batchCount > 0 && CFAbsoluteTimeGetCurrent() - startTime > self.batchTimeBudget) {
+            break;
+        }
+
+        NSString *key = keys[self.nextKeyIndex];
+        // The record may have been removed since the keys were read.
+        id _Nullable object = [transaction objectForKey:key inCollection:collection];
+        if (object) {
+            [self migrateObject:object key:key collection:collection transaction:transaction];
+        }
+        self.nextKeyIndex++;
+        batchCount++;
+        lastKey = key;
+    }
+
+    if (self.nextKeyIndex < keys.count) {
+        [self saveCheckpointWithCollectionIndex:self.collectionIndex lastKey:lastKey transaction:transaction];
+    } else {
+        // On to the next collection, whose keys are read before its first batch.
+        self.collectionIndex++;
+        self.keys = nil;
+        self.nextKeyIndex = 0;
+        [self saveCheckpointWithCollectionIndex:self.collectionIndex lastKey:nil transaction:transaction];
+    }
+    return NO;
+}
+
+- (CGFloat)progress
+{
+    NSUInteger collectionCount = self.collectionsToMigrate.count;
+    if (collectionCount < 1) {
+        return 1;
+    }
+    CGFloat collectionProgress = (self.keys.count > 0 ? (CGFloat)self.nextKeyIndex / self.keys.count : 0);
+    return MIN(1, (self.collectionIndex + collectionProgress) / collectionCount);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -8,6 +8,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 typedef void (^OWSDatabaseMigrationCompletion)(void);
 
+// Posted on the main thread as a migration makes progress, e.g. so that the UI can show it.
+extern NSString *const OWSDatabaseMigrationProgressNotification;
+// userInfo keys for OWSDatabaseMigrationProgressNotification.
+extern NSString *const OWSDatabaseMigrationIdKey;
+// An NSNumber from 0 to 1.
+extern NSString *const OWSDatabaseMigrationProgressKey;
+
 @class OWSPrimaryStorage;
 
 @interface OWSDatabaseMigration : TSYapDatabaseObject
@@ -22,6 +29,12 @@ typedef void (^OWSDatabaseMigrationCompletion)(void);
 // If you must write a launch-blocking migration, override runUp.
 - (void)runUpWithCompletion:(OWSDatabaseMigrationCompletion)completion;
 
+// Migrations which the app can work without, e.g. reindexing, are run once the app is ready rather than holding
+// up launch.  NO by default.
+- (BOOL)canRunAfterLaunch;
+
+- (void)postProgress:(CGFloat)progress;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -7,6 +7,10 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+NSString *const OWSDatabaseMigrationProgressNotification = @"OWSDatabaseMigrationProgressNotification";
+NSString *const OWSDatabaseMigrationIdKey = @"OWSDatabaseMigrationIdKey";
+NSString *const OWSDatabaseMigrationProgressKey = @"OWSDatabaseMigrationProgressKey";
+
 @implementation OWSDatabaseMigration
 
 - (void)saveWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
@@ -65,11 +69,27 @@ NS_ASSUME_NONNULL_BEGIN
         completionBlock:^{
             DDLogInfo(@"Completed migration %@", self.uniqueId);
             [self save];
+            [self postProgress:1];
 
             completion();
         }];
 }
 
+- (BOOL)canRunAfterLaunch
+{
+    return NO;
+}
+
+- (void)postProgress:(CGFloat)progress
+{
+    [[NSNotificationCenter defaultCenter] postNotificationNameAsync:OWSDatabaseMigrationProgressNotification
+                                                             object:nil
+                                                           userInfo:@{
+                                                               OWSDatabaseMigrationIdKey : self.uniqueId,
+                                                               OWSDatabaseMigrationProgressKey : @(progress),
+                                                           }];
+}
+
 #pragma mark - Database Connections
 
 #ifdef DEBUG
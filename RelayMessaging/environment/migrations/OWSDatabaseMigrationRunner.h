@@ -16,6 +16,9 @@ typedef void (^OWSDatabaseMigrationCompletion)(void);
 
 /**
  * Run any outstanding version migrations.
+ *
+ * The completion is called once the migrations which block launch are done.  Those which can run after launch
+ * are then run in the background once the app is ready.
  */
 - (void)runAllOutstandingWithCompletion:(OWSDatabaseMigrationCompletion)completion;
 
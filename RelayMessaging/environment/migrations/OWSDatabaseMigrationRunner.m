@@ -11,9 +11,12 @@
 #import "OWS107LegacySounds.h"
 #import "OWS108CallLoggingPreference.h"
 #import "OWS109OutgoingMessageState.h"
+#import "OWS110ReindexMessages.h"
+#import "OWS111ClearThreadImages.h"
 #import "OWSDatabaseMigration.h"
 #import <RelayMessaging/RelayMessaging-Swift.h>
 #import <RelayServiceKit/AppContext.h>
+#import <RelayServiceKit/AppReadiness.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -34,7 +37,7 @@ NS_ASSUME_NONNULL_BEGIN
 // This should all migrations which do NOT qualify as safeBlockingMigrations:
 - (NSArray<OWSDatabaseMigration *> *)allMigrations
 {
-//    OWSPrimaryStorage *primaryStorage = OWSPrimaryStorage.sharedManager;
+    OWSPrimaryStorage *primaryStorage = self.primaryStorage;
     return @[
              
              // Legacy Signal Migrations
@@ -46,6 +49,9 @@ NS_ASSUME_NONNULL_BEGIN
 //        [[OWS107LegacySounds alloc] initWithPrimaryStorage:primaryStorage],
 //        [[OWS108CallLoggingPreference alloc] initWithPrimaryStorage:primaryStorage],
 //        [[OWS109OutgoingMessageState alloc] initWithPrimaryStorage:primaryStorage]
+
+        [[OWS110ReindexMessages alloc] initWithPrimaryStorage:primaryStorage],
+        [[OWS111ClearThreadImages alloc] initWithPrimaryStorage:primaryStorage],
     ];
 }
 
@@ -59,7 +65,30 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)runAllOutstandingWithCompletion:(OWSDatabaseMigrationCompletion)completion
 {
-    [self runMigrations:[self.allMigrations mutableCopy] completion:completion];
+    NSMutableArray<OWSDatabaseMigration *> *blockingMigrations = [NSMutableArray new];
+    NSMutableArray<OWSDatabaseMigration *> *deferredMigrations = [NSMutableArray new];
+    for (OWSDatabaseMigration *migration in self.allMigrations) {
+        if (migration.canRunAfterLaunch) {
+            [deferredMigrations addObject:migration];
+        } else {
+            [blockingMigrations addObject:migration];
+        }
+    }
+
+    [self runMigrations:blockingMigrations
+             completion:^{
+                 completion();
+
+                 // The rest are run once the inbox is showing.
+                 [AppReadiness runNowOrWhenAppIsReady:^{
+                     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+                         [self runMigrations:deferredMigrations
+                                  completion:^{
+                                      DDLogInfo(@"%@ Deferred migrations complete.", self.logTag);
+                                  }];
+                     });
+                 }];
+             }];
 }
 
 // Run migrations serially to:
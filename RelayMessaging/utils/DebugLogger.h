@@ -16,6 +16,9 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)enableTTYLogging;
 
+// Writes buffered log messages without waiting on the logging queue, for use when the process is about to die.
+- (void)flushForCrash;
+
 - (void)wipeLogs;
 
 - (NSArray<NSString *> *)allLogFilePaths;
@@ -3,9 +3,11 @@
 //
 
 #import "DebugLogger.h"
+#import "OWSRingBufferLogger.h"
 #import "OWSScrubbingLogFormatter.h"
 #import <RelayServiceKit/AppContext.h>
 #import <RelayServiceKit/OWSFileSystem.h>
+#import <signal.h>
 
 #pragma mark Logging - Production logging wants us to write some logs to a file in case we need it for debugging.
 #import <CocoaLumberjack/DDTTYLogger.h>
@@ -13,10 +15,58 @@
 NS_ASSUME_NONNULL_BEGIN
 
 const NSUInteger kMaxDebugLogFileSize = 1024 * 1024 * 3;
+// The most log messages waiting to be written.  Also the most that can be lost if we crash.
+const NSUInteger kDebugLogBufferCapacity = 4096;
+// How long to spend writing buffered log messages when crashing.
+const NSTimeInterval kDebugLogCrashFlushTimeout = 1;
+
+static NSUncaughtExceptionHandler *_Nullable previousUncaughtExceptionHandler;
+
+static void DebugLoggerUncaughtExceptionHandler(NSException *exception)
+{
+    // Don't use +[DDLog flushLog], which can block forever if we're crashing on the logging queue.
+    [DebugLogger.sharedLogger flushForCrash];
+
+    if (previousUncaughtExceptionHandler) {
+        previousUncaughtExceptionHandler(exception);
+    }
+}
+
+// Crashes which don't go through an uncaught exception.
+static const int kDebugLoggerCrashSignals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV, SIGTRAP };
+static struct sigaction previousCrashSignalActions[NSIG];
+// Read from signal handlers, which mustn't message objects, so it mirrors the fileLogger property.
+static OWSRingBufferLogger *_Nullable crashSignalLogger;
+
+static void DebugLoggerCrashSignalHandler(int signalNumber, siginfo_t *info, void *context)
+{
+    __unsafe_unretained OWSRingBufferLogger *_Nullable logger = crashSignalLogger;
+    if (logger) {
+        OWSRingBufferLoggerWriteForCrash(logger);
+    }
+
+    // Restore the previous handler and raise again, so that it (or the default action) sees the crash.
+    sigaction(signalNumber, &previousCrashSignalActions[signalNumber], NULL);
+    raise(signalNumber);
+}
+
+static void DebugLoggerInstallCrashSignalHandlers(void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &DebugLoggerCrashSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+
+    for (size_t index = 0; index < sizeof(kDebugLoggerCrashSignals) / sizeof(kDebugLoggerCrashSignals[0]); index++) {
+        int signalNumber = kDebugLoggerCrashSignals[index];
+        sigaction(signalNumber, &action, &previousCrashSignalActions[signalNumber]);
+    }
+}
 
 @interface DebugLogger ()
 
-@property (nonatomic, nullable) DDFileLogger *fileLogger;
+@property (atomic, nullable) OWSRingBufferLogger *fileLogger;
 
 @end
 
@@ -60,26 +110,39 @@ const NSUInteger kMaxDebugLogFileSize = 1024 * 1024 * 3;
     NSString *logsDirPath = [self logsDirPath];
 
     // Logging to file, because it's in the Cache folder, they are not uploaded in iTunes/iCloud backups.
-    id<DDLogFileManager> logFileManager =
-        [[DDLogFileManagerDefault alloc] initWithLogsDirectory:logsDirPath defaultFileProtectionLevel:@""];
-    self.fileLogger = [[DDFileLogger alloc] initWithLogFileManager:logFileManager];
-
-    // 24 hour rolling.
-    self.fileLogger.rollingFrequency = kDayInterval;
-    // Keep last 3 days of logs - or last 3 logs (if logs rollover due to max file size).
-    self.fileLogger.logFileManager.maximumNumberOfLogFiles = 3;
-    self.fileLogger.maximumFileSize = kMaxDebugLogFileSize;
-    self.fileLogger.logFormatter = [OWSScrubbingLogFormatter new];
-
-    [DDLog addLogger:self.fileLogger];
+    OWSRingBufferLogger *fileLogger =
+        [[OWSRingBufferLogger alloc] initWithLogsDirectory:logsDirPath capacity:kDebugLogBufferCapacity];
+
+    // Keep the last 3 logs, rolling over due to max file size.
+    fileLogger.maximumNumberOfLogFiles = 3;
+    fileLogger.maximumFileSize = kMaxDebugLogFileSize;
+    // Messages are only formatted and scrubbed as they're written.
+    fileLogger.logFormatter = [OWSScrubbingLogFormatter new];
+
+    self.fileLogger = fileLogger;
+    crashSignalLogger = fileLogger;
+    [DDLog addLogger:fileLogger];
+
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        previousUncaughtExceptionHandler = NSGetUncaughtExceptionHandler();
+        NSSetUncaughtExceptionHandler(&DebugLoggerUncaughtExceptionHandler);
+        DebugLoggerInstallCrashSignalHandlers();
+    });
 }
 
 - (void)disableFileLogging
 {
+    crashSignalLogger = nil;
     [DDLog removeLogger:self.fileLogger];
     self.fileLogger = nil;
 }
 
+- (void)flushForCrash
+{
+    [self.fileLogger flushWithTimeout:kDebugLogCrashFlushTimeout];
+}
+
 - (void)enableTTYLogging
 {
     [DDLog addLogger:DDTTYLogger.sharedInstance];
@@ -104,7 +167,7 @@ const NSUInteger kMaxDebugLogFileSize = 1024 * 1024 * 3;
     }
     // To be extra conservative, also add all logs from log file manager.
     // This should be redundant with the logic above.
-    [logPathSet addObjectsFromArray:self.fileLogger.logFileManager.unsortedLogFilePaths];
+    [logPathSet addObjectsFromArray:self.fileLogger.logFilePaths];
     NSArray<NSString *> *logPaths = logPathSet.allObjects;
     return [logPaths sortedArrayUsingSelector:@selector((compare:))];
 }
@@ -0,0 +1,57 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A redaction applied by OWSLogScrubber.
+//
+// Rules are consulted only at characters for which they return YES from -canStartMatchWithCharacter:, and
+// must not allocate when they don't match; this is what keeps scrubbing cheap for the common log line.
+@protocol OWSLogScrubbingRule <NSObject>
+
+- (BOOL)canStartMatchWithCharacter:(unichar)character;
+
+// Returns the length of the match starting at `index`, or 0 if there is none.
+- (NSUInteger)matchLengthAtIndex:(NSUInteger)index
+                        inBuffer:(CFStringInlineBuffer *)buffer
+                          length:(NSUInteger)length;
+
+- (void)appendReplacementForMatch:(NSRange)range inString:(NSString *)string toString:(NSMutableString *)result;
+
+@end
+
+#pragma mark -
+
+// Replaces "+" followed by 10-15 digits, keeping the last three digits.
+@interface OWSPhoneNumberScrubbingRule : NSObject <OWSLogScrubbingRule>
+
+@end
+
+// Replaces hex data descriptions, e.g. "<01234567 89abcdef>", keeping the first byte.
+@interface OWSDataScrubbingRule : NSObject <OWSLogScrubbingRule>
+
+@end
+
+#pragma mark -
+
+// Applies a fixed set of rules to strings in a single pass.
+//
+// Where rules could match at the same position, the earlier rule wins.  Scanning resumes after each match.
+// Strings with no matches are returned as-is, without being copied.  Safe to use from any thread.
+@interface OWSLogScrubber : NSObject
+
+@property (nonatomic, readonly) NSArray<id<OWSLogScrubbingRule>> *rules;
+
+// Phone numbers and data.
++ (instancetype)defaultScrubber;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithRules:(NSArray<id<OWSLogScrubbingRule>> *)rules NS_DESIGNATED_INITIALIZER;
+
+- (NSString *)scrubString:(NSString *)string;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,243 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSLogScrubber.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Rules are tracked in a bitmask.
+static const NSUInteger kOWSLogScrubberMaxRuleCount = 32;
+static const unichar kOWSLogScrubberASCIILimit = 128;
+
+static NSCharacterSet *OWSDecimalDigitCharacterSet(void)
+{
+    static NSCharacterSet *characterSet;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        characterSet = [NSCharacterSet decimalDigitCharacterSet];
+    });
+    return characterSet;
+}
+
+// Matches "\d", i.e. any decimal digit, not just ASCII ones.
+static inline BOOL OWSIsDecimalDigit(unichar character)
+{
+    if (character < kOWSLogScrubberASCIILimit) {
+        return character >= '0' && character <= '9';
+    }
+    return [OWSDecimalDigitCharacterSet() characterIsMember:character];
+}
+
+// Matches "[\da-f]", case insensitively.
+static inline BOOL OWSIsHexDigit(unichar character)
+{
+    return (character >= 'a' && character <= 'f') || (character >= 'A' && character <= 'F')
+        || OWSIsDecimalDigit(character);
+}
+
+static inline unichar OWSCharacterAtIndex(CFStringInlineBuffer *buffer, NSUInteger index)
+{
+    return CFStringGetCharacterFromInlineBuffer(buffer, (CFIndex)index);
+}
+
+#pragma mark -
+
+@implementation OWSPhoneNumberScrubbingRule
+
+- (BOOL)canStartMatchWithCharacter:(unichar)character
+{
+    return character == '+';
+}
+
+- (NSUInteger)matchLengthAtIndex:(NSUInteger)index inBuffer:(CFStringInlineBuffer *)buffer length:(NSUInteger)length
+{
+    // Equivalent to "\+\d{7,12}(\d{3})": the longest run of up to 15 digits, which must be at least 10.
+    NSUInteger digitCount = 0;
+    while (digitCount < 15 && index + 1 + digitCount < length
+        && OWSIsDecimalDigit(OWSCharacterAtIndex(buffer, index + 1 + digitCount))) {
+        digitCount++;
+    }
+    return digitCount >= 10 ? 1 + digitCount : 0;
+}
+
+- (void)appendReplacementForMatch:(NSRange)range inString:(NSString *)string toString:(NSMutableString *)result
+{
+    [result appendString:@"[ REDACTED_PHONE_NUMBER:xxx"];
+    [result appendString:[string substringWithRange:NSMakeRange(NSMaxRange(range) - 3, 3)]];
+    [result appendString:@" ]"];
+}
+
+@end
+
+#pragma mark -
+
+@implementation OWSDataScrubbingRule
+
+- (BOOL)canStartMatchWithCharacter:(unichar)character
+{
+    return character == '<';
+}
+
+- (BOOL)hasHexWordAtIndex:(NSUInteger)index inBuffer:(CFStringInlineBuffer *)buffer length:(NSUInteger)length
+{
+    if (index + 8 > length) {
+        return NO;
+    }
+    for (NSUInteger i = index; i < index + 8; i++) {
+        if (!OWSIsHexDigit(OWSCharacterAtIndex(buffer, i))) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (NSUInteger)matchLengthAtIndex:(NSUInteger)index inBuffer:(CFStringInlineBuffer *)buffer length:(NSUInteger)length
+{
+    // Equivalent to "<([\da-f]{2})[\da-f]{6}( [\da-f]{8})*>".  Words are fixed length, so there's no
+    // need to backtrack.
+    NSUInteger position = index + 1;
+    if (![self hasHexWordAtIndex:position inBuffer:buffer length:length]) {
+        return 0;
+    }
+    position += 8;
+
+    while (position < length && OWSCharacterAtIndex(buffer, position) == ' '
+        && [self hasHexWordAtIndex:position + 1 inBuffer:buffer length:length]) {
+        position += 9;
+    }
+
+    if (position >= length || OWSCharacterAtIndex(buffer, position) != '>') {
+        return 0;
+    }
+    return position + 1 - index;
+}
+
+- (void)appendReplacementForMatch:(NSRange)range inString:(NSString *)string toString:(NSMutableString *)result
+{
+    // We capture only the first two characters of the hex string for logging.
+    // example log line: "Called someFunction with nsData: <01234567 89abcdef>"
+    //  scrubbed output: "Called someFunction with nsData: [ REDACTED_DATA:01... ]"
+    [result appendString:@"[ REDACTED_DATA:"];
+    [result appendString:[string substringWithRange:NSMakeRange(range.location + 1, 2)]];
+    [result appendString:@"... ]"];
+}
+
+@end
+
+#pragma mark -
+
+@implementation OWSLogScrubber {
+    // For each ASCII character, the rules which can start a match there.
+    uint32_t _asciiRuleMasks[kOWSLogScrubberASCIILimit];
+    // The rules which can start a match at some non-ASCII character.
+    uint32_t _nonASCIIRuleMask;
+}
+
++ (instancetype)defaultScrubber
+{
+    static OWSLogScrubber *instance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        instance = [[self alloc] initWithRules:@[
+            [OWSPhoneNumberScrubbingRule new],
+            [OWSDataScrubbingRule new],
+        ]];
+    });
+    return instance;
+}
+
+- (instancetype)initWithRules:(NSArray<id<OWSLogScrubbingRule>> *)rules
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    OWSAssertDebug(rules.count <= kOWSLogScrubberMaxRuleCount);
+
+    _rules = [rules copy];
+
+    [rules enumerateObjectsUsingBlock:^(id<OWSLogScrubbingRule> rule, NSUInteger ruleIndex, BOOL *stop) {
+        if (ruleIndex >= kOWSLogScrubberMaxRuleCount) {
+            *stop = YES;
+            return;
+        }
+        uint32_t ruleBit = (uint32_t)1 << ruleIndex;
+        for (unichar character = 0; character < kOWSLogScrubberASCIILimit; character++) {
+            if ([rule canStartMatchWithCharacter:character]) {
+                self->_asciiRuleMasks[character] |= ruleBit;
+            }
+        }
+        for (NSUInteger character = kOWSLogScrubberASCIILimit; character <= 0xFFFF; character++) {
+            if ([rule canStartMatchWithCharacter:(unichar)character]) {
+                self->_nonASCIIRuleMask |= ruleBit;
+                break;
+            }
+        }
+    }];
+
+    return self;
+}
+
+- (NSString *)scrubString:(NSString *)string
+{
+    NSUInteger length = string.length;
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer((__bridge CFStringRef)string, &buffer, CFRangeMake(0, (CFIndex)length));
+
+    // Only created once there's something to replace.
+    NSMutableString *_Nullable result = nil;
+    NSUInteger copiedLength = 0;
+
+    NSUInteger index = 0;
+    while (index < length) {
+        unichar character = OWSCharacterAtIndex(&buffer, index);
+        uint32_t candidateMask
+            = character < kOWSLogScrubberASCIILimit ? _asciiRuleMasks[character] : _nonASCIIRuleMask;
+
+        id<OWSLogScrubbingRule> _Nullable matchingRule = nil;
+        NSUInteger matchLength = 0;
+        while (candidateMask != 0) {
+            NSUInteger ruleIndex = (NSUInteger)__builtin_ctz(candidateMask);
+            candidateMask &= candidateMask - 1;
+
+            id<OWSLogScrubbingRule> rule = self.rules[ruleIndex];
+            if (character >= kOWSLogScrubberASCIILimit && ![rule canStartMatchWithCharacter:character]) {
+                continue;
+            }
+            matchLength = [rule matchLengthAtIndex:index inBuffer:&buffer length:length];
+            if (matchLength > 0) {
+                matchingRule = rule;
+                break;
+            }
+        }
+
+        if (!matchingRule) {
+            index++;
+            continue;
+        }
+
+        if (!result) {
+            result = [NSMutableString stringWithCapacity:length];
+        }
+        if (index > copiedLength) {
+            [result appendString:[string substringWithRange:NSMakeRange(copiedLength, index - copiedLength)]];
+        }
+        [matchingRule appendReplacementForMatch:NSMakeRange(index, matchLength) inString:string toString:result];
+        index += matchLength;
+        copiedLength = index;
+    }
+
+    if (!result) {
+        return string;
+    }
+    if (copiedLength < length) {
+        [result appendString:[string substringFromIndex:copiedLength]];
+    }
+    return [result copy];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -213,8 +213,8 @@ NSString *const PropertyListPreferencesKeyShowWebPreview = @"ShowWebPreview";
 
 -(void)setUseGravatars:(BOOL)value
 {
-    [ThreadManager.sharedManager flushImageCache];
     [self setValueForKey:PropertyListPreferencesKeyUseGravatars toValue:@(value)];
+    [ThreadAvatarService.shared useGravatarsDidChange];
 }
 
 -(BOOL)showWebPreviews
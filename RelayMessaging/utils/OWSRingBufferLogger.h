@@ -0,0 +1,53 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import <CocoaLumberjack/DDLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A file logger which keeps the cost of a log call off the logging queue.
+//
+// -logMessage: just appends the message to a fixed-size lock-free ring buffer.  A background writer drains
+// the buffer in batches, formats the messages with the log formatter and appends them to the log file with a
+// single write per batch.  Formatting (including scrubbing) therefore only happens for messages which are
+// actually written.  When the log file exceeds the maximum size, it is rotated.
+//
+// If the buffer fills faster than the writer drains it, new messages are dropped and the count of dropped
+// messages is written in their place.
+//
+// Each buffered message also keeps a truncated plain-text copy, so that a signal handler can write out whatever
+// is still buffered when the process crashes; see OWSRingBufferLoggerWriteForCrash.
+@interface OWSRingBufferLogger : DDAbstractLogger <DDLogger>
+
+@property (nonatomic, readonly) NSString *logsDirectory;
+@property (nonatomic, readonly) NSUInteger capacity;
+
+// Should be set before the logger is added.
+@property (nonatomic) unsigned long long maximumFileSize;
+// Including the current file.
+@property (nonatomic) NSUInteger maximumNumberOfLogFiles;
+// How long a message may wait in the buffer before being written.
+@property (nonatomic) NSTimeInterval flushInterval;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithLogsDirectory:(NSString *)logsDirectory capacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+// The current file first, then older files.
+- (NSArray<NSString *> *)logFilePaths;
+
+// Writes everything in the buffer before returning.  Also called by +[DDLog flushLog].
+- (void)flush;
+
+// For use when the process is about to die: writes what it can of the buffer, waiting at most `timeout`.
+- (void)flushWithTimeout:(NSTimeInterval)timeout;
+
+@end
+
+// Async-signal-safe, for use from signal handlers: appends the messages still in the buffer to the current log
+// file.  The log formatter can't run here, so the messages are unformatted, truncated, and crudely scrubbed:
+// every run of hex digits containing a decimal digit is masked.  The logger must outlive the call.
+void OWSRingBufferLoggerWriteForCrash(__unsafe_unretained OWSRingBufferLogger *logger);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,394 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSRingBufferLogger.h"
+#import <RelayServiceKit/OWSFileSystem.h>
+#import <fcntl.h>
+#import <stdatomic.h>
+#import <unistd.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const unsigned long long kOWSRingBufferLoggerDefaultMaximumFileSize = 1024 * 1024 * 3;
+static const NSUInteger kOWSRingBufferLoggerDefaultMaximumNumberOfLogFiles = 3;
+static const NSTimeInterval kOWSRingBufferLoggerDefaultFlushInterval = 1;
+// The longest crash copy kept of each buffered message, including the terminating NUL.
+static const size_t kOWSRingBufferLoggerCrashLineLength = 256;
+
+@interface OWSRingBufferLogger ()
+
+@property (nonatomic, readonly) NSString *logFileName;
+@property (nonatomic, readonly) dispatch_queue_t writerQueue;
+// Wakes the writer early when the buffer is filling up.
+@property (nonatomic, readonly) dispatch_source_t wakeSource;
+@property (nonatomic, readonly) dispatch_source_t flushTimer;
+
+// The following should only be accessed on the writer queue.
+@property (nonatomic, nullable) NSFileHandle *fileHandle;
+@property (nonatomic) unsigned long long fileSize;
+
+@end
+
+#pragma mark -
+
+@implementation OWSRingBufferLogger {
+    // A single-producer, single-consumer ring buffer of retained DDLogMessages.  The producer is the logger
+    // queue, on which DDLog calls -logMessage:; the consumer is the writer queue.  Indices increase
+    // monotonically and are reduced modulo the capacity on access.
+    void *_Nullable *_slots;
+    // The next slot to read.  Only written by the consumer.
+    _Atomic(NSUInteger) _head;
+    // The next slot to write.  Only written by the producer.
+    _Atomic(NSUInteger) _tail;
+    _Atomic(NSUInteger) _droppedCount;
+    NSUInteger _wakeThreshold;
+    // A NUL-terminated copy of each slot's message, written by the producer before it publishes the slot, for
+    // OWSRingBufferLoggerWriteForCrash which can't touch the DDLogMessages.
+    char *_crashLines;
+    char *_crashLogFilePath;
+}
+
+- (instancetype)initWithLogsDirectory:(NSString *)logsDirectory capacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    OWSAssertDebug(logsDirectory.length > 0);
+    OWSAssertDebug(capacity > 0);
+
+    _logsDirectory = logsDirectory;
+    _capacity = MAX((NSUInteger)1, capacity);
+    _maximumFileSize = kOWSRingBufferLoggerDefaultMaximumFileSize;
+    _maximumNumberOfLogFiles = kOWSRingBufferLoggerDefaultMaximumNumberOfLogFiles;
+    _flushInterval = kOWSRingBufferLoggerDefaultFlushInterval;
+    _logFileName = [NSBundle mainBundle].bundleIdentifier ?: @"log";
+
+    _slots = calloc(_capacity, sizeof(void *));
+    _crashLines = calloc(_capacity, kOWSRingBufferLoggerCrashLineLength);
+    _crashLogFilePath = strdup([self logFilePathAtIndex:0].fileSystemRepresentation);
+    atomic_init(&_head, 0);
+    atomic_init(&_tail, 0);
+    atomic_init(&_droppedCount, 0);
+    // Leave plenty of room for messages logged while the writer is catching up.
+    _wakeThreshold = MAX((NSUInteger)1, _capacity / 4);
+
+    _writerQueue = dispatch_queue_create("org.whispersystems.ringBufferLogger", DISPATCH_QUEUE_SERIAL);
+
+    __weak OWSRingBufferLogger *weakSelf = self;
+    _wakeSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, _writerQueue);
+    dispatch_source_set_event_handler(_wakeSource, ^{
+        [weakSelf drainBuffer];
+    });
+    dispatch_resume(_wakeSource);
+
+    _flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _writerQueue);
+    uint64_t interval = (uint64_t)(_flushInterval * NSEC_PER_SEC);
+    dispatch_source_set_timer(_flushTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 4);
+    dispatch_source_set_event_handler(_flushTimer, ^{
+        [weakSelf drainBuffer];
+    });
+    dispatch_resume(_flushTimer);
+
+    return self;
+}
+
+- (void)dealloc
+{
+    dispatch_source_cancel(_wakeSource);
+    dispatch_source_cancel(_flushTimer);
+
+    NSUInteger head = atomic_load(&_head);
+    NSUInteger tail = atomic_load(&_tail);
+    for (NSUInteger index = head; index != tail; index++) {
+        CFRelease(_slots[index % _capacity]);
+    }
+    free(_slots);
+    free(_crashLines);
+    free(_crashLogFilePath);
+
+    [_fileHandle closeFile];
+}
+
+- (void)setFlushInterval:(NSTimeInterval)flushInterval
+{
+    _flushInterval = flushInterval;
+
+    uint64_t interval = (uint64_t)(flushInterval * NSEC_PER_SEC);
+    dispatch_source_set_timer(
+        self.flushTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 4);
+}
+
+#pragma mark - DDLogger
+
+// Called on the logger queue.  This is the hot path: no formatting, locking or allocation.
+- (void)logMessage:(DDLogMessage *)logMessage
+{
+    NSUInteger tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+    NSUInteger head = atomic_load_explicit(&_head, memory_order_acquire);
+    NSUInteger count = tail - head;
+    if (count >= _capacity) {
+        atomic_fetch_add_explicit(&_droppedCount, 1, memory_order_relaxed);
+        dispatch_source_merge_data(_wakeSource, 1);
+        return;
+    }
+
+    NSUInteger slot = tail % _capacity;
+    _slots[slot] = (__bridge_retained void *)logMessage;
+
+    // Copying into preallocated storage doesn't allocate.
+    NSString *string = logMessage.message;
+    char *crashLine = _crashLines + slot * kOWSRingBufferLoggerCrashLineLength;
+    NSUInteger crashLineLength = 0;
+    [string getBytes:crashLine
+             maxLength:kOWSRingBufferLoggerCrashLineLength - 1
+            usedLength:&crashLineLength
+              encoding:NSUTF8StringEncoding
+               options:NSStringEncodingConversionAllowLossy
+                 range:NSMakeRange(0, string.length)
+        remainingRange:NULL];
+    crashLine[crashLineLength] = '\0';
+
+    atomic_store_explicit(&_tail, tail + 1, memory_order_release);
+
+    if (count + 1 == _wakeThreshold) {
+        dispatch_source_merge_data(_wakeSource, 1);
+    }
+}
+
+- (void)flush
+{
+    dispatch_sync(self.writerQueue, ^{
+        [self drainBuffer];
+        [self.fileHandle synchronizeFile];
+    });
+}
+
+- (void)flushWithTimeout:(NSTimeInterval)timeout
+{
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    dispatch_async(self.writerQueue, ^{
+        [self drainBuffer];
+        [self.fileHandle synchronizeFile];
+        dispatch_semaphore_signal(semaphore);
+    });
+    dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)));
+}
+
+- (void)willRemoveLogger
+{
+    dispatch_sync(self.writerQueue, ^{
+        [self drainBuffer];
+        [self.fileHandle closeFile];
+        self.fileHandle = nil;
+    });
+}
+
+#pragma mark - Writer
+
+- (void)drainBuffer
+{
+    NSUInteger head = atomic_load_explicit(&_head, memory_order_relaxed);
+    NSUInteger tail = atomic_load_explicit(&_tail, memory_order_acquire);
+    NSUInteger droppedCount = atomic_exchange_explicit(&_droppedCount, 0, memory_order_relaxed);
+    if (head == tail && droppedCount == 0) {
+        return;
+    }
+
+    // Take the messages out first, so that the slots are free for the producer while we format.
+    NSMutableArray<DDLogMessage *> *messages = [NSMutableArray arrayWithCapacity:tail - head];
+    for (NSUInteger index = head; index != tail; index++) {
+        NSUInteger slot = index % _capacity;
+        [messages addObject:(__bridge_transfer DDLogMessage *)_slots[slot]];
+        _slots[slot] = NULL;
+    }
+    atomic_store_explicit(&_head, tail, memory_order_release);
+
+    id<DDLogFormatter> _Nullable formatter = _logFormatter;
+    NSMutableData *batch = [NSMutableData new];
+    for (DDLogMessage *message in messages) {
+        NSString *_Nullable line = formatter ? [formatter formatLogMessage:message] : message.message;
+        if (!line) {
+            continue;
+        }
+        [batch appendData:[line dataUsingEncoding:NSUTF8StringEncoding]];
+        [batch appendBytes:"\n" length:1];
+    }
+    if (droppedCount > 0) {
+        NSString *line = [NSString stringWithFormat:@"%@ dropped %lu log messages.\n",
+                                   self.logTag,
+                                   (unsigned long)droppedCount];
+        [batch appendData:[line dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    [self writeData:batch];
+}
+
+- (void)writeData:(NSData *)data
+{
+    if (data.length < 1) {
+        return;
+    }
+
+    if (self.fileHandle && self.fileSize > 0 && self.fileSize + data.length > self.maximumFileSize) {
+        [self rotateLogFiles];
+    }
+
+    NSFileHandle *_Nullable fileHandle = self.fileHandle ?: [self openCurrentLogFile];
+    if (!fileHandle) {
+        return;
+    }
+
+    @try {
+        [fileHandle writeData:data];
+        self.fileSize += data.length;
+    } @catch (NSException *exception) {
+        // e.g. the disk is full.  Reopen next time.
+        [fileHandle closeFile];
+        self.fileHandle = nil;
+    }
+}
+
+- (nullable NSFileHandle *)openCurrentLogFile
+{
+    [OWSFileSystem ensureDirectoryExists:self.logsDirectory];
+
+    NSString *filePath = [self logFilePathAtIndex:0];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
+        [[NSFileManager defaultManager] createFileAtPath:filePath contents:nil attributes:nil];
+        // Logs are written while the app is in the background.
+        [OWSFileSystem protectFileOrFolderAtPath:filePath];
+    }
+
+    NSFileHandle *_Nullable fileHandle = [NSFileHandle fileHandleForWritingAtPath:filePath];
+    if (!fileHandle) {
+        return nil;
+    }
+    self.fileSize = [fileHandle seekToEndOfFile];
+    self.fileHandle = fileHandle;
+
+    if (self.fileSize >= self.maximumFileSize) {
+        [self rotateLogFiles];
+        return [self openCurrentLogFile];
+    }
+    return fileHandle;
+}
+
+- (void)rotateLogFiles
+{
+    [self.fileHandle closeFile];
+    self.fileHandle = nil;
+    self.fileSize = 0;
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSUInteger fileCount = MAX((NSUInteger)1, self.maximumNumberOfLogFiles);
+    [OWSFileSystem deleteFileIfExists:[self logFilePathAtIndex:fileCount - 1]];
+    for (NSUInteger index = fileCount - 1; index > 0; index--) {
+        NSString *sourcePath = [self logFilePathAtIndex:index - 1];
+        if ([fileManager fileExistsAtPath:sourcePath]) {
+            [fileManager moveItemAtPath:sourcePath toPath:[self logFilePathAtIndex:index] error:nil];
+        }
+    }
+}
+
+#pragma mark - Crashes
+
+// Masks, in place, every run of hex digits which contains a decimal digit: phone numbers, addresses and ids.
+static void OWSRingBufferLoggerMaskCrashLine(char *line, size_t length)
+{
+    size_t runStart = 0;
+    BOOL isInRun = NO;
+    BOOL runHasDigit = NO;
+    for (size_t index = 0; index <= length; index++) {
+        char c = (index < length ? line[index] : '\0');
+        BOOL isDigit = (c >= '0' && c <= '9');
+        BOOL isHexDigit = isDigit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        if (isHexDigit) {
+            if (!isInRun) {
+                isInRun = YES;
+                runStart = index;
+                runHasDigit = NO;
+            }
+            runHasDigit = runHasDigit || isDigit;
+            continue;
+        }
+        if (isInRun && runHasDigit) {
+            memset(line + runStart, '*', index - runStart);
+        }
+        isInRun = NO;
+    }
+}
+
+static void OWSRingBufferLoggerWriteAll(int fileDescriptor, const char *bytes, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fileDescriptor, bytes, length);
+        if (written <= 0) {
+            return;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+}
+
+// Only uses open, write and close, which are async-signal-safe, and doesn't allocate or message objects.
+void OWSRingBufferLoggerWriteForCrash(__unsafe_unretained OWSRingBufferLogger *logger)
+{
+    if (!logger || !logger->_crashLogFilePath) {
+        return;
+    }
+
+    NSUInteger head = atomic_load_explicit(&logger->_head, memory_order_acquire);
+    NSUInteger tail = atomic_load_explicit(&logger->_tail, memory_order_acquire);
+    if (head == tail) {
+        return;
+    }
+
+    int fileDescriptor = open(logger->_crashLogFilePath, O_WRONLY | O_APPEND | O_CREAT, 0600);
+    if (fileDescriptor < 0) {
+        return;
+    }
+
+    static const char header[] = "Unwritten log messages at crash:\n";
+    OWSRingBufferLoggerWriteAll(fileDescriptor, header, sizeof(header) - 1);
+
+    char line[kOWSRingBufferLoggerCrashLineLength];
+    for (NSUInteger index = head; index != tail; index++) {
+        const char *crashLine = logger->_crashLines + (index % logger->_capacity) * kOWSRingBufferLoggerCrashLineLength;
+        size_t length = strnlen(crashLine, kOWSRingBufferLoggerCrashLineLength - 1);
+        memcpy(line, crashLine, length);
+        OWSRingBufferLoggerMaskCrashLine(line, length);
+        line[length] = '\n';
+        OWSRingBufferLoggerWriteAll(fileDescriptor, line, length + 1);
+    }
+
+    close(fileDescriptor);
+}
+
+#pragma mark - Files
+
+- (NSString *)logFilePathAtIndex:(NSUInteger)index
+{
+    NSString *fileName = (index == 0
+            ? [self.logFileName stringByAppendingPathExtension:@"log"]
+            : [NSString stringWithFormat:@"%@.%lu.log", self.logFileName, (unsigned long)index]);
+    return [self.logsDirectory stringByAppendingPathComponent:fileName];
+}
+
+- (NSArray<NSString *> *)logFilePaths
+{
+    NSMutableArray<NSString *> *result = [NSMutableArray new];
+    for (NSUInteger index = 0; index < MAX((NSUInteger)1, self.maximumNumberOfLogFiles); index++) {
+        NSString *filePath = [self logFilePathAtIndex:index];
+        if ([[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
+            [result addObject:filePath];
+        }
+    }
+    return result;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -4,8 +4,17 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class OWSLogScrubber;
+
 @interface OWSScrubbingLogFormatter : DDLogFileFormatterDefault
 
+@property (nonatomic, readonly) OWSLogScrubber *scrubber;
+
+// Uses the default scrubber.
+- (instancetype)init;
+
+- (instancetype)initWithScrubber:(OWSLogScrubber *)scrubber;
+
 @end
 
 NS_ASSUME_NONNULL_END
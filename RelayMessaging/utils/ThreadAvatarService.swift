@@ -0,0 +1,213 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+import Foundation
+
+// Renders thread avatars for the inbox without touching the database or decoding images on the main thread.
+//
+// Avatars are cached by a fingerprint of what the avatar is drawn from (the thread's own image, the announcement
+// icon or the other participant's avatar) rather than by thread id, so the many thread changes which have nothing
+// to do with the avatar (e.g. lastMessageDate) don't throw away rendered avatars, and a changed avatar never
+// reuses a stale one.
+//
+// Everything but the rendering itself happens on the main thread.
+@objc public class ThreadAvatarService: NSObject {
+
+    @objc public static let shared = ThreadAvatarService()
+
+    // Posted on the main thread when avatars drawn from a recipient's avatar have changed.
+    @objc public static let avatarsDidChangeNotification = Notification.Name("ThreadAvatarServiceAvatarsDidChange")
+
+    // Source images, for callers which draw the avatar themselves.
+    private let sourceCache = NSCache<NSString, UIImage>()
+    // Rendered avatars, by fingerprint and diameter.
+    private let renderedCache = ImageCache()
+    private var pendingCompletions = [String: [(UIImage) -> Void]]()
+    private let renderQueue = DispatchQueue(label: "ThreadAvatarService.render", qos: .userInitiated)
+
+    // Bumped whenever the recipient's avatar changes, since that isn't recorded on the thread.
+    private var recipientAvatarGenerations = [String: Int]()
+    // Reading the preference is a database read, so it's only done once per change.
+    private var cachedUseGravatars: Bool?
+
+    private override init() {
+        super.init()
+
+        sourceCache.countLimit = 256
+
+        NotificationCenter.default.addObserver(self,
+                                               selector: #selector(recipientAvatarUpdated(notification:)),
+                                               name: NSNotification.Name(rawValue: FLRecipientAvatarUpdatedNotification),
+                                               object: nil)
+        NotificationCenter.default.addObserver(self,
+                                               selector: #selector(didReceiveMemoryWarning),
+                                               name: NSNotification.Name.UIApplicationDidReceiveMemoryWarning,
+                                               object: nil)
+    }
+
+    deinit {
+        NotificationCenter.default.removeObserver(self)
+    }
+
+    // MARK: - Fingerprints
+
+    private var useGravatars: Bool {
+        if let useGravatars = cachedUseGravatars {
+            return useGravatars
+        }
+        let useGravatars = Environment.preferences().useGravatars()
+        cachedUseGravatars = useGravatars
+        return useGravatars
+    }
+
+    // Identifies the avatar's content.  Only reads the thread in memory.
+    @objc(fingerprintForThread:)
+    public func fingerprint(thread: TSThread) -> String {
+        AssertIsOnMainThread()
+
+        if thread.image != nil {
+            // Images assigned before fingerprints were recorded are stable until the image is next updated.
+            return "image:\(thread.imageFingerprint ?? "legacy:\(thread.uniqueId)")"
+        } else if thread.type == FLThreadTypeAnnouncement {
+            return "announcement"
+        } else if thread.isOneOnOne, let recipientId = thread.otherParticipantId {
+            let generation = recipientAvatarGenerations[recipientId] ?? 0
+            return "recipient:\(recipientId):\(useGravatars ? "gravatar" : "avatar"):\(generation)"
+        }
+        return "default"
+    }
+
+    private class func sourceImage(thread: TSThread) -> UIImage? {
+        if let image = thread.image {
+            return image
+        } else if thread.type == FLThreadTypeAnnouncement {
+            return UIImage(named: "Announcement")
+        } else if thread.isOneOnOne, let recipientId = thread.otherParticipantId {
+            return TextSecureKitEnv.shared().contactsManager.avatarImageRecipientId(recipientId)
+        }
+        return nil
+    }
+
+    private var placeholderImage: UIImage? {
+        return UIImage(named: "empty-group-avatar-gray")
+    }
+
+    // MARK: - Images
+
+    // The unscaled avatar, read synchronously.  Prefer avatar(thread:diameter:completion:) anywhere scrolling.
+    @objc(imageForThread:)
+    public func image(thread: TSThread) -> UIImage? {
+        AssertIsOnMainThread()
+
+        let key = fingerprint(thread: thread) as NSString
+        if let image = sourceCache.object(forKey: key) {
+            return image
+        }
+        guard let image = ThreadAvatarService.sourceImage(thread: thread) else {
+            return placeholderImage
+        }
+        sourceCache.setObject(image, forKey: key)
+        return image
+    }
+
+    // Returns the avatar at once if it's already been rendered at this diameter.  Otherwise returns a placeholder
+    // and renders the avatar in the background, calling the completion on the main thread once it's ready.  The
+    // completion isn't called if the returned image is already the avatar.
+    @objc(avatarForThread:diameter:completion:)
+    public func avatar(thread: TSThread, diameter: CGFloat, completion: @escaping (UIImage) -> Void) -> UIImage? {
+        AssertIsOnMainThread()
+
+        let fingerprint = self.fingerprint(thread: thread)
+        if let image = renderedCache.image(forKey: fingerprint as NSString, diameter: diameter) {
+            return image
+        }
+
+        let pendingKey = "\(fingerprint)@\(diameter)"
+        if pendingCompletions[pendingKey] != nil {
+            pendingCompletions[pendingKey]?.append(completion)
+            return placeholderImage
+        }
+        pendingCompletions[pendingKey] = [completion]
+
+        let scale = UIScreen.main.scale
+        let placeholderImage = self.placeholderImage
+        renderQueue.async {
+            let source = ThreadAvatarService.sourceImage(thread: thread) ?? placeholderImage
+            let rendered = source.map { ThreadAvatarService.render(image: $0, diameter: diameter, scale: scale) }
+
+            DispatchQueue.main.async {
+                let completions = self.pendingCompletions.removeValue(forKey: pendingKey) ?? []
+                guard let image = rendered else {
+                    return
+                }
+                self.renderedCache.setImage(image, forKey: fingerprint as NSString, diameter: diameter)
+                for completion in completions {
+                    completion(image)
+                }
+            }
+        }
+        return placeholderImage
+    }
+
+    // Draws the image into a bitmap of the avatar's size, aspect filled, which also decodes it.
+    private class func render(image: UIImage, diameter: CGFloat, scale: CGFloat) -> UIImage {
+        let size = CGSize(width: diameter, height: diameter)
+        guard image.size.width > 0, image.size.height > 0 else {
+            return image
+        }
+        let ratio = max(size.width / image.size.width, size.height / image.size.height)
+        let drawSize = CGSize(width: image.size.width * ratio, height: image.size.height * ratio)
+        let drawRect = CGRect(x: (size.width - drawSize.width) / 2,
+                              y: (size.height - drawSize.height) / 2,
+                              width: drawSize.width,
+                              height: drawSize.height)
+
+        UIGraphicsBeginImageContextWithOptions(size, false, scale)
+        defer { UIGraphicsEndImageContext() }
+        image.draw(in: drawRect)
+        guard let rendered = UIGraphicsGetImageFromCurrentImageContext() else {
+            owsFailDebug("Couldn't render avatar.")
+            return image
+        }
+        return rendered
+    }
+
+    // MARK: - Invalidation
+
+    // Avatars drawn from the thread itself never need to be invalidated, since their fingerprint changes with
+    // them.  Only recipients' avatars and the gravatar preference live elsewhere.
+    @objc func recipientAvatarUpdated(notification: Notification) {
+        AssertIsOnMainThread()
+
+        guard let recipientId = notification.userInfo?["recipientId"] as? String else {
+            owsFailDebug("\(self.logTag) Missing recipientId.")
+            return
+        }
+        recipientAvatarGenerations[recipientId] = (recipientAvatarGenerations[recipientId] ?? 0) + 1
+        NotificationCenter.default.post(name: ThreadAvatarService.avatarsDidChangeNotification,
+                                        object: nil,
+                                        userInfo: ["recipientId": recipientId])
+    }
+
+    // Call once the gravatar preference has changed.
+    @objc public func useGravatarsDidChange() {
+        AssertIsOnMainThread()
+
+        cachedUseGravatars = nil
+        NotificationCenter.default.post(name: ThreadAvatarService.avatarsDidChangeNotification, object: nil)
+    }
+
+    @objc public func flush() {
+        AssertIsOnMainThread()
+
+        sourceCache.removeAllObjects()
+        renderedCache.removeAllImages()
+        cachedUseGravatars = nil
+    }
+
+    @objc func didReceiveMemoryWarning() {
+        sourceCache.removeAllObjects()
+        renderedCache.removeAllImages()
+    }
+}
@@ -15,7 +15,8 @@ import Foundation
     // Shared singleton
     @objc public static let sharedManager = ThreadManager()
 
-    fileprivate let imageCache = NSCache<NSString, UIImage>()
+    // Images by thread id, along with the thread's imageFingerprint when they were cached.
+    fileprivate let imageCache = NSCache<NSString, CachedThreadImage>()
     
     fileprivate let dbReadConnection  = { () -> YapDatabaseConnection in
         let aConnection: YapDatabaseConnection = OWSPrimaryStorage.shared().newDatabaseConnection()
@@ -35,48 +36,40 @@ import Foundation
                                                selector: #selector(yapDatabaseModified),
                                                name: NSNotification.Name.YapDatabaseModified,
                                                object: nil)
+        NotificationCenter.default.addObserver(self,
+                                               selector: #selector(avatarsDidChange),
+                                               name: ThreadAvatarService.avatarsDidChangeNotification,
+                                               object: nil)
     }
     
     deinit {
         NotificationCenter.default.removeObserver(self)
     }
     
+    // Avatars for the inbox should come from ThreadAvatarService directly, which doesn't block on the database.
     @objc public func image(threadId: String) -> UIImage? {
-        if let image = self.imageCache.object(forKey: threadId as NSString) {
-            return image
-        } else {
-            var thread: TSThread?
-            self.dbReadConnection.read { (transaction) in
-                thread = TSThread.fetch(uniqueId: threadId, transaction: transaction)
-            }
-            guard thread != nil else {
-                Logger.debug("Attempt to retrieve unknown thread: \(threadId)")
-                return nil
-            }
-            
-            if let image = thread!.image {
-                // thread has assigned image
-                self.imageCache.setObject(image, forKey: threadId as NSString)
-                return image
-            } else if thread!.type == FLThreadTypeAnnouncement {
-                if let image = UIImage(named: "Announcement") {
-                    self.imageCache.setObject(image, forKey: threadId as NSString)
-                    return image
-                }
-            } else if thread!.isOneOnOne {
-                // one-on-one, use other avatar
-                if let image = TextSecureKitEnv.shared().contactsManager.avatarImageRecipientId(thread!.otherParticipantId!) {
-                    self.imageCache.setObject(image, forKey: threadId as NSString)
-                    return image
-                }
-            }
+        if let cachedImage = self.imageCache.object(forKey: threadId as NSString) {
+            return cachedImage.image
+        }
+        var thread: TSThread?
+        self.dbReadConnection.read { (transaction) in
+            thread = TSThread.fetch(uniqueId: threadId, transaction: transaction)
         }
-        // Return default avatar
-        return UIImage.init(named:"empty-group-avatar-gray");
+        guard thread != nil else {
+            Logger.debug("Attempt to retrieve unknown thread: \(threadId)")
+            return nil
+        }
+        guard let image = ThreadAvatarService.shared.image(thread: thread!) else {
+            return nil
+        }
+        self.imageCache.setObject(CachedThreadImage(image: image, imageFingerprint: thread!.imageFingerprint),
+                                  forKey: threadId as NSString)
+        return image
     }
     
     @objc public func flushImageCache() {
         imageCache.removeAllObjects()
+        ThreadAvatarService.shared.flush()
     }
     
     @objc func threadExpressionUpdated(notification: Notification?) {
@@ -150,17 +143,49 @@ import Foundation
 //        }
 //    }
     
+    // Only changes to a thread's own image drop its cached image, not the many other changes to threads.
     @objc func yapDatabaseModified(notification: Notification?) {
         
         DispatchQueue.global(qos: .background).async {
             let notifications = self.dbReadConnection.beginLongLivedReadTransaction()
+            var cachedThreadIds = [String]()
             self.dbReadConnection.enumerateChangedKeys(inCollection: TSThread.collection(),
-                                                     in: notifications) { (threadId, stop) in
-                                                        // Remove cached image
-                                                        self.imageCache.removeObject(forKey: threadId as NSString)
+                                                       in: notifications) { (threadId, stop) in
+                                                        if self.imageCache.object(forKey: threadId as NSString) != nil {
+                                                            cachedThreadIds.append(threadId)
+                                                        }
+            }
+            guard cachedThreadIds.count > 0 else {
+                return
+            }
+            self.dbReadConnection.read { (transaction) in
+                for threadId in cachedThreadIds {
+                    guard let cachedImage = self.imageCache.object(forKey: threadId as NSString) else {
+                        continue
+                    }
+                    let thread = TSThread.fetch(uniqueId: threadId, transaction: transaction)
+                    if thread == nil || thread!.imageFingerprint != cachedImage.imageFingerprint {
+                        self.imageCache.removeObject(forKey: threadId as NSString)
+                    }
+                }
             }
         }
     }
+    
+    // Recipients' avatars aren't recorded on threads.
+    @objc func avatarsDidChange(notification: Notification?) {
+        imageCache.removeAllObjects()
+    }
 
+}
 
+fileprivate class CachedThreadImage: NSObject {
+    let image: UIImage
+    let imageFingerprint: String?
+    
+    init(image: UIImage, imageFingerprint: String?) {
+        self.image = image
+        self.imageFingerprint = imageFingerprint
+        super.init()
+    }
 }
@@ -25,8 +25,13 @@ typedef NS_ENUM(NSInteger, RefreshPreKeysMode) {
                         success:(void (^)(void))successHandler
                         failure:(void (^)(NSError *error))failureHandler;
 
+// Asks the service how many one-time prekeys it has left, and refreshes them if necessary.
 + (void)checkPreKeys;
 
+// Refreshes prekeys if necessary, deciding from the prekeys used by incoming sessions, and only asking the
+// service when that can't be trusted.
++ (void)checkPreKeysLocally;
+
 + (void)checkPreKeysIfNecessary;
 
 @end
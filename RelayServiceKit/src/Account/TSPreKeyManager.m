@@ -31,6 +31,15 @@
 // whenever ~2/3 of them have been consumed.
 static const NSUInteger kEphemeralPreKeysMinimumCount = 35;
 
+// How often we ask the service how many one-time prekeys it has left.
+//
+// In between, we count the prekeys used by incoming sessions.  The service
+// can also hand out prekeys to senders which never use them, so we still
+// check now and then.
+#define kPreKeyServiceCheckFrequencySeconds ((NSTimeInterval)2 * kDayInterval)
+
+static NSString *const kLastPreKeyServiceCheckDateKey = @"OWSStorageInternalSettingsLastPreKeyServiceCheckDate";
+
 // This global should only be accessed on prekeyQueue.
 static NSDate *lastPreKeyCheckTimestamp = nil;
 
@@ -89,6 +98,26 @@ static const NSUInteger kMaxPrekeyUpdateFailureCount = 5;
     return queue;
 }
 
+// Prekeys are generated for the reserve on this queue, so that generating
+// them doesn't compete with launch or message processing.
++ (dispatch_queue_t)reserveQueue
+{
+    static dispatch_once_t onceToken;
+    static dispatch_queue_t queue;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("io.forsta.relay.prekeyReserveQueue",
+            dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_BACKGROUND, 0));
+    });
+    return queue;
+}
+
++ (void)replenishPreKeyReserveIfNecessary
+{
+    dispatch_async(TSPreKeyManager.reserveQueue, ^{
+        [[OWSPrimaryStorage sharedManager] replenishPreKeyReserve];
+    });
+}
+
 + (void)checkPreKeysIfNecessary
 {
     if (!CurrentAppContext().isMainApp) {
@@ -114,14 +143,79 @@ static const NSUInteger kMaxPrekeyUpdateFailureCount = 5;
             lastPreKeyCheckTimestamp = [NSDate date];
 
             if ([TSAccountManager isRegistered]) {
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                    [TSPreKeyManager checkPreKeys];
-                });
+                [TSPreKeyManager checkPreKeysLocally];
             }
         }
     });
 }
 
++ (void)checkPreKeysLocally
+{
+    if (!CurrentAppContext().isMainApp) {
+        return;
+    }
+
+    dispatch_async(TSPreKeyManager.prekeyQueue, ^{
+        OWSPrimaryStorage *primaryStorage = [OWSPrimaryStorage sharedManager];
+        NSNumber *_Nullable unconsumedPreKeyCount = [primaryStorage unconsumedUploadedPreKeyCount];
+        NSDate *_Nullable lastServiceCheckDate =
+            [primaryStorage.dbReadConnection dateForKey:kLastPreKeyServiceCheckDateKey
+                                           inCollection:TSStorageInternalSettingsCollection];
+
+        if (!unconsumedPreKeyCount || !lastServiceCheckDate
+            || fabs(lastServiceCheckDate.timeIntervalSinceNow) >= kPreKeyServiceCheckFrequencySeconds) {
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [TSPreKeyManager checkPreKeys];
+            });
+            return;
+        }
+
+        if (unconsumedPreKeyCount.unsignedIntegerValue <= kEphemeralPreKeysMinimumCount) {
+            DDLogInfo(@"%@ Updating one-time and signed prekeys since only %@ one-time prekeys are left.",
+                self.logTag,
+                unconsumedPreKeyCount);
+            [self refreshPreKeysWithMode:RefreshPreKeysMode_SignedAndOneTime];
+        } else if ([self shouldRotateSignedPreKey]) {
+            DDLogInfo(@"%@ Updating signed prekey due to rotation period.", self.logTag);
+            [self refreshPreKeysWithMode:RefreshPreKeysMode_SignedOnly];
+        } else {
+            [self replenishPreKeyReserveIfNecessary];
+        }
+    });
+}
+
++ (BOOL)shouldRotateSignedPreKey
+{
+    OWSPrimaryStorage *primaryStorage = [OWSPrimaryStorage sharedManager];
+    NSNumber *currentSignedPrekeyId = [primaryStorage currentSignedPrekeyId];
+    if (!currentSignedPrekeyId) {
+        DDLogError(@"%@ %s Couldn't find current signed prekey id", self.logTag, __PRETTY_FUNCTION__);
+        return YES;
+    }
+    SignedPreKeyRecord *currentRecord = [primaryStorage loadSignedPrekeyOrNil:currentSignedPrekeyId.intValue];
+    if (!currentRecord) {
+        OWSFailDebug(@"%@ %s Couldn't find signed prekey for id: %@",
+            self.logTag,
+            __PRETTY_FUNCTION__,
+            currentSignedPrekeyId);
+        return YES;
+    }
+    return fabs([currentRecord.generatedAt timeIntervalSinceNow]) >= kSignedPreKeyRotationTime;
+}
+
++ (void)refreshPreKeysWithMode:(RefreshPreKeysMode)mode
+{
+    [self registerPreKeysWithMode:mode
+        success:^{
+            DDLogInfo(@"%@ New prekeys registered with server.", self.logTag);
+
+            [self clearSignedPreKeyRecords];
+        }
+        failure:^(NSError *error) {
+            DDLogWarn(@"%@ Failed to update prekeys with the server: %@", self.logTag, error);
+        }];
+}
+
 + (void)registerPreKeysWithMode:(RefreshPreKeysMode)mode
                         success:(void (^)(void))successHandler
                         failure:(void (^)(NSError *error))failureHandler
@@ -155,10 +249,10 @@ static const NSUInteger kMaxPrekeyUpdateFailureCount = 5;
         if (modeCopy == RefreshPreKeysMode_SignedAndOneTime) {
             description = @"signed and one-time prekeys";
             PreKeyRecord *lastResortPreKey = [primaryStorage getOrGenerateLastResortKey];
-            preKeys = [primaryStorage generatePreKeyRecords];
-            // Store the new one-time keys immediately, before they are sent to the
+            // Stores the new one-time keys immediately, before they are sent to the
             // service to prevent race conditions and other edge cases.
-            [primaryStorage storePreKeyRecords:preKeys];
+            preKeys = [primaryStorage takePreKeyRecordsForUpload];
+            [self replenishPreKeyReserveIfNecessary];
 
             request = [OWSRequestFactory registerPrekeysRequestWithPrekeyArray:preKeys
                                                                    identityKey:identityKeyPair.publicKey
@@ -180,6 +274,10 @@ static const NSUInteger kMaxPrekeyUpdateFailureCount = 5;
                 // On success, update the "current" signed prekey state.
                 [primaryStorage setCurrentSignedPrekeyId:signedPreKey.Id];
 
+                if (preKeys) {
+                    [primaryStorage markPreKeyRecordsAsUploaded:preKeys];
+                }
+
                 successHandler();
 
                 [TSPreKeyManager clearPreKeyUpdateFailureCount];
@@ -241,54 +339,24 @@ static const NSUInteger kMaxPrekeyUpdateFailureCount = 5;
             NSString *preKeyCountKey = @"count";
             NSNumber *count = [responseObject objectForKey:preKeyCountKey];
 
-            BOOL didUpdatePreKeys = NO;
-            void (^updatePreKeys)(RefreshPreKeysMode) = ^(RefreshPreKeysMode mode) {
-                [self registerPreKeysWithMode:mode
-                    success:^{
-                        DDLogInfo(@"%@ New prekeys registered with server.", self.logTag);
-
-                        [self clearSignedPreKeyRecords];
-                    }
-                    failure:^(NSError *error) {
-                        DDLogWarn(@"%@ Failed to update prekeys with the server: %@", self.logTag, error);
-                    }];
-            };
+            [[OWSPrimaryStorage sharedManager].dbReadWriteConnection setDate:[NSDate new]
+                                                                      forKey:kLastPreKeyServiceCheckDateKey
+                                                                inCollection:TSStorageInternalSettingsCollection];
 
+            BOOL didUpdatePreKeys = NO;
             BOOL shouldUpdateOneTimePreKeys = count.integerValue <= kEphemeralPreKeysMinimumCount;
 
             if (shouldUpdateOneTimePreKeys) {
                 DDLogInfo(@"%@ Updating one-time and signed prekeys due to shortage of one-time prekeys.", self.logTag);
-                updatePreKeys(RefreshPreKeysMode_SignedAndOneTime);
+                [self refreshPreKeysWithMode:RefreshPreKeysMode_SignedAndOneTime];
+                didUpdatePreKeys = YES;
+            } else if ([self shouldRotateSignedPreKey]) {
+                DDLogInfo(@"%@ Updating signed prekey due to rotation period.", self.logTag);
+                [self refreshPreKeysWithMode:RefreshPreKeysMode_SignedOnly];
                 didUpdatePreKeys = YES;
             } else {
-                OWSPrimaryStorage *primaryStorage = [OWSPrimaryStorage sharedManager];
-                NSNumber *currentSignedPrekeyId = [primaryStorage currentSignedPrekeyId];
-                BOOL shouldUpdateSignedPrekey = NO;
-                if (!currentSignedPrekeyId) {
-                    DDLogError(@"%@ %s Couldn't find current signed prekey id", self.logTag, __PRETTY_FUNCTION__);
-                    shouldUpdateSignedPrekey = YES;
-                } else {
-                    SignedPreKeyRecord *currentRecord =
-                        [primaryStorage loadSignedPrekeyOrNil:currentSignedPrekeyId.intValue];
-                    if (!currentRecord) {
-                        OWSFailDebug(@"%@ %s Couldn't find signed prekey for id: %@",
-                            self.logTag,
-                            __PRETTY_FUNCTION__,
-                            currentSignedPrekeyId);
-                        shouldUpdateSignedPrekey = YES;
-                    } else {
-                        shouldUpdateSignedPrekey
-                        = fabs([currentRecord.generatedAt timeIntervalSinceNow]) >= kSignedPreKeyRotationTime;
-                    }
-                }
-                
-                if (shouldUpdateSignedPrekey) {
-                    DDLogInfo(@"%@ Updating signed prekey due to rotation period.", self.logTag);
-                    updatePreKeys(RefreshPreKeysMode_SignedOnly);
-                    didUpdatePreKeys = YES;
-                } else {
-                    DDLogDebug(@"%@ Not updating prekeys.", self.logTag);
-                }
+                DDLogDebug(@"%@ Not updating prekeys.", self.logTag);
+                [self replenishPreKeyReserveIfNecessary];
             }
 
             if (!didUpdatePreKeys) {
@@ -20,6 +20,11 @@
 #import <RelayServiceKit/RelayServiceKit-Swift.h>
 
 #define FLTagMathPath @"/v1/directory/user/"
+#define FLModifiedSinceParameter @"modified_gte"
+// Overlap between consecutive delta windows to absorb clock skew with CCSM.  Re-applying a record is idempotent.
+#define FLSyncOverlapInterval (5 * 60)
+// Deletions only show up as records missing from a full sync, so one is done at least this often.
+#define FLFullSyncInterval (24 * 60 * 60)
 #define CCSMHomeURL [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CCSM_Home_URL"]
 
 @implementation CCSMCommManager
@@ -285,14 +290,21 @@
                                    }] resume];
 }
 
+// The server's date is taken from the first page, so that anything changed while paging is fetched again next time.
 +(void)updateAllTheThings:(NSString *)urlString
                collection:(NSMutableDictionary *)collection
-                  success:(void (^)(void))successBlock
+               serverDate:(nullable NSDate *)serverDate
+                  success:(void (^)(NSDate *_Nullable serverDate))successBlock
                   failure:(void (^)(NSError *error))failureBlock
 {
-    NSURL *url = [NSURL URLWithString:[urlString stringByAddingPercentEncodingWithAllowedCharacters:[NSCharacterSet URLFragmentAllowedCharacterSet]]];
+    // Paging links, and URLs with queries, are already encoded.
+    NSURL *url = [NSURL URLWithString:urlString];
+    if (url == nil) {
+        url = [NSURL URLWithString:[urlString stringByAddingPercentEncodingWithAllowedCharacters:[NSCharacterSet URLFragmentAllowedCharacterSet]]];
+    }
     [self getPage:url
-          success:^(NSDictionary *result){
+          success:^(NSDictionary *result, NSHTTPURLResponse *_Nullable response){
+              NSDate *pageServerDate = serverDate ?: [self serverDateFromResponse:response];
               NSArray *results = [result objectForKey:@"results"];
               for (id thing in results) {
                   [collection setValue:thing forKey:[thing valueForKey:@"id"]];
@@ -301,10 +313,11 @@
               if (next && (NSNull *)next != [NSNull null]) {
                   [self updateAllTheThings:next
                                 collection:collection
+                                serverDate:pageServerDate
                                    success:successBlock
                                    failure:failureBlock];
               } else {
-                  successBlock();
+                  successBlock(pageServerDate);
               }
           }
           failure:^(NSError *err){
@@ -312,8 +325,31 @@
           }];
 }
 
++(nullable NSDate *)serverDateFromResponse:(nullable NSHTTPURLResponse *)response
+{
+    NSString *dateString = response.allHeaderFields[@"Date"];
+    if (dateString.length == 0) {
+        return nil;
+    }
+    
+    static NSDateFormatter *formatter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // RFC 7231 HTTP-date.
+        formatter = [NSDateFormatter new];
+        formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+        formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+        formatter.dateFormat = @"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'";
+    });
+    NSDate *date = [formatter dateFromString:dateString];
+    if (date == nil) {
+        DDLogWarn(@"%@ Couldn't parse server date: %@", self.logTag, dateString);
+    }
+    return date;
+}
+
 +(void)getPage:(NSURL *)url
-       success:(void (^)(NSDictionary *result))successBlock
+       success:(void (^)(NSDictionary *result, NSHTTPURLResponse *_Nullable response))successBlock
        failure:(void (^)(NSError *error))failureBlock
 {
     NSMutableURLRequest *request = [self authRequestWithURL:url];
@@ -327,7 +363,10 @@
                                            NSDictionary *result = [NSJSONSerialization JSONObjectWithData:data
                                                                                                   options:0
                                                                                                     error:NULL];
-                                           successBlock(result);
+                                           NSHTTPURLResponse *HTTPresponse = ([response isKindOfClass:[NSHTTPURLResponse class]]
+                                                                              ? (NSHTTPURLResponse *)response
+                                                                              : nil);
+                                           successBlock(result, HTTPresponse);
                                        }
                                        else if (connectionError != nil) {
                                            failureBlock(connectionError);
@@ -401,6 +440,7 @@
             [CCSMStorage.sharedInstance setUsers:@{ }];
             [CCSMStorage.sharedInstance setOrgInfo:@{ }];
             [CCSMStorage.sharedInstance setTags:@{ }];
+            [CCSMStorage.sharedInstance resetSyncDates];
         }
                 
         [CCSMStorage.sharedInstance setSessionToken:[payload objectForKey:@"token"]];
@@ -423,15 +463,35 @@
 
 +(void)refreshCCSMUsers
 {
-    
+    NSDate *lastSync = [self deltaSyncDateWithSyncDate:[CCSMStorage.sharedInstance getUsersSyncDate]
+                                          fullSyncDate:[CCSMStorage.sharedInstance getUsersFullSyncDate]];
     NSMutableDictionary *users = [NSMutableDictionary new];
     
-    [self updateAllTheThings:[NSString stringWithFormat:@"%@/v1/user/", CCSMHomeURL]
+    [self updateAllTheThings:[self syncURLStringWithPath:@"/v1/user/" since:lastSync]
                   collection:users
-                     success:^{
-                         DDLogDebug(@"Refreshed all users.");
-                         [CCSMStorage.sharedInstance setUsers:[NSDictionary dictionaryWithDictionary:users]];
-                         [self notifyOfUsersRefresh];
+                  serverDate:nil
+                     success:^(NSDate *_Nullable serverDate) {
+                         NSDictionary *previousUsers = [CCSMStorage.sharedInstance getUsers] ?: @{};
+                         if (lastSync == nil) {
+                             // Deleted users are only missing from a full sync; a delta never mentions them.
+                             NSMutableSet *removedIds = [NSMutableSet setWithArray:previousUsers.allKeys];
+                             [removedIds minusSet:[NSSet setWithArray:users.allKeys]];
+                             DDLogDebug(@"Refreshed all users, %lu removed.", (unsigned long)removedIds.count);
+                             [CCSMStorage.sharedInstance setUsers:[NSDictionary dictionaryWithDictionary:users]];
+                             [self notifyOfRefresh:FLCCSMUsersUpdated
+                                       withChanges:nil
+                                        removedIds:removedIds.allObjects
+                                          syncDate:serverDate];
+                         } else {
+                             DDLogDebug(@"Refreshed %lu changed users.", (unsigned long)users.count);
+                             NSMutableDictionary *mergedUsers = [previousUsers mutableCopy];
+                             [mergedUsers addEntriesFromDictionary:users];
+                             [CCSMStorage.sharedInstance setUsers:[NSDictionary dictionaryWithDictionary:mergedUsers]];
+                             [self notifyOfRefresh:FLCCSMUsersUpdated
+                                       withChanges:[NSDictionary dictionaryWithDictionary:users]
+                                        removedIds:nil
+                                          syncDate:serverDate];
+                         }
                      }
                      failure:^(NSError *err){
                          DDLogError(@"Failed to refresh all users. Error: %@", err.localizedDescription);
@@ -440,11 +500,14 @@
 
 +(void)refreshCCSMTags
 {
+    NSDate *lastSync = [self deltaSyncDateWithSyncDate:[CCSMStorage.sharedInstance getTagsSyncDate]
+                                          fullSyncDate:[CCSMStorage.sharedInstance getTagsFullSyncDate]];
     NSMutableDictionary *tags = [NSMutableDictionary new];
     
-    [self updateAllTheThings:[NSString stringWithFormat:@"%@/v1/tag/", CCSMHomeURL]
+    [self updateAllTheThings:[self syncURLStringWithPath:@"/v1/tag/" since:lastSync]
                   collection:tags
-                     success:^{
+                  serverDate:nil
+                     success:^(NSDate *_Nullable serverDate) {
                          NSMutableDictionary *holdingDict = [NSMutableDictionary new];
                          for (NSString *key in [tags allKeys]) {
                              NSDictionary *dict = [tags objectForKey:key];
@@ -452,15 +515,60 @@
                                  [holdingDict setObject:dict forKey:key];
                              }
                          }
-                         [CCSMStorage.sharedInstance setTags:[NSDictionary dictionaryWithDictionary:holdingDict]];
-                         [self notifyOfTagsRefresh];
-                         DDLogDebug(@"Refreshed all tags.");
+                         NSDictionary *previousTags = [CCSMStorage.sharedInstance getTags] ?: @{};
+                         if (lastSync == nil) {
+                             NSMutableSet *removedIds = [NSMutableSet setWithArray:previousTags.allKeys];
+                             [removedIds minusSet:[NSSet setWithArray:holdingDict.allKeys]];
+                             [CCSMStorage.sharedInstance setTags:[NSDictionary dictionaryWithDictionary:holdingDict]];
+                             [self notifyOfRefresh:FLCCSMTagsUpdated
+                                       withChanges:nil
+                                        removedIds:removedIds.allObjects
+                                          syncDate:serverDate];
+                             DDLogDebug(@"Refreshed all tags, %lu removed.", (unsigned long)removedIds.count);
+                         } else {
+                             NSMutableDictionary *mergedTags = [previousTags mutableCopy];
+                             [mergedTags addEntriesFromDictionary:holdingDict];
+                             [CCSMStorage.sharedInstance setTags:[NSDictionary dictionaryWithDictionary:mergedTags]];
+                             [self notifyOfRefresh:FLCCSMTagsUpdated
+                                       withChanges:[NSDictionary dictionaryWithDictionary:holdingDict]
+                                        removedIds:nil
+                                          syncDate:serverDate];
+                             DDLogDebug(@"Refreshed %lu changed tags.", (unsigned long)holdingDict.count);
+                         }
                      }
                      failure:^(NSError *err){
                          DDLogError(@"Failed to refresh all tags. Error: %@", err.localizedDescription);
                      }];
 }
 
+// Returns nil when the whole directory should be pulled: on the first sync, and periodically to pick up deletions.
++(nullable NSDate *)deltaSyncDateWithSyncDate:(nullable NSDate *)syncDate fullSyncDate:(nullable NSDate *)fullSyncDate
+{
+    if (syncDate == nil || fullSyncDate == nil || fabs(fullSyncDate.timeIntervalSinceNow) > FLFullSyncInterval) {
+        return nil;
+    }
+    return syncDate;
+}
+
++(NSString *)syncURLStringWithPath:(NSString *)path since:(nullable NSDate *)lastSync
+{
+    NSString *urlString = [NSString stringWithFormat:@"%@%@", CCSMHomeURL, path];
+    if (lastSync == nil) {
+        return urlString;
+    }
+    
+    static NSISO8601DateFormatter *formatter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        formatter = [NSISO8601DateFormatter new];
+    });
+    NSDate *since = [lastSync dateByAddingTimeInterval:-FLSyncOverlapInterval];
+    NSURLComponents *components = [NSURLComponents componentsWithString:urlString];
+    components.queryItems = @[ [NSURLQueryItem queryItemWithName:FLModifiedSinceParameter
+                                                           value:[formatter stringFromDate:since]] ];
+    return components.string;
+}
+
 +(void)processOrgInfoWithURL:(NSString *)urlString
 {
     if (urlString.length > 0) {
@@ -481,14 +589,23 @@
     }
 }
 
-+(void)notifyOfUsersRefresh
+// The sync date is the server's, and is only present if it sent one; without it the cursor doesn't advance.
++(void)notifyOfRefresh:(NSString *)notificationName
+           withChanges:(nullable NSDictionary *)changes
+            removedIds:(nullable NSArray<NSString *> *)removedIds
+              syncDate:(nullable NSDate *)syncDate
 {
-    [NSNotificationCenter.defaultCenter postNotificationNameAsync:FLCCSMUsersUpdated object:nil];
-}
-
-+(void)notifyOfTagsRefresh
-{
-    [[NSNotificationCenter defaultCenter] postNotificationNameAsync:FLCCSMTagsUpdated object:nil];
+    NSMutableDictionary *userInfo = [NSMutableDictionary new];
+    if (syncDate) {
+        userInfo[FLCCSMSyncDateKey] = syncDate;
+    }
+    if (changes) {
+        userInfo[FLCCSMChangedRecordsKey] = changes;
+    }
+    if (removedIds.count > 0) {
+        userInfo[FLCCSMRemovedRecordIdsKey] = removedIds;
+    }
+    [NSNotificationCenter.defaultCenter postNotificationNameAsync:notificationName object:nil userInfo:userInfo];
 }
 
 #pragma mark - CCSM proxied TextSecure registration
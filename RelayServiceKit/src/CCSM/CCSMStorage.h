@@ -18,6 +18,12 @@ extern NSString *const CCSMStorageKeyOrgInfo;
 extern NSString *const CCSMStorageKeyUsers;
 extern NSString *const CCSMStorageKeyTags;
 extern NSString *const CCSMStorageKeyTSServerURL;
+extern NSString *const CCSMStorageKeyUsersSyncDate;
+extern NSString *const CCSMStorageKeyTagsSyncDate;
+extern NSString *const CCSMStorageKeyUsersFullSyncDate;
+extern NSString *const CCSMStorageKeyTagsFullSyncDate;
+
+@class YapDatabaseReadWriteTransaction;
 
 
 @interface CCSMStorage : NSObject
@@ -50,6 +56,23 @@ extern NSString *const CCSMStorageKeyTSServerURL;
 - (NSDictionary *)getTags;
 -(void)setTags:(NSDictionary *)value;
 
+// Delta sync cursors, in the server's time.  A nil date means the next refresh must pull the full directory, as
+// must one long enough after the last full sync.
+// The setters take a transaction so the cursor advances atomically with the records it covers.
+- (NSDate *)getUsersSyncDate;
+- (NSDate *)getUsersFullSyncDate;
+- (void)setUsersSyncDate:(NSDate *)value
+              isFullSync:(BOOL)isFullSync
+             transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+- (NSDate *)getTagsSyncDate;
+- (NSDate *)getTagsFullSyncDate;
+- (void)setTagsSyncDate:(NSDate *)value
+             isFullSync:(BOOL)isFullSync
+            transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+-(void)resetSyncDates;
+
 @end
 
 //@interface CCSMEnvironment : NSObject
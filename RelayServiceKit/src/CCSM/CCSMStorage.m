@@ -36,6 +36,10 @@ NSString *const CCSMStorageKeyOrgInfo = @"Org Info";
 NSString *const CCSMStorageKeyUsers = @"Users";
 NSString *const CCSMStorageKeyTags = @"Tags";
 NSString *const CCSMStorageKeyTSServerURL = @"TSServerURL";
+NSString *const CCSMStorageKeyUsersSyncDate = @"Users Sync Date";
+NSString *const CCSMStorageKeyTagsSyncDate = @"Tags Sync Date";
+NSString *const CCSMStorageKeyUsersFullSyncDate = @"Users Full Sync Date";
+NSString *const CCSMStorageKeyTagsFullSyncDate = @"Tags Full Sync Date";
 
 + (instancetype)sharedInstance
 {
@@ -160,6 +164,58 @@ NSString *const CCSMStorageKeyTSServerURL = @"TSServerURL";
     return [self tryGetValueForKey:CCSMStorageKeyTags];
 }
 
+
+- (nullable NSDate *)getUsersSyncDate
+{
+    return [self tryGetValueForKey:CCSMStorageKeyUsersSyncDate];
+}
+
+- (nullable NSDate *)getUsersFullSyncDate
+{
+    return [self tryGetValueForKey:CCSMStorageKeyUsersFullSyncDate];
+}
+
+- (void)setUsersSyncDate:(NSDate *)value
+              isFullSync:(BOOL)isFullSync
+             transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [transaction setObject:value forKey:CCSMStorageKeyUsersSyncDate inCollection:CCSMStorageDatabaseCollection];
+    if (isFullSync) {
+        [transaction setObject:value forKey:CCSMStorageKeyUsersFullSyncDate inCollection:CCSMStorageDatabaseCollection];
+    }
+}
+
+
+- (nullable NSDate *)getTagsSyncDate
+{
+    return [self tryGetValueForKey:CCSMStorageKeyTagsSyncDate];
+}
+
+- (nullable NSDate *)getTagsFullSyncDate
+{
+    return [self tryGetValueForKey:CCSMStorageKeyTagsFullSyncDate];
+}
+
+- (void)setTagsSyncDate:(NSDate *)value
+             isFullSync:(BOOL)isFullSync
+            transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [transaction setObject:value forKey:CCSMStorageKeyTagsSyncDate inCollection:CCSMStorageDatabaseCollection];
+    if (isFullSync) {
+        [transaction setObject:value forKey:CCSMStorageKeyTagsFullSyncDate inCollection:CCSMStorageDatabaseCollection];
+    }
+}
+
+-(void)resetSyncDates
+{
+    [self.writeConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeObjectForKey:CCSMStorageKeyUsersSyncDate inCollection:CCSMStorageDatabaseCollection];
+        [transaction removeObjectForKey:CCSMStorageKeyTagsSyncDate inCollection:CCSMStorageDatabaseCollection];
+        [transaction removeObjectForKey:CCSMStorageKeyUsersFullSyncDate inCollection:CCSMStorageDatabaseCollection];
+        [transaction removeObjectForKey:CCSMStorageKeyTagsFullSyncDate inCollection:CCSMStorageDatabaseCollection];
+    }];
+}
+
 -(NSString *)textSecureURLString
 {
     if (_textSecureURLString == nil) {
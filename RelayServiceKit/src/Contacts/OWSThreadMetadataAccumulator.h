@@ -0,0 +1,49 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class TSThread;
+@class YapDatabaseReadWriteTransaction;
+
+typedef void (^OWSThreadChangeBlock)(TSThread *thread);
+
+// Holds the thread changes made while a batch of messages is processed, so that each changed thread is written,
+// and its views updated, once per batch rather than several times per message.
+//
+// Changes are applied to the thread instance they're made on immediately, and to the latest copy of the thread
+// when the batch is flushed, or when the thread is saved by anything else before then.
+//
+// A batch lives in a single transaction, and must be flushed before the transaction commits.
+@interface OWSThreadMetadataAccumulator : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+// The batch in progress in this transaction, if any.
++ (nullable OWSThreadMetadataAccumulator *)accumulatorForTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (OWSThreadMetadataAccumulator *)beginBatchWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+// A change with a key supersedes any earlier change to the thread with the same key.
+- (void)applyChangeToThread:(TSThread *)thread
+                     forKey:(nullable NSString *)key
+                changeBlock:(OWSThreadChangeBlock)changeBlock;
+
+- (void)touchThread:(TSThread *)thread;
+
+// Posts TSThreadExpressionChangedNotification for the thread once the batch is flushed.
+- (void)expressionDidChangeForThread:(TSThread *)thread;
+
+// Applies and forgets the thread's pending changes.  Called when the thread is about to be saved.
+- (void)applyPendingChangesToThread:(TSThread *)thread;
+
+// Applies the thread's pending changes to a copy fetched during the batch, which lacks them, but keeps them pending.
+- (void)applyPendingChangesToCopyOfThread:(TSThread *)thread;
+
+// Writes every changed thread and ends the batch.
+- (void)flushWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,185 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSThreadMetadataAccumulator.h"
+#import "NSNotificationCenter+OWS.h"
+#import "TSThread.h"
+#import <YapDatabase/YapDatabase.h>
+#import <objc/runtime.h>
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+static void *kOWSThreadMetadataAccumulator_Transaction = &kOWSThreadMetadataAccumulator_Transaction;
+
+@interface OWSThreadPendingChange : NSObject
+
+@property (nonatomic, readonly, nullable) NSString *key;
+@property (nonatomic, readonly) OWSThreadChangeBlock changeBlock;
+
+@end
+
+#pragma mark -
+
+@implementation OWSThreadPendingChange
+
+- (instancetype)initWithKey:(nullable NSString *)key changeBlock:(OWSThreadChangeBlock)changeBlock
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _key = key;
+    _changeBlock = changeBlock;
+
+    return self;
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSThreadMetadataAccumulator ()
+
+// Map of "thread id"-to-"changes not yet written", in the order they were made.
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, NSMutableArray<OWSThreadPendingChange *> *> *pendingChanges;
+@property (nonatomic, readonly) NSMutableSet<NSString *> *touchedThreadIds;
+@property (nonatomic, readonly) NSMutableSet<NSString *> *expressionChangedThreadIds;
+
+@end
+
+#pragma mark -
+
+@implementation OWSThreadMetadataAccumulator
+
+- (instancetype)initPrivate
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _pendingChanges = [NSMutableDictionary new];
+    _touchedThreadIds = [NSMutableSet new];
+    _expressionChangedThreadIds = [NSMutableSet new];
+
+    return self;
+}
+
++ (nullable OWSThreadMetadataAccumulator *)accumulatorForTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(transaction);
+
+    return objc_getAssociatedObject(transaction, kOWSThreadMetadataAccumulator_Transaction);
+}
+
++ (OWSThreadMetadataAccumulator *)beginBatchWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(transaction);
+    OWSAssertDebug(![self accumulatorForTransaction:transaction]);
+
+    OWSThreadMetadataAccumulator *accumulator = [[OWSThreadMetadataAccumulator alloc] initPrivate];
+    objc_setAssociatedObject(
+        transaction, kOWSThreadMetadataAccumulator_Transaction, accumulator, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return accumulator;
+}
+
+- (void)applyChangeToThread:(TSThread *)thread
+                     forKey:(nullable NSString *)key
+                changeBlock:(OWSThreadChangeBlock)changeBlock
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+    OWSAssertDebug(changeBlock);
+
+    changeBlock(thread);
+
+    NSMutableArray<OWSThreadPendingChange *> *_Nullable changes = self.pendingChanges[thread.uniqueId];
+    if (!changes) {
+        changes = [NSMutableArray new];
+        self.pendingChanges[thread.uniqueId] = changes;
+    }
+    if (key) {
+        NSUInteger index = [changes indexOfObjectPassingTest:^BOOL(OWSThreadPendingChange *change, NSUInteger idx, BOOL *stop) {
+            return [change.key isEqualToString:key];
+        }];
+        if (index != NSNotFound) {
+            [changes removeObjectAtIndex:index];
+        }
+    }
+    [changes addObject:[[OWSThreadPendingChange alloc] initWithKey:key changeBlock:changeBlock]];
+}
+
+- (void)touchThread:(TSThread *)thread
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    [self.touchedThreadIds addObject:thread.uniqueId];
+}
+
+- (void)expressionDidChangeForThread:(TSThread *)thread
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    [self.expressionChangedThreadIds addObject:thread.uniqueId];
+}
+
+- (void)applyPendingChangesToThread:(TSThread *)thread
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    [self applyPendingChangesToCopyOfThread:thread];
+
+    [self.pendingChanges removeObjectForKey:thread.uniqueId];
+    // Saving the thread updates its views.
+    [self.touchedThreadIds removeObject:thread.uniqueId];
+}
+
+- (void)applyPendingChangesToCopyOfThread:(TSThread *)thread
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    for (OWSThreadPendingChange *change in self.pendingChanges[thread.uniqueId]) {
+        change.changeBlock(thread);
+    }
+}
+
+- (void)flushWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(transaction);
+    OWSAssertDebug([OWSThreadMetadataAccumulator accumulatorForTransaction:transaction] == self);
+
+    objc_setAssociatedObject(transaction, kOWSThreadMetadataAccumulator_Transaction, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+
+    for (NSString *threadId in self.pendingChanges.allKeys) {
+        TSThread *_Nullable thread = [transaction objectForKey:threadId inCollection:[TSThread collection]];
+        if (!thread) {
+            // The thread was removed during the batch.
+            continue;
+        }
+        [self applyPendingChangesToThread:thread];
+        [thread saveWithTransaction:transaction];
+    }
+
+    for (NSString *threadId in self.touchedThreadIds) {
+        [transaction touchObjectForKey:threadId inCollection:[TSThread collection]];
+    }
+
+    for (NSString *threadId in self.expressionChangedThreadIds) {
+        TSThread *_Nullable thread = [transaction objectForKey:threadId inCollection:[TSThread collection]];
+        if (thread) {
+            [NSNotificationCenter.defaultCenter postNotificationNameAsync:TSThreadExpressionChangedNotification
+                                                                   object:thread];
+        }
+    }
+
+    [self.pendingChanges removeAllObjects];
+    [self.touchedThreadIds removeAllObjects];
+    [self.expressionChangedThreadIds removeAllObjects];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -41,6 +41,12 @@ extern NSString *const TSThread_NotificationKey_UniqueId;
  */
 @property (nullable) UIImage *image;
 
+/**
+ *  Changes whenever the image does, so that rendered copies of the image can be cached by it.
+ *  Nil for images assigned before it was recorded.
+ */
+@property (nullable, readonly) NSString *imageFingerprint;
+
 //@property (readonly, nullable) NSString *conversationColorName;
 //- (void)updateConversationColorName:(NSString *)colorName transaction:(nonnull YapDatabaseReadWriteTransaction *)transaction;
 
@@ -131,6 +137,14 @@ extern NSString *const TSThread_NotificationKey_UniqueId;
 
 - (void)removeAllThreadInteractionsWithTransaction:(nonnull YapDatabaseReadWriteTransaction *)transaction;
 
+/**
+ *  Removes the thread and what's kept about it, such as its inbox summary, but not its interactions.
+ *  For callers which remove the interactions themselves, e.g. a chunk at a time.
+ *
+ *  @param transaction Database transaction.
+ */
+- (void)removeKeepingInteractionsWithTransaction:(nonnull YapDatabaseReadWriteTransaction *)transaction;
+
 
 #pragma mark Disappearing Messages
 
@@ -172,6 +186,13 @@ extern NSString *const TSThread_NotificationKey_UniqueId;
 @property (readonly, assign) BOOL isOneOnOne;
 @property (readonly, nullable) NSString *otherParticipantId;
 
+/**
+ *  Get or create thread with thread UUID
+ */
++(nullable instancetype)getOrCreateThreadWithId:(nonnull NSString *)threadId;
++(nullable instancetype)getOrCreateThreadWithId:(nonnull NSString *)threadId
+                                    transaction:(nonnull YapDatabaseReadWriteTransaction *)transaction;
+
 /**
  *  Get or create thread with array of participant UUIDs
  */
@@ -6,8 +6,12 @@
 #import "NSDate+OWS.h"
 #import "NSString+SSK.h"
 #import "OWSDisappearingMessagesConfiguration.h"
+#import "OWSInboxSummary.h"
 #import "OWSPrimaryStorage.h"
+#import "OWSReadReceiptManager.h"
 #import "OWSReadTracking.h"
+#import "OWSThreadMetadataAccumulator.h"
+#import "OWSUnreadCounter.h"
 #import "TSDatabaseView.h"
 #import "TSIncomingMessage.h"
 #import "TSInfoMessage.h"
@@ -41,6 +45,7 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
 @property (nonatomic, nullable) NSDate *lastMessageDate;
 @property (nonatomic, copy, nullable) NSString *messageDraft;
 @property (atomic, nullable) NSDate *mutedUntilDate;
+@property (nullable) NSString *imageFingerprint;
 
 @end
 
@@ -126,11 +131,61 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
     return thread;
 }
 
+- (void)saveWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    // Don't let a batch's changes be overwritten by, or written after, this save.
+    [[OWSThreadMetadataAccumulator accumulatorForTransaction:transaction] applyPendingChangesToThread:self];
+
+    [super saveWithTransaction:transaction];
+
+    [OWSInboxSummary threadWasSaved:self transaction:transaction];
+}
+
+- (void)touchWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSThreadMetadataAccumulator *_Nullable accumulator =
+        [OWSThreadMetadataAccumulator accumulatorForTransaction:transaction];
+    if (accumulator) {
+        [accumulator touchThread:self];
+        return;
+    }
+
+    [super touchWithTransaction:transaction];
+}
+
+- (void)applyChangeToSelfAndLatestCopy:(YapDatabaseReadWriteTransaction *)transaction
+                           changeBlock:(void (^)(id))changeBlock
+{
+    [self applyChange:changeBlock forKey:nil transaction:transaction];
+}
+
+- (void)applyChange:(OWSThreadChangeBlock)changeBlock
+             forKey:(nullable NSString *)key
+        transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    // During a batch, changes are queued in order, and written when the batch is flushed.
+    OWSThreadMetadataAccumulator *_Nullable accumulator =
+        [OWSThreadMetadataAccumulator accumulatorForTransaction:transaction];
+    if (accumulator) {
+        [accumulator applyChangeToThread:self forKey:key changeBlock:changeBlock];
+        return;
+    }
+
+    [super applyChangeToSelfAndLatestCopy:transaction changeBlock:changeBlock];
+}
+
 - (void)removeWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
 {
     [self removeAllThreadInteractionsWithTransaction:transaction];
-    
+
+    [self removeKeepingInteractionsWithTransaction:transaction];
+}
+
+- (void)removeKeepingInteractionsWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
     [super removeWithTransaction:transaction];
+
+    [OWSInboxSummary threadWasRemoved:self transaction:transaction];
 }
 
 - (void)removeAllThreadInteractionsWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
@@ -286,17 +341,31 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
 
 - (NSUInteger)unreadMessageCountWithTransaction:(YapDatabaseReadTransaction *)transaction
 {
-    return [[transaction ext:TSUnreadDatabaseViewExtensionName] numberOfItemsInGroup:self.uniqueId];
+    return [OWSUnreadCounter unreadCountForThreadId:self.uniqueId transaction:transaction];
 }
 
 - (void)markAllAsReadWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
 {
+    // Read receipts only carry the time they were read, so one per sender, for their latest message, is enough.
+    uint64_t readTimestamp = [NSDate ows_millisecondTimeStamp];
+    NSMutableDictionary<NSString *, TSIncomingMessage *> *latestMessageBySender = [NSMutableDictionary new];
     for (id<OWSReadTracking> message in [self unseenMessagesWithTransaction:transaction]) {
-        [message markAsReadAtTimestamp:[NSDate ows_millisecondTimeStamp] sendReadReceipt:YES transaction:transaction];
+        [message markAsReadAtTimestamp:readTimestamp sendReadReceipt:NO transaction:transaction];
+
+        if ([message isKindOfClass:[TSIncomingMessage class]]) {
+            TSIncomingMessage *incomingMessage = (TSIncomingMessage *)message;
+            if (incomingMessage.messageAuthorId.length > 0) {
+                // Unseen messages are in sort order.
+                latestMessageBySender[incomingMessage.messageAuthorId] = incomingMessage;
+            }
+        }
     }
-    
+    for (TSIncomingMessage *message in latestMessageBySender.allValues) {
+        [OWSReadReceiptManager.sharedManager messageWasReadLocally:message];
+    }
+
     // Just to be defensive, we'll also check for unread messages.
-    OWSAssertDebug([self unseenMessagesWithTransaction:transaction].count < 1);
+    OWSAssertDebug([self unreadMessageCountWithTransaction:transaction] == 0);
 }
 
 - (nullable TSInteraction *)lastInteractionForInboxWithTransaction:(YapDatabaseReadTransaction *)transaction
@@ -345,12 +414,7 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
 - (nonnull NSString *)lastMessageTextWithTransaction:(YapDatabaseReadTransaction *)transaction
 {
     TSInteraction *interaction = [self lastInteractionForInboxWithTransaction:transaction];
-    if ([interaction conformsToProtocol:@protocol(OWSPreviewText)]) {
-        id<OWSPreviewText> previewable = (id<OWSPreviewText>)interaction;
-        return [previewable previewTextWithTransaction:transaction].filterStringForDisplay;
-    } else {
-        return @"";
-    }
+    return [OWSInboxSummary previewTextForInteraction:interaction transaction:transaction];
 }
 
 // Returns YES IFF the interaction should show up in the inbox as the last message.
@@ -386,14 +450,24 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
         return;
     }
     
-    [self applyChangeToSelfAndLatestCopy:transaction changeBlock:^(TSThread *thread) {
+    // Compare against the batch's pending last message too, if any, or an older message would replace it.
+    [[OWSThreadMetadataAccumulator accumulatorForTransaction:transaction] applyPendingChangesToCopyOfThread:self];
+
+    NSDate *lastMessageDate = [lastMessage dateForSorting];
+    if (self.hasEverHadMessage && [lastMessageDate timeIntervalSinceDate:self.lastMessageDate] <= 0) {
+        return;
+    }
+
+    // Only a later message gets this far, so each change supersedes the last, and a batch only keeps the latest.
+    [self applyChange:^(TSThread *thread) {
         thread.hasEverHadMessage = YES;
-        
-        NSDate *lastMessageDate = [lastMessage dateForSorting];
+
         if (!thread.lastMessageDate || [lastMessageDate timeIntervalSinceDate:thread.lastMessageDate] > 0) {
             thread.lastMessageDate = lastMessageDate;
         }
-    }];
+    }
+               forKey:@"lastMessage"
+          transaction:transaction];
 }
 
 #pragma mark Disappearing Messages
@@ -617,28 +691,51 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
         return;
     }
     
-    [self applyChangeToSelfAndLatestCopy:transaction changeBlock:^(TSThread *thread) {
-        NSString *threadExpression = [(NSDictionary *)[payload objectForKey:FLDistributionKey] objectForKey:FLExpressionKey];
-        NSString *threadType = [payload objectForKey:FLThreadTypeKey];
-        NSString *threadTitle = [payload objectForKey:FLThreadTitleKey];
-        if (threadTitle != nil) {
-            thread.title = threadTitle;
-        }
-        thread.type = ((threadType.length > 0) ? threadType : nil );
-        
-        NSArray *members = [(NSDictionary *)[payload objectForKey:@"data"] objectForKey:@"members"];
-        if (members != nil) {
-            thread.participantIds = members;
+    NSString *threadExpression = [(NSDictionary *)[payload objectForKey:FLDistributionKey] objectForKey:FLExpressionKey];
+    NSString *threadType = [payload objectForKey:FLThreadTypeKey];
+    NSString *threadTitle = [payload objectForKey:FLThreadTitleKey];
+    NSString *_Nullable newType = ((threadType.length > 0) ? threadType : nil );
+    NSArray *members = [(NSDictionary *)[payload objectForKey:@"data"] objectForKey:@"members"];
+
+    BOOL shouldUpdateExpression = (![threadExpression isEqualToString:self.universalExpression] ||
+                                   members != nil ||
+                                   (members ?: self.participantIds).count == 0 ||
+                                   self.prettyExpression.length == 0);
+
+    // Most messages repeat what the thread already has; don't rewrite it for those.
+    BOOL hasChanges = ((threadTitle != nil && ![threadTitle isEqualToString:self.title]) ||
+                       !(newType == _type || [newType isEqualToString:_type]) ||
+                       (members != nil && ![members isEqualToArray:self.participantIds]) ||
+                       (shouldUpdateExpression && !(threadExpression == self.universalExpression ||
+                                                    [threadExpression isEqualToString:self.universalExpression])));
+    if (hasChanges) {
+        [self applyChange:^(TSThread *thread) {
+            if (threadTitle != nil) {
+                thread.title = threadTitle;
+            }
+            thread.type = newType;
+
+            if (members != nil) {
+                thread.participantIds = members;
+            }
+
+            if (shouldUpdateExpression) {
+                thread.universalExpression = threadExpression;
+            }
         }
+                   forKey:nil
+              transaction:transaction];
+    }
 
-        if (![threadExpression isEqualToString:self.universalExpression] ||
-            members != nil ||
-            thread.participantIds.count == 0 ||
-            thread.prettyExpression.length == 0) {
-            thread.universalExpression = threadExpression;
+    if (shouldUpdateExpression) {
+        OWSThreadMetadataAccumulator *_Nullable accumulator =
+            [OWSThreadMetadataAccumulator accumulatorForTransaction:transaction];
+        if (accumulator) {
+            [accumulator expressionDidChangeForThread:self];
+        } else {
             [NSNotificationCenter.defaultCenter postNotificationNameAsync:TSThreadExpressionChangedNotification object:self];
         }
-    }];
+    }
 }
 
 -(void)updateParticipants:(nonnull NSArray *)participants
@@ -676,8 +773,10 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
         return;
     }
     
+    NSString *imageFingerprint = [NSUUID UUID].UUIDString;
     [self applyChangeToSelfAndLatestCopy:transaction changeBlock:^(TSThread *thread) {
         [thread setImage:newImage];
+        thread.imageFingerprint = imageFingerprint;
         
         // Avatars are stored directly in the database, so there's no need
         // to keep the attachment around after assigning the image.
@@ -691,8 +790,10 @@ NSString *const TSThread_NotificationKey_UniqueId = @"TSThread_NotificationKey_U
     if ([self.image isEqual:image]) {
         return;
     }
+    NSString *imageFingerprint = [NSUUID UUID].UUIDString;
     [self applyChangeToSelfAndLatestCopy:transaction changeBlock:^(TSThread *thread) {
         [thread setImage:image];
+        thread.imageFingerprint = imageFingerprint;
     }];
 
 }
@@ -16,7 +16,7 @@
 #import "TSQuotedMessage.h"
 #import "TextSecureKitEnv.h"
 #import "TSThread.h"
-#import "FLCCSMJSONService.h"
+#import "FLMessageBody.h"
 #import "TSConstants.h"
 #import "TSAccountManager.h"
 #import <RelayServiceKit/RelayServiceKit-Swift.h>
@@ -73,10 +73,10 @@ NS_ASSUME_NONNULL_BEGIN
     OWSIncomingSentMessageTranscript *transcript = self.incomingSentMessageTranscript;
     DDLogDebug(@"%@ Recording transcript: %@", self.logTag, transcript);
     
-    __block NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:transcript.body];
+    FLMessageBody *messageBody = transcript.messageBody;
 
     if (transcript.isEndSessionMessage) {
-        NSString *recipientId = [[jsonPayload objectForKey:FLMessageSenderKey] objectForKey:FLUserIdKey];
+        NSString *_Nullable recipientId = messageBody.senderUserId;
         if (recipientId != nil) {
             TSThread *thread = [TSThread getOrCreateThreadWithParticipants:@[TSAccountManager.localUID, recipientId] transaction:transaction];
             if (thread == nil) {
@@ -93,28 +93,31 @@ NS_ASSUME_NONNULL_BEGIN
         }
     }
 
-    NSDictionary *dataBlob = [jsonPayload objectForKey:@"data"];
-    if ([dataBlob allKeys].count == 0) {
+    if (messageBody.data == nil) {
         DDLogDebug(@"Received sync message contained no data object.");
         return;
     }
 
-    if ([[jsonPayload objectForKey:FLMessageTypeKey] isEqualToString:FLMessageTypeControlKey]) {
-        NSString *controlMessageType = [dataBlob objectForKey:FLMessageTypeControlKey];
-        DDLogInfo(@"Control sync message received: %@", controlMessageType);
+    if (messageBody.isControlMessage) {
+        DDLogInfo(@"Control sync message received: %@", messageBody.controlType);
         
-        IncomingControlMessage *controlMessage = [[IncomingControlMessage alloc] initWithTimestamp:transcript.timestamp
-                                                                                         serverAge:nil
-                                                                                            author:[TSAccountManager localUID]
-                                                                                            device:transcript.sourceDevice
-                                                                                           payload:jsonPayload
-                                                                                       attachments:transcript.attachmentPointerProtos];
+        IncomingControlMessage *_Nullable controlMessage =
+            [[IncomingControlMessage alloc] initWithTimestamp:transcript.timestamp
+                                                    serverAge:nil
+                                                       author:[TSAccountManager localUID]
+                                                       device:transcript.sourceDevice
+                                                  messageBody:messageBody
+                                                  attachments:transcript.attachmentPointerProtos];
+        if (controlMessage == nil) {
+            DDLogDebug(@"%@ Ignoring invalid control sync message.", self.logTag);
+            return;
+        }
         [ControlMessageManager processIncomingControlMessageWithMessage:controlMessage transaction:transaction];
         return;
         
-    } else if ([[jsonPayload objectForKey:FLMessageTypeKey] isEqualToString:FLMessageTypeContentKey]) {
+    } else if (messageBody.isContentMessage) {
         
-        TSThread *thread = [TSThread getOrCreateThreadWithPayload:jsonPayload transaction:transaction];
+        TSThread *thread = [TSThread getOrCreateThreadWithPayload:messageBody.payload transaction:transaction];
         if (thread == nil) {
             OWSFailDebug(@"%@: Received sync message contained invalid thread data.", self.logTag);
             return;
@@ -136,9 +139,9 @@ NS_ASSUME_NONNULL_BEGIN
                                                     expireStartedAt:transcript.expirationStartedAt
                                                      isVoiceMessage:NO
                                                       quotedMessage:transcript.quotedMessage];
-        outgoingMessage.uniqueId = [jsonPayload objectForKey:FLMessageIdKey];
-        outgoingMessage.messageType = [jsonPayload objectForKey:FLMessageTypeKey];
-        outgoingMessage.forstaPayload = [jsonPayload mutableCopy];
+        outgoingMessage.uniqueId = messageBody.messageId;
+        outgoingMessage.messageType = messageBody.messageType;
+        outgoingMessage.forstaPayload = [messageBody.payload mutableCopy];
         
         TSQuotedMessage *_Nullable quotedMessage = transcript.quotedMessage;
         if (quotedMessage && quotedMessage.thumbnailAttachmentPointerId) {
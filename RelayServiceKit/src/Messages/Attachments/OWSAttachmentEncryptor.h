@@ -0,0 +1,32 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Encrypts attachments a chunk at a time, so that memory use doesn't grow with the size of the attachment.
+//
+// The output is the same format as +[Cryptography encryptAttachmentData:outKey:outDigest:]:
+// IV || AES-256-CBC(plaintext) || HMAC-SHA256(IV || ciphertext), with a 64 byte key (AES key || HMAC key)
+// and a digest which is the SHA-256 of the whole output.  The digest is computed as the output is written.
+@interface OWSAttachmentEncryptor : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
++ (BOOL)encryptFileAtPath:(NSString *)plaintextFilePath
+                   toPath:(NSString *)ciphertextFilePath
+                   outKey:(NSData *_Nullable *_Nonnull)outKey
+                outDigest:(NSData *_Nullable *_Nonnull)outDigest
+                    error:(NSError **)error;
+
+// For tests.
++ (BOOL)encryptFileAtPath:(NSString *)plaintextFilePath
+                   toPath:(NSString *)ciphertextFilePath
+              chunkLength:(NSUInteger)chunkLength
+                   outKey:(NSData *_Nullable *_Nonnull)outKey
+                outDigest:(NSData *_Nullable *_Nonnull)outDigest
+                    error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,169 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSAttachmentEncryptor.h"
+#import "OWSError.h"
+#import <CommonCrypto/CommonCrypto.h>
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const NSUInteger kOWSAttachmentEncryptorDefaultChunkLength = 64 * 1024;
+static const NSUInteger kOWSAttachmentEncryptorAESKeyLength = kCCKeySizeAES256;
+static const NSUInteger kOWSAttachmentEncryptorHMACKeyLength = 32;
+static const NSUInteger kOWSAttachmentEncryptorIVLength = kCCBlockSizeAES128;
+
+// Every byte of output goes through the digest, and everything but the MAC itself goes through the MAC.
+static BOOL OWSWriteEncryptorOutput(NSOutputStream *outputStream,
+    CCHmacContext *_Nullable hmacContext,
+    CC_SHA256_CTX *digestContext,
+    const uint8_t *bytes,
+    size_t length)
+{
+    if (hmacContext) {
+        CCHmacUpdate(hmacContext, bytes, length);
+    }
+    CC_SHA256_Update(digestContext, bytes, (CC_LONG)length);
+
+    size_t offset = 0;
+    while (offset < length) {
+        NSInteger written = [outputStream write:bytes + offset maxLength:length - offset];
+        if (written <= 0) {
+            return NO;
+        }
+        offset += (size_t)written;
+    }
+    return YES;
+}
+
+@implementation OWSAttachmentEncryptor
+
++ (BOOL)encryptFileAtPath:(NSString *)plaintextFilePath
+                   toPath:(NSString *)ciphertextFilePath
+                   outKey:(NSData *_Nullable *_Nonnull)outKey
+                outDigest:(NSData *_Nullable *_Nonnull)outDigest
+                    error:(NSError **)error
+{
+    return [self encryptFileAtPath:plaintextFilePath
+                            toPath:ciphertextFilePath
+                       chunkLength:kOWSAttachmentEncryptorDefaultChunkLength
+                            outKey:outKey
+                         outDigest:outDigest
+                             error:error];
+}
+
++ (BOOL)encryptFileAtPath:(NSString *)plaintextFilePath
+                   toPath:(NSString *)ciphertextFilePath
+              chunkLength:(NSUInteger)chunkLength
+                   outKey:(NSData *_Nullable *_Nonnull)outKey
+                outDigest:(NSData *_Nullable *_Nonnull)outDigest
+                    error:(NSError **)error
+{
+    OWSAssertDebug(plaintextFilePath.length > 0);
+    OWSAssertDebug(ciphertextFilePath.length > 0);
+    OWSAssertDebug(chunkLength > 0);
+
+    *outKey = nil;
+    *outDigest = nil;
+
+    NSInputStream *_Nullable inputStream = [NSInputStream inputStreamWithFileAtPath:plaintextFilePath];
+    NSOutputStream *_Nullable outputStream = [NSOutputStream outputStreamToFileAtPath:ciphertextFilePath append:NO];
+    if (!inputStream || !outputStream) {
+        DDLogError(@"%@ could not open attachment streams.", self.logTag);
+        *error = OWSErrorMakeWriteAttachmentDataError();
+        return NO;
+    }
+
+    NSData *encryptionKey = [Cryptography generateRandomBytes:kOWSAttachmentEncryptorAESKeyLength];
+    NSData *hmacKey = [Cryptography generateRandomBytes:kOWSAttachmentEncryptorHMACKeyLength];
+    NSData *iv = [Cryptography generateRandomBytes:kOWSAttachmentEncryptorIVLength];
+
+    CCCryptorRef cryptor = NULL;
+    CCCryptorStatus cryptorStatus = CCCryptorCreate(kCCEncrypt,
+        kCCAlgorithmAES128,
+        kCCOptionPKCS7Padding,
+        encryptionKey.bytes,
+        encryptionKey.length,
+        iv.bytes,
+        &cryptor);
+    if (cryptorStatus != kCCSuccess) {
+        OWSFailDebug(@"%@ could not create cryptor: %d", self.logTag, (int)cryptorStatus);
+        *error = OWSErrorMakeFailedToSendOutgoingMessageError();
+        return NO;
+    }
+
+    CCHmacContext hmacContext;
+    CCHmacInit(&hmacContext, kCCHmacAlgSHA256, hmacKey.bytes, hmacKey.length);
+    CC_SHA256_CTX digestContext;
+    CC_SHA256_Init(&digestContext);
+
+    [inputStream open];
+    [outputStream open];
+
+    NSMutableData *inputBuffer = [NSMutableData dataWithLength:chunkLength];
+    NSMutableData *outputBuffer = [NSMutableData dataWithLength:CCCryptorGetOutputLength(cryptor, chunkLength, true)];
+    BOOL success = OWSWriteEncryptorOutput(outputStream, &hmacContext, &digestContext, iv.bytes, iv.length);
+    while (success) {
+        NSInteger readLength = [inputStream read:inputBuffer.mutableBytes maxLength:chunkLength];
+        if (readLength < 0) {
+            DDLogError(@"%@ could not read attachment: %@", self.logTag, inputStream.streamError);
+            success = NO;
+            break;
+        }
+
+        size_t outputLength = 0;
+        if (readLength == 0) {
+            cryptorStatus = CCCryptorFinal(cryptor, outputBuffer.mutableBytes, outputBuffer.length, &outputLength);
+        } else {
+            cryptorStatus = CCCryptorUpdate(cryptor,
+                inputBuffer.bytes,
+                (size_t)readLength,
+                outputBuffer.mutableBytes,
+                outputBuffer.length,
+                &outputLength);
+        }
+        if (cryptorStatus != kCCSuccess) {
+            OWSFailDebug(@"%@ could not encrypt attachment: %d", self.logTag, (int)cryptorStatus);
+            success = NO;
+            break;
+        }
+        success = OWSWriteEncryptorOutput(outputStream, &hmacContext, &digestContext, outputBuffer.bytes, outputLength);
+
+        if (readLength == 0) {
+            break;
+        }
+    }
+
+    if (success) {
+        uint8_t mac[CC_SHA256_DIGEST_LENGTH];
+        CCHmacFinal(&hmacContext, mac);
+        success = OWSWriteEncryptorOutput(outputStream, NULL, &digestContext, mac, sizeof(mac));
+    }
+
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &digestContext);
+
+    CCCryptorRelease(cryptor);
+    [inputStream close];
+    [outputStream close];
+
+    if (!success) {
+        DDLogError(@"%@ could not write encrypted attachment: %@", self.logTag, outputStream.streamError);
+        [[NSFileManager defaultManager] removeItemAtPath:ciphertextFilePath error:nil];
+        *error = OWSErrorMakeWriteAttachmentDataError();
+        return NO;
+    }
+
+    NSMutableData *key = [NSMutableData new];
+    [key appendData:encryptionKey];
+    [key appendData:hmacKey];
+    *outKey = [key copy];
+    *outDigest = [NSData dataWithBytes:digest length:sizeof(digest)];
+    return YES;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -10,6 +10,7 @@
 #import "OWSError.h"
 #import "OWSPrimaryStorage.h"
 #import "OWSRequestFactory.h"
+#import "OWSSegmentedDownloader.h"
 #import "OWSSignalServiceProtos.pb.h"
 #import "TSAttachmentPointer.h"
 #import "TSAttachmentStream.h"
@@ -175,13 +176,15 @@ static const CGFloat kAttachmentDownloadProgressTheta = 0.001f;
                                             pointer:attachment
                                             success:markAndHandleSuccess
                                             failure:markAndHandleFailure];
+                        // Whether or not the data was valid, we're done with it.  If it wasn't,
+                        // the next attempt should start over rather than resume.
+                        [[OWSSegmentedDownloader sharedDownloader] removeDownloadWithIdentifier:attachment.uniqueId];
                     }
-                    failure:^(NSURLSessionDataTask *_Nullable task, NSError *error) {
+                    failure:^(NSError *error) {
                         if (attachment.serverId < 100) {
                             // This looks like the symptom of the "frequent 404
                             // downloading attachments with low server ids".
-                            NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)task.response;
-                            NSInteger statusCode = [httpResponse statusCode];
+                            NSInteger statusCode = [error.userInfo[OWSErrorHTTPStatusCodeKey] integerValue];
                             OWSFailDebug(@"%@ %d Failure with suspicious attachment id: %llu, %@",
                                 self.logTag,
                                 (int)statusCode,
@@ -252,119 +255,36 @@ static const CGFloat kAttachmentDownloadProgressTheta = 0.001f;
 - (void)downloadFromLocation:(NSString *)location
                      pointer:(TSAttachmentPointer *)pointer
                      success:(void (^)(NSData *encryptedData))successHandler
-                     failure:(void (^)(NSURLSessionDataTask *_Nullable task, NSError *error))failureHandler
+                     failure:(void (^)(NSError *error))failureHandler
 {
-    AFHTTPSessionManager *manager = [AFHTTPSessionManager manager];
-    manager.requestSerializer     = [AFHTTPRequestSerializer serializer];
-    [manager.requestSerializer setValue:OWSMimeTypeApplicationOctetStream forHTTPHeaderField:@"Content-Type"];
-    manager.responseSerializer = [AFHTTPResponseSerializer serializer];
-    manager.completionQueue    = dispatch_get_main_queue();
-
-    // We want to avoid large downloads from a compromised or buggy service.
-    const long kMaxDownloadSize = LONG_MAX;
-//    const long kMaxDownloadSize = 150 * 1024 * 1024;
-    // TODO stream this download rather than storing the entire blob.
-    __block NSURLSessionDataTask *task = nil;
-    __block BOOL hasCheckedContentLength = NO;
-    task = [manager GET:location
-        parameters:nil
-        progress:^(NSProgress *progress) {
-            OWSAssertDebug(progress != nil);
-            
-            // Don't do anything until we've received at least one byte of data.
-            if (progress.completedUnitCount < 1) {
-                return;
-            }
-
-            void (^abortDownload)(void) = ^{
-                OWSFailDebug(@"%@ Download aborted.", self.logTag);
-                [task cancel];
-            };
-
-            if (progress.totalUnitCount > kMaxDownloadSize || progress.completedUnitCount > kMaxDownloadSize) {
-                // A malicious service might send a misleading content length header,
-                // so....
-                //
-                // If the current downloaded bytes or the expected total byes
-                // exceed the max download size, abort the download.
-                DDLogError(@"%@ Attachment download exceed expected content length: %lld, %lld.",
-                    self.logTag,
-                    (long long)progress.totalUnitCount,
-                    (long long)progress.completedUnitCount);
-                abortDownload();
-                return;
-            }
+    NSURL *_Nullable url = [NSURL URLWithString:location];
+    if (!url) {
+        DDLogError(@"%@ Attachment download has invalid location.", self.logTag);
+        return failureHandler(OWSErrorMakeUnableToProcessServerResponseError());
+    }
 
-            [self fireProgressNotification:MAX(kAttachmentDownloadProgressTheta, progress.fractionCompleted)
+    // Downloads are keyed by attachment id, so a retry resumes from whatever segments the
+    // previous attempt (possibly in a previous launch) managed to download.
+    [[OWSSegmentedDownloader sharedDownloader] downloadWithIdentifier:pointer.uniqueId
+        url:url
+        progress:^(double fractionCompleted) {
+            [self fireProgressNotification:MAX(kAttachmentDownloadProgressTheta, fractionCompleted)
                               attachmentId:pointer.uniqueId];
-
-            // We only need to check the content length header once.
-            if (hasCheckedContentLength) {
-                return;
-            }
-            
-            // Once we've received some bytes of the download, check the content length
-            // header for the download.
-            //
-            // If the task doesn't exist, or doesn't have a response, or is missing
-            // the expected headers, or has an invalid or oversize content length, etc.,
-            // abort the download.
-            NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)task.response;
-            if (![httpResponse isKindOfClass:[NSHTTPURLResponse class]]) {
-                DDLogError(@"%@ Attachment download has missing or invalid response.", self.logTag);
-                abortDownload();
-                return;
-            }
-            
-            NSDictionary *headers = [httpResponse allHeaderFields];
-            if (![headers isKindOfClass:[NSDictionary class]]) {
-                DDLogError(@"%@ Attachment download invalid headers.", self.logTag);
-                abortDownload();
-                return;
-            }
-            
-            
-            NSString *contentLength = headers[@"Content-Length"];
-            if (![contentLength isKindOfClass:[NSString class]]) {
-                DDLogError(@"%@ Attachment download missing or invalid content length.", self.logTag);
-                abortDownload();
-                return;
-            }
-            
-            
-            if (contentLength.longLongValue > kMaxDownloadSize) {
-                DDLogError(@"%@ Attachment download content length exceeds max download size.", self.logTag);
-                abortDownload();
-                return;
-            }
-            
-            // This response has a valid content length that is less
-            // than our max download size.  Proceed with the download.
-            hasCheckedContentLength = YES;
         }
-        success:^(NSURLSessionDataTask *task, id _Nullable responseObject) {
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                if (![responseObject isKindOfClass:[NSData class]]) {
-                    DDLogError(@"%@ Failed retrieval of attachment. Response had unexpected format.", self.logTag);
-                    NSError *error = OWSErrorMakeUnableToProcessServerResponseError();
-                    return failureHandler(task, error);
-                }
-                NSData *responseData = (NSData *)responseObject;
-                if (responseData.length > kMaxDownloadSize) {
-                    DDLogError(@"%@ Attachment download content length exceeds max download size.", self.logTag);
-                    NSError *error = OWSErrorWithCodeDescription(
-                        OWSErrorCodeInvalidMessage, NSLocalizedString(@"ERROR_MESSAGE_INVALID_MESSAGE", @""));
-                    failureHandler(task, error);
-                } else {
-                    successHandler(responseData);
-                }
-            });
+        success:^(NSString *filePath) {
+            NSError *readError;
+            NSData *_Nullable encryptedData =
+                [NSData dataWithContentsOfFile:filePath options:NSDataReadingMappedIfSafe error:&readError];
+            if (!encryptedData) {
+                DDLogError(@"%@ Failed to read downloaded attachment: %@", self.logTag, readError);
+                [[OWSSegmentedDownloader sharedDownloader] removeDownloadWithIdentifier:pointer.uniqueId];
+                return failureHandler(readError ?: OWSErrorMakeUnableToProcessServerResponseError());
+            }
+            successHandler(encryptedData);
         }
-        failure:^(NSURLSessionDataTask *_Nullable task, NSError *error) {
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                DDLogError(@"Failed to retrieve attachment with error: %@", error.description);
-                return failureHandler(task, error);
-            });
+        failure:^(NSError *error) {
+            DDLogError(@"Failed to retrieve attachment with error: %@", error.description);
+            failureHandler(error);
         }];
 }
 
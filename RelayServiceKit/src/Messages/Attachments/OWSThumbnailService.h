@@ -0,0 +1,84 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class TSAttachmentStream;
+
+typedef NS_ENUM(NSUInteger, OWSThumbnailSize) {
+    // Quoted replies.  This is the legacy thumbnail which lives alongside the attachment.
+    OWSThumbnailSizeSmall = 0,
+    // Media gallery tiles.
+    OWSThumbnailSizeMedium,
+    // Conversation message bubbles.
+    OWSThumbnailSizeLarge,
+};
+
+typedef NS_ENUM(NSInteger, OWSThumbnailPriority) {
+    OWSThumbnailPriorityPrefetch = 0,
+    OWSThumbnailPriorityVisible,
+};
+
+typedef void (^OWSThumbnailCompletion)(UIImage *_Nullable image);
+
+// Generates, stores and caches downsampled renditions of image, animated and video attachments.
+//
+// Thumbnails other than OWSThumbnailSizeSmall are kept in a size-bounded disk cache which is
+// trimmed least-recently-used first.  Decoded bitmaps are held in a memory cache bounded by
+// pixel cost so that the visible range of a conversation or gallery can be redrawn without
+// touching the disk.  All decoding happens off the main thread.
+@interface OWSThumbnailService : NSObject
+
++ (instancetype)sharedService NS_SWIFT_NAME(shared());
+
+- (instancetype)init NS_UNAVAILABLE;
+
+// Maximum dimension, in pixels, of thumbnails of the given size.
++ (CGFloat)maxPixelSizeForThumbnailSize:(OWSThumbnailSize)thumbnailSize;
+
+// The smallest thumbnail size which covers a view of the given point size on this screen.
++ (OWSThumbnailSize)thumbnailSizeForViewSize:(CGSize)viewSize;
+
+@property (nonatomic) NSUInteger maxDiskCacheBytes;
+
+// Returns the decoded thumbnail if it's already in memory.  Safe to call on the main thread.
+- (nullable UIImage *)cachedThumbnailForAttachment:(TSAttachmentStream *)attachment
+                                     thumbnailSize:(OWSThumbnailSize)thumbnailSize
+    NS_SWIFT_NAME(cachedThumbnail(attachment:size:));
+
+// Loads or generates the thumbnail on a background queue. Completion is invoked on the main thread,
+// and is invoked synchronously if the thumbnail is already in memory.
+//
+// Duplicate requests are coalesced; a later request with a higher priority promotes the pending one.
+// Returns an id with which to cancel the request, or nil if it has already completed.
+- (nullable NSUUID *)thumbnailForAttachment:(TSAttachmentStream *)attachment
+                              thumbnailSize:(OWSThumbnailSize)thumbnailSize
+                                   priority:(OWSThumbnailPriority)priority
+                                 completion:(nullable OWSThumbnailCompletion)completion
+    NS_SWIFT_NAME(thumbnail(attachment:size:priority:completion:));
+
+// Views call this as their content scrolls in and out of view.
+- (void)updatePriority:(OWSThumbnailPriority)priority
+       forAttachmentId:(NSString *)attachmentId NS_SWIFT_NAME(updatePriority(_:attachmentId:));
+
+// Cancels one request; its completion is not invoked.  The work is only cancelled once no other request needs it.
+- (void)cancelRequest:(NSUUID *)requestId NS_SWIFT_NAME(cancelRequest(_:));
+
+// Cancels every request for the attachment, for when it's being deleted.  Pending completions are not invoked.
+- (void)cancelRequestsForAttachmentId:(NSString *)attachmentId NS_SWIFT_NAME(cancelRequests(attachmentId:));
+
+// Synchronous variant for callers which are already off the main thread.  Views should use the
+// asynchronous variant instead, since a cache miss may generate the thumbnail from the full-size media.
+- (nullable UIImage *)thumbnailForAttachment:(TSAttachmentStream *)attachment
+                               thumbnailSize:(OWSThumbnailSize)thumbnailSize NS_SWIFT_NAME(thumbnail(attachment:size:));
+
+- (void)removeThumbnailsForAttachmentId:(NSString *)attachmentId;
+
+- (void)clearMemoryCache;
+
+@end
+
+NS_ASSUME_NONNULL_END
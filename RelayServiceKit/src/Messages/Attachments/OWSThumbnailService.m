@@ -0,0 +1,479 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSThumbnailService.h"
+#import "OWSFileSystem.h"
+#import "TSAttachmentStream.h"
+
+@import ImageIO;
+
+NS_ASSUME_NONNULL_BEGIN
+
+const NSUInteger kOWSThumbnailDefaultMaxDiskCacheBytes = 100 * 1024 * 1024;
+// Roughly four screens worth of large bubble thumbnails.
+const NSUInteger kOWSThumbnailMaxMemoryCost = 48 * 1024 * 1024;
+// When trimming, evict down to this fraction of the limit so we don't trim on every write.
+const double kOWSThumbnailDiskCacheTrimRatio = 0.8;
+
+@interface OWSThumbnailService ()
+
+@property (nonatomic, readonly) NSOperationQueue *operationQueue;
+@property (nonatomic, readonly) dispatch_queue_t diskQueue;
+@property (nonatomic, readonly) NSCache<NSString *, UIImage *> *memoryCache;
+@property (nonatomic, readonly) NSString *cacheDirPath;
+
+// These properties should only be accessed while synchronized on self.
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, NSOperation *> *pendingOperations;
+// Keyed by cache key, then by request id; requests without a completion map to NSNull.
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, NSMutableDictionary<NSUUID *, id> *> *pendingRequests;
+@property (nonatomic, readonly) NSMutableDictionary<NSUUID *, NSString *> *requestCacheKeys;
+// Thumbnails which couldn't be generated from media which exists, so aren't worth trying again.
+@property (nonatomic, readonly) NSMutableSet<NSString *> *failedCacheKeys;
+
+// This property should only be accessed on the disk queue.
+// nil until the first trim has measured the cache.
+@property (nonatomic, nullable) NSNumber *diskCacheBytes;
+
+@end
+
+#pragma mark -
+
+@implementation OWSThumbnailService
+
++ (instancetype)sharedService
+{
+    static OWSThumbnailService *sharedService = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedService = [[self alloc] initDefault];
+    });
+    return sharedService;
+}
+
+- (instancetype)initDefault
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _operationQueue = [NSOperationQueue new];
+    _operationQueue.name = @"OWSThumbnailService";
+    _operationQueue.maxConcurrentOperationCount = 2;
+    _operationQueue.qualityOfService = NSQualityOfServiceUtility;
+
+    _diskQueue = dispatch_queue_create("org.whispersystems.thumbnails.disk", DISPATCH_QUEUE_SERIAL);
+
+    _memoryCache = [NSCache new];
+    _memoryCache.totalCostLimit = kOWSThumbnailMaxMemoryCost;
+
+    _pendingOperations = [NSMutableDictionary new];
+    _pendingRequests = [NSMutableDictionary new];
+    _requestCacheKeys = [NSMutableDictionary new];
+    _failedCacheKeys = [NSMutableSet new];
+    _maxDiskCacheBytes = kOWSThumbnailDefaultMaxDiskCacheBytes;
+
+    _cacheDirPath = [[OWSFileSystem cachesDirectoryPath] stringByAppendingPathComponent:@"Thumbnails"];
+    [OWSFileSystem ensureDirectoryExists:_cacheDirPath];
+
+    OWSSingletonAssert();
+
+    dispatch_async(self.diskQueue, ^{
+        [self trimDiskCacheIfNecessary];
+    });
+
+    return self;
+}
+
+#pragma mark - Sizes
+
++ (CGFloat)maxPixelSizeForThumbnailSize:(OWSThumbnailSize)thumbnailSize
+{
+    switch (thumbnailSize) {
+        case OWSThumbnailSizeSmall:
+            return 200;
+        case OWSThumbnailSizeMedium:
+            return 400;
+        case OWSThumbnailSizeLarge:
+            return 1024;
+    }
+}
+
++ (OWSThumbnailSize)thumbnailSizeForViewSize:(CGSize)viewSize
+{
+    CGFloat pixels = MAX(viewSize.width, viewSize.height) * UIScreen.mainScreen.scale;
+    if (pixels <= [self maxPixelSizeForThumbnailSize:OWSThumbnailSizeSmall]) {
+        return OWSThumbnailSizeSmall;
+    } else if (pixels <= [self maxPixelSizeForThumbnailSize:OWSThumbnailSizeMedium]) {
+        return OWSThumbnailSizeMedium;
+    }
+    return OWSThumbnailSizeLarge;
+}
+
+- (NSString *)cacheKeyForAttachmentId:(NSString *)attachmentId thumbnailSize:(OWSThumbnailSize)thumbnailSize
+{
+    return [NSString stringWithFormat:@"%@-%lu", attachmentId, (unsigned long)thumbnailSize];
+}
+
+- (nullable NSString *)filePathForAttachment:(TSAttachmentStream *)attachment
+                               thumbnailSize:(OWSThumbnailSize)thumbnailSize
+{
+    if (thumbnailSize == OWSThumbnailSizeSmall) {
+        return attachment.thumbnailPath;
+    }
+    return [self cacheFilePathForAttachmentId:attachment.uniqueId thumbnailSize:thumbnailSize];
+}
+
+- (NSString *)cacheFilePathForAttachmentId:(NSString *)attachmentId thumbnailSize:(OWSThumbnailSize)thumbnailSize
+{
+    NSString *filename = [self cacheKeyForAttachmentId:attachmentId thumbnailSize:thumbnailSize];
+    return [[self.cacheDirPath stringByAppendingPathComponent:filename] stringByAppendingPathExtension:@"jpg"];
+}
+
+#pragma mark - Requests
+
+- (nullable UIImage *)cachedThumbnailForAttachment:(TSAttachmentStream *)attachment
+                                     thumbnailSize:(OWSThumbnailSize)thumbnailSize
+{
+    return [self.memoryCache objectForKey:[self cacheKeyForAttachmentId:attachment.uniqueId thumbnailSize:thumbnailSize]];
+}
+
+- (nullable NSUUID *)thumbnailForAttachment:(TSAttachmentStream *)attachment
+                              thumbnailSize:(OWSThumbnailSize)thumbnailSize
+                                   priority:(OWSThumbnailPriority)priority
+                                 completion:(nullable OWSThumbnailCompletion)completion
+{
+    NSString *cacheKey = [self cacheKeyForAttachmentId:attachment.uniqueId thumbnailSize:thumbnailSize];
+    UIImage *_Nullable cachedImage = [self.memoryCache objectForKey:cacheKey];
+    BOOL hasFailed;
+    @synchronized(self) {
+        hasFailed = [self.failedCacheKeys containsObject:cacheKey];
+    }
+    if (cachedImage || hasFailed) {
+        if (completion) {
+            if (NSThread.isMainThread) {
+                completion(cachedImage);
+            } else {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completion(cachedImage);
+                });
+            }
+        }
+        return nil;
+    }
+
+    NSUUID *requestId = [NSUUID UUID];
+    @synchronized(self) {
+        NSMutableDictionary<NSUUID *, id> *requests = self.pendingRequests[cacheKey];
+        if (!requests) {
+            requests = [NSMutableDictionary new];
+            self.pendingRequests[cacheKey] = requests;
+        }
+        requests[requestId] = (completion ? [completion copy] : [NSNull null]);
+        self.requestCacheKeys[requestId] = cacheKey;
+
+        NSOperation *_Nullable pendingOperation = self.pendingOperations[cacheKey];
+        if (pendingOperation) {
+            NSOperationQueuePriority queuePriority = [self queuePriorityForPriority:priority];
+            if (pendingOperation.queuePriority < queuePriority) {
+                pendingOperation.queuePriority = queuePriority;
+            }
+            return requestId;
+        }
+
+        __weak OWSThumbnailService *weakSelf = self;
+        NSBlockOperation *operation = [NSBlockOperation new];
+        __weak NSBlockOperation *weakOperation = operation;
+        [operation addExecutionBlock:^{
+            OWSThumbnailService *strongSelf = weakSelf;
+            NSOperation *_Nullable strongOperation = weakOperation;
+            if (!strongSelf || !strongOperation || strongOperation.isCancelled) {
+                return;
+            }
+            UIImage *_Nullable image = [strongSelf thumbnailForAttachment:attachment thumbnailSize:thumbnailSize];
+            [strongSelf completeOperation:strongOperation cacheKey:cacheKey image:image];
+        }];
+        operation.queuePriority = [self queuePriorityForPriority:priority];
+        self.pendingOperations[cacheKey] = operation;
+        [self.operationQueue addOperation:operation];
+    }
+    return requestId;
+}
+
+- (NSOperationQueuePriority)queuePriorityForPriority:(OWSThumbnailPriority)priority
+{
+    switch (priority) {
+        case OWSThumbnailPriorityPrefetch:
+            return NSOperationQueuePriorityLow;
+        case OWSThumbnailPriorityVisible:
+            return NSOperationQueuePriorityHigh;
+    }
+}
+
+- (void)completeOperation:(NSOperation *)operation cacheKey:(NSString *)cacheKey image:(nullable UIImage *)image
+{
+    NSArray<OWSThumbnailCompletion> *completions;
+    @synchronized(self) {
+        if (self.pendingOperations[cacheKey] != operation) {
+            // Cancelled and superseded by a newer request which will deliver its own completions.
+            return;
+        }
+        NSMutableArray<OWSThumbnailCompletion> *pendingCompletions = [NSMutableArray new];
+        [self.pendingRequests[cacheKey] enumerateKeysAndObjectsUsingBlock:^(NSUUID *requestId, id completion, BOOL *stop) {
+            [self.requestCacheKeys removeObjectForKey:requestId];
+            if (completion != [NSNull null]) {
+                [pendingCompletions addObject:completion];
+            }
+        }];
+        completions = [pendingCompletions copy];
+        [self.pendingRequests removeObjectForKey:cacheKey];
+        [self.pendingOperations removeObjectForKey:cacheKey];
+    }
+    if (completions.count < 1) {
+        return;
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (OWSThumbnailCompletion completion in completions) {
+            completion(image);
+        }
+    });
+}
+
+- (void)updatePriority:(OWSThumbnailPriority)priority forAttachmentId:(NSString *)attachmentId
+{
+    NSOperationQueuePriority queuePriority = [self queuePriorityForPriority:priority];
+    @synchronized(self) {
+        for (NSUInteger size = OWSThumbnailSizeSmall; size <= OWSThumbnailSizeLarge; size++) {
+            NSString *cacheKey = [self cacheKeyForAttachmentId:attachmentId thumbnailSize:size];
+            self.pendingOperations[cacheKey].queuePriority = queuePriority;
+        }
+    }
+}
+
+- (void)cancelRequest:(NSUUID *)requestId
+{
+    @synchronized(self) {
+        NSString *_Nullable cacheKey = self.requestCacheKeys[requestId];
+        if (!cacheKey) {
+            // Already completed or cancelled.
+            return;
+        }
+        [self.requestCacheKeys removeObjectForKey:requestId];
+        NSMutableDictionary<NSUUID *, id> *_Nullable requests = self.pendingRequests[cacheKey];
+        [requests removeObjectForKey:requestId];
+        if (requests.count < 1) {
+            [self cancelOperationForCacheKey:cacheKey];
+        }
+    }
+}
+
+- (void)cancelRequestsForAttachmentId:(NSString *)attachmentId
+{
+    @synchronized(self) {
+        for (NSUInteger size = OWSThumbnailSizeSmall; size <= OWSThumbnailSizeLarge; size++) {
+            NSString *cacheKey = [self cacheKeyForAttachmentId:attachmentId thumbnailSize:size];
+            [self.requestCacheKeys removeObjectsForKeys:self.pendingRequests[cacheKey].allKeys];
+            [self cancelOperationForCacheKey:cacheKey];
+        }
+    }
+}
+
+// Should only be called while synchronized on self.
+- (void)cancelOperationForCacheKey:(NSString *)cacheKey
+{
+    [self.pendingOperations[cacheKey] cancel];
+    [self.pendingOperations removeObjectForKey:cacheKey];
+    [self.pendingRequests removeObjectForKey:cacheKey];
+}
+
+#pragma mark - Generation
+
+- (nullable UIImage *)thumbnailForAttachment:(TSAttachmentStream *)attachment
+                               thumbnailSize:(OWSThumbnailSize)thumbnailSize
+{
+    NSString *cacheKey = [self cacheKeyForAttachmentId:attachment.uniqueId thumbnailSize:thumbnailSize];
+    UIImage *_Nullable image = [self.memoryCache objectForKey:cacheKey];
+    if (image) {
+        return image;
+    }
+
+    @synchronized(self) {
+        if ([self.failedCacheKeys containsObject:cacheKey]) {
+            return nil;
+        }
+    }
+
+    NSString *_Nullable filePath = [self filePathForAttachment:attachment thumbnailSize:thumbnailSize];
+    if (!filePath) {
+        return nil;
+    }
+
+    image = [self decodedImageAtPath:filePath];
+    if (image) {
+        if (thumbnailSize != OWSThumbnailSizeSmall) {
+            [self touchCacheFileAtPath:filePath];
+        }
+    } else {
+        image = [attachment decodedThumbnailWithMaxPixelSize:[OWSThumbnailService maxPixelSizeForThumbnailSize:thumbnailSize]];
+        if (!image) {
+            DDLogWarn(@"%@ Unable to build thumbnail for attachmentId: %@", self.logTag, attachment.uniqueId);
+            // Media which hasn't been restored yet may still yield a thumbnail once it has.
+            NSString *_Nullable mediaPath = attachment.filePath;
+            if (mediaPath && [[NSFileManager defaultManager] fileExistsAtPath:mediaPath]) {
+                @synchronized(self) {
+                    [self.failedCacheKeys addObject:cacheKey];
+                }
+            }
+            return nil;
+        }
+        NSData *_Nullable data = UIImageJPEGRepresentation(image, 0.9);
+        if (data.length > 0 && [data writeToFile:filePath atomically:YES]) {
+            DDLogDebug(@"%@ generated thumbnail with size: %lu", self.logTag, (unsigned long)data.length);
+            if (thumbnailSize != OWSThumbnailSizeSmall) {
+                [self didAddCacheFileWithByteCount:data.length];
+            }
+        } else {
+            OWSFailDebug(@"%@ Unable to write thumbnail for attachmentId: %@", self.logTag, attachment.uniqueId);
+        }
+    }
+
+    [self.memoryCache setObject:image forKey:cacheKey cost:[self memoryCostForImage:image]];
+    return image;
+}
+
+// Decodes eagerly so that the bitmap is ready to draw by the time it reaches the main thread.
+- (nullable UIImage *)decodedImageAtPath:(NSString *)filePath
+{
+    if (![[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
+        return nil;
+    }
+    CGImageSourceRef imageSource = CGImageSourceCreateWithURL((__bridge CFURLRef)[NSURL fileURLWithPath:filePath], NULL);
+    if (imageSource == NULL) {
+        return nil;
+    }
+    NSDictionary *options = @{
+        (NSString const *)kCGImageSourceShouldCacheImmediately : (NSNumber const *)kCFBooleanTrue,
+    };
+    CGImageRef cgImage = CGImageSourceCreateImageAtIndex(imageSource, 0, (__bridge CFDictionaryRef)options);
+    CFRelease(imageSource);
+    if (cgImage == NULL) {
+        return nil;
+    }
+    UIImage *image = [[UIImage alloc] initWithCGImage:cgImage];
+    CGImageRelease(cgImage);
+    return image;
+}
+
+- (NSUInteger)memoryCostForImage:(UIImage *)image
+{
+    CGImageRef cgImage = image.CGImage;
+    if (cgImage == NULL) {
+        return (NSUInteger)(image.size.width * image.size.height * image.scale * image.scale * 4);
+    }
+    return CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage);
+}
+
+#pragma mark - Disk Cache
+
+- (void)removeThumbnailsForAttachmentId:(NSString *)attachmentId
+{
+    [self cancelRequestsForAttachmentId:attachmentId];
+    for (NSUInteger size = OWSThumbnailSizeSmall; size <= OWSThumbnailSizeLarge; size++) {
+        NSString *cacheKey = [self cacheKeyForAttachmentId:attachmentId thumbnailSize:size];
+        [self.memoryCache removeObjectForKey:cacheKey];
+        @synchronized(self) {
+            [self.failedCacheKeys removeObject:cacheKey];
+        }
+    }
+    dispatch_async(self.diskQueue, ^{
+        // The small thumbnail is removed along with the attachment's own files.
+        for (NSUInteger size = OWSThumbnailSizeMedium; size <= OWSThumbnailSizeLarge; size++) {
+            NSString *filePath = [self cacheFilePathForAttachmentId:attachmentId thumbnailSize:size];
+            NSNumber *_Nullable byteCount = [OWSFileSystem fileSizeOfPath:filePath];
+            if (byteCount && [OWSFileSystem deleteFileIfExists:filePath] && self.diskCacheBytes) {
+                self.diskCacheBytes = @(MAX(0, self.diskCacheBytes.longLongValue - byteCount.longLongValue));
+            }
+        }
+    });
+}
+
+- (void)clearMemoryCache
+{
+    [self.memoryCache removeAllObjects];
+}
+
+- (void)touchCacheFileAtPath:(NSString *)filePath
+{
+    dispatch_async(self.diskQueue, ^{
+        [[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate : [NSDate new] }
+                                         ofItemAtPath:filePath
+                                                error:nil];
+    });
+}
+
+- (void)didAddCacheFileWithByteCount:(NSUInteger)byteCount
+{
+    dispatch_async(self.diskQueue, ^{
+        if (self.diskCacheBytes) {
+            self.diskCacheBytes = @(self.diskCacheBytes.unsignedLongLongValue + byteCount);
+        }
+        [self trimDiskCacheIfNecessary];
+    });
+}
+
+// Evicts least recently used thumbnails once the cache exceeds its limit.
+- (void)trimDiskCacheIfNecessary
+{
+    if (self.diskCacheBytes && self.diskCacheBytes.unsignedLongLongValue <= self.maxDiskCacheBytes) {
+        return;
+    }
+
+    NSArray<NSURLResourceKey> *keys = @[ NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey ];
+    NSError *error;
+    NSArray<NSURL *> *_Nullable fileURLs =
+        [[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:self.cacheDirPath]
+                                      includingPropertiesForKeys:keys
+                                                         options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                           error:&error];
+    if (!fileURLs) {
+        DDLogError(@"%@ Could not enumerate thumbnail cache: %@", self.logTag, error);
+        return;
+    }
+
+    unsigned long long totalBytes = 0;
+    NSMutableArray<NSDictionary<NSURLResourceKey, id> *> *entries = [NSMutableArray new];
+    for (NSURL *fileURL in fileURLs) {
+        NSDictionary<NSURLResourceKey, id> *_Nullable values = [fileURL resourceValuesForKeys:keys error:nil];
+        if (!values) {
+            continue;
+        }
+        totalBytes += [values[NSURLTotalFileAllocatedSizeKey] unsignedLongLongValue];
+        NSMutableDictionary *entry = [values mutableCopy];
+        entry[NSURLPathKey] = fileURL.path;
+        [entries addObject:entry];
+    }
+
+    if (totalBytes > self.maxDiskCacheBytes) {
+        [entries sortUsingComparator:^NSComparisonResult(NSDictionary *left, NSDictionary *right) {
+            return [left[NSURLContentModificationDateKey] compare:right[NSURLContentModificationDateKey]];
+        }];
+        unsigned long long targetBytes = (unsigned long long)(self.maxDiskCacheBytes * kOWSThumbnailDiskCacheTrimRatio);
+        NSUInteger evictedCount = 0;
+        for (NSDictionary *entry in entries) {
+            if (totalBytes <= targetBytes) {
+                break;
+            }
+            if ([OWSFileSystem deleteFile:entry[NSURLPathKey]]) {
+                totalBytes -= [entry[NSURLTotalFileAllocatedSizeKey] unsignedLongLongValue];
+                evictedCount++;
+            }
+        }
+        DDLogInfo(@"%@ Evicted %lu thumbnails from disk cache.", self.logTag, (unsigned long)evictedCount);
+    }
+    self.diskCacheBytes = @(totalBytes);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -38,9 +38,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 #if TARGET_OS_IPHONE
 - (nullable UIImage *)image;
+// May generate the thumbnail, so views should use OWSThumbnailService's asynchronous variant instead.
 - (nullable UIImage *)thumbnailImage;
 - (nullable NSData *)thumbnailData;
 - (nullable NSData *)validStillImageData;
+// Downsamples the media to a decoded bitmap no larger than maxPixelSize in either dimension.
+// This may be slow and should not be called on the main thread.
+- (nullable UIImage *)decodedThumbnailWithMaxPixelSize:(CGFloat)maxPixelSize;
 #endif
 
 - (BOOL)isAnimated;
@@ -6,6 +6,7 @@
 #import "MIMETypeUtil.h"
 #import "NSData+Image.h"
 #import "OWSFileSystem.h"
+#import "OWSThumbnailService.h"
 #import "TSAttachmentPointer.h"
 
 @import YapDatabase;
@@ -94,16 +95,30 @@ NS_ASSUME_NONNULL_BEGIN
         _creationTimestamp = [NSDate new];
     }
 
-    // This is going to be slow the first time it runs.
-    [self ensureThumbnail];
-
     return self;
 }
 
 - (void)saveWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
 {
     [super saveWithTransaction:transaction];
-    [self ensureThumbnail];
+    [self enqueueThumbnailGeneration];
+}
+
+- (void)enqueueThumbnailGeneration
+{
+    if (![[self class] hasThumbnailForMimeType:self.contentType]) {
+        return;
+    }
+    NSString *_Nullable thumbnailPath = self.thumbnailPath;
+    if (!thumbnailPath || [[NSFileManager defaultManager] fileExistsAtPath:thumbnailPath]) {
+        return;
+    }
+    // Quoted replies need the small thumbnail; generate it in the background rather than
+    // inside the write transaction.  Thumbnails which can't be generated aren't retried.
+    [OWSThumbnailService.sharedService thumbnailForAttachment:self
+                                                thumbnailSize:OWSThumbnailSizeSmall
+                                                     priority:OWSThumbnailPriorityPrefetch
+                                                   completion:nil];
 }
 
 - (void)upgradeFromAttachmentSchemaVersion:(NSUInteger)attachmentSchemaVersion
@@ -270,6 +285,8 @@ NS_ASSUME_NONNULL_BEGIN
 {
     NSError *error;
 
+    [OWSThumbnailService.sharedService removeThumbnailsForAttachmentId:self.uniqueId];
+
     NSString *_Nullable thumbnailPath = self.thumbnailPath;
     if (thumbnailPath) {
         [[NSFileManager defaultManager] removeItemAtPath:thumbnailPath error:&error];
@@ -383,21 +400,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (nullable UIImage *)thumbnailImage
 {
-    NSString *thumbnailPath = self.thumbnailPath;
-    if (!thumbnailPath) {
+    if (!self.thumbnailPath) {
         OWSAssertDebug(!self.isImage && !self.isVideo && !self.isAnimated);
 
         return nil;
     }
 
-    if (![[NSFileManager defaultManager] fileExistsAtPath:thumbnailPath]) {
-        // This isn't true for some useful edge cases tested by the Debug UI.
-        DDLogError(@"%@ missing thumbnail for attachmentId: %@", self.logTag, self.uniqueId);
-
-        return nil;
-    }
-
-    return [UIImage imageWithContentsOfFile:self.thumbnailPath];
+    return [OWSThumbnailService.sharedService thumbnailForAttachment:self thumbnailSize:OWSThumbnailSizeSmall];
 }
 
 - (nullable NSData *)thumbnailData
@@ -409,6 +418,7 @@ NS_ASSUME_NONNULL_BEGIN
         return nil;
     }
 
+    [self ensureThumbnail];
     if (![[NSFileManager defaultManager] fileExistsAtPath:thumbnailPath]) {
         OWSFailDebug(@"%@ missing thumbnail for attachmentId: %@", self.logTag, self.uniqueId);
 
@@ -430,39 +440,50 @@ NS_ASSUME_NONNULL_BEGIN
         return;
     }
 
+    // Generates and writes the small thumbnail if necessary.
+    (void)[OWSThumbnailService.sharedService thumbnailForAttachment:self thumbnailSize:OWSThumbnailSizeSmall];
+}
+
+- (nullable UIImage *)decodedThumbnailWithMaxPixelSize:(CGFloat)maxPixelSize
+{
     if (![[NSFileManager defaultManager] fileExistsAtPath:self.mediaURL.path]) {
         DDLogError(@"%@ while generating thumbnail, source file doesn't exist: %@", self.logTag, self.mediaURL);
         // If we're not lazy-restoring this message, the attachment should exist on disk.
         OWSAssertDebug(self.lazyRestoreFragmentId);
-        return;
+        return nil;
     }
 
-    // TODO proper resolution?
-    CGFloat thumbnailSize = 200;
-
     UIImage *_Nullable result;
     if (self.isImage || self.isAnimated) {
         if (![self isValidImage]) {
             DDLogWarn(@"%@ skipping thumbnail generation for invalid image at path: %@", self.logTag, self.filePath);
-            return;
+            return nil;
         }
 
         CGImageSourceRef imageSource = CGImageSourceCreateWithURL((__bridge CFURLRef)self.mediaURL, NULL);
         OWSAssertDebug(imageSource != NULL);
+        if (imageSource == NULL) {
+            return nil;
+        }
         NSDictionary *imageOptions = @{
             (NSString const *)kCGImageSourceCreateThumbnailFromImageIfAbsent : (NSNumber const *)kCFBooleanTrue,
-            (NSString const *)kCGImageSourceThumbnailMaxPixelSize : @(thumbnailSize),
-            (NSString const *)kCGImageSourceCreateThumbnailWithTransform : (NSNumber const *)kCFBooleanTrue
+            (NSString const *)kCGImageSourceThumbnailMaxPixelSize : @(maxPixelSize),
+            (NSString const *)kCGImageSourceCreateThumbnailWithTransform : (NSNumber const *)kCFBooleanTrue,
+            // Decode now, on this thread, rather than lazily when first drawn.
+            (NSString const *)kCGImageSourceShouldCacheImmediately : (NSNumber const *)kCFBooleanTrue
         };
         CGImageRef thumbnail
             = CGImageSourceCreateThumbnailAtIndex(imageSource, 0, (__bridge CFDictionaryRef)imageOptions);
         CFRelease(imageSource);
+        if (thumbnail == NULL) {
+            return nil;
+        }
 
         result = [[UIImage alloc] initWithCGImage:thumbnail];
         CGImageRelease(thumbnail);
 
     } else if (self.isVideo) {
-        result = [self videoStillImageWithMaxSize:CGSizeMake(thumbnailSize, thumbnailSize)];
+        result = [self videoStillImageWithMaxSize:CGSizeMake(maxPixelSize, maxPixelSize)];
     } else {
         OWSFailDebug(@"%@ trying to generate thumnail for unexpected attachment: %@ of type: %@",
             self.logTag,
@@ -470,16 +491,7 @@ NS_ASSUME_NONNULL_BEGIN
             self.contentType);
     }
 
-    if (result == nil) {
-        OWSFailDebug(@"%@ Unable to build thumbnail for attachmentId: %@", self.logTag, self.uniqueId);
-        return;
-    }
-
-    NSData *thumbnailData = UIImageJPEGRepresentation(result, 0.9);
-
-    OWSAssertDebug(thumbnailData.length > 0);
-    DDLogDebug(@"%@ generated thumbnail with size: %lu", self.logTag, (unsigned long)thumbnailData.length);
-    [thumbnailData writeToFile:thumbnailPath atomically:YES];
+    return result;
 }
 
 - (nullable UIImage *)videoStillImage
@@ -502,8 +514,14 @@ NS_ASSUME_NONNULL_BEGIN
     NSError *err = NULL;
     CMTime time = CMTimeMake(1, 60);
     CGImageRef imgRef = [generator copyCGImageAtTime:time actualTime:NULL error:&err];
+    if (imgRef == NULL) {
+        DDLogError(@"%@ Could not generate video still: %@", self.logTag, err);
+        return nil;
+    }
 
-    return [[UIImage alloc] initWithCGImage:imgRef];
+    UIImage *image = [[UIImage alloc] initWithCGImage:imgRef];
+    CGImageRelease(imgRef);
+    return image;
 }
 
 + (void)deleteAttachments
@@ -4,6 +4,7 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class FLMessageBody;
 @class OWSContact;
 @class OWSSignalServiceProtosAttachmentPointer;
 @class OWSSignalServiceProtosDataMessage;
@@ -20,7 +21,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (instancetype)initWithProto:(OWSSignalServiceProtosSyncMessageSent *)sentProto
                  sourceDevice:(UInt32)sourceDevice
-                     threadId:(NSString *)threadId
+                  messageBody:(FLMessageBody *)messageBody
                   transaction:(YapDatabaseReadWriteTransaction *)transaction;
 
 @property (nonatomic, readonly) OWSSignalServiceProtosDataMessage *dataMessage;
@@ -34,6 +35,7 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, readonly) BOOL isEndSessionMessage;
 @property (nonatomic, readonly, nullable) NSData *groupId;
 @property (nonatomic, readonly) NSString *body;
+@property (nonatomic, readonly) FLMessageBody *messageBody;
 @property (nonatomic, readonly) NSArray<OWSSignalServiceProtosAttachmentPointer *> *attachmentPointerProtos;
 @property (nonatomic, readonly) TSThread *thread;
 @property (nonatomic, readonly, nullable) TSQuotedMessage *quotedMessage;
@@ -9,7 +9,7 @@
 #import "TSOutgoingMessage.h"
 #import "TSQuotedMessage.h"
 #import "TSThread.h"
-#import "FLCCSMJSONService.h"
+#import "FLMessageBody.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -17,9 +17,11 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (instancetype)initWithProto:(OWSSignalServiceProtosSyncMessageSent *)sentProto
                  sourceDevice:(UInt32)sourceDevice
-                     threadId:(NSString *)threadId
+                  messageBody:(FLMessageBody *)messageBody
                   transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
+    OWSAssertDebug(messageBody);
+
     self = [super init];
     if (!self) {
         return self;
@@ -31,10 +33,10 @@ NS_ASSUME_NONNULL_BEGIN
     _expirationStartedAt = sentProto.expirationStartTimestamp;
     _expirationDuration = sentProto.message.expireTimer;
     _body = _dataMessage.body;
+    _messageBody = messageBody;
     _isExpirationTimerUpdate = (_dataMessage.flags & OWSSignalServiceProtosDataMessageFlagsExpirationTimerUpdate) != 0;
     _isEndSessionMessage = (_dataMessage.flags & OWSSignalServiceProtosDataMessageFlagsEndSession) != 0;
-    NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:sentProto.message.body];
-    _thread = [TSThread getOrCreateThreadWithPayload:jsonPayload transaction:transaction];
+    _thread = [TSThread getOrCreateThreadWithPayload:messageBody.payload transaction:transaction];
 
     return self;
 }
@@ -9,6 +9,7 @@
 #define FLBlobShapeRevision 1
 
 #import "FLCCSMJSONService.h"
+#import "FLMessageBody.h"
 #import "TSOutgoingMessage.h"
 #import "TSThread.h"
 #import "CCSMStorage.h"
@@ -301,12 +302,7 @@
 #pragma mark - JSON body parsing methods
 +(nullable NSDictionary *)payloadDictionaryFromMessageBody:(NSString *_Nullable)body
 {
-    NSArray *jsonArray = [self arrayFromMessageBody:body];
-    NSDictionary *jsonPayload = nil;
-    if (jsonArray.count > 0) {
-        jsonPayload = [jsonArray lastObject];
-    }
-    return jsonPayload;
+    return [FLMessageBody messageBodyWithString:body].payload;
 }
 
 +(nullable NSArray *)arrayFromMessageBody:(NSString *_Nonnull)body
@@ -0,0 +1,46 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The Forsta payload of a message body: the last object of the body's JSON array.
+//
+// A body is parsed once, when the envelope is handled, and the result is passed along with the envelope, so
+// that handlers don't each run the JSON parser over it again. The typed properties are nil unless the payload
+// has a value of the expected type for them.
+//
+// Immutable, so safe to share between threads.
+@interface FLMessageBody : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithPayload:(NSDictionary *)payload NS_DESIGNATED_INITIALIZER;
+
+// Returns nil if the body isn't a JSON array whose last object is a dictionary.
++ (nullable instancetype)messageBodyWithString:(nullable NSString *)string;
+
+@property (nonatomic, readonly) NSDictionary *payload;
+
+@property (nonatomic, readonly, nullable) NSString *messageId;
+@property (nonatomic, readonly, nullable) NSString *messageType;
+@property (nonatomic, readonly, nullable) NSString *messageRef;
+
+@property (nonatomic, readonly, nullable) NSString *threadId;
+@property (nonatomic, readonly, nullable) NSString *threadType;
+@property (nonatomic, readonly, nullable) NSString *threadTitle;
+@property (nonatomic, readonly, nullable) NSString *distributionExpression;
+
+@property (nonatomic, readonly, nullable) NSString *senderUserId;
+
+// Nil when the payload has no data, or empty data.
+@property (nonatomic, readonly, nullable) NSDictionary *data;
+@property (nonatomic, readonly, nullable) NSString *controlType;
+@property (nonatomic, readonly) NSArray<NSString *> *dataAttachmentIds;
+
+@property (nonatomic, readonly) BOOL isControlMessage;
+@property (nonatomic, readonly) BOOL isContentMessage;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,122 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "FLMessageBody.h"
+#import "CCSMKeys.h"
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@implementation FLMessageBody
+
+- (instancetype)initWithPayload:(NSDictionary *)payload
+{
+    OWSAssertDebug(payload);
+
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _payload = [payload copy];
+
+    _messageId = [FLMessageBody stringForKey:FLMessageIdKey inDictionary:payload];
+    _messageType = [FLMessageBody stringForKey:FLMessageTypeKey inDictionary:payload];
+    _messageRef = [FLMessageBody stringForKey:@"messageRef" inDictionary:payload];
+
+    _threadId = [FLMessageBody stringForKey:FLThreadIDKey inDictionary:payload];
+    _threadType = [FLMessageBody stringForKey:FLThreadTypeKey inDictionary:payload];
+    _threadTitle = [FLMessageBody stringForKey:FLThreadTitleKey inDictionary:payload];
+
+    NSDictionary *_Nullable distribution = [FLMessageBody dictionaryForKey:FLDistributionKey inDictionary:payload];
+    _distributionExpression = [FLMessageBody stringForKey:FLExpressionKey inDictionary:distribution];
+
+    NSDictionary *_Nullable sender = [FLMessageBody dictionaryForKey:FLMessageSenderKey inDictionary:payload];
+    _senderUserId = [FLMessageBody stringForKey:FLUserIdKey inDictionary:sender];
+
+    NSDictionary *_Nullable data = [FLMessageBody dictionaryForKey:@"data" inDictionary:payload];
+    _data = (data.count > 0 ? data : nil);
+    _controlType = [FLMessageBody stringForKey:FLMessageTypeControlKey inDictionary:_data];
+
+    NSMutableArray<NSString *> *dataAttachmentIds = [NSMutableArray new];
+    id _Nullable attachments = _data[@"attachments"];
+    if ([attachments isKindOfClass:[NSArray class]]) {
+        for (id attachmentId in attachments) {
+            if ([attachmentId isKindOfClass:[NSString class]]) {
+                [dataAttachmentIds addObject:attachmentId];
+            }
+        }
+    }
+    _dataAttachmentIds = [dataAttachmentIds copy];
+
+    return self;
+}
+
++ (nullable instancetype)messageBodyWithString:(nullable NSString *)string
+{
+    if (string.length < 1) {
+        return nil;
+    }
+
+    NSData *_Nullable data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    if (!data) {
+        return nil;
+    }
+
+    NSError *error;
+    id _Nullable json = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+    if (error || !json) {
+        DDLogError(@"%@ JSON Parsing error: %@", self.logTag, error.description);
+        return nil;
+    }
+    if (![json isKindOfClass:[NSArray class]]) {
+        DDLogError(@"%@ Unexpected message body type: %@", self.logTag, [json class]);
+        return nil;
+    }
+    id _Nullable payload = [json lastObject];
+    if (![payload isKindOfClass:[NSDictionary class]]) {
+        DDLogError(@"%@ Unexpected message payload type: %@", self.logTag, [payload class]);
+        return nil;
+    }
+
+    return [[self alloc] initWithPayload:payload];
+}
+
++ (nullable NSString *)stringForKey:(NSString *)key inDictionary:(nullable NSDictionary *)dictionary
+{
+    id _Nullable value = dictionary[key];
+    return ([value isKindOfClass:[NSString class]] ? value : nil);
+}
+
++ (nullable NSDictionary *)dictionaryForKey:(NSString *)key inDictionary:(nullable NSDictionary *)dictionary
+{
+    id _Nullable value = dictionary[key];
+    return ([value isKindOfClass:[NSDictionary class]] ? value : nil);
+}
+
+#pragma mark -
+
+- (BOOL)isControlMessage
+{
+    return [self.messageType isEqualToString:FLMessageTypeControlKey];
+}
+
+- (BOOL)isContentMessage
+{
+    return [self.messageType isEqualToString:FLMessageTypeContentKey];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@ messageId: %@, messageType: %@, threadId: %@>",
+                     self.class,
+                     self.messageId,
+                     self.messageType,
+                     self.threadId];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -17,35 +17,28 @@ import UIKit
                                 serverAge: NSNumber?,
                                 author: String,
                                 device: UInt32,
-                                payload: NSDictionary,
+                                messageBody: FLMessageBody,
                                 attachments: Array<OWSSignalServiceProtosAttachmentPointer>?) {
         
-        let messageType = payload.object(forKey: "messageType") as! String
-        
-        if (messageType.count == 0) {
+        guard messageBody.isControlMessage else {
             Logger.error("Attempted to create control message with invalid payload.");
             return nil
         }
         
-        let dataBlob = payload.object(forKey: "data") as! NSDictionary
-        if dataBlob.allKeys.count == 0 {
+        guard messageBody.data != nil else {
             Logger.error("Attempted to create control message without data object.")
             return nil
         }
         
-        let controlType = dataBlob.object(forKey: FLMessageTypeControlKey) as! String
-        if controlType.count == 0 {
+        guard let controlType = messageBody.controlType, controlType.count > 0 else {
             Logger.error("Attempted to create control message without a type.")
             return nil
         }
         
         self.attachmentPointers = attachments
-        self.controlMessageType = dataBlob.object(forKey: FLMessageTypeControlKey) as! String
+        self.controlMessageType = controlType
         
-        var attachmentIds:[String] = []
-        if ((dataBlob.object(forKey: "attachments")) != nil) {
-            attachmentIds = dataBlob.object(forKey: "attachments") as! [String]
-        }
+        let attachmentIds = messageBody.dataAttachmentIds
 
         super.init(incomingMessageWithTimestamp: timestamp,
                    serverAge:serverAge,
@@ -58,7 +51,7 @@ import UIKit
                    quotedMessage: nil)
                 
         self.messageType = FLMessageTypeControlKey
-        self.forstaPayload = payload.copy() as! [AnyHashable : Any]
+        self.forstaPayload = messageBody.payload
     }
     
     @objc required public init(coder: NSCoder) {
@@ -4,7 +4,9 @@
 
 #import "TSInteraction.h"
 #import "NSDate+OWS.h"
+#import "OWSInboxSummary.h"
 #import "OWSPrimaryStorage+messageIDs.h"
+#import "OWSUnreadCounter.h"
 #import "TSDatabaseSecondaryIndexes.h"
 #import "TSThread.h"
 
@@ -160,17 +162,32 @@ NSString *NSStringFromOWSInteractionType(OWSInteractionType value)
         self.uniqueId = [OWSPrimaryStorage getAndIncrementMessageIdWithTransaction:transaction];
     }
 
+    [OWSUnreadCounter interactionWillBeSaved:self transaction:transaction];
+
     [super saveWithTransaction:transaction];
 
     TSThread *fetchedThread = [TSThread fetchObjectWithUniqueID:self.uniqueThreadId transaction:transaction];
 
     [fetchedThread updateWithLastMessage:self transaction:transaction];
+    if (fetchedThread) {
+        [OWSInboxSummary interactionWasSaved:self inThread:fetchedThread transaction:transaction];
+    }
+}
+
+- (void)touchWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [super touchWithTransaction:transaction];
+
+    [OWSInboxSummary interactionWasTouched:self transaction:transaction];
 }
 
 - (void)removeWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
 {
+    [OWSUnreadCounter interactionWillBeRemoved:self transaction:transaction];
+
     [super removeWithTransaction:transaction];
 
+    [OWSInboxSummary interactionWasRemoved:self transaction:transaction];
     [self touchThreadWithTransaction:transaction];
 }
 
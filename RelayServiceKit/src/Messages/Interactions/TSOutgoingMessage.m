@@ -8,6 +8,7 @@
 #import "MessageSender.h"
 #import "OWSOutgoingSyncMessage.h"
 #import "OWSPrimaryStorage.h"
+#import "OWSReadReceiptManager.h"
 #import "OWSSignalServiceProtos.pb.h"
 #import "ProtoBuf+OWS.h"
 #import "TSAccountManager.h"
@@ -399,9 +400,46 @@ NSString *NSStringForOutgoingMessageRecipientState(OWSOutgoingMessageRecipientSt
         return;
     }
 
+    [self applyReadWatermarksWithTransaction:transaction];
+
     [super saveWithTransaction:transaction];
 }
 
+// Read marks only visit messages newer than the recipient's previous read mark, so a message saved after a read
+// mark which covers it, e.g. a transcript of a message sent from a linked device which arrives late, is marked
+// here instead.
+- (void)applyReadWatermarksWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    NSDictionary<NSString *, NSNumber *> *watermarks =
+        [OWSReadReceiptManager readWatermarksForThreadId:self.uniqueThreadId transaction:transaction];
+    if (watermarks.count < 1) {
+        return;
+    }
+
+    NSMutableDictionary<NSString *, TSOutgoingMessageRecipientState *> *_Nullable newRecipientStateMap;
+    for (NSString *recipientId in watermarks) {
+        uint64_t watermark = watermarks[recipientId].unsignedLongLongValue;
+        TSOutgoingMessageRecipientState *_Nullable recipientState = self.recipientStateMap[recipientId];
+        if (self.timestamp > watermark || recipientState.readTimestamp != nil) {
+            continue;
+        }
+
+        if (!recipientState) {
+            recipientState = [TSOutgoingMessageRecipientState new];
+        }
+        recipientState.state = OWSOutgoingMessageRecipientStateSent;
+        recipientState.readTimestamp = @(watermark);
+
+        if (!newRecipientStateMap) {
+            newRecipientStateMap = [self.recipientStateMap mutableCopy] ?: [NSMutableDictionary new];
+        }
+        newRecipientStateMap[recipientId] = recipientState;
+    }
+    if (newRecipientStateMap) {
+        self.recipientStateMap = [newRecipientStateMap copy];
+    }
+}
+
 - (BOOL)shouldStartExpireTimerWithTransaction:(YapDatabaseReadTransaction *)transaction
 {
     // It's not clear if we should wait until _all_ recipients have reached "sent or later"
@@ -666,6 +704,9 @@ NSString *NSStringForOutgoingMessageRecipientState(OWSOutgoingMessageRecipientSt
     TSOutgoingMessageRecipientState *_Nullable recipientState = [self.recipientStateMap valueForKey:recipientId];
     if (!recipientState) {
         recipientState = [TSOutgoingMessageRecipientState new];
+    } else if (recipientState.state == OWSOutgoingMessageRecipientStateSent && recipientState.readTimestamp != nil) {
+        // Already read; don't rewrite the message.
+        return;
     }
     if (recipientState.state != OWSOutgoingMessageRecipientStateSent) {
         DDLogWarn(@"%@ marking unsent message as read.", self.logTag);
@@ -1301,6 +1301,7 @@ NSString *const MessageSenderRateLimitedException = @"RateLimitedException";
                  } @catch (NSException *exception) {
                      encryptionException = exception;
                  }
+                 [self.primaryStorage flushSessionStoreWithTransaction:transaction];
              }];
             
             if (encryptionException) {
@@ -14,6 +14,7 @@
 #import "OWSQueues.h"
 #import "OWSSignalServiceProtos.pb.h"
 #import "OWSStorage.h"
+#import "OWSThreadMetadataAccumulator.h"
 #import "TSDatabaseView.h"
 #import "TSErrorMessage.h"
 #import "TSYapDatabaseObject.h"
@@ -405,6 +406,10 @@ NSString *const OWSMessageContentJobFinderExtensionGroup = @"OWSMessageContentJo
 
     __block NSMutableArray<OWSMessageContentJob *> *processedJobs = [NSMutableArray new];
     [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        // Write each thread the batch changes once, rather than for every message.
+        OWSThreadMetadataAccumulator *threadMetadataAccumulator =
+            [OWSThreadMetadataAccumulator beginBatchWithTransaction:transaction];
+
         for (OWSMessageContentJob *job in jobs) {
 
             // FIXME: Supressing this message for now
@@ -443,6 +448,8 @@ NSString *const OWSMessageContentJobFinderExtensionGroup = @"OWSMessageContentJo
                 break;
             }
         }
+
+        [threadMetadataAccumulator flushWithTransaction:transaction];
     }];
     return processedJobs;
 }
@@ -15,6 +15,12 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)enumerateExpiredMessagesWithBlock:(void (^_Nonnull)(TSMessage *message))block
                               transaction:(YapDatabaseReadTransaction *)transaction;
 
+// The ids of up to `limit` messages which expired at or before `timestamp`, earliest expiration first.
+// A limit of 0 means no limit, in which case the order is unspecified.
+- (NSArray<NSString *> *)fetchExpiredMessageIdsAt:(uint64_t)timestamp
+                                            limit:(NSUInteger)limit
+                                      transaction:(YapDatabaseReadTransaction *)transaction;
+
 - (void)enumerateUnstartedExpiringMessagesInThread:(TSThread *)thread
                                              block:(void (^_Nonnull)(TSMessage *message))block
                                        transaction:(YapDatabaseReadTransaction *)transaction;
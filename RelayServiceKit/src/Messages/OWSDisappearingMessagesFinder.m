@@ -81,17 +81,29 @@ static NSString *const OWSDisappearingMessageFinderExpiresAtIndex = @"index_mess
 }
 
 - (NSArray<NSString *> *)fetchExpiredMessageIdsWithTransaction:(YapDatabaseReadTransaction *_Nonnull)transaction
+{
+    return [self fetchExpiredMessageIdsAt:[NSDate ows_millisecondTimeStamp] limit:0 transaction:transaction];
+}
+
+- (NSArray<NSString *> *)fetchExpiredMessageIdsAt:(uint64_t)timestamp
+                                            limit:(NSUInteger)limit
+                                      transaction:(YapDatabaseReadTransaction *)transaction
 {
     OWSAssertDebug(transaction);
 
     NSMutableArray<NSString *> *messageIds = [NSMutableArray new];
 
-    uint64_t now = [NSDate ows_millisecondTimeStamp];
     // When (expiresAt == 0) the message SHOULD NOT expire. Careful ;)
-    NSString *formattedString = [NSString stringWithFormat:@"WHERE %@ > 0 AND %@ <= %lld",
-                                          OWSDisappearingMessageFinderExpiresAtColumn,
-                                          OWSDisappearingMessageFinderExpiresAtColumn,
-                                          now];
+    NSMutableString *formattedString = [NSMutableString stringWithFormat:@"WHERE %@ > 0 AND %@ <= %lld",
+                                                        OWSDisappearingMessageFinderExpiresAtColumn,
+                                                        OWSDisappearingMessageFinderExpiresAtColumn,
+                                                        timestamp];
+    if (limit > 0) {
+        // The index is ordered by expiration, so this is a range scan which stops after `limit` rows.
+        [formattedString appendFormat:@" ORDER BY %@ ASC LIMIT %lu",
+                         OWSDisappearingMessageFinderExpiresAtColumn,
+                         (unsigned long)limit];
+    }
     YapDatabaseQuery *query = [YapDatabaseQuery queryWithFormat:formattedString];
     [[transaction ext:OWSDisappearingMessageFinderExpiresAtIndex]
         enumerateKeysMatchingQuery:query
@@ -17,10 +17,13 @@
 #import "TSMessage.h"
 #import "TSThread.h"
 #import "SSKAsserts.h"
-#import "FLCCSMJSONService.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
+static const NSUInteger kDisappearingMessagesChunkSize = 100;
+static const NSTimeInterval kDisappearingMessagesChunkDuration = 0.05;
+static const NSTimeInterval kDisappearingMessagesChunkInterval = 0.05;
+
 // Can we move to Signal-iOS?
 @interface OWSDisappearingMessagesJob ()
 
@@ -28,6 +31,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (nonatomic, readonly) OWSDisappearingMessagesFinder *disappearingMessagesFinder;
 
+// The most messages deleted in one transaction.
+@property (nonatomic) NSUInteger chunkSize;
+// Roughly the longest one transaction will spend deleting messages.
+@property (nonatomic) NSTimeInterval chunkDuration;
+// The pause between chunks.
+@property (nonatomic) NSTimeInterval chunkInterval;
+// Whether the next chunk has been scheduled.  Should only be accessed on the serial queue.
+@property (nonatomic) BOOL hasPendingChunk;
+
 + (dispatch_queue_t)serialQueue;
 
 // These three properties should only be accessed on the main thread.
@@ -70,6 +82,9 @@ void AssertIsOnDisappearingMessagesQueue()
 
     _databaseConnection = primaryStorage.newDatabaseConnection;
     _disappearingMessagesFinder = [OWSDisappearingMessagesFinder new];
+    _chunkSize = kDisappearingMessagesChunkSize;
+    _chunkDuration = kDisappearingMessagesChunkDuration;
+    _chunkInterval = kDisappearingMessagesChunkInterval;
 
     // suspenders in case a deletion schedule is missed.
     NSTimeInterval kFallBackTimerInterval = 5 * kMinuteInterval;
@@ -112,7 +127,11 @@ void AssertIsOnDisappearingMessagesQueue()
     return queue;
 }
 
-- (NSUInteger)deleteExpiredMessages
+// Deletes a bounded chunk of expired messages in a single short transaction, so that expiring a large backlog
+// (e.g. after the device has been offline) doesn't hold the write lock for long.
+//
+// Sets `hasMore` if the chunk didn't delete every expired message.
+- (NSUInteger)deleteExpiredMessagesChunkHasMore:(BOOL *)hasMore
 {
     AssertIsOnDisappearingMessagesQueue();
 
@@ -121,35 +140,73 @@ void AssertIsOnDisappearingMessagesQueue()
     OWSBackgroundTask *_Nullable backgroundTask = [OWSBackgroundTask backgroundTaskWithLabelStr:__PRETTY_FUNCTION__];
 
     __block NSUInteger expirationCount = 0;
+    __block BOOL chunkIsFull = NO;
     [self.databaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *_Nonnull transaction) {
-        [self.disappearingMessagesFinder enumerateExpiredMessagesWithBlock:^(TSMessage *message) {
+        CFAbsoluteTime startedAt = CFAbsoluteTimeGetCurrent();
+        NSArray<NSString *> *messageIds = [self.disappearingMessagesFinder fetchExpiredMessageIdsAt:now
+                                                                                              limit:self.chunkSize
+                                                                                        transaction:transaction];
+        chunkIsFull = messageIds.count >= self.chunkSize;
+
+        for (NSString *messageId in messageIds) {
+            if (expirationCount > 0 && CFAbsoluteTimeGetCurrent() - startedAt > self.chunkDuration) {
+                // Removing messages with attachments can be slow.  Leave the rest for the next chunk.
+                chunkIsFull = YES;
+                break;
+            }
+
+            TSMessage *_Nullable message = [TSMessage fetchObjectWithUniqueID:messageId transaction:transaction];
+            if (![message isKindOfClass:[TSMessage class]]) {
+                DDLogError(@"%@ unexpected object: %@", self.logTag, message);
+                continue;
+            }
+
             // sanity check
             if (message.expiresAt > now) {
                 OWSFailDebug(
                     @"%@ Refusing to remove message which doesn't expire until: %lld", self.logTag, message.expiresAt);
-                return;
+                continue;
             }
 
-            DDLogInfo(@"%@ Removing message which expired at: %lld", self.logTag, message.expiresAt);
+            DDLogVerbose(@"%@ Removing message which expired at: %lld", self.logTag, message.expiresAt);
             [message removeWithTransaction:transaction];
             expirationCount++;
         }
-                                                               transaction:transaction];
     }];
 
     DDLogDebug(@"%@ Removed %lu expired messages", self.logTag, (unsigned long)expirationCount);
 
     backgroundTask = nil;
+    // If nothing could be deleted, don't spin on the same messages.
+    *hasMore = chunkIsFull && expirationCount > 0;
     return expirationCount;
 }
 
-// deletes any expired messages and schedules the next run.
+// deletes a chunk of expired messages and schedules the next run.
 - (NSUInteger)runLoop
 {
     DDLogVerbose(@"%@ in runLoop", self.logTag);
     AssertIsOnDisappearingMessagesQueue();
 
-    NSUInteger deletedCount = [self deleteExpiredMessages];
+    if (self.hasPendingChunk) {
+        // Already working through a backlog.
+        return 0;
+    }
+
+    BOOL hasMore = NO;
+    NSUInteger deletedCount = [self deleteExpiredMessagesChunkHasMore:&hasMore];
+
+    if (hasMore) {
+        // Yield between chunks so that other writes, e.g. incoming messages, and UI reads can proceed.
+        self.hasPendingChunk = YES;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.chunkInterval * NSEC_PER_SEC)),
+            OWSDisappearingMessagesJob.serialQueue,
+            ^{
+                self.hasPendingChunk = NO;
+                [self runLoop];
+            });
+        return deletedCount;
+    }
 
     __block NSNumber *nextExpirationTimestampNumber;
     [self.databaseConnection readWithBlock:^(YapDatabaseReadTransaction *_Nonnull transaction) {
@@ -199,8 +256,8 @@ void AssertIsOnDisappearingMessagesQueue()
                                     contactsManager:(id<ContactsManagerProtocol>)contactsManager
                                         transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
-    NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:message.body];
-    TSThread *thread = [TSThread getOrCreateThreadWithPayload:jsonPayload transaction:transaction];
+    // The message has usually parsed its payload already.
+    TSThread *thread = [TSThread getOrCreateThreadWithPayload:message.forstaPayload transaction:transaction];
     if (thread == nil) {
         DDLogError(@"%@: unable to create thread.", self.logTag);
         return;
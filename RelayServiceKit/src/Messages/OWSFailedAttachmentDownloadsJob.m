@@ -3,7 +3,9 @@
 //
 
 #import "OWSFailedAttachmentDownloadsJob.h"
+#import "NSDate+OWS.h"
 #import "OWSPrimaryStorage.h"
+#import "OWSSegmentedDownloader.h"
 #import "TSAttachmentPointer.h"
 #import <YapDatabase/YapDatabase.h>
 #import <YapDatabase/YapDatabaseQuery.h>
@@ -13,6 +15,9 @@ NS_ASSUME_NONNULL_BEGIN
 
 static NSString *const OWSFailedAttachmentDownloadsJobAttachmentStateColumn = @"state";
 static NSString *const OWSFailedAttachmentDownloadsJobAttachmentStateIndex = @"index_attachment_downloads_on_state";
+// Interrupted downloads keep their progress so that "tap to retry" can resume them, but we don't
+// want to hold onto partial data for attachments the user never retries.
+static const NSTimeInterval kPartialDownloadMaxAge = 7 * kDayInterval;
 
 @interface OWSFailedAttachmentDownloadsJob ()
 
@@ -91,6 +96,8 @@ static NSString *const OWSFailedAttachmentDownloadsJobAttachmentStateIndex = @"i
         }];
 
     DDLogDebug(@"%@ Marked %u attachments as unsent", self.logTag, count);
+
+    [[OWSSegmentedDownloader sharedDownloader] removePartialDownloadsOlderThan:kPartialDownloadMaxAge];
 }
 
 #pragma mark - YapDatabaseExtension
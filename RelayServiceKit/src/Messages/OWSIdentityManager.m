@@ -15,6 +15,7 @@
 #import "OWSPrimaryStorage+sessionStore.h"
 #import "OWSPrimaryStorage.h"
 #import "OWSRecipientIdentity.h"
+#import "OWSRecipientIdentityCache.h"
 #import "OWSVerificationStateChangeMessage.h"
 #import "OWSVerificationStateSyncMessage.h"
 #import "TSAccountManager.h"
@@ -60,6 +61,7 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
 @property (nonatomic, readonly) OWSPrimaryStorage *primaryStorage;
 @property (nonatomic, readonly) YapDatabaseConnection *dbConnection;
 @property (nonatomic, readonly) MessageSender *messageSender;
+@property (nonatomic, readonly) OWSRecipientIdentityCache *recipientIdentityCache;
 
 @end
 
@@ -101,6 +103,7 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
     _dbConnection = primaryStorage.newDatabaseConnection;
     self.dbConnection.objectCacheEnabled = NO;
     _messageSender = messageSender;
+    _recipientIdentityCache = OWSRecipientIdentityCache.sharedCache;
     
     OWSSingletonAssert();
     
@@ -138,11 +141,10 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
 
 - (nullable NSData *)identityKeyForRecipientId:(NSString *)recipientId
 {
-    __block NSData *_Nullable result = nil;
-    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
-        result = [self identityKeyForRecipientId:recipientId transaction:transaction];
-    }];
-    return result;
+    OWSAssertDebug(recipientId.length > 0);
+
+    return [self.recipientIdentityCache recipientIdentityForRecipientId:recipientId dbConnection:self.dbConnection]
+        .identityKey;
 }
 
 - (nullable NSData *)identityKeyForRecipientId:(NSString *)recipientId
@@ -151,7 +153,7 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
     OWSAssertDebug(recipientId.length > 0);
     OWSAssertDebug(transaction);
     
-    return [OWSRecipientIdentity fetchObjectWithUniqueID:recipientId transaction:transaction].identityKey;
+    return [self.recipientIdentityCache recipientIdentityForRecipientId:recipientId transaction:transaction].identityKey;
 }
 
 - (nullable ECKeyPair *)identityKeyPair
@@ -365,11 +367,11 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
 
 - (OWSVerificationState)verificationStateForRecipientId:(NSString *)recipientId
 {
-    __block OWSVerificationState result;
-    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *_Nonnull transaction) {
-        result = [self verificationStateForRecipientId:recipientId transaction:transaction];
-    }];
-    return result;
+    OWSAssertDebug(recipientId.length > 0);
+
+    OWSRecipientIdentity *_Nullable currentIdentity =
+        [self.recipientIdentityCache recipientIdentityForRecipientId:recipientId dbConnection:self.dbConnection];
+    return [self verificationStateForRecipientIdentity:currentIdentity];
 }
 
 - (OWSVerificationState)verificationStateForRecipientId:(NSString *)recipientId
@@ -379,18 +381,17 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
     OWSAssertDebug(transaction);
     
     OWSRecipientIdentity *_Nullable currentIdentity =
-    [OWSRecipientIdentity fetchObjectWithUniqueID:recipientId transaction:transaction];
-    
+        [self.recipientIdentityCache recipientIdentityForRecipientId:recipientId transaction:transaction];
+    return [self verificationStateForRecipientIdentity:currentIdentity];
+}
+
+- (OWSVerificationState)verificationStateForRecipientIdentity:(nullable OWSRecipientIdentity *)currentIdentity
+{
     if (!currentIdentity) {
         // We might not know the identity for this recipient yet.
         return OWSVerificationStateDefault;
     }
     
-    if (![currentIdentity isKindOfClass:[OWSRecipientIdentity class]]) {
-        OWSFailDebug(@"%@ unexpectd object(%@) returned by db fetch!", self.logTag, [currentIdentity class]);
-        return OWSVerificationStateDefault;
-    }
-    
     return currentIdentity.verificationState;
 }
 
@@ -398,38 +399,37 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
 {
     OWSAssertDebug(recipientId.length > 0);
     
-    __block OWSRecipientIdentity *_Nullable result;
-    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *_Nonnull transaction) {
-        result = [OWSRecipientIdentity fetchObjectWithUniqueID:recipientId transaction:transaction];
-    }];
-    return result;
+    // The cached copy is shared.
+    return [[self.recipientIdentityCache recipientIdentityForRecipientId:recipientId dbConnection:self.dbConnection]
+        copy];
 }
 
 - (nullable OWSRecipientIdentity *)untrustedIdentityForSendingToRecipientId:(NSString *)recipientId
 {
     OWSAssertDebug(recipientId.length > 0);
     
-    __block OWSRecipientIdentity *_Nullable result;
-    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *_Nonnull transaction) {
-        OWSRecipientIdentity *_Nullable recipientIdentity =
-        [OWSRecipientIdentity fetchObjectWithUniqueID:recipientId transaction:transaction];
-        
-        if (recipientIdentity == nil) {
-            // trust on first use
-            return;
-        }
-        
-        BOOL isTrusted = [self isTrustedIdentityKey:recipientIdentity.identityKey
-                                        recipientId:recipientId
-                                          direction:TSMessageDirectionOutgoing
-                                        transaction:transaction];
-        if (isTrusted) {
-            return;
-        } else {
-            result = recipientIdentity;
-        }
-    }];
-    return result;
+    OWSRecipientIdentity *_Nullable recipientIdentity =
+        [self.recipientIdentityCache recipientIdentityForRecipientId:recipientId dbConnection:self.dbConnection];
+    if (recipientIdentity == nil) {
+        // trust on first use
+        return nil;
+    }
+
+    BOOL isTrusted;
+    if ([[TSAccountManager localUID] isEqualToString:recipientId]) {
+        // Checked against our own key pair, which needs a transaction.
+        __block BOOL isTrustedLocalKey;
+        [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *_Nonnull transaction) {
+            isTrustedLocalKey = [self isTrustedIdentityKey:recipientIdentity.identityKey
+                                               recipientId:recipientId
+                                                 direction:TSMessageDirectionOutgoing
+                                               transaction:transaction];
+        }];
+        isTrusted = isTrustedLocalKey;
+    } else {
+        isTrusted = [self isTrustedKey:recipientIdentity.identityKey forSendingToIdentity:recipientIdentity];
+    }
+    return (isTrusted ? nil : [recipientIdentity copy]);
 }
 
 - (void)fireIdentityStateChangeNotification
@@ -494,7 +494,7 @@ NSString *const kNSNotificationName_IdentityStateDidChange = @"kNSNotificationNa
         }
         case TSMessageDirectionOutgoing: {
             OWSRecipientIdentity *existingIdentity =
-            [OWSRecipientIdentity fetchObjectWithUniqueID:recipientId transaction:transaction];
+                [self.recipientIdentityCache recipientIdentityForRecipientId:recipientId transaction:transaction];
             return [self isTrustedKey:identityKey forSendingToIdentity:existingIdentity];
         }
         default: {
@@ -0,0 +1,66 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "TSYapDatabaseObject.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class TSInteraction;
+@class TSThread;
+@class YapDatabaseReadTransaction;
+@class YapDatabaseReadWriteTransaction;
+
+// What the inbox shows for a thread, kept in its own collection and keyed by thread id, so that a row of the inbox
+// can be drawn from one small record instead of from the thread's interactions and the unread view.
+//
+// The summaries are updated in the same transaction as every save, touch and removal of an interaction or a
+// thread, by way of -[TSInteraction saveWithTransaction:], -[TSThread saveWithTransaction:] and so on, and are
+// only written when what the inbox shows has changed.  Until they've been built for the first time, or for a
+// thread without one, +summaryForThread:transaction: works the summary out from the thread instead.
+//
+// The thread's display name isn't kept here, since it depends on the contacts and the locale, which can change
+// without the thread being saved.
+@interface OWSInboxSummary : TSYapDatabaseObject
+
+@property (nonatomic, readonly) NSString *threadId;
+@property (nonatomic, readonly, nullable) NSString *lastInteractionId;
+// The last inbox interaction's timestampForSorting.
+@property (nonatomic, readonly) uint64_t lastInteractionTimestamp;
+@property (nonatomic, readonly) NSString *previewText;
+@property (nonatomic, readonly) NSUInteger unreadCount;
+
+- (nullable TSInteraction *)lastInteractionWithTransaction:(YapDatabaseReadTransaction *)transaction
+    NS_SWIFT_NAME(lastInteraction(transaction:));
+
++ (OWSInboxSummary *)summaryForThread:(TSThread *)thread
+                          transaction:(YapDatabaseReadTransaction *)transaction
+    NS_SWIFT_NAME(summary(thread:transaction:));
+
++ (NSString *)previewTextForInteraction:(nullable TSInteraction *)interaction
+                            transaction:(YapDatabaseReadTransaction *)transaction;
+
+#pragma mark - Updating
+
++ (void)interactionWasSaved:(TSInteraction *)interaction
+                   inThread:(TSThread *)thread
+                transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)interactionWasTouched:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)interactionWasRemoved:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)threadWasSaved:(TSThread *)thread transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)threadWasRemoved:(TSThread *)thread transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+#pragma mark - Building
+
+// Returns YES if the summaries had to be built.
++ (BOOL)buildIfNecessaryWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)rebuildWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+@end
+
+NS_ASSUME_NONNULL_END
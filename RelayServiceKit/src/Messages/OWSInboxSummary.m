@@ -0,0 +1,269 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSInboxSummary.h"
+#import "NSString+SSK.h"
+#import "OWSUnreadCounter.h"
+#import "TSInteraction.h"
+#import "TSThread.h"
+#import <YapDatabase/YapDatabase.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+static NSString *const OWSInboxSummaryStateCollection = @"OWSInboxSummaryStateCollection";
+// Only present once the summaries have been built.
+static NSString *const OWSInboxSummaryBuiltKey = @"built";
+
+@interface OWSInboxSummary ()
+
+@property (nonatomic, nullable) NSString *lastInteractionId;
+@property (nonatomic) uint64_t lastInteractionTimestamp;
+@property (nonatomic) NSString *previewText;
+@property (nonatomic) NSUInteger unreadCount;
+
+@end
+
+#pragma mark -
+
+@implementation OWSInboxSummary
+
+- (instancetype)initWithThread:(TSThread *)thread
+               lastInteraction:(nullable TSInteraction *)lastInteraction
+                   transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    self = [super initWithUniqueId:thread.uniqueId];
+    if (!self) {
+        return self;
+    }
+
+    _previewText = @"";
+    [self updateWithThread:thread transaction:transaction];
+    [self updateWithLastInteraction:lastInteraction transaction:transaction];
+
+    return self;
+}
+
+- (nullable instancetype)initWithCoder:(NSCoder *)coder
+{
+    return [super initWithCoder:coder];
+}
+
+- (NSString *)threadId
+{
+    return self.uniqueId;
+}
+
+- (nullable TSInteraction *)lastInteractionWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    if (!self.lastInteractionId) {
+        return nil;
+    }
+    return [TSInteraction fetchObjectWithUniqueID:self.lastInteractionId transaction:transaction];
+}
+
+- (void)updateWithThread:(TSThread *)thread transaction:(YapDatabaseReadTransaction *)transaction
+{
+    self.unreadCount = [OWSUnreadCounter unreadCountForThreadId:thread.uniqueId transaction:transaction];
+}
+
+- (void)updateWithLastInteraction:(nullable TSInteraction *)interaction
+                      transaction:(YapDatabaseReadTransaction *)transaction
+{
+    self.lastInteractionId = interaction.uniqueId;
+    self.lastInteractionTimestamp = interaction.timestampForSorting;
+    self.previewText = [OWSInboxSummary previewTextForInteraction:interaction transaction:transaction];
+}
+
+#pragma mark - Reading
+
++ (BOOL)isBuiltWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [transaction objectForKey:OWSInboxSummaryBuiltKey inCollection:OWSInboxSummaryStateCollection] != nil;
+}
+
++ (OWSInboxSummary *)computedSummaryForThread:(TSThread *)thread transaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [[self alloc] initWithThread:thread
+                        lastInteraction:[thread lastInteractionForInboxWithTransaction:transaction]
+                            transaction:transaction];
+}
+
++ (OWSInboxSummary *)summaryForThread:(TSThread *)thread transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    OWSInboxSummary *_Nullable summary = [self fetchObjectWithUniqueID:thread.uniqueId transaction:transaction];
+    if (summary) {
+        return summary;
+    }
+    return [self computedSummaryForThread:thread transaction:transaction];
+}
+
++ (NSString *)previewTextForInteraction:(nullable TSInteraction *)interaction
+                            transaction:(YapDatabaseReadTransaction *)transaction
+{
+    if ([interaction conformsToProtocol:@protocol(OWSPreviewText)]) {
+        id<OWSPreviewText> previewable = (id<OWSPreviewText>)interaction;
+        return [previewable previewTextWithTransaction:transaction].filterStringForDisplay;
+    } else {
+        return @"";
+    }
+}
+
+#pragma mark - Updating
+
+// Applies the change to a copy of the thread's summary, and only writes it if the change made a difference.
++ (void)updateSummaryForThread:(TSThread *)thread
+                   transaction:(YapDatabaseReadWriteTransaction *)transaction
+                    usingBlock:(void (^)(OWSInboxSummary *summary))block
+{
+    OWSInboxSummary *_Nullable oldSummary = [self fetchObjectWithUniqueID:thread.uniqueId transaction:transaction];
+    if (!oldSummary) {
+        // e.g. the thread's first interaction.
+        [[self computedSummaryForThread:thread transaction:transaction] saveWithTransaction:transaction];
+        return;
+    }
+
+    OWSInboxSummary *summary = [oldSummary copy];
+    block(summary);
+    if (![summary isEqual:oldSummary]) {
+        [summary saveWithTransaction:transaction];
+    }
+}
+
++ (void)interactionWasSaved:(TSInteraction *)interaction
+                   inThread:(TSThread *)thread
+                transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(interaction.uniqueId.length > 0);
+    OWSAssertDebug(thread);
+
+    if (![self isBuiltWithTransaction:transaction]) {
+        return;
+    }
+
+    [self updateSummaryForThread:thread
+                     transaction:transaction
+                      usingBlock:^(OWSInboxSummary *summary) {
+                          [summary updateWithThread:thread transaction:transaction];
+
+                          if (![TSThread shouldInteractionAppearInInbox:interaction]) {
+                              return;
+                          }
+                          if (summary.lastInteractionId == nil ||
+                              [summary.lastInteractionId isEqualToString:interaction.uniqueId] ||
+                              interaction.timestampForSorting >= summary.lastInteractionTimestamp) {
+                              [summary updateWithLastInteraction:interaction transaction:transaction];
+                          }
+                      }];
+}
+
++ (void)interactionWasTouched:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (interaction.uniqueId.length < 1 || ![self isBuiltWithTransaction:transaction]) {
+        return;
+    }
+
+    // e.g. an attachment has been downloaded, which may change the preview.
+    OWSInboxSummary *_Nullable summary =
+        [self fetchObjectWithUniqueID:interaction.uniqueThreadId transaction:transaction];
+    if (![summary.lastInteractionId isEqualToString:interaction.uniqueId]) {
+        return;
+    }
+    NSString *previewText = [self previewTextForInteraction:interaction transaction:transaction];
+    if (![previewText isEqualToString:summary.previewText]) {
+        summary = [summary copy];
+        summary.previewText = previewText;
+        [summary saveWithTransaction:transaction];
+    }
+}
+
++ (void)interactionWasRemoved:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (interaction.uniqueId.length < 1 || ![self isBuiltWithTransaction:transaction]) {
+        return;
+    }
+
+    TSThread *_Nullable thread = [TSThread fetchObjectWithUniqueID:interaction.uniqueThreadId transaction:transaction];
+    if (!thread) {
+        return;
+    }
+
+    [self updateSummaryForThread:thread
+                     transaction:transaction
+                      usingBlock:^(OWSInboxSummary *summary) {
+                          [summary updateWithThread:thread transaction:transaction];
+
+                          if ([summary.lastInteractionId isEqualToString:interaction.uniqueId]) {
+                              [summary updateWithLastInteraction:[thread lastInteractionForInboxWithTransaction:transaction]
+                                                     transaction:transaction];
+                          }
+                      }];
+}
+
++ (void)threadWasSaved:(TSThread *)thread transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (thread.uniqueId.length < 1 || ![self isBuiltWithTransaction:transaction]) {
+        return;
+    }
+
+    [self updateSummaryForThread:thread
+                     transaction:transaction
+                      usingBlock:^(OWSInboxSummary *summary) {
+                          [summary updateWithThread:thread transaction:transaction];
+                      }];
+}
+
++ (void)threadWasRemoved:(TSThread *)thread transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (thread.uniqueId.length < 1) {
+        return;
+    }
+
+    [transaction removeObjectForKey:thread.uniqueId inCollection:[self collection]];
+}
+
+#pragma mark - Building
+
++ (BOOL)buildIfNecessaryWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if ([self isBuiltWithTransaction:transaction]) {
+        return NO;
+    }
+
+    DDLogInfo(@"%@ Building inbox summaries.", self.logTag);
+    [self rebuildWithTransaction:transaction];
+    return YES;
+}
+
++ (void)rebuildWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [transaction removeAllObjectsInCollection:[self collection]];
+
+    NSMutableArray<OWSInboxSummary *> *summaries = [NSMutableArray new];
+    [transaction enumerateKeysAndObjectsInCollection:[TSThread collection]
+                                          usingBlock:^(NSString *key, id object, BOOL *stop) {
+                                              if (![object isKindOfClass:[TSThread class]]) {
+                                                  OWSFailDebug(@"%@ Unexpected object in thread collection: %@",
+                                                      self.logTag,
+                                                      [object class]);
+                                                  return;
+                                              }
+                                              [summaries addObject:[self computedSummaryForThread:object
+                                                                                       transaction:transaction]];
+                                          }];
+    // Written after enumerating, since the database can't be changed during an enumeration.
+    for (OWSInboxSummary *summary in summaries) {
+        [summary saveWithTransaction:transaction];
+    }
+    [transaction setObject:@(YES) forKey:OWSInboxSummaryBuiltKey inCollection:OWSInboxSummaryStateCollection];
+
+    DDLogInfo(@"%@ Built %lu inbox summaries.", self.logTag, (unsigned long)summaries.count);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -196,16 +196,19 @@ NS_ASSUME_NONNULL_BEGIN
     OWSAssertDebug(successBlock);
     OWSAssertDebug(failureBlock);
 
-    // Check whether we need to refresh our PreKeys every time we receive a PreKeyWhisperMessage.
-    [TSPreKeyManager checkPreKeys];
-
     [self decryptEnvelope:envelope
             cipherTypeName:@"PreKey Bundle"
         cipherMessageBlock:^id<CipherMessage> _Nonnull(NSData * _Nonnull encryptedData) {
             return [[PreKeyWhisperMessage alloc] init_throws_withData:encryptedData];
         }
-              successBlock:successBlock
-              failureBlock:failureBlock];
+        successBlock:^(NSData *_Nullable plaintextData, YapDatabaseReadWriteTransaction *transaction) {
+            successBlock(plaintextData, transaction);
+
+            // Check whether we need to refresh our PreKeys every time we receive a PreKeyWhisperMessage,
+            // once its prekey has been used.
+            [TSPreKeyManager checkPreKeysLocally];
+        }
+        failureBlock:failureBlock];
 }
 
 - (void)decryptEnvelope:(SSKEnvelope *)envelope
@@ -253,6 +256,7 @@ NS_ASSUME_NONNULL_BEGIN
                     failureBlock(error);
                 });
             }
+            [primaryStorage flushSessionStoreWithTransaction:transaction];
         }];
 }
 
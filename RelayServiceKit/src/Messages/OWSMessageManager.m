@@ -39,7 +39,7 @@
 #import "TSQuotedMessage.h"
 #import "TextSecureKitEnv.h"
 #import <RelayServiceKit/RelayServiceKit-Swift.h>
-#import "FLCCSMJSONService.h"
+#import "FLMessageBody.h"
 #import "SSKAsserts.h"
 
 @import SignalCoreKit;
@@ -375,16 +375,31 @@ NS_ASSUME_NONNULL_BEGIN
         }
     }
     
+    // The body is only parsed here; the handlers share the result.
+    FLMessageBody *_Nullable messageBody = [FLMessageBody messageBodyWithString:dataMessage.body];
+
     if ((dataMessage.flags & OWSSignalServiceProtosDataMessageFlagsEndSession) != 0) {
-        [self handleEndSessionMessageWithEnvelope:envelope dataMessage:dataMessage transaction:transaction];
+        [self handleEndSessionMessageWithEnvelope:envelope
+                                      dataMessage:dataMessage
+                                      messageBody:messageBody
+                                      transaction:transaction];
     } else if ((dataMessage.flags & OWSSignalServiceProtosDataMessageFlagsExpirationTimerUpdate) != 0) {
-        [self handleExpirationTimerUpdateMessageWithEnvelope:envelope dataMessage:dataMessage transaction:transaction];
+        [self handleExpirationTimerUpdateMessageWithEnvelope:envelope
+                                                 dataMessage:dataMessage
+                                                 messageBody:messageBody
+                                                 transaction:transaction];
     } else if ((dataMessage.flags & OWSSignalServiceProtosDataMessageFlagsProfileKeyUpdate) != 0) {
         [self handleProfileKeyMessageWithEnvelope:envelope dataMessage:dataMessage];
     } else if (dataMessage.attachments.count > 0) {
-        [self handleReceivedMediaWithEnvelope:envelope dataMessage:dataMessage transaction:transaction];
+        [self handleReceivedMediaWithEnvelope:envelope
+                                  dataMessage:dataMessage
+                                  messageBody:messageBody
+                                  transaction:transaction];
     } else {
-        [self handleReceivedTextMessageWithEnvelope:envelope dataMessage:dataMessage transaction:transaction];
+        [self handleReceivedTextMessageWithEnvelope:envelope
+                                        dataMessage:dataMessage
+                                        messageBody:messageBody
+                                        transaction:transaction];
     }
 }
 
@@ -430,6 +445,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)handleReceivedMediaWithEnvelope:(SSKEnvelope *)envelope
                             dataMessage:(OWSSignalServiceProtosDataMessage *)dataMessage
+                            messageBody:(nullable FLMessageBody *)messageBody
                             transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
     OWSAssertDebug(envelope);
@@ -447,6 +463,7 @@ NS_ASSUME_NONNULL_BEGIN
     
     TSIncomingMessage *_Nullable createdMessage = [self handleReceivedEnvelope:envelope
                                                                withDataMessage:dataMessage
+                                                                   messageBody:messageBody
                                                                  attachmentIds:attachmentsProcessor.attachmentIds
                                                                    transaction:transaction];
     
@@ -487,20 +504,19 @@ NS_ASSUME_NONNULL_BEGIN
     }
     
     if (syncMessage.hasSent) {
-        NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody: syncMessage.sent.message.body];
-        if (jsonPayload == nil) {
+        FLMessageBody *_Nullable messageBody = [FLMessageBody messageBodyWithString:syncMessage.sent.message.body];
+        if (messageBody == nil) {
             OWSFailDebug(@"sync message with no body");
             return;
         }
-        NSString *threadId = [jsonPayload objectForKey:FLThreadIDKey];
-        if (threadId == nil) {
+        if (messageBody.threadId == nil) {
             OWSFailDebug(@"sync message body had no threadId");
             return;
         }
         OWSIncomingSentMessageTranscript *transcript =
         [[OWSIncomingSentMessageTranscript alloc] initWithProto:syncMessage.sent
                                                    sourceDevice:envelope.sourceDevice
-                                                       threadId:threadId
+                                                    messageBody:messageBody
                                                     transaction:transaction];
         
         OWSRecordTranscriptJob *recordJob =
@@ -531,21 +547,23 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)handleEndSessionMessageWithEnvelope:(SSKEnvelope *)envelope
                                 dataMessage:(OWSSignalServiceProtosDataMessage *)dataMessage
+                                messageBody:(nullable FLMessageBody *)messageBody
                                 transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
     OWSAssertDebug(envelope);
     OWSAssertDebug(dataMessage);
     OWSAssertDebug(transaction);
     
-    NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:dataMessage.body];
-    TSThread *thread = [TSThread getOrCreateThreadWithPayload:jsonPayload transaction:transaction];
+    TSThread *_Nullable thread = nil;
+    if (messageBody) {
+        thread = [TSThread getOrCreateThreadWithPayload:messageBody.payload transaction:transaction];
+    }
     if (thread == nil) {
         OWSFailDebug(@"%@: unable to build thread for end session message.", self.logTag);
         return;
     }
     
-    NSDictionary *dataBlob = [jsonPayload objectForKey:@"data"];
-    if ([dataBlob allKeys].count == 0) {
+    if (messageBody.data == nil) {
         OWSFailDebug(@"Received message contained no data object.");
         return;
     }
@@ -560,14 +578,17 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)handleExpirationTimerUpdateMessageWithEnvelope:(SSKEnvelope *)envelope
                                            dataMessage:(OWSSignalServiceProtosDataMessage *)dataMessage
+                                           messageBody:(nullable FLMessageBody *)messageBody
                                            transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
     OWSAssertDebug(envelope);
     OWSAssertDebug(dataMessage);
     OWSAssertDebug(transaction);
     
-    NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:dataMessage.body];
-    TSThread *thread = [TSThread getOrCreateThreadWithPayload:jsonPayload transaction:transaction];
+    TSThread *_Nullable thread = nil;
+    if (messageBody) {
+        thread = [TSThread getOrCreateThreadWithPayload:messageBody.payload transaction:transaction];
+    }
     
     if (thread == nil) {
         DDLogDebug(@"%@: unable to build thread for received envelope.", self.logTag);
@@ -630,13 +651,18 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)handleReceivedTextMessageWithEnvelope:(SSKEnvelope *)envelope
                                   dataMessage:(OWSSignalServiceProtosDataMessage *)dataMessage
+                                  messageBody:(nullable FLMessageBody *)messageBody
                                   transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
     OWSAssertDebug(envelope);
     OWSAssertDebug(dataMessage);
     OWSAssertDebug(transaction);
     
-    [self handleReceivedEnvelope:envelope withDataMessage:dataMessage attachmentIds:@[] transaction:transaction];
+    [self handleReceivedEnvelope:envelope
+                 withDataMessage:dataMessage
+                     messageBody:messageBody
+                   attachmentIds:@[]
+                     transaction:transaction];
 }
 
 
@@ -729,6 +755,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (TSIncomingMessage *_Nullable)handleReceivedEnvelope:(SSKEnvelope *)envelope
                                        withDataMessage:(OWSSignalServiceProtosDataMessage *)dataMessage
+                                           messageBody:(nullable FLMessageBody *)messageBody
                                          attachmentIds:(NSArray<NSString *> *)attachmentIds
                                            transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
@@ -737,39 +764,42 @@ NS_ASSUME_NONNULL_BEGIN
     OWSAssertDebug(transaction);
     
     //  Catch incoming messages and process the new way.
-    NSString *body = dataMessage.body;
-    NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:body];
-    NSDictionary *dataBlob = [jsonPayload objectForKey:@"data"];
-    if ([dataBlob allKeys].count == 0) {
+    if (messageBody.data == nil) {
         DDLogDebug(@"Received message contained no data object.");
         return nil;
     }
     
     // Process per messageType
-    if ([[jsonPayload objectForKey:FLMessageTypeKey] isEqualToString:FLMessageTypeControlKey]) {
-        IncomingControlMessage *controlMessage = [[IncomingControlMessage alloc] initWithTimestamp:envelope.timestamp
-                                                                                         serverAge:envelope.age
-                                                                                            author:envelope.source
-                                                                                            device:envelope.sourceDevice
-                                                                                           payload:jsonPayload
-                                                                                       attachments:dataMessage.attachments];
-            [ControlMessageManager processIncomingControlMessageWithMessage:controlMessage transaction:transaction];
+    if (messageBody.isControlMessage) {
+        IncomingControlMessage *_Nullable controlMessage =
+            [[IncomingControlMessage alloc] initWithTimestamp:envelope.timestamp
+                                                    serverAge:envelope.age
+                                                       author:envelope.source
+                                                       device:envelope.sourceDevice
+                                                  messageBody:messageBody
+                                                  attachments:dataMessage.attachments];
+        if (controlMessage == nil) {
+            DDLogDebug(@"%@ Ignoring invalid control message.", self.logTag);
+            return nil;
+        }
+        [ControlMessageManager processIncomingControlMessageWithMessage:controlMessage transaction:transaction];
         return nil;
         
-    } else if ([[jsonPayload objectForKey:FLMessageTypeKey] isEqualToString:FLMessageTypeContentKey]) {
+    } else if (messageBody.isContentMessage) {
         // Process per Thread type
-        if ([[jsonPayload objectForKey:FLThreadTypeKey] isEqualToString:FLThreadTypeConversation] ||
-            [[jsonPayload objectForKey:FLThreadTypeKey] isEqualToString:FLThreadTypeAnnouncement]) {
+        if ([messageBody.threadType isEqualToString:FLThreadTypeConversation] ||
+            [messageBody.threadType isEqualToString:FLThreadTypeAnnouncement]) {
             return [self handleThreadContentMessageWithEnvelope:envelope
                                                 withDataMessage:dataMessage
+                                                    messageBody:messageBody
                                                   attachmentIds:attachmentIds
                                                     transaction:transaction];
         } else {
-            DDLogDebug(@"%@ Unhandled thread type: %@", self.logTag, [jsonPayload objectForKey:FLThreadTypeKey]);
+            DDLogDebug(@"%@ Unhandled thread type: %@", self.logTag, messageBody.threadType);
             return nil;
         }
     } else {
-        DDLogDebug(@"%@ Unhandled message type: %@", self.logTag, [jsonPayload objectForKey:FLMessageTypeKey]);
+        DDLogDebug(@"%@ Unhandled message type: %@", self.logTag, messageBody.messageType);
         return nil;
     }
 }
@@ -777,16 +807,15 @@ NS_ASSUME_NONNULL_BEGIN
 #pragma mark - message handlers by type
 -(TSIncomingMessage *)handleThreadContentMessageWithEnvelope:(SSKEnvelope *)envelope
                                              withDataMessage:(OWSSignalServiceProtosDataMessage *)dataMessage
+                                                 messageBody:(FLMessageBody *)messageBody
                                                attachmentIds:(NSArray<NSString *> *)attachmentIds
                                                  transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
-    NSDictionary *jsonPayload = [FLCCSMJSONService payloadDictionaryFromMessageBody:dataMessage.body];
-    
     // getOrCreate a thread and an incomingMessage
-    TSThread *thread = [TSThread getOrCreateThreadWithPayload:jsonPayload transaction:transaction];
+    TSThread *thread = [TSThread getOrCreateThreadWithPayload:messageBody.payload transaction:transaction];
 
     // Check to see if we already have this message
-    NSString *messageId = [jsonPayload objectForKey:FLMessageIdKey];
+    NSString *messageId = messageBody.messageId;
     if (messageId.length == 0) {
         DDLogError(@"%@: received message with no id.", self.logTag);
         return nil;
@@ -800,7 +829,7 @@ NS_ASSUME_NONNULL_BEGIN
     }
     
     // Quoted/Replay message handling
-    NSString *messageRefString = [jsonPayload objectForKey:@"messageRef"];
+    NSString *messageRefString = messageBody.messageRef;
     TSQuotedMessage *quotedMessage = nil;
     if (messageRefString.length > 0) {
         TSMessage *parentMessage = [TSMessage fetchObjectWithUniqueID:messageRefString transaction:transaction];
@@ -832,9 +861,9 @@ NS_ASSUME_NONNULL_BEGIN
                                                                  expiresInSeconds:dataMessage.expireTimer
                                                                     quotedMessage:quotedMessage];
     
-    incomingMessage.uniqueId = [jsonPayload objectForKey:FLMessageIdKey];
-    incomingMessage.messageType = [jsonPayload objectForKey:FLMessageTypeKey];
-    incomingMessage.forstaPayload = jsonPayload;
+    incomingMessage.uniqueId = messageId;
+    incomingMessage.messageType = messageBody.messageType;
+    incomingMessage.forstaPayload = messageBody.payload;
     [incomingMessage saveWithTransaction:transaction];
     
     if (incomingMessage && thread) {
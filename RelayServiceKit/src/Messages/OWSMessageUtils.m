@@ -7,10 +7,10 @@
 #import "MIMETypeUtil.h"
 #import "MessageSender.h"
 #import "OWSPrimaryStorage.h"
+#import "OWSUnreadCounter.h"
 #import "TSAccountManager.h"
 #import "TSAttachment.h"
 #import "TSAttachmentStream.h"
-#import "TSDatabaseView.h"
 #import "TSIncomingMessage.h"
 #import "TSMessage.h"
 #import "TSOutgoingMessage.h"
@@ -69,7 +69,7 @@ NS_ASSUME_NONNULL_BEGIN
 {
     __block NSUInteger numberOfItems;
     [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
-        numberOfItems = [[transaction ext:TSUnreadDatabaseViewExtensionName] numberOfItemsInAllGroups];
+        numberOfItems = [OWSUnreadCounter totalUnreadCountWithTransaction:transaction];
     }];
 
     return numberOfItems;
@@ -79,9 +79,8 @@ NS_ASSUME_NONNULL_BEGIN
 {
     __block NSUInteger numberOfItems;
     [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
-        id databaseView = [transaction ext:TSUnreadDatabaseViewExtensionName];
-        OWSAssertDebug(databaseView);
-        numberOfItems = ([databaseView numberOfItemsInAllGroups] - [databaseView numberOfItemsInGroup:thread.uniqueId]);
+        numberOfItems = ([OWSUnreadCounter totalUnreadCountWithTransaction:transaction] -
+            [OWSUnreadCounter unreadCountForThreadId:thread.uniqueId transaction:transaction]);
     }];
 
     return numberOfItems;
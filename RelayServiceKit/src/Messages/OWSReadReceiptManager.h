@@ -58,12 +58,24 @@ extern NSString *const kIncomingMessageMarkedAsReadNotification;
 
 
 #pragma mark - Control message read mark handler
+
+// Read marks only move forward: each recipient has a "read watermark" per thread,
+// and only the outgoing messages which a read mark newly covers are updated.
 - (void)markAsReadByRecipientId:(NSString *)recipientId
            beforeTimestamp:(uint64_t)timestamp
                     thread:(TSThread *)thread
                   wasLocal:(BOOL)wasLocal
                transaction:(YapDatabaseReadWriteTransaction *)transaction;
 
+// The timestamp of the latest read mark of each recipient in the thread, keyed by recipient id.
++ (NSDictionary<NSString *, NSNumber *> *)readWatermarksForThreadId:(NSString *)threadId
+                                                       transaction:(YapDatabaseReadTransaction *)transaction;
+
+// The timestamp of the latest read mark from this recipient in this thread, or 0 if there hasn't been one.
+- (uint64_t)readWatermarkForRecipientId:(NSString *)recipientId
+                                 thread:(TSThread *)thread
+                            transaction:(YapDatabaseReadTransaction *)transaction;
+
 #pragma mark - Locally Read
 
 // This method cues this manager:
@@ -115,6 +115,8 @@ NSString *const kIncomingMessageMarkedAsReadNotification = @"kIncomingMessageMar
 #pragma mark -
 
 NSString *const OWSReadReceiptManagerCollection = @"OWSReadReceiptManagerCollection";
+// Map of "thread id"-to-("recipient id"-to-"read watermark").
+NSString *const OWSReadReceiptManagerReadWatermarkCollection = @"OWSReadReceiptManagerReadWatermarkCollection";
 NSString *const OWSReadReceiptManagerAreReadReceiptsEnabled = @"areReadReceiptsEnabled";
 
 @interface OWSReadReceiptManager ()
@@ -548,11 +550,30 @@ NSString *const OWSReadReceiptManagerAreReadReceiptsEnabled = @"areReadReceiptsE
     OWSAssertDebug(thread);
     OWSAssertDebug(transaction);
     OWSAssertDebug(recipientId);
-    
+
+    NSDictionary<NSString *, NSNumber *> *_Nullable watermarks =
+        [transaction objectForKey:thread.uniqueId inCollection:OWSReadReceiptManagerReadWatermarkCollection];
+    uint64_t previousWatermark = [watermarks[recipientId] unsignedLongLongValue];
+    if (timestamp <= previousWatermark) {
+        // Everything this read mark covers was covered by an earlier one.
+        return;
+    }
+
+    NSMutableDictionary<NSString *, NSNumber *> *newWatermarks
+        = (watermarks ? [watermarks mutableCopy] : [NSMutableDictionary new]);
+    newWatermarks[recipientId] = @(timestamp);
+    [transaction setObject:[newWatermarks copy]
+                    forKey:thread.uniqueId
+              inCollection:OWSReadReceiptManagerReadWatermarkCollection];
+
     NSMutableArray<TSOutgoingMessage *> *newlyReadList = [NSMutableArray new];
-    
+
+    // Messages are sorted by timestamp, so walk back from the newest until we pass the
+    // previous watermark.  Every message beyond that point was either covered by an
+    // earlier read mark or, if it was saved since, marked as it was saved.
     [[TSDatabaseView threadOutgoingMessageDatabaseView:transaction]
      enumerateRowsInGroup:thread.uniqueId
+     withOptions:NSEnumerationReverse
      usingBlock:^(NSString *collection,
                   NSString *key,
                   id object,
@@ -562,22 +583,45 @@ NSString *const OWSReadReceiptManagerAreReadReceiptsEnabled = @"areReadReceiptsE
          
          // This method should only be processing TSOutgoingMessages objects
          TSOutgoingMessage *possiblyRead = (TSOutgoingMessage *)object;
+
+         if (previousWatermark > 0 && possiblyRead.timestamp <= previousWatermark) {
+             *stop = YES;
+             return;
+         }
          
          if (possiblyRead.timestamp <= timestamp) {
              [newlyReadList addObject:possiblyRead];
          }
      }];
     
-    if (newlyReadList.count > 0) {
-        for (TSOutgoingMessage *readMessage in newlyReadList) {
-            [readMessage updateWithReadRecipientId:recipientId
-                                     readTimestamp:timestamp
-                                       transaction:transaction];
-        }
-        
+    for (TSOutgoingMessage *readMessage in newlyReadList) {
+        [readMessage updateWithReadRecipientId:recipientId readTimestamp:timestamp transaction:transaction];
     }
 }
 
+- (uint64_t)readWatermarkForRecipientId:(NSString *)recipientId
+                                 thread:(TSThread *)thread
+                            transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(thread);
+    OWSAssertDebug(transaction);
+
+    return [[OWSReadReceiptManager readWatermarksForThreadId:thread.uniqueId transaction:transaction][recipientId]
+        unsignedLongLongValue];
+}
+
++ (NSDictionary<NSString *, NSNumber *> *)readWatermarksForThreadId:(NSString *)threadId
+                                                       transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSAssertDebug(threadId.length > 0);
+    OWSAssertDebug(transaction);
+
+    NSDictionary<NSString *, NSNumber *> *_Nullable watermarks =
+        [transaction objectForKey:threadId inCollection:OWSReadReceiptManagerReadWatermarkCollection];
+    return watermarks ?: @{};
+}
+
 #pragma mark - Settings
 
 - (void)prepareCachedValues
@@ -0,0 +1,46 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class OWSPrimaryStorage;
+@class TSThread;
+
+// Posted on the main thread as a thread deletion makes progress.  The userInfo contains the keys below.
+extern NSString *const OWSThreadDeletionJobProgressNotification;
+extern NSString *const OWSThreadDeletionJobThreadIdKey;
+extern NSString *const OWSThreadDeletionJobDeletedCountKey;
+extern NSString *const OWSThreadDeletionJobTotalCountKey;
+
+// Called on the main thread.  `totalCount` is the number of interactions the thread had when it was deleted.
+typedef void (^OWSThreadDeletionProgressBlock)(NSUInteger deletedCount, NSUInteger totalCount);
+typedef void (^OWSThreadDeletionCompletionBlock)(void);
+
+// Deletes threads in the background.
+//
+// The thread itself is removed immediately, so that it disappears from the inbox, and a tombstone recording
+// the deletion is saved alongside it.  Its interactions (and their attachments) are then removed in short
+// transactions of bounded size, updating the tombstone as they go.  Tombstones survive relaunch;
+// -startIfNecessary resumes any deletions which didn't finish.
+//
+// Only interactions which sorted no later than the thread's last interaction at the time of deletion are
+// removed, so that messages which arrive afterwards (recreating the thread) are kept.
+@interface OWSThreadDeletionJob : NSObject
+
++ (instancetype)sharedJob;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithPrimaryStorage:(OWSPrimaryStorage *)primaryStorage NS_DESIGNATED_INITIALIZER;
+
+- (void)deleteThread:(TSThread *)thread
+            progress:(nullable OWSThreadDeletionProgressBlock)progress
+          completion:(nullable OWSThreadDeletionCompletionBlock)completion;
+
+// Resumes unfinished deletions, e.g. from before the app was last terminated.
+- (void)startIfNecessary;
+
+@end
+
+NS_ASSUME_NONNULL_END
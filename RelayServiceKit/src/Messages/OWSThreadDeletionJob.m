@@ -0,0 +1,371 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSThreadDeletionJob.h"
+#import "NSNotificationCenter+OWS.h"
+#import "OWSBackgroundTask.h"
+#import "OWSPrimaryStorage.h"
+#import "TSDatabaseView.h"
+#import "TSInteraction.h"
+#import "TSThread.h"
+#import "SSKAsserts.h"
+#import <YapDatabase/YapDatabase.h>
+#import <YapDatabase/YapDatabaseView.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+NSString *const OWSThreadDeletionJobProgressNotification = @"OWSThreadDeletionJobProgressNotification";
+NSString *const OWSThreadDeletionJobThreadIdKey = @"threadId";
+NSString *const OWSThreadDeletionJobDeletedCountKey = @"deletedCount";
+NSString *const OWSThreadDeletionJobTotalCountKey = @"totalCount";
+
+// Tombstones, keyed by thread id.
+static NSString *const OWSThreadDeletionJobCollection = @"OWSThreadDeletionJobCollection";
+static NSString *const OWSThreadDeletionTombstoneMaxTimestampForSortingKey = @"maxTimestampForSorting";
+
+static const NSUInteger kThreadDeletionChunkSize = 200;
+static const NSTimeInterval kThreadDeletionChunkDuration = 0.05;
+static const NSTimeInterval kThreadDeletionChunkInterval = 0.05;
+
+@interface OWSThreadDeletionJob ()
+
+@property (nonatomic, readonly) YapDatabaseConnection *databaseConnection;
+@property (nonatomic, readonly) dispatch_queue_t serialQueue;
+
+// The most interactions removed in one transaction.
+@property (nonatomic) NSUInteger chunkSize;
+// Roughly the longest one transaction will spend removing interactions.
+@property (nonatomic) NSTimeInterval chunkDuration;
+// The pause between chunks.
+@property (nonatomic) NSTimeInterval chunkInterval;
+
+// The following should only be accessed on the serial queue.
+@property (nonatomic, readonly) NSMutableSet<NSString *> *activeThreadIds;
+@property (nonatomic, readonly)
+    NSMutableDictionary<NSString *, NSMutableArray<OWSThreadDeletionProgressBlock> *> *progressBlocks;
+@property (nonatomic, readonly)
+    NSMutableDictionary<NSString *, NSMutableArray<OWSThreadDeletionCompletionBlock> *> *completionBlocks;
+
+@end
+
+#pragma mark -
+
+@implementation OWSThreadDeletionJob
+
++ (instancetype)sharedJob
+{
+    static OWSThreadDeletionJob *sharedJob = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedJob = [[self alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]];
+    });
+    return sharedJob;
+}
+
+- (instancetype)initWithPrimaryStorage:(OWSPrimaryStorage *)primaryStorage
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _databaseConnection = primaryStorage.newDatabaseConnection;
+    _serialQueue = dispatch_queue_create("org.whispersystems.thread.deletion", DISPATCH_QUEUE_SERIAL);
+    _chunkSize = kThreadDeletionChunkSize;
+    _chunkDuration = kThreadDeletionChunkDuration;
+    _chunkInterval = kThreadDeletionChunkInterval;
+    _activeThreadIds = [NSMutableSet new];
+    _progressBlocks = [NSMutableDictionary new];
+    _completionBlocks = [NSMutableDictionary new];
+
+    OWSSingletonAssert();
+
+    return self;
+}
+
+- (void)assertIsOnSerialQueue
+{
+#ifdef DEBUG
+    if (@available(iOS 10.0, *)) {
+        dispatch_assert_queue(self.serialQueue);
+    }
+#endif
+}
+
+#pragma mark -
+
+- (void)deleteThread:(TSThread *)thread
+            progress:(nullable OWSThreadDeletionProgressBlock)progress
+          completion:(nullable OWSThreadDeletionCompletionBlock)completion
+{
+    OWSAssertDebug(thread.uniqueId.length > 0);
+
+    NSString *threadId = thread.uniqueId;
+    dispatch_async(self.serialQueue, ^{
+        if (progress) {
+            [self addBlock:progress forThreadId:threadId toDictionary:self.progressBlocks];
+        }
+        if (completion) {
+            [self addBlock:completion forThreadId:threadId toDictionary:self.completionBlocks];
+        }
+
+        __block NSUInteger deletedCount = 0;
+        __block NSUInteger totalCount = 0;
+        [self.databaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+            NSDictionary *_Nullable tombstone = [self saveTombstoneForThread:thread transaction:transaction];
+            if (tombstone) {
+                deletedCount = [tombstone[OWSThreadDeletionJobDeletedCountKey] unsignedIntegerValue];
+                totalCount = [tombstone[OWSThreadDeletionJobTotalCountKey] unsignedIntegerValue];
+            }
+
+            // -[TSThread removeWithTransaction:] would also remove every interaction in this transaction.
+            [thread removeKeepingInteractionsWithTransaction:transaction];
+        }];
+
+        DDLogInfo(@"%@ Deleting thread: %@ with %lu interactions.", self.logTag, threadId, (unsigned long)totalCount);
+
+        [self reportProgressForThreadId:threadId deletedCount:deletedCount totalCount:totalCount];
+        [self processThreadId:threadId];
+    });
+}
+
+// Saves (or extends) the thread's tombstone.  Returns nil if the thread has nothing left to remove.
+- (nullable NSDictionary *)saveTombstoneForThread:(TSThread *)thread
+                                      transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    YapDatabaseViewTransaction *interactionsByThread = [transaction ext:TSMessageDatabaseViewExtensionName];
+    OWSAssertDebug(interactionsByThread);
+
+    NSDictionary *_Nullable existingTombstone =
+        [transaction objectForKey:thread.uniqueId inCollection:OWSThreadDeletionJobCollection];
+    uint64_t maxTimestampForSorting =
+        [existingTombstone[OWSThreadDeletionTombstoneMaxTimestampForSortingKey] unsignedLongLongValue];
+    NSUInteger deletedCount = [existingTombstone[OWSThreadDeletionJobDeletedCountKey] unsignedIntegerValue];
+
+    NSUInteger interactionCount = [interactionsByThread numberOfItemsInGroup:thread.uniqueId];
+    TSInteraction *_Nullable lastInteraction = [interactionsByThread lastObjectInGroup:thread.uniqueId];
+    if ([lastInteraction isKindOfClass:[TSInteraction class]]) {
+        maxTimestampForSorting = MAX(maxTimestampForSorting, lastInteraction.timestampForSorting);
+    }
+
+    if (interactionCount < 1) {
+        [transaction removeObjectForKey:thread.uniqueId inCollection:OWSThreadDeletionJobCollection];
+        return nil;
+    }
+
+    NSDictionary *tombstone = @{
+        OWSThreadDeletionTombstoneMaxTimestampForSortingKey : @(maxTimestampForSorting),
+        OWSThreadDeletionJobDeletedCountKey : @(deletedCount),
+        OWSThreadDeletionJobTotalCountKey : @(deletedCount + interactionCount),
+    };
+    [transaction setObject:tombstone forKey:thread.uniqueId inCollection:OWSThreadDeletionJobCollection];
+    return tombstone;
+}
+
+- (void)startIfNecessary
+{
+    dispatch_async(self.serialQueue, ^{
+        __block NSArray<NSString *> *threadIds;
+        [self.databaseConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+            threadIds = [transaction allKeysInCollection:OWSThreadDeletionJobCollection];
+        }];
+
+        if (threadIds.count > 0) {
+            DDLogInfo(@"%@ Resuming %lu thread deletions.", self.logTag, (unsigned long)threadIds.count);
+        }
+        for (NSString *threadId in threadIds) {
+            [self processThreadId:threadId];
+        }
+    });
+}
+
+#pragma mark - Chunks
+
+// Removes chunks of the thread's interactions until none remain, yielding between chunks so that other
+// writes, e.g. incoming messages, and UI reads can proceed.
+- (void)processThreadId:(NSString *)threadId
+{
+    [self assertIsOnSerialQueue];
+
+    if ([self.activeThreadIds containsObject:threadId]) {
+        return;
+    }
+    [self.activeThreadIds addObject:threadId];
+
+    [self processNextChunkForThreadId:threadId];
+}
+
+- (void)processNextChunkForThreadId:(NSString *)threadId
+{
+    [self assertIsOnSerialQueue];
+
+    BOOL hasMore = NO;
+    [self deleteChunkForThreadId:threadId hasMore:&hasMore];
+
+    if (!hasMore) {
+        [self.activeThreadIds removeObject:threadId];
+        [self.progressBlocks removeObjectForKey:threadId];
+        NSArray<OWSThreadDeletionCompletionBlock> *completionBlocks = [self.completionBlocks[threadId] copy];
+        [self.completionBlocks removeObjectForKey:threadId];
+        if (completionBlocks.count > 0) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                for (OWSThreadDeletionCompletionBlock completion in completionBlocks) {
+                    completion();
+                }
+            });
+        }
+        return;
+    }
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.chunkInterval * NSEC_PER_SEC)),
+        self.serialQueue,
+        ^{
+            [self processNextChunkForThreadId:threadId];
+        });
+}
+
+// Removes a bounded chunk of the thread's interactions in a single short transaction and records the progress
+// in the thread's tombstone, removing the tombstone once the thread is done.
+//
+// Sets `hasMore` if the thread has interactions left to remove.
+- (void)deleteChunkForThreadId:(NSString *)threadId hasMore:(BOOL *)hasMore
+{
+    [self assertIsOnSerialQueue];
+
+    OWSBackgroundTask *_Nullable backgroundTask = [OWSBackgroundTask backgroundTaskWithLabelStr:__PRETTY_FUNCTION__];
+
+    __block BOOL isDone = NO;
+    __block NSUInteger chunkCount = 0;
+    __block NSUInteger deletedCount = 0;
+    __block NSUInteger totalCount = 0;
+    [self.databaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        NSDictionary *_Nullable tombstone =
+            [transaction objectForKey:threadId inCollection:OWSThreadDeletionJobCollection];
+        if (![tombstone isKindOfClass:[NSDictionary class]]) {
+            isDone = YES;
+            return;
+        }
+        uint64_t maxTimestampForSorting =
+            [tombstone[OWSThreadDeletionTombstoneMaxTimestampForSortingKey] unsignedLongLongValue];
+        deletedCount = [tombstone[OWSThreadDeletionJobDeletedCountKey] unsignedIntegerValue];
+        totalCount = [tombstone[OWSThreadDeletionJobTotalCountKey] unsignedIntegerValue];
+
+        // Deleted interactions leave the view, so the next chunk is always at the start of the group.
+        NSMutableArray<NSString *> *interactionIds = [NSMutableArray new];
+        __block BOOL didDetectCorruption = NO;
+        YapDatabaseViewTransaction *interactionsByThread = [transaction ext:TSMessageDatabaseViewExtensionName];
+        OWSAssertDebug(interactionsByThread);
+        [interactionsByThread enumerateKeysInGroup:threadId
+                                       withOptions:0
+                                             range:NSMakeRange(0, self.chunkSize)
+                                        usingBlock:^(NSString *collection, NSString *key, NSUInteger index, BOOL *stop) {
+                                            if (![key isKindOfClass:[NSString class]] || key.length < 1) {
+                                                OWSFailDebug(@"%@ invalid key in thread interactions: %@, %@.",
+                                                    self.logTag,
+                                                    key,
+                                                    [key class]);
+                                                didDetectCorruption = YES;
+                                                *stop = YES;
+                                                return;
+                                            }
+                                            [interactionIds addObject:key];
+                                        }];
+
+        if (didDetectCorruption) {
+            // Leave the tombstone in place and try again after the view has been repaired.
+            [NSNotificationCenter.defaultCenter
+                postNotificationNameAsync:FLICorruptViewExtensionNotification
+                                   object:nil
+                                 userInfo:@{ @"viewName" : TSMessageDatabaseViewExtensionName }];
+            return;
+        }
+
+        CFAbsoluteTime startedAt = CFAbsoluteTimeGetCurrent();
+        BOOL didReachEnd = interactionIds.count < self.chunkSize;
+        for (NSString *interactionId in interactionIds) {
+            if (chunkCount > 0 && CFAbsoluteTimeGetCurrent() - startedAt > self.chunkDuration) {
+                // Removing interactions with attachments can be slow.  Leave the rest for the next chunk.
+                didReachEnd = NO;
+                break;
+            }
+
+            // We need to fetch each interaction, since [TSInteraction removeWithTransaction:] does important work,
+            // e.g. removing attachments.
+            TSInteraction *_Nullable interaction =
+                [TSInteraction fetchObjectWithUniqueID:interactionId transaction:transaction];
+            if (!interaction) {
+                OWSFailDebug(@"%@ couldn't load thread's interaction for deletion.", self.logTag);
+                continue;
+            }
+            if (interaction.timestampForSorting > maxTimestampForSorting) {
+                // The view is sorted, so this and everything after it arrived after the thread was deleted.
+                didReachEnd = YES;
+                break;
+            }
+            [interaction removeWithTransaction:transaction];
+            chunkCount++;
+        }
+
+        deletedCount = MIN(deletedCount + chunkCount, totalCount);
+        if (didReachEnd) {
+            [transaction removeObjectForKey:threadId inCollection:OWSThreadDeletionJobCollection];
+            deletedCount = totalCount;
+            isDone = YES;
+        } else {
+            NSMutableDictionary *updatedTombstone = [tombstone mutableCopy];
+            updatedTombstone[OWSThreadDeletionJobDeletedCountKey] = @(deletedCount);
+            [transaction setObject:[updatedTombstone copy] forKey:threadId inCollection:OWSThreadDeletionJobCollection];
+        }
+    }];
+
+    backgroundTask = nil;
+
+    if (totalCount > 0) {
+        [self reportProgressForThreadId:threadId deletedCount:deletedCount totalCount:totalCount];
+    }
+    if (isDone) {
+        DDLogInfo(@"%@ Finished deleting thread: %@", self.logTag, threadId);
+    }
+    // If nothing could be removed, e.g. because the view is corrupt, don't spin on the same interactions.
+    *hasMore = !isDone && chunkCount > 0;
+}
+
+#pragma mark - Progress
+
+- (void)addBlock:(id)block forThreadId:(NSString *)threadId toDictionary:(NSMutableDictionary *)dictionary
+{
+    [self assertIsOnSerialQueue];
+
+    NSMutableArray *_Nullable blocks = dictionary[threadId];
+    if (!blocks) {
+        blocks = [NSMutableArray new];
+        dictionary[threadId] = blocks;
+    }
+    [blocks addObject:[block copy]];
+}
+
+- (void)reportProgressForThreadId:(NSString *)threadId
+                     deletedCount:(NSUInteger)deletedCount
+                       totalCount:(NSUInteger)totalCount
+{
+    [self assertIsOnSerialQueue];
+
+    NSArray<OWSThreadDeletionProgressBlock> *progressBlocks = [self.progressBlocks[threadId] copy];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (OWSThreadDeletionProgressBlock progress in progressBlocks) {
+            progress(deletedCount, totalCount);
+        }
+        [[NSNotificationCenter defaultCenter] postNotificationName:OWSThreadDeletionJobProgressNotification
+                                                            object:nil
+                                                          userInfo:@{
+                                                              OWSThreadDeletionJobThreadIdKey : threadId,
+                                                              OWSThreadDeletionJobDeletedCountKey : @(deletedCount),
+                                                              OWSThreadDeletionJobTotalCountKey : @(totalCount),
+                                                          }];
+    });
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
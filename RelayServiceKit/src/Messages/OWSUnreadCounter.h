@@ -0,0 +1,41 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class TSInteraction;
+@class YapDatabaseReadTransaction;
+@class YapDatabaseReadWriteTransaction;
+
+// Maintains per-thread and total unread counts, so that reading them is O(1) however many messages are unread.
+//
+// An interaction counts as unread under the same rules as TSUnreadDatabaseViewExtensionName.  The counts are
+// adjusted in the same transaction as every save and removal of an interaction, by way of
+// -[TSInteraction saveWithTransaction:] and -[TSInteraction removeWithTransaction:].  Writes that bypass those
+// (e.g. removing a whole collection) can leave the counts out of step with the view; +repairIfNecessaryWithTransaction:
+// checks the counts against the view and rebuilds them if they've drifted.
+//
+// Until the counts have been built for the first time, the view is used instead.
+@interface OWSUnreadCounter : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
++ (NSUInteger)unreadCountForThreadId:(NSString *)threadId transaction:(YapDatabaseReadTransaction *)transaction;
+
++ (NSUInteger)totalUnreadCountWithTransaction:(YapDatabaseReadTransaction *)transaction;
+
+// Should be called with the interaction's new state, before it's saved.
++ (void)interactionWillBeSaved:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)interactionWillBeRemoved:(TSInteraction *)interaction
+                     transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+// Returns YES if the counts had to be rebuilt.
++ (BOOL)repairIfNecessaryWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
++ (void)rebuildWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,195 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSUnreadCounter.h"
+#import "TSDatabaseView.h"
+#import "TSInteraction.h"
+#import "SSKAsserts.h"
+#import <YapDatabase/YapDatabase.h>
+#import <YapDatabase/YapDatabaseView.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Thread id (the unread view's group) => NSNumber.  Threads with no unread interactions have no entry.
+static NSString *const OWSUnreadCountsByThreadCollection = @"OWSUnreadCountsByThreadCollection";
+// Interaction id => thread id, for each interaction that's counted.  Lets a save tell whether the interaction was
+// already counted, without relying on the previous version of the object, which may be the same instance.
+static NSString *const OWSUnreadInteractionsCollection = @"OWSUnreadInteractionsCollection";
+static NSString *const OWSUnreadCounterStateCollection = @"OWSUnreadCounterStateCollection";
+// Only present once the counts have been built.
+static NSString *const OWSUnreadCounterTotalKey = @"total";
+
+@implementation OWSUnreadCounter
+
+#pragma mark - Reading
+
++ (nullable NSNumber *)storedTotalWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [transaction objectForKey:OWSUnreadCounterTotalKey inCollection:OWSUnreadCounterStateCollection];
+}
+
++ (NSUInteger)storedCountForGroup:(NSString *)group transaction:(YapDatabaseReadTransaction *)transaction
+{
+    NSNumber *_Nullable count = [transaction objectForKey:group inCollection:OWSUnreadCountsByThreadCollection];
+    return count.unsignedIntegerValue;
+}
+
++ (NSUInteger)unreadCountForThreadId:(NSString *)threadId transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSAssertDebug(threadId.length > 0);
+
+    if (![self storedTotalWithTransaction:transaction]) {
+        return [[transaction ext:TSUnreadDatabaseViewExtensionName] numberOfItemsInGroup:threadId.lowercaseString];
+    }
+    return [self storedCountForGroup:threadId.lowercaseString transaction:transaction];
+}
+
++ (NSUInteger)totalUnreadCountWithTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    NSNumber *_Nullable total = [self storedTotalWithTransaction:transaction];
+    if (!total) {
+        return [[transaction ext:TSUnreadDatabaseViewExtensionName] numberOfItemsInAllGroups];
+    }
+    return total.unsignedIntegerValue;
+}
+
+#pragma mark - Updating
+
++ (void)interactionWillBeSaved:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(interaction.uniqueId.length > 0);
+
+    if (![self storedTotalWithTransaction:transaction]) {
+        // The first rebuild will count it.
+        return;
+    }
+
+    NSString *_Nullable oldGroup =
+        [transaction objectForKey:interaction.uniqueId inCollection:OWSUnreadInteractionsCollection];
+    NSString *_Nullable newGroup = [TSDatabaseView unreadGroupForObject:interaction];
+    if (oldGroup == newGroup || [oldGroup isEqualToString:newGroup]) {
+        return;
+    }
+
+    if (oldGroup) {
+        [self addDelta:-1 toGroup:oldGroup transaction:transaction];
+        [transaction removeObjectForKey:interaction.uniqueId inCollection:OWSUnreadInteractionsCollection];
+    }
+    if (newGroup) {
+        [self addDelta:1 toGroup:newGroup transaction:transaction];
+        [transaction setObject:newGroup forKey:interaction.uniqueId inCollection:OWSUnreadInteractionsCollection];
+    }
+}
+
++ (void)interactionWillBeRemoved:(TSInteraction *)interaction
+                     transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (interaction.uniqueId.length < 1 || ![self storedTotalWithTransaction:transaction]) {
+        return;
+    }
+
+    NSString *_Nullable oldGroup =
+        [transaction objectForKey:interaction.uniqueId inCollection:OWSUnreadInteractionsCollection];
+    if (!oldGroup) {
+        return;
+    }
+    [self addDelta:-1 toGroup:oldGroup transaction:transaction];
+    [transaction removeObjectForKey:interaction.uniqueId inCollection:OWSUnreadInteractionsCollection];
+}
+
++ (void)addDelta:(NSInteger)delta toGroup:(NSString *)group transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    NSInteger count = (NSInteger)[self storedCountForGroup:group transaction:transaction] + delta;
+    NSInteger total = [self storedTotalWithTransaction:transaction].integerValue + delta;
+    if (count < 0 || total < 0) {
+        // The next repair will fix this.
+        OWSFailDebug(@"%@ unread count for %@ would become negative.", self.logTag, group);
+        count = MAX(0, count);
+        total = MAX(0, total);
+    }
+
+    if (count > 0) {
+        [transaction setObject:@(count) forKey:group inCollection:OWSUnreadCountsByThreadCollection];
+    } else {
+        [transaction removeObjectForKey:group inCollection:OWSUnreadCountsByThreadCollection];
+    }
+    [transaction setObject:@(total) forKey:OWSUnreadCounterTotalKey inCollection:OWSUnreadCounterStateCollection];
+}
+
+#pragma mark - Consistency
+
++ (BOOL)repairIfNecessaryWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    YapDatabaseViewTransaction *_Nullable unreadView = [transaction ext:TSUnreadDatabaseViewExtensionName];
+    if (!unreadView) {
+        OWSFailDebug(@"%@ unread view isn't ready.", self.logTag);
+        return NO;
+    }
+
+    NSNumber *_Nullable storedTotal = [self storedTotalWithTransaction:transaction];
+    if (!storedTotal) {
+        DDLogInfo(@"%@ Building unread counts.", self.logTag);
+        [self rebuildWithTransaction:transaction];
+        return YES;
+    }
+
+    // Only the counts are compared, which is O(threads) rather than O(unread interactions).
+    BOOL isConsistent = YES;
+    NSUInteger total = 0;
+    NSArray<NSString *> *groups = [unreadView allGroups];
+    for (NSString *group in groups) {
+        NSUInteger count = [unreadView numberOfItemsInGroup:group];
+        total += count;
+        if ([self storedCountForGroup:group transaction:transaction] != count) {
+            DDLogWarn(@"%@ Unread count for %@ has drifted.", self.logTag, group);
+            isConsistent = NO;
+        }
+    }
+    if ([transaction numberOfKeysInCollection:OWSUnreadCountsByThreadCollection] != groups.count
+        || [transaction numberOfKeysInCollection:OWSUnreadInteractionsCollection] != total
+        || storedTotal.unsignedIntegerValue != total) {
+        DDLogWarn(@"%@ Total unread count has drifted.", self.logTag);
+        isConsistent = NO;
+    }
+
+    if (isConsistent) {
+        return NO;
+    }
+    [self rebuildWithTransaction:transaction];
+    return YES;
+}
+
++ (void)rebuildWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    YapDatabaseViewTransaction *_Nullable unreadView = [transaction ext:TSUnreadDatabaseViewExtensionName];
+    if (!unreadView) {
+        OWSFailDebug(@"%@ unread view isn't ready.", self.logTag);
+        return;
+    }
+
+    [transaction removeAllObjectsInCollection:OWSUnreadCountsByThreadCollection];
+    [transaction removeAllObjectsInCollection:OWSUnreadInteractionsCollection];
+
+    // Keys only; there's no need to deserialize the interactions.
+    __block NSUInteger total = 0;
+    for (NSString *group in [unreadView allGroups]) {
+        __block NSUInteger count = 0;
+        [unreadView enumerateKeysInGroup:group
+                              usingBlock:^(NSString *collection, NSString *key, NSUInteger index, BOOL *stop) {
+                                  [transaction setObject:group forKey:key inCollection:OWSUnreadInteractionsCollection];
+                                  count++;
+                              }];
+        if (count > 0) {
+            [transaction setObject:@(count) forKey:group inCollection:OWSUnreadCountsByThreadCollection];
+        }
+        total += count;
+    }
+    [transaction setObject:@(total) forKey:OWSUnreadCounterTotalKey inCollection:OWSUnreadCounterStateCollection];
+
+    DDLogInfo(@"%@ Rebuilt unread counts: %lu.", self.logTag, (unsigned long)total);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,52 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef void (^OWSResumableUploadProgressBlock)(double fractionCompleted);
+
+// PUTs a file to a URL, streaming it from disk.
+//
+// Each attempt sends the whole file, unless resumption is allowed.  Then each later attempt first asks the server
+// how much it already has with an empty PUT carrying "Content-Range: bytes */<length>".  A server which supports
+// resumable uploads answers "308 Resume Incomplete" with a Range header covering the bytes it has acknowledged;
+// the rest of the file is then sent in chunks, each acknowledged before the next is sent.  Other servers get the
+// whole file again.
+//
+// Callbacks are invoked on a global queue.
+@interface OWSResumableUpload : NSObject
+
+@property (nonatomic, readonly) NSString *filePath;
+@property (nonatomic, readonly) NSURL *url;
+@property (nonatomic, readonly) unsigned long long fileLength;
+
+// The number of leading bytes the server has acknowledged.
+@property (atomic, readonly) unsigned long long acknowledgedOffset;
+@property (atomic, readonly) BOOL serverSupportsResumption;
+
+// Only set this for upload locations known to implement the resumable upload protocol.  Any other server, such
+// as a presigned S3 URL, stores the empty query PUT as the object, overwriting whatever was uploaded.
+//
+// Defaults to NO.
+@property (nonatomic) BOOL allowsResumption;
+
+// The length of each request when resuming.  Bounds the memory used by a resumed upload.
+@property (nonatomic) NSUInteger chunkLength;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithFilePath:(NSString *)filePath
+                             url:(NSURL *)url
+            sessionConfiguration:(NSURLSessionConfiguration *)sessionConfiguration NS_DESIGNATED_INITIALIZER;
+
+// May be called again after a failure to resume.  Must not be called while an attempt is in flight.
+//
+// Errors for HTTP failures carry the status code under OWSErrorHTTPStatusCodeKey.
+- (void)uploadWithProgress:(nullable OWSResumableUploadProgressBlock)progressBlock
+                   success:(void (^)(void))successBlock
+                   failure:(void (^)(NSError *error))failureBlock;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,361 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSResumableUpload.h"
+#import "MIMETypeUtil.h"
+#import "OWSError.h"
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const NSUInteger kOWSResumableUploadDefaultChunkLength = 1024 * 1024;
+// "Resume Incomplete", as used by resumable upload protocols.
+static const NSInteger kOWSResumableUploadStatusResumeIncomplete = 308;
+
+@interface OWSResumableUpload () <NSURLSessionTaskDelegate>
+
+@property (nonatomic, readonly) NSURLSessionConfiguration *sessionConfiguration;
+@property (nonatomic, readonly) dispatch_queue_t serialQueue;
+
+@property (atomic) unsigned long long acknowledgedOffset;
+@property (atomic) BOOL serverSupportsResumption;
+
+// The following should only be accessed on the serial queue.
+@property (nonatomic, nullable) NSURLSession *session;
+@property (nonatomic) NSUInteger attemptCount;
+// Whether we've asked the server for the state of the upload yet.
+@property (nonatomic) BOOL hasQueriedServer;
+// The offset in the file of the body of the request in flight, used for progress.
+@property (nonatomic) unsigned long long requestOffset;
+@property (nonatomic, nullable) OWSResumableUploadProgressBlock progressBlock;
+@property (nonatomic, nullable) void (^successBlock)(void);
+@property (nonatomic, nullable) void (^failureBlock)(NSError *error);
+
+@end
+
+#pragma mark -
+
+@implementation OWSResumableUpload
+
+- (instancetype)initWithFilePath:(NSString *)filePath
+                             url:(NSURL *)url
+            sessionConfiguration:(NSURLSessionConfiguration *)sessionConfiguration
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    OWSAssertDebug(filePath.length > 0);
+
+    _filePath = filePath;
+    _url = url;
+    _sessionConfiguration = sessionConfiguration;
+    _chunkLength = kOWSResumableUploadDefaultChunkLength;
+    _serialQueue = dispatch_queue_create("org.whispersystems.resumableUpload", DISPATCH_QUEUE_SERIAL);
+
+    NSError *error;
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:&error];
+    if (!attributes) {
+        OWSFailDebug(@"%@ could not read upload file attributes: %@", self.logTag, error);
+    }
+    _fileLength = attributes.fileSize;
+
+    return self;
+}
+
+- (void)uploadWithProgress:(nullable OWSResumableUploadProgressBlock)progressBlock
+                   success:(void (^)(void))successBlock
+                   failure:(void (^)(NSError *error))failureBlock
+{
+    dispatch_async(self.serialQueue, ^{
+        OWSAssertDebug(!self.session);
+
+        self.progressBlock = progressBlock;
+        self.successBlock = successBlock;
+        self.failureBlock = failureBlock;
+
+        // A session per attempt, so that it can be invalidated (releasing its delegate, us) when the attempt ends.
+        NSOperationQueue *delegateQueue = [NSOperationQueue new];
+        delegateQueue.maxConcurrentOperationCount = 1;
+        delegateQueue.underlyingQueue = self.serialQueue;
+        self.session = [NSURLSession sessionWithConfiguration:self.sessionConfiguration
+                                                     delegate:self
+                                                delegateQueue:delegateQueue];
+
+        self.attemptCount++;
+        if (self.attemptCount > 1 && self.allowsResumption
+            && (!self.hasQueriedServer || self.serverSupportsResumption)) {
+            [self queryServer];
+        } else {
+            // The first attempt, and every attempt to a server which can't resume, sends the whole file.
+            [self sendWholeFile];
+        }
+    });
+}
+
+#pragma mark - Requests
+
+- (NSMutableURLRequest *)putRequest
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:self.url];
+    request.HTTPMethod = @"PUT";
+    [request setValue:OWSMimeTypeApplicationOctetStream forHTTPHeaderField:@"Content-Type"];
+    return request;
+}
+
+- (void)sendWholeFile
+{
+    DDLogInfo(@"%@ uploading %llu bytes.", self.logTag, self.fileLength);
+
+    self.acknowledgedOffset = 0;
+    self.requestOffset = 0;
+    // The body is streamed from the file, so memory use doesn't grow with the size of the upload.
+    NSURLSessionUploadTask *task =
+        [self.session uploadTaskWithRequest:[self putRequest] fromFile:[NSURL fileURLWithPath:self.filePath]];
+    [task resume];
+}
+
+- (void)queryServer
+{
+    OWSAssertDebug(self.allowsResumption);
+
+    DDLogInfo(@"%@ querying upload state.", self.logTag);
+
+    NSMutableURLRequest *request = [self putRequest];
+    [request setValue:[NSString stringWithFormat:@"bytes */%llu", self.fileLength]
+        forHTTPHeaderField:@"Content-Range"];
+    self.requestOffset = self.acknowledgedOffset;
+    NSURLSessionUploadTask *task = [self.session uploadTaskWithRequest:request fromData:[NSData new]];
+    [task resume];
+}
+
+- (void)sendNextChunk
+{
+    unsigned long long offset = self.acknowledgedOffset;
+    if (offset >= self.fileLength) {
+        [self succeed];
+        return;
+    }
+
+    NSData *_Nullable chunk = [self readChunkAtOffset:offset];
+    if (chunk.length < 1) {
+        DDLogError(@"%@ could not read upload file at offset: %llu", self.logTag, offset);
+        [self failWithError:OWSErrorMakeWriteAttachmentDataError()];
+        return;
+    }
+
+    DDLogVerbose(@"%@ uploading %lu bytes at %llu.", self.logTag, (unsigned long)chunk.length, offset);
+
+    NSMutableURLRequest *request = [self putRequest];
+    [request setValue:[NSString stringWithFormat:@"bytes %llu-%llu/%llu",
+                                offset,
+                                offset + chunk.length - 1,
+                                self.fileLength]
+        forHTTPHeaderField:@"Content-Range"];
+    self.requestOffset = offset;
+    NSURLSessionUploadTask *task = [self.session uploadTaskWithRequest:request fromData:chunk];
+    [task resume];
+}
+
+- (nullable NSData *)readChunkAtOffset:(unsigned long long)offset
+{
+    NSFileHandle *_Nullable fileHandle = [NSFileHandle fileHandleForReadingAtPath:self.filePath];
+    if (!fileHandle) {
+        return nil;
+    }
+
+    NSData *_Nullable result;
+    @try {
+        [fileHandle seekToFileOffset:offset];
+        result = [fileHandle readDataOfLength:(NSUInteger)MIN((unsigned long long)self.chunkLength, self.fileLength - offset)];
+    } @catch (NSException *exception) {
+        DDLogError(@"%@ could not read upload file: %@", self.logTag, exception);
+    }
+    [fileHandle closeFile];
+    return result;
+}
+
+#pragma mark - NSURLSessionTaskDelegate
+
+- (void)URLSession:(NSURLSession *)session
+                        task:(NSURLSessionTask *)task
+             didSendBodyData:(int64_t)bytesSent
+              totalBytesSent:(int64_t)totalBytesSent
+    totalBytesExpectedToSend:(int64_t)totalBytesExpectedToSend
+{
+    if (session != self.session || self.fileLength == 0 || !self.progressBlock) {
+        return;
+    }
+
+    double progress = (double)(self.requestOffset + (unsigned long long)totalBytesSent) / (double)self.fileLength;
+    self.progressBlock(MIN(progress, 1.0));
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(nullable NSError *)error
+{
+    if (session != self.session) {
+        return;
+    }
+
+    if (error) {
+        DDLogWarn(@"%@ upload request failed: %@", self.logTag, error);
+        [self failWithError:error];
+        return;
+    }
+
+    NSHTTPURLResponse *response = (NSHTTPURLResponse *)task.response;
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        DDLogError(@"%@ missing or unexpected response: %@", self.logTag, response);
+        [self failWithError:[self uploadError]];
+        return;
+    }
+
+    NSString *_Nullable contentRange = [task.originalRequest valueForHTTPHeaderField:@"Content-Range"];
+    BOOL isQuery = [contentRange hasPrefix:@"bytes */"];
+    [self handleResponse:response isQuery:isQuery wasResumedRequest:(contentRange != nil)];
+}
+
+#pragma mark - Responses
+
+- (void)handleResponse:(NSHTTPURLResponse *)response isQuery:(BOOL)isQuery wasResumedRequest:(BOOL)wasResumedRequest
+{
+    NSInteger statusCode = response.statusCode;
+    BOOL isSuccess = statusCode >= 200 && statusCode < 300;
+
+    if (statusCode == kOWSResumableUploadStatusResumeIncomplete) {
+        unsigned long long previousOffset = self.acknowledgedOffset;
+        if (isQuery) {
+            self.hasQueriedServer = YES;
+        }
+        self.serverSupportsResumption = YES;
+        self.acknowledgedOffset = [self acknowledgedOffsetFromResponse:response];
+
+        if (!isQuery && self.acknowledgedOffset <= previousOffset) {
+            // The server accepted nothing from that request; let the caller decide whether to try again.
+            DDLogError(@"%@ upload made no progress at %llu.", self.logTag, previousOffset);
+            [self failWithError:[self uploadErrorWithStatusCode:statusCode]];
+            return;
+        }
+
+        DDLogInfo(@"%@ server has %llu of %llu bytes.", self.logTag, self.acknowledgedOffset, self.fileLength);
+        [self sendNextChunk];
+        return;
+    }
+
+    if (isQuery) {
+        self.hasQueriedServer = YES;
+        if (isSuccess && self.serverSupportsResumption) {
+            // A server which has already shown it can resume is telling us the upload is complete.
+            [self succeed];
+            return;
+        }
+
+        // The server doesn't understand the query, so it can't resume.  Send everything again.
+        DDLogInfo(@"%@ server can't resume upload: %d", self.logTag, (int)statusCode);
+        self.serverSupportsResumption = NO;
+        [self sendWholeFile];
+        return;
+    }
+
+    if (!isSuccess) {
+        DDLogError(@"%@ unexpected server response: %d", self.logTag, (int)statusCode);
+        [self failWithError:[self uploadErrorWithStatusCode:statusCode]];
+        return;
+    }
+
+    if (wasResumedRequest && self.requestOffset + self.chunkLength < self.fileLength) {
+        // A server shouldn't claim the upload is complete before it has the final chunk.
+        OWSFailDebug(@"%@ upload completed early at %llu.", self.logTag, self.requestOffset);
+        [self failWithError:[self uploadErrorWithStatusCode:statusCode]];
+        return;
+    }
+
+    [self succeed];
+}
+
+// Parses a Range header of the form "bytes=0-<last>".  A missing header means the server has nothing.
+- (unsigned long long)acknowledgedOffsetFromResponse:(NSHTTPURLResponse *)response
+{
+    NSString *_Nullable range;
+    for (NSString *key in response.allHeaderFields) {
+        if ([key caseInsensitiveCompare:@"Range"] == NSOrderedSame) {
+            range = response.allHeaderFields[key];
+            break;
+        }
+    }
+    if (![range isKindOfClass:[NSString class]] || ![range hasPrefix:@"bytes=0-"]) {
+        return 0;
+    }
+
+    NSScanner *scanner = [NSScanner scannerWithString:[range substringFromIndex:@"bytes=0-".length]];
+    unsigned long long lastByte = 0;
+    if (![scanner scanUnsignedLongLong:&lastByte] || lastByte >= self.fileLength) {
+        DDLogError(@"%@ invalid Range header: %@", self.logTag, range);
+        return 0;
+    }
+    return lastByte + 1;
+}
+
+#pragma mark - Completion
+
+- (void)succeed
+{
+    DDLogInfo(@"%@ upload complete.", self.logTag);
+
+    self.acknowledgedOffset = self.fileLength;
+    void (^_Nullable successBlock)(void) = self.successBlock;
+    [self endAttempt];
+
+    if (successBlock) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            successBlock();
+        });
+    }
+}
+
+- (void)failWithError:(NSError *)error
+{
+    void (^_Nullable failureBlock)(NSError *) = self.failureBlock;
+    [self endAttempt];
+
+    if (failureBlock) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            failureBlock(error);
+        });
+    }
+}
+
+- (void)endAttempt
+{
+    [self.session invalidateAndCancel];
+    self.session = nil;
+    self.progressBlock = nil;
+    self.successBlock = nil;
+    self.failureBlock = nil;
+}
+
+#pragma mark - Errors
+
+- (NSError *)uploadError
+{
+    return OWSErrorWithCodeDescription(OWSErrorCodeUploadFailed,
+        NSLocalizedString(@"ERROR_DESCRIPTION_REQUEST_FAILED", @"Error indicating that a socket request failed."));
+}
+
+- (NSError *)uploadErrorWithStatusCode:(NSInteger)statusCode
+{
+    return [NSError errorWithDomain:OWSRelayServiceKitErrorDomain
+                               code:OWSErrorCodeUploadFailed
+                           userInfo:@{
+                               NSLocalizedDescriptionKey : NSLocalizedString(@"ERROR_DESCRIPTION_REQUEST_FAILED",
+                                   @"Error indicating that a socket request failed."),
+                               OWSErrorHTTPStatusCodeKey : @(statusCode),
+                           }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -3,12 +3,15 @@
 //
 
 #import "OWSUploadOperation.h"
-#import "MIMETypeUtil.h"
 #import "NSError+MessageSending.h"
 #import "NSNotificationCenter+OWS.h"
+#import "OWSAttachmentEncryptor.h"
+#import "OWSDispatch.h"
 #import "OWSError.h"
+#import "OWSFileSystem.h"
 #import "OWSOperation.h"
 #import "OWSRequestFactory.h"
+#import "OWSResumableUpload.h"
 #import "TSAttachmentStream.h"
 #import "TSNetworkManager.h"
 
@@ -30,6 +33,13 @@ static const CGFloat kAttachmentUploadProgressTheta = 0.001f;
 @property (readonly, nonatomic) NSString *attachmentId;
 @property (readonly, nonatomic) YapDatabaseConnection *dbConnection;
 
+// State kept across retries.  Only accessed on the attachments queue.
+@property (nonatomic, nullable) NSString *encryptedFilePath;
+@property (nonatomic, nullable) NSData *encryptionKey;
+@property (nonatomic, nullable) NSData *digest;
+@property (nonatomic) UInt64 serverId;
+@property (nonatomic, nullable) OWSResumableUpload *upload;
+
 @end
 
 @implementation OWSUploadOperation
@@ -77,6 +87,60 @@ static const CGFloat kAttachmentUploadProgressTheta = 0.001f;
     
     [self fireNotificationWithProgress:0];
 
+    dispatch_async([OWSDispatch attachmentsQueue], ^{
+        if (![self prepareEncryptedFileForAttachmentStream:attachmentStream]) {
+            return;
+        }
+
+        if (self.upload) {
+            // Resume the upload from the previous attempt.
+            [self uploadAttachmentStream:attachmentStream];
+        } else {
+            [self allocateAndUploadAttachmentStream:attachmentStream];
+        }
+    });
+}
+
+// The attachment is encrypted once per operation, so that retries can resume the upload of the same bytes.
+- (BOOL)prepareEncryptedFileForAttachmentStream:(TSAttachmentStream *)attachmentStream
+{
+    if (self.encryptedFilePath) {
+        return YES;
+    }
+
+    NSString *_Nullable plaintextFilePath = attachmentStream.filePath;
+    if (!plaintextFilePath) {
+        NSError *error = OWSErrorMakeFailedToSendOutgoingMessageError();
+        error.isRetryable = NO;
+        [self reportError:error];
+        return NO;
+    }
+
+    DDLogDebug(@"%@ encrypting attachment: %@", self.logTag, self.attachmentId);
+    NSString *encryptedFilePath = [OWSFileSystem temporaryFilePath];
+    NSData *_Nullable encryptionKey;
+    NSData *_Nullable digest;
+    NSError *_Nullable error;
+    if (![OWSAttachmentEncryptor encryptFileAtPath:plaintextFilePath
+                                            toPath:encryptedFilePath
+                                            outKey:&encryptionKey
+                                         outDigest:&digest
+                                             error:&error]) {
+        DDLogError(@"%@ Failed to encrypt attachment with error: %@", self.logTag, error);
+        error = error ?: OWSErrorMakeFailedToSendOutgoingMessageError();
+        error.isRetryable = YES;
+        [self reportError:error];
+        return NO;
+    }
+
+    self.encryptedFilePath = encryptedFilePath;
+    self.encryptionKey = encryptionKey;
+    self.digest = digest;
+    return YES;
+}
+
+- (void)allocateAndUploadAttachmentStream:(TSAttachmentStream *)attachmentStream
+{
     DDLogDebug(@"%@ alloc attachment: %@", self.logTag, self.attachmentId);
     TSRequest *request = [OWSRequestFactory allocAttachmentRequest];
     [self.networkManager makeRequest:request
@@ -91,10 +155,26 @@ static const CGFloat kAttachmentUploadProgressTheta = 0.001f;
 
             NSDictionary *responseDict = (NSDictionary *)responseObject;
             UInt64 serverId = ((NSDecimalNumber *)[responseDict objectForKey:@"id"]).unsignedLongLongValue;
-            NSString *location = [responseDict objectForKey:@"location"];
+            NSString *_Nullable location = [responseDict objectForKey:@"location"];
+            NSURL *_Nullable url = [location isKindOfClass:[NSString class]] ? [NSURL URLWithString:location] : nil;
+            if (!url) {
+                DDLogError(@"%@ missing upload location from server: %@", self.logTag, responseObject);
+                NSError *error = OWSErrorMakeUnableToProcessServerResponseError();
+                error.isRetryable = YES;
+                [self reportError:error];
+                return;
+            }
 
             dispatch_async([OWSDispatch attachmentsQueue], ^{
-                [self uploadWithServerId:serverId location:location attachmentStream:attachmentStream];
+                self.serverId = serverId;
+                self.upload = [[OWSResumableUpload alloc]
+                        initWithFilePath:self.encryptedFilePath
+                                     url:url
+                    sessionConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration]];
+                // Allocated locations are presigned S3 URLs, which don't implement resumable uploads, so
+                // retries resend the whole (already encrypted) file.
+                self.upload.allowsResumption = NO;
+                [self uploadAttachmentStream:attachmentStream];
             });
         }
         failure:^(NSURLSessionDataTask *task, NSError *error) {
@@ -104,76 +184,69 @@ static const CGFloat kAttachmentUploadProgressTheta = 0.001f;
         }];
 }
 
-- (void)uploadWithServerId:(UInt64)serverId
-                  location:(NSString *)location
-          attachmentStream:(TSAttachmentStream *)attachmentStream
+- (void)uploadAttachmentStream:(TSAttachmentStream *)attachmentStream
 {
-    DDLogDebug(@"%@ started uploading data for attachment: %@", self.logTag, self.attachmentId);
-    NSError *error;
-    NSData *attachmentData = [attachmentStream readDataFromFileWithError:&error];
-    if (error) {
-        DDLogError(@"%@ Failed to read attachment data with error: %@", self.logTag, error);
-        error.isRetryable = YES;
-        [self reportError:error];
-        return;
-    }
+    OWSResumableUpload *upload = self.upload;
+    OWSAssertDebug(upload);
 
-    NSData *encryptionKey;
-    NSData *digest;
-    NSData *_Nullable encryptedAttachmentData =
-        [Cryptography encryptAttachmentData:attachmentData outKey:&encryptionKey outDigest:&digest];
-    if (!encryptedAttachmentData) {
-        OWSFailDebug(@"%@ could not encrypt attachment data.", self.logTag);
-        error = OWSErrorMakeFailedToSendOutgoingMessageError();
-        error.isRetryable = YES;
-        [self reportError:error];
-        return;
+    DDLogDebug(@"%@ started uploading data for attachment: %@", self.logTag, self.attachmentId);
+    [upload uploadWithProgress:^(double fractionCompleted) {
+        [self fireNotificationWithProgress:(CGFloat)fractionCompleted];
     }
-    attachmentStream.encryptionKey = encryptionKey;
-    attachmentStream.digest = digest;
-
-    NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:[NSURL URLWithString:location]];
-    request.HTTPMethod = @"PUT";
-    [request setValue:OWSMimeTypeApplicationOctetStream forHTTPHeaderField:@"Content-Type"];
-
-    AFURLSessionManager *manager = [[AFURLSessionManager alloc]
-        initWithSessionConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration]];
-
-    NSURLSessionUploadTask *uploadTask;
-    uploadTask = [manager uploadTaskWithRequest:request
-        fromData:encryptedAttachmentData
-        progress:^(NSProgress *_Nonnull uploadProgress) {
-            [self fireNotificationWithProgress:uploadProgress.fractionCompleted];
-        }
-        completionHandler:^(NSURLResponse *_Nonnull response, id _Nullable responseObject, NSError *_Nullable error) {
-            OWSAssertIsOnMainThread();
-            if (error) {
-                error.isRetryable = YES;
-                [self reportError:error];
-                return;
-            }
-
-            NSInteger statusCode = ((NSHTTPURLResponse *)response).statusCode;
-            BOOL isValidResponse = (statusCode >= 200) && (statusCode < 400);
-            if (!isValidResponse) {
-                DDLogError(@"%@ Unexpected server response: %d", self.logTag, (int)statusCode);
-                NSError *invalidResponseError = OWSErrorMakeUnableToProcessServerResponseError();
-                invalidResponseError.isRetryable = YES;
-                [self reportError:invalidResponseError];
-                return;
-            }
-
+        success:^{
             DDLogInfo(@"%@ Uploaded attachment: %p.", self.logTag, attachmentStream.uniqueId);
-            attachmentStream.serverId = serverId;
+            attachmentStream.encryptionKey = self.encryptionKey;
+            attachmentStream.digest = self.digest;
+            attachmentStream.serverId = self.serverId;
             attachmentStream.isUploaded = YES;
             [attachmentStream saveAsyncWithCompletionBlock:^{
                 [self reportSuccess];
             }];
+        }
+        failure:^(NSError *error) {
+            DDLogError(@"%@ Failed to upload attachment with error: %@", self.logTag, error);
+            NSInteger statusCode = [error.userInfo[OWSErrorHTTPStatusCodeKey] integerValue];
+            dispatch_async([OWSDispatch attachmentsQueue], ^{
+                if (statusCode >= 400 && statusCode < 500) {
+                    // The upload location has probably expired, so allocate a new one next time.  The encrypted
+                    // file is kept, so the retry doesn't have to encrypt again.
+                    self.upload = nil;
+                }
+                error.isRetryable = YES;
+                [self reportError:error];
+            });
         }];
+}
+
+- (void)deleteEncryptedFile
+{
+    NSString *_Nullable encryptedFilePath = self.encryptedFilePath;
+    if (encryptedFilePath) {
+        dispatch_async([OWSDispatch attachmentsQueue], ^{
+            [OWSFileSystem deleteFileIfExists:encryptedFilePath];
+        });
+    }
+}
+
+#pragma mark - OWSOperation overrides
 
-    [uploadTask resume];
+- (void)didSucceed
+{
+    [self deleteEncryptedFile];
+}
+
+- (void)didCancel
+{
+    [self deleteEncryptedFile];
 }
 
+- (void)didFailWithError:(NSError *)error
+{
+    [self deleteEncryptedFile];
+}
+
+#pragma mark -
+
 - (void)fireNotificationWithProgress:(CGFloat)aProgress
 {
     NSNotificationCenter *notificationCenter = [NSNotificationCenter defaultCenter];
@@ -159,7 +159,12 @@ typedef void (^failureBlock)(NSURLSessionDataTask *task, NSError *error);
     return ^(NSURLSessionDataTask *_Nullable task, NSError *_Nonnull networkError) {
       NSInteger statusCode = [task statusCode];
 
-      [OutageDetection.sharedManager reportConnectionFailure];
+      // Any other response shows that the service is up, even if it turned the request down.
+      if (statusCode == 0 || statusCode >= 500) {
+          [OutageDetection.sharedManager reportConnectionFailure];
+      } else {
+          [OutageDetection.sharedManager reportConnectionSuccess];
+      }
 
       NSError *error = [self errorWithHTTPCode:statusCode
                                    description:nil
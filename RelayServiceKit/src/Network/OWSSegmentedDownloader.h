@@ -0,0 +1,96 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A contiguous byte range of a segmented download.
+@interface OWSDownloadSegment : NSObject
+
+@property (nonatomic, readonly) NSUInteger index;
+@property (nonatomic, readonly) unsigned long long start;
+@property (nonatomic, readonly) unsigned long long length;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithIndex:(NSUInteger)index
+                        start:(unsigned long long)start
+                       length:(unsigned long long)length NS_DESIGNATED_INITIALIZER;
+
+// The value of the HTTP Range header which requests this segment, e.g. "bytes=0-1023".
+- (NSString *)rangeHeaderValue;
+
+@end
+
+#pragma mark -
+
+typedef void (^OWSSegmentedDownloadProgressBlock)(double fractionCompleted);
+typedef void (^OWSSegmentedDownloadSuccessBlock)(NSString *filePath);
+typedef void (^OWSSegmentedDownloadFailureBlock)(NSError *error);
+
+// Downloads a resource as a series of parallel HTTP Range requests.
+//
+// Completed segments are written directly into a partial file on disk and recorded in a manifest
+// alongside it, so a download which fails, is cancelled, or is interrupted by the app being
+// terminated picks up from the segments it already has the next time it is requested with the same
+// identifier.  Failed segments are retried with backoff a bounded number of times, after which the
+// download fails but keeps its progress.
+//
+// The number of requests in flight is bounded across all downloads.
+@interface OWSSegmentedDownloader : NSObject
+
++ (instancetype)sharedDownloader;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+// `storageDirectory` holds the partial files and their manifests.
+- (instancetype)initWithSessionConfiguration:(NSURLSessionConfiguration *)sessionConfiguration
+                            storageDirectory:(NSString *)storageDirectory NS_DESIGNATED_INITIALIZER;
+
+// Maximum number of requests in flight across all downloads.
+@property (nonatomic) NSUInteger maxConcurrentRequests;
+// Maximum number of requests in flight for a single download.
+@property (nonatomic) NSUInteger maxConcurrentRequestsPerDownload;
+// Length of the segments of new downloads.  Resumed downloads keep their original segment length.
+@property (nonatomic) unsigned long long segmentLength;
+@property (nonatomic) NSUInteger maxAttemptsPerSegment;
+// The delay before the first retry of a segment; doubles with each subsequent attempt.
+@property (nonatomic) NSTimeInterval retryBaseInterval;
+@property (nonatomic) unsigned long long maxDownloadSize;
+
+// The largest of a fixed ladder of segment lengths which doesn't exceed `contentLength`.
++ (unsigned long long)segmentLengthForContentLength:(unsigned long long)contentLength;
+
+// Splits `contentLength` bytes into segments of `segmentLength`; the last segment may be shorter.
++ (NSArray<OWSDownloadSegment *> *)segmentsForContentLength:(unsigned long long)contentLength
+                                              segmentLength:(unsigned long long)segmentLength;
+
+// `identifier` must be stable across launches, e.g. an attachment id.  `url` may differ between
+// attempts (e.g. a signed URL which has expired); persisted progress is reused as long as the
+// resource's length and entity tag haven't changed.
+//
+// Requesting an identifier which is already downloading adds the callbacks to the existing download.
+// Callbacks are invoked on a global queue.  The file passed to `success` remains on disk until
+// removeDownloadWithIdentifier: is called.
+- (void)downloadWithIdentifier:(NSString *)identifier
+                           url:(NSURL *)url
+                      progress:(nullable OWSSegmentedDownloadProgressBlock)progress
+                       success:(OWSSegmentedDownloadSuccessBlock)success
+                       failure:(OWSSegmentedDownloadFailureBlock)failure;
+
+// Cancels any requests in flight without invoking the callbacks.  Progress is kept.
+- (void)cancelDownloadWithIdentifier:(NSString *)identifier;
+
+// Cancels the download and discards its progress.  Callers should call this once they've consumed
+// a completed download, or if its contents turn out to be invalid.
+- (void)removeDownloadWithIdentifier:(NSString *)identifier;
+
+// Discards partial downloads which haven't made progress in `maxAge`.
+- (void)removePartialDownloadsOlderThan:(NSTimeInterval)maxAge;
+
+// Cancels all downloads and releases the URL session.  The downloader can't be used afterward.
+- (void)invalidate;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,911 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSSegmentedDownloader.h"
+#import "OWSError.h"
+#import "OWSFileSystem.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const NSUInteger kOWSSegmentedDownloaderDefaultMaxConcurrentRequests = 4;
+static const NSUInteger kOWSSegmentedDownloaderDefaultMaxConcurrentRequestsPerDownload = 3;
+static const unsigned long long kOWSSegmentedDownloaderDefaultSegmentLength = 512 * 1024;
+static const NSUInteger kOWSSegmentedDownloaderDefaultMaxAttemptsPerSegment = 4;
+static const NSTimeInterval kOWSSegmentedDownloaderDefaultRetryBaseInterval = 1;
+// A stalled request should fail and be retried rather than hold a slot indefinitely.
+static const NSTimeInterval kOWSSegmentedDownloaderRequestTimeout = 30;
+// Don't flood observers with progress for every packet.
+static const double kOWSSegmentedDownloaderProgressGranularity = 0.01;
+
+static NSString *const kManifestKeyContentLength = @"contentLength";
+static NSString *const kManifestKeySegmentLength = @"segmentLength";
+static NSString *const kManifestKeyEntityTag = @"entityTag";
+static NSString *const kManifestKeyCompletedSegments = @"completedSegments";
+
+@implementation OWSDownloadSegment
+
+- (instancetype)initWithIndex:(NSUInteger)index start:(unsigned long long)start length:(unsigned long long)length
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    OWSAssertDebug(length > 0);
+
+    _index = index;
+    _start = start;
+    _length = length;
+
+    return self;
+}
+
+- (NSString *)rangeHeaderValue
+{
+    return [NSString stringWithFormat:@"bytes=%llu-%llu", self.start, self.start + self.length - 1];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@ %lu: %llu+%llu>",
+                     self.class,
+                     (unsigned long)self.index,
+                     self.start,
+                     self.length];
+}
+
+@end
+
+#pragma mark -
+
+// The state of a single download.  Should only be accessed on the downloader's serial queue.
+@interface OWSSegmentedDownload : NSObject
+
+@property (nonatomic, readonly) NSString *identifier;
+@property (nonatomic) NSURL *url;
+@property (nonatomic, readonly) NSString *dataFilePath;
+@property (nonatomic, readonly) NSString *manifestFilePath;
+
+// nil until the content length is known.
+@property (nonatomic, nullable) NSArray<OWSDownloadSegment *> *segments;
+@property (nonatomic) unsigned long long contentLength;
+@property (nonatomic) unsigned long long segmentLength;
+@property (nonatomic, nullable) NSString *entityTag;
+@property (nonatomic, nullable) NSFileHandle *fileHandle;
+
+@property (nonatomic, readonly) NSMutableIndexSet *completedSegments;
+@property (nonatomic, readonly) NSMutableIndexSet *activeSegments;
+// Segments waiting out their retry backoff.
+@property (nonatomic, readonly) NSMutableIndexSet *delayedSegments;
+@property (nonatomic, readonly) NSMutableDictionary<NSNumber *, NSNumber *> *attemptCounts;
+@property (nonatomic, readonly) NSMutableSet<NSURLSessionTask *> *tasks;
+@property (nonatomic) unsigned long long inFlightByteCount;
+@property (nonatomic) double lastReportedProgress;
+
+@property (nonatomic, readonly) NSMutableArray<OWSSegmentedDownloadProgressBlock> *progressBlocks;
+@property (nonatomic, readonly) NSMutableArray<OWSSegmentedDownloadSuccessBlock> *successBlocks;
+@property (nonatomic, readonly) NSMutableArray<OWSSegmentedDownloadFailureBlock> *failureBlocks;
+
+@end
+
+@implementation OWSSegmentedDownload
+
+- (instancetype)initWithIdentifier:(NSString *)identifier url:(NSURL *)url storageDirectory:(NSString *)storageDirectory
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _identifier = identifier;
+    _url = url;
+
+    NSString *fileName =
+        [identifier stringByAddingPercentEncodingWithAllowedCharacters:[NSCharacterSet alphanumericCharacterSet]];
+    _dataFilePath = [storageDirectory stringByAppendingPathComponent:[fileName stringByAppendingPathExtension:@"partial"]];
+    _manifestFilePath = [storageDirectory stringByAppendingPathComponent:[fileName stringByAppendingPathExtension:@"plist"]];
+
+    _completedSegments = [NSMutableIndexSet new];
+    _activeSegments = [NSMutableIndexSet new];
+    _delayedSegments = [NSMutableIndexSet new];
+    _attemptCounts = [NSMutableDictionary new];
+    _tasks = [NSMutableSet new];
+    _progressBlocks = [NSMutableArray new];
+    _successBlocks = [NSMutableArray new];
+    _failureBlocks = [NSMutableArray new];
+
+    return self;
+}
+
+- (BOOL)isComplete
+{
+    return self.segments != nil && self.completedSegments.count == self.segments.count;
+}
+
+- (nullable OWSDownloadSegment *)nextWaitingSegment
+{
+    for (OWSDownloadSegment *segment in self.segments) {
+        NSUInteger index = segment.index;
+        if (![self.completedSegments containsIndex:index] && ![self.activeSegments containsIndex:index]
+            && ![self.delayedSegments containsIndex:index]) {
+            return segment;
+        }
+    }
+    return nil;
+}
+
+- (unsigned long long)completedByteCount
+{
+    unsigned long long result = 0;
+    for (OWSDownloadSegment *segment in self.segments) {
+        if ([self.completedSegments containsIndex:segment.index]) {
+            result += segment.length;
+        }
+    }
+    return result;
+}
+
+- (NSUInteger)incrementAttemptCountForSegmentIndex:(NSUInteger)index
+{
+    NSUInteger attemptCount = self.attemptCounts[@(index)].unsignedIntegerValue + 1;
+    self.attemptCounts[@(index)] = @(attemptCount);
+    return attemptCount;
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSSegmentRequest : NSObject
+
+@property (nonatomic, readonly) OWSSegmentedDownload *download;
+@property (nonatomic, readonly) NSUInteger segmentIndex;
+// The first request of a new download also discovers the length of the resource.
+@property (nonatomic, readonly) BOOL isProbe;
+@property (nonatomic, readonly) unsigned long long requestedLength;
+@property (nonatomic, readonly) NSMutableData *data;
+
+@end
+
+@implementation OWSSegmentRequest
+
+- (instancetype)initWithDownload:(OWSSegmentedDownload *)download
+                    segmentIndex:(NSUInteger)segmentIndex
+                         isProbe:(BOOL)isProbe
+                 requestedLength:(unsigned long long)requestedLength
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _download = download;
+    _segmentIndex = segmentIndex;
+    _isProbe = isProbe;
+    _requestedLength = requestedLength;
+    _data = [NSMutableData new];
+
+    return self;
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSSegmentedDownloader () <NSURLSessionDataDelegate>
+
+@property (nonatomic, readonly) NSURLSession *session;
+@property (nonatomic, readonly) NSString *storageDirectory;
+@property (nonatomic, readonly) dispatch_queue_t serialQueue;
+
+// These properties should only be accessed on the serial queue.
+//
+// Downloads are serviced in the order they were requested.
+@property (nonatomic, readonly) NSMutableArray<OWSSegmentedDownload *> *downloads;
+@property (nonatomic, readonly) NSMutableDictionary<NSNumber *, OWSSegmentRequest *> *requests;
+
+@end
+
+#pragma mark -
+
+@implementation OWSSegmentedDownloader
+
++ (instancetype)sharedDownloader
+{
+    static OWSSegmentedDownloader *sharedDownloader = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+        NSString *storageDirectory =
+            [[OWSFileSystem cachesDirectoryPath] stringByAppendingPathComponent:@"PartialDownloads"];
+        sharedDownloader =
+            [[self alloc] initWithSessionConfiguration:configuration storageDirectory:storageDirectory];
+    });
+    return sharedDownloader;
+}
+
+- (instancetype)initWithSessionConfiguration:(NSURLSessionConfiguration *)sessionConfiguration
+                            storageDirectory:(NSString *)storageDirectory
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _maxConcurrentRequests = kOWSSegmentedDownloaderDefaultMaxConcurrentRequests;
+    _maxConcurrentRequestsPerDownload = kOWSSegmentedDownloaderDefaultMaxConcurrentRequestsPerDownload;
+    _segmentLength = kOWSSegmentedDownloaderDefaultSegmentLength;
+    _maxAttemptsPerSegment = kOWSSegmentedDownloaderDefaultMaxAttemptsPerSegment;
+    _retryBaseInterval = kOWSSegmentedDownloaderDefaultRetryBaseInterval;
+    _maxDownloadSize = ULLONG_MAX;
+
+    _storageDirectory = storageDirectory;
+    [OWSFileSystem ensureDirectoryExists:storageDirectory];
+    [OWSFileSystem protectFileOrFolderAtPath:storageDirectory];
+
+    _serialQueue = dispatch_queue_create("org.whispersystems.segmentedDownloader", DISPATCH_QUEUE_SERIAL);
+    _downloads = [NSMutableArray new];
+    _requests = [NSMutableDictionary new];
+
+    sessionConfiguration.URLCache = nil;
+    sessionConfiguration.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    sessionConfiguration.timeoutIntervalForRequest = kOWSSegmentedDownloaderRequestTimeout;
+
+    // Session callbacks are delivered on the serial queue, so they can touch download state directly.
+    NSOperationQueue *delegateQueue = [NSOperationQueue new];
+    delegateQueue.maxConcurrentOperationCount = 1;
+    delegateQueue.underlyingQueue = _serialQueue;
+    _session = [NSURLSession sessionWithConfiguration:sessionConfiguration delegate:self delegateQueue:delegateQueue];
+
+    OWSSingletonAssert();
+
+    return self;
+}
+
+#pragma mark - Segments
+
++ (unsigned long long)segmentLengthForContentLength:(unsigned long long)contentLength
+{
+    const unsigned long long k1MB = 1024 * 1024;
+    const unsigned long long k500KB = 500 * 1024;
+    const unsigned long long k100KB = 100 * 1024;
+    const unsigned long long k50KB = 50 * 1024;
+    const unsigned long long k10KB = 10 * 1024;
+    const unsigned long long k1KB = 1 * 1024;
+    for (NSNumber *segmentLength in @[ @(k1MB), @(k500KB), @(k100KB), @(k50KB), @(k10KB), @(k1KB) ]) {
+        if (contentLength >= segmentLength.unsignedLongLongValue) {
+            return segmentLength.unsignedLongLongValue;
+        }
+    }
+    return contentLength;
+}
+
++ (NSArray<OWSDownloadSegment *> *)segmentsForContentLength:(unsigned long long)contentLength
+                                              segmentLength:(unsigned long long)segmentLength
+{
+    OWSAssertDebug(segmentLength > 0);
+
+    NSMutableArray<OWSDownloadSegment *> *segments = [NSMutableArray new];
+    unsigned long long segmentStart = 0;
+    while (segmentStart < contentLength) {
+        unsigned long long length = MIN(segmentLength, contentLength - segmentStart);
+        [segments addObject:[[OWSDownloadSegment alloc] initWithIndex:segments.count start:segmentStart length:length]];
+        segmentStart += length;
+    }
+    return [segments copy];
+}
+
+#pragma mark - Public
+
+- (void)downloadWithIdentifier:(NSString *)identifier
+                           url:(NSURL *)url
+                      progress:(nullable OWSSegmentedDownloadProgressBlock)progress
+                       success:(OWSSegmentedDownloadSuccessBlock)success
+                       failure:(OWSSegmentedDownloadFailureBlock)failure
+{
+    OWSAssertDebug(identifier.length > 0);
+    OWSAssertDebug(url);
+
+    dispatch_async(self.serialQueue, ^{
+        OWSSegmentedDownload *_Nullable download = [self downloadWithIdentifier:identifier];
+        if (download) {
+            DDLogInfo(@"%@ joining download in progress: %@", self.logTag, identifier);
+            // Later segments should use the most recent URL.
+            download.url = url;
+        } else {
+            download = [[OWSSegmentedDownload alloc] initWithIdentifier:identifier
+                                                                    url:url
+                                                       storageDirectory:self.storageDirectory];
+            [self loadManifestForDownload:download];
+            [self.downloads addObject:download];
+        }
+        if (progress) {
+            [download.progressBlocks addObject:progress];
+        }
+        [download.successBlocks addObject:success];
+        [download.failureBlocks addObject:failure];
+
+        if (download.isComplete) {
+            // The previous attempt finished downloading but its caller never consumed it.
+            [self didCompleteDownload:download];
+            return;
+        }
+
+        [self processQueue];
+    });
+}
+
+- (void)cancelDownloadWithIdentifier:(NSString *)identifier
+{
+    dispatch_async(self.serialQueue, ^{
+        OWSSegmentedDownload *_Nullable download = [self downloadWithIdentifier:identifier];
+        if (!download) {
+            return;
+        }
+        [self endDownload:download];
+        [self processQueue];
+    });
+}
+
+- (void)removeDownloadWithIdentifier:(NSString *)identifier
+{
+    dispatch_async(self.serialQueue, ^{
+        OWSSegmentedDownload *_Nullable download = [self downloadWithIdentifier:identifier];
+        if (download) {
+            [self endDownload:download];
+        } else {
+            download = [[OWSSegmentedDownload alloc] initWithIdentifier:identifier
+                                                                    url:[NSURL new]
+                                                       storageDirectory:self.storageDirectory];
+        }
+        [self deleteFilesForDownload:download];
+        [self processQueue];
+    });
+}
+
+- (void)removePartialDownloadsOlderThan:(NSTimeInterval)maxAge
+{
+    dispatch_async(self.serialQueue, ^{
+        NSMutableSet<NSString *> *activeFilePaths = [NSMutableSet new];
+        for (OWSSegmentedDownload *download in self.downloads) {
+            [activeFilePaths addObject:download.dataFilePath];
+            [activeFilePaths addObject:download.manifestFilePath];
+        }
+
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        NSError *error;
+        NSArray<NSString *> *_Nullable fileNames = [fileManager contentsOfDirectoryAtPath:self.storageDirectory
+                                                                                    error:&error];
+        if (error) {
+            DDLogError(@"%@ could not list partial downloads: %@", self.logTag, error);
+            return;
+        }
+
+        NSDate *cutoffDate = [NSDate dateWithTimeIntervalSinceNow:-maxAge];
+        NSUInteger removedCount = 0;
+        for (NSString *fileName in fileNames) {
+            NSString *filePath = [self.storageDirectory stringByAppendingPathComponent:fileName];
+            if ([activeFilePaths containsObject:filePath]) {
+                continue;
+            }
+            NSDate *_Nullable modificationDate =
+                [fileManager attributesOfItemAtPath:filePath error:nil][NSFileModificationDate];
+            if (modificationDate && [modificationDate compare:cutoffDate] == NSOrderedDescending) {
+                continue;
+            }
+            if ([OWSFileSystem deleteFileIfExists:filePath]) {
+                removedCount++;
+            }
+        }
+        if (removedCount > 0) {
+            DDLogInfo(@"%@ removed %lu stale partial download files.", self.logTag, (unsigned long)removedCount);
+        }
+    });
+}
+
+- (void)invalidate
+{
+    dispatch_sync(self.serialQueue, ^{
+        for (OWSSegmentedDownload *download in [self.downloads copy]) {
+            [self endDownload:download];
+        }
+    });
+    [self.session invalidateAndCancel];
+}
+
+#pragma mark - Scheduling
+
+- (nullable OWSSegmentedDownload *)downloadWithIdentifier:(NSString *)identifier
+{
+    for (OWSSegmentedDownload *download in self.downloads) {
+        if ([download.identifier isEqualToString:identifier]) {
+            return download;
+        }
+    }
+    return nil;
+}
+
+// Starts as many requests as the concurrency limits allow.
+- (void)processQueue
+{
+    for (OWSSegmentedDownload *download in self.downloads) {
+        while (self.requests.count < self.maxConcurrentRequests
+            && download.activeSegments.count < self.maxConcurrentRequestsPerDownload) {
+            if (!download.segments) {
+                // We can't plan the segments until the first request tells us the content length.
+                if (download.activeSegments.count > 0 || [download.delayedSegments containsIndex:0]) {
+                    break;
+                }
+                [self startRequestForDownload:download
+                                 segmentIndex:0
+                                 rangeHeader:[NSString stringWithFormat:@"bytes=0-%llu", self.segmentLength - 1]
+                                      isProbe:YES
+                              requestedLength:self.segmentLength];
+                break;
+            }
+
+            OWSDownloadSegment *_Nullable segment = [download nextWaitingSegment];
+            if (!segment) {
+                break;
+            }
+            [self startRequestForDownload:download
+                             segmentIndex:segment.index
+                              rangeHeader:segment.rangeHeaderValue
+                                  isProbe:NO
+                          requestedLength:segment.length];
+        }
+
+        if (self.requests.count >= self.maxConcurrentRequests) {
+            return;
+        }
+    }
+}
+
+- (void)startRequestForDownload:(OWSSegmentedDownload *)download
+                   segmentIndex:(NSUInteger)segmentIndex
+                    rangeHeader:(NSString *)rangeHeader
+                        isProbe:(BOOL)isProbe
+                requestedLength:(unsigned long long)requestedLength
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:download.url];
+    [request setValue:rangeHeader forHTTPHeaderField:@"Range"];
+
+    NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request];
+    self.requests[@(task.taskIdentifier)] = [[OWSSegmentRequest alloc] initWithDownload:download
+                                                                           segmentIndex:segmentIndex
+                                                                                isProbe:isProbe
+                                                                        requestedLength:requestedLength];
+    [download.activeSegments addIndex:segmentIndex];
+    [download.tasks addObject:task];
+    [task resume];
+}
+
+#pragma mark - NSURLSessionDataDelegate
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data
+{
+    OWSSegmentRequest *_Nullable request = self.requests[@(dataTask.taskIdentifier)];
+    if (!request) {
+        [dataTask cancel];
+        return;
+    }
+
+    [request.data appendData:data];
+
+    // A server which ignores the Range header sends the whole resource in response to the first request.
+    unsigned long long maxLength = request.isProbe ? self.maxDownloadSize : request.requestedLength;
+    if (request.data.length > maxLength) {
+        DDLogError(@"%@ response exceeds expected length: %llu", self.logTag, maxLength);
+        [dataTask cancel];
+        return;
+    }
+
+    OWSSegmentedDownload *download = request.download;
+    download.inFlightByteCount += data.length;
+    [self reportProgressForDownload:download];
+}
+
+- (void)URLSession:(NSURLSession *)session
+                 dataTask:(NSURLSessionDataTask *)dataTask
+        willCacheResponse:(NSCachedURLResponse *)proposedResponse
+        completionHandler:(void (^)(NSCachedURLResponse *_Nullable cachedResponse))completionHandler
+{
+    completionHandler(nil);
+}
+
+#pragma mark - NSURLSessionTaskDelegate
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(nullable NSError *)error
+{
+    OWSSegmentRequest *_Nullable request = self.requests[@(task.taskIdentifier)];
+    if (!request) {
+        // The download was cancelled.
+        return;
+    }
+    [self.requests removeObjectForKey:@(task.taskIdentifier)];
+
+    OWSSegmentedDownload *download = request.download;
+    [download.tasks removeObject:task];
+    [download.activeSegments removeIndex:request.segmentIndex];
+    download.inFlightByteCount -= MIN(download.inFlightByteCount, request.data.length);
+
+    if (error) {
+        DDLogWarn(@"%@ segment %lu of %@ failed: %@",
+            self.logTag,
+            (unsigned long)request.segmentIndex,
+            download.identifier,
+            error);
+        [self segmentRequest:request didFailWithError:error isRetryable:YES];
+    } else {
+        [self handleResponse:(NSHTTPURLResponse *)task.response forRequest:request];
+    }
+
+    [self processQueue];
+}
+
+#pragma mark - Responses
+
+- (void)handleResponse:(NSHTTPURLResponse *)response forRequest:(OWSSegmentRequest *)request
+{
+    OWSSegmentedDownload *download = request.download;
+
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        DDLogError(@"%@ missing or unexpected response: %@", self.logTag, response);
+        [self segmentRequest:request didFailWithError:[self downloadError] isRetryable:YES];
+        return;
+    }
+
+    NSInteger statusCode = response.statusCode;
+    if (statusCode != 200 && statusCode != 206) {
+        DDLogError(@"%@ response has invalid status code: %ld", self.logTag, (long)statusCode);
+        // Client errors (e.g. an expired URL) won't succeed on retry; the caller needs a new URL.
+        BOOL isRetryable = statusCode < 400 || statusCode >= 500;
+        [self segmentRequest:request
+            didFailWithError:[self downloadErrorWithStatusCode:statusCode]
+                 isRetryable:isRetryable];
+        return;
+    }
+
+    NSString *_Nullable entityTag = response.allHeaderFields[@"ETag"];
+    if (download.entityTag && entityTag && ![download.entityTag isEqualToString:entityTag]) {
+        [self resourceDidChangeForDownload:download];
+        return;
+    }
+
+    if (statusCode == 200) {
+        // The server ignored our Range header and sent the whole resource.
+        unsigned long long length = request.data.length;
+        if (length < 1) {
+            DDLogError(@"%@ full response is empty.", self.logTag);
+            [self segmentRequest:request didFailWithError:[self downloadError] isRetryable:YES];
+            return;
+        }
+        if (download.segments && length != download.contentLength) {
+            [self resourceDidChangeForDownload:download];
+            return;
+        }
+        // Any other segments in flight are now redundant.
+        [self cancelRequestsForDownload:download];
+        [self beginDownload:download contentLength:length segmentLength:length entityTag:entityTag];
+        [self writeData:request.data segmentIndex:0 download:download];
+        return;
+    }
+
+    unsigned long long rangeStart = 0;
+    unsigned long long contentLength = 0;
+    if (![self parseContentRange:response.allHeaderFields[@"Content-Range"]
+                      rangeStart:&rangeStart
+                   contentLength:&contentLength]) {
+        DDLogError(@"%@ partial response has invalid Content-Range: %@",
+            self.logTag,
+            response.allHeaderFields[@"Content-Range"]);
+        [self segmentRequest:request didFailWithError:[self downloadError] isRetryable:YES];
+        return;
+    }
+
+    if (request.isProbe) {
+        if (contentLength > self.maxDownloadSize) {
+            DDLogError(@"%@ content length exceeds max download size: %llu", self.logTag, contentLength);
+            [self failDownload:download error:[self downloadError]];
+            return;
+        }
+        [self beginDownload:download contentLength:contentLength segmentLength:self.segmentLength entityTag:entityTag];
+    } else if (contentLength != download.contentLength) {
+        [self resourceDidChangeForDownload:download];
+        return;
+    }
+
+    OWSDownloadSegment *segment = download.segments[request.segmentIndex];
+    if (rangeStart != segment.start || request.data.length != segment.length) {
+        DDLogError(@"%@ partial response doesn't match segment: %@, %llu, %lu",
+            self.logTag,
+            segment,
+            rangeStart,
+            (unsigned long)request.data.length);
+        [self segmentRequest:request didFailWithError:[self downloadError] isRetryable:YES];
+        return;
+    }
+
+    [self writeData:request.data segmentIndex:segment.index download:download];
+}
+
+// None of the download's progress is valid any more, so discard it.  The next attempt starts over.
+- (void)resourceDidChangeForDownload:(OWSSegmentedDownload *)download
+{
+    DDLogError(@"%@ resource changed during download: %@", self.logTag, download.identifier);
+
+    [self failDownload:download error:[self downloadError]];
+    [self deleteFilesForDownload:download];
+}
+
+// Parses "bytes <start>-<end>/<total>".
+- (BOOL)parseContentRange:(nullable NSString *)contentRange
+               rangeStart:(unsigned long long *)rangeStart
+            contentLength:(unsigned long long *)contentLength
+{
+    if (![contentRange isKindOfClass:[NSString class]]) {
+        return NO;
+    }
+    NSScanner *scanner = [NSScanner scannerWithString:contentRange];
+    unsigned long long rangeEnd = 0;
+    if (![scanner scanString:@"bytes" intoString:NULL] || ![scanner scanUnsignedLongLong:rangeStart]
+        || ![scanner scanString:@"-" intoString:NULL] || ![scanner scanUnsignedLongLong:&rangeEnd]
+        || ![scanner scanString:@"/" intoString:NULL] || ![scanner scanUnsignedLongLong:contentLength]) {
+        return NO;
+    }
+    return *rangeStart <= rangeEnd && rangeEnd < *contentLength;
+}
+
+#pragma mark - Writing
+
+- (void)beginDownload:(OWSSegmentedDownload *)download
+        contentLength:(unsigned long long)contentLength
+        segmentLength:(unsigned long long)segmentLength
+            entityTag:(nullable NSString *)entityTag
+{
+    [download.fileHandle closeFile];
+    download.fileHandle = nil;
+    [download.completedSegments removeAllIndexes];
+
+    download.contentLength = contentLength;
+    download.segmentLength = segmentLength;
+    download.entityTag = entityTag;
+    download.segments = [OWSSegmentedDownloader segmentsForContentLength:contentLength segmentLength:segmentLength];
+
+    [OWSFileSystem deleteFileIfExists:download.manifestFilePath];
+    [OWSFileSystem deleteFileIfExists:download.dataFilePath];
+    if (![[NSFileManager defaultManager] createFileAtPath:download.dataFilePath contents:nil attributes:nil]) {
+        DDLogError(@"%@ could not create partial file: %@", self.logTag, download.dataFilePath);
+    }
+}
+
+- (void)writeData:(NSData *)data segmentIndex:(NSUInteger)segmentIndex download:(OWSSegmentedDownload *)download
+{
+    OWSDownloadSegment *segment = download.segments[segmentIndex];
+
+    @try {
+        if (!download.fileHandle) {
+            download.fileHandle = [NSFileHandle fileHandleForWritingAtPath:download.dataFilePath];
+        }
+        if (!download.fileHandle) {
+            DDLogError(@"%@ could not open partial file: %@", self.logTag, download.dataFilePath);
+            [self failDownload:download error:OWSErrorMakeWriteAttachmentDataError()];
+            return;
+        }
+        [download.fileHandle seekToFileOffset:segment.start];
+        [download.fileHandle writeData:data];
+        // The manifest must never claim data which isn't on disk.
+        [download.fileHandle synchronizeFile];
+    } @catch (NSException *exception) {
+        DDLogError(@"%@ could not write partial file: %@", self.logTag, exception);
+        [self failDownload:download error:OWSErrorMakeWriteAttachmentDataError()];
+        return;
+    }
+
+    [download.completedSegments addIndex:segmentIndex];
+    [self saveManifestForDownload:download];
+    [self reportProgressForDownload:download];
+
+    if (download.isComplete) {
+        [self didCompleteDownload:download];
+    }
+}
+
+- (void)reportProgressForDownload:(OWSSegmentedDownload *)download
+{
+    if (download.contentLength < 1) {
+        return;
+    }
+    double progress = MIN(1.0,
+        (double)(download.completedByteCount + download.inFlightByteCount) / (double)download.contentLength);
+    if (progress - download.lastReportedProgress < kOWSSegmentedDownloaderProgressGranularity && progress < 1.0) {
+        return;
+    }
+    download.lastReportedProgress = progress;
+
+    NSArray<OWSSegmentedDownloadProgressBlock> *progressBlocks = [download.progressBlocks copy];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (OWSSegmentedDownloadProgressBlock progressBlock in progressBlocks) {
+            progressBlock(progress);
+        }
+    });
+}
+
+#pragma mark - Completion
+
+- (void)segmentRequest:(OWSSegmentRequest *)request didFailWithError:(NSError *)error isRetryable:(BOOL)isRetryable
+{
+    OWSSegmentedDownload *download = request.download;
+    NSUInteger segmentIndex = request.segmentIndex;
+    NSUInteger attemptCount = [download incrementAttemptCountForSegmentIndex:segmentIndex];
+    if (!isRetryable || attemptCount >= self.maxAttemptsPerSegment) {
+        [self failDownload:download error:error];
+        return;
+    }
+
+    // Back off exponentially, with jitter so that parallel segments don't retry in lockstep.
+    NSTimeInterval delay = self.retryBaseInterval * pow(2, attemptCount - 1) * (0.5 + arc4random_uniform(1000) / 1000.0);
+    DDLogInfo(@"%@ retrying segment %lu of %@ in %.1fs",
+        self.logTag,
+        (unsigned long)segmentIndex,
+        download.identifier,
+        delay);
+    [download.delayedSegments addIndex:segmentIndex];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.serialQueue, ^{
+        [download.delayedSegments removeIndex:segmentIndex];
+        [self processQueue];
+    });
+}
+
+- (void)didCompleteDownload:(OWSSegmentedDownload *)download
+{
+    DDLogInfo(@"%@ completed download: %@, %llu bytes", self.logTag, download.identifier, download.contentLength);
+
+    NSArray<OWSSegmentedDownloadSuccessBlock> *successBlocks = [download.successBlocks copy];
+    NSString *filePath = download.dataFilePath;
+    [self endDownload:download];
+
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (OWSSegmentedDownloadSuccessBlock successBlock in successBlocks) {
+            successBlock(filePath);
+        }
+    });
+}
+
+// Completed segments remain on disk so that the next attempt can resume.
+- (void)failDownload:(OWSSegmentedDownload *)download error:(NSError *)error
+{
+    DDLogError(@"%@ download failed: %@, %lu/%lu segments complete, %@",
+        self.logTag,
+        download.identifier,
+        (unsigned long)download.completedSegments.count,
+        (unsigned long)download.segments.count,
+        error);
+
+    NSArray<OWSSegmentedDownloadFailureBlock> *failureBlocks = [download.failureBlocks copy];
+    [self endDownload:download];
+
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (OWSSegmentedDownloadFailureBlock failureBlock in failureBlocks) {
+            failureBlock(error);
+        }
+    });
+}
+
+- (void)cancelRequestsForDownload:(OWSSegmentedDownload *)download
+{
+    for (NSURLSessionTask *task in download.tasks) {
+        [self.requests removeObjectForKey:@(task.taskIdentifier)];
+        [task cancel];
+    }
+    [download.tasks removeAllObjects];
+    [download.activeSegments removeAllIndexes];
+    download.inFlightByteCount = 0;
+}
+
+- (void)endDownload:(OWSSegmentedDownload *)download
+{
+    [self cancelRequestsForDownload:download];
+    [download.progressBlocks removeAllObjects];
+    [download.successBlocks removeAllObjects];
+    [download.failureBlocks removeAllObjects];
+
+    [download.fileHandle closeFile];
+    download.fileHandle = nil;
+
+    [self.downloads removeObject:download];
+}
+
+#pragma mark - Persistence
+
+- (void)loadManifestForDownload:(OWSSegmentedDownload *)download
+{
+    NSDictionary *_Nullable manifest = [NSDictionary dictionaryWithContentsOfFile:download.manifestFilePath];
+    if (!manifest) {
+        return;
+    }
+
+    NSNumber *_Nullable contentLength = manifest[kManifestKeyContentLength];
+    NSNumber *_Nullable segmentLength = manifest[kManifestKeySegmentLength];
+    NSString *_Nullable entityTag = manifest[kManifestKeyEntityTag];
+    NSArray *_Nullable completedSegments = manifest[kManifestKeyCompletedSegments];
+    NSNumber *_Nullable fileSize = [OWSFileSystem fileSizeOfPath:download.dataFilePath];
+    if (![contentLength isKindOfClass:[NSNumber class]] || ![segmentLength isKindOfClass:[NSNumber class]]
+        || ![completedSegments isKindOfClass:[NSArray class]] || fileSize == nil
+        || contentLength.unsignedLongLongValue < 1 || segmentLength.unsignedLongLongValue < 1) {
+        DDLogWarn(@"%@ discarding invalid manifest: %@", self.logTag, download.identifier);
+        [self deleteFilesForDownload:download];
+        return;
+    }
+
+    download.contentLength = contentLength.unsignedLongLongValue;
+    download.segmentLength = segmentLength.unsignedLongLongValue;
+    download.entityTag = [entityTag isKindOfClass:[NSString class]] ? entityTag : nil;
+    download.segments = [OWSSegmentedDownloader segmentsForContentLength:download.contentLength
+                                                           segmentLength:download.segmentLength];
+    for (NSNumber *segmentIndex in completedSegments) {
+        if (![segmentIndex isKindOfClass:[NSNumber class]]
+            || segmentIndex.unsignedIntegerValue >= download.segments.count) {
+            continue;
+        }
+        OWSDownloadSegment *segment = download.segments[segmentIndex.unsignedIntegerValue];
+        // Only trust segments which actually made it to disk.
+        if (segment.start + segment.length <= fileSize.unsignedLongLongValue) {
+            [download.completedSegments addIndex:segment.index];
+        }
+    }
+
+    DDLogInfo(@"%@ resuming download: %@, %lu/%lu segments complete",
+        self.logTag,
+        download.identifier,
+        (unsigned long)download.completedSegments.count,
+        (unsigned long)download.segments.count);
+}
+
+- (void)saveManifestForDownload:(OWSSegmentedDownload *)download
+{
+    NSMutableArray<NSNumber *> *completedSegments = [NSMutableArray new];
+    [download.completedSegments enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        [completedSegments addObject:@(index)];
+    }];
+
+    NSMutableDictionary *manifest = [NSMutableDictionary new];
+    manifest[kManifestKeyContentLength] = @(download.contentLength);
+    manifest[kManifestKeySegmentLength] = @(download.segmentLength);
+    manifest[kManifestKeyEntityTag] = download.entityTag;
+    manifest[kManifestKeyCompletedSegments] = completedSegments;
+
+    if (![manifest writeToFile:download.manifestFilePath atomically:YES]) {
+        DDLogError(@"%@ could not write manifest: %@", self.logTag, download.identifier);
+    }
+}
+
+- (void)deleteFilesForDownload:(OWSSegmentedDownload *)download
+{
+    [OWSFileSystem deleteFileIfExists:download.manifestFilePath];
+    [OWSFileSystem deleteFileIfExists:download.dataFilePath];
+}
+
+#pragma mark - Errors
+
+- (NSError *)downloadError
+{
+    return OWSErrorWithCodeDescription(OWSErrorCodeDownloadFailed,
+        NSLocalizedString(@"ERROR_DESCRIPTION_REQUEST_FAILED", @"Error indicating that a socket request failed."));
+}
+
+- (NSError *)downloadErrorWithStatusCode:(NSInteger)statusCode
+{
+    return [NSError errorWithDomain:OWSRelayServiceKitErrorDomain
+                               code:OWSErrorCodeDownloadFailed
+                           userInfo:@{
+                               NSLocalizedDescriptionKey : NSLocalizedString(@"ERROR_DESCRIPTION_REQUEST_FAILED",
+                                   @"Error indicating that a socket request failed."),
+                               OWSErrorHTTPStatusCodeKey : @(statusCode),
+                           }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -3,7 +3,7 @@
 //
 
 import Foundation
-import os
+import Reachability
 
 @objc
 public class OutageDetection: NSObject {
@@ -25,106 +25,66 @@ public class OutageDetection: NSObject {
             }
         }
     }
-    private var shouldCheckForOutage = false {
-        didSet {
-            AssertIsOnMainThread(file: #function)
 
-            ensureCheckTimer()
-        }
-    }
+    // An outage is only declared once connections have kept failing for a while with the network reachable, so
+    // that a flaky or missing network isn't mistaken for one.
+    @objc public static let outageFailureCount = 3
+    @objc public static let outageDuration: TimeInterval = 60
 
-    // We only show the outage warning when we're certain there's an outage.
-    // DNS lookup failures, etc. are not considered an outage.
-    private func checkForOutageSync() -> Bool {
-        let host = CFHostCreateWithName(nil, "api.forsta.io" as CFString).takeRetainedValue()
-        CFHostStartInfoResolution(host, .addresses, nil)
-        var success: DarwinBoolean = false
-        guard let addresses = CFHostGetAddressing(host, &success)?.takeUnretainedValue() as NSArray? else {
-            Logger.error("\(logTag) CFHostGetAddressing failed: no addresses.")
-            return false
-        }
-        guard success.boolValue else {
-            Logger.error("\(logTag) CFHostGetAddressing failed.")
-            return false
-        }
-        var isOutageDetected = false
-        for case let address as NSData in addresses {
-            var hostname = [CChar](repeating: 0, count: Int(NI_MAXHOST))
-            if getnameinfo(address.bytes.assumingMemoryBound(to: sockaddr.self), socklen_t(address.length),
-                           &hostname, socklen_t(hostname.count), nil, 0, NI_NUMERICHOST) == 0 {
-                let addressString = String(cString: hostname)
-                let kHealthyAddress = "127.0.0.1"
-                let kOutageAddress = "127.0.0.2"
-                if addressString == kHealthyAddress {
-                    // Do nothing.
-                } else if addressString == kOutageAddress {
-                    isOutageDetected = true
-                } else {
-                    // For now, log an error until our outage strategy is firmed up.
-                    Logger.error("\(logTag) unexpected address: \(addressString)")
-//                    owsFailDebug("\(logTag) unexpected address: \(addressString)")
-                }
-            }
-        }
-        return isOutageDetected
-    }
+    private var consecutiveFailureCount = 0
+    private var firstFailureDate: Date?
 
-    private func checkForOutageAsync() {
-        Logger.info("\(self.logTag) \(#function).")
+    private lazy var reachability: Reachability? = Reachability.forInternetConnection()
 
-        DispatchQueue.global().async {
-            let isOutageDetected = self.checkForOutageSync()
-            DispatchQueue.main.async {
-                self.hasOutage = isOutageDetected
-            }
-        }
-    }
+    // Exposed for testing.
+    @objc
+    public func connectionDidFail(date: Date, isNetworkReachable: Bool) {
+        AssertIsOnMainThread(file: #function)
 
-    private var checkTimer: Timer?
-    private func ensureCheckTimer() {
-        // Only monitor for outages in the main app.
-        guard CurrentAppContext().isMainApp else {
+        guard isNetworkReachable else {
+            // Offline rather than an outage.
+            connectionDidSucceed()
             return
         }
 
-        if shouldCheckForOutage {
-            if checkTimer != nil {
-                // Already has timer.
-                return
-            }
-
-            // The TTL of the DNS record is 60 seconds.
-            checkTimer = WeakTimer.scheduledTimer(timeInterval: 60, target: self, userInfo: nil, repeats: true) { [weak self] _ in
-                AssertIsOnMainThread(file: #function)
+        consecutiveFailureCount += 1
+        let firstFailureDate = self.firstFailureDate ?? date
+        self.firstFailureDate = firstFailureDate
 
-                guard CurrentAppContext().isMainAppAndActive else {
-                    return
-                }
+        if consecutiveFailureCount >= OutageDetection.outageFailureCount &&
+            date.timeIntervalSince(firstFailureDate) >= OutageDetection.outageDuration {
+            hasOutage = true
+        }
+    }
 
-                guard let strongSelf = self else {
-                    return
-                }
+    // Exposed for testing.
+    @objc
+    public func connectionDidSucceed() {
+        AssertIsOnMainThread(file: #function)
 
-                strongSelf.checkForOutageAsync()
-            }
-        } else {
-            checkTimer?.invalidate()
-            checkTimer = nil
-        }
+        consecutiveFailureCount = 0
+        firstFailureDate = nil
+        hasOutage = false
     }
 
     @objc
     public func reportConnectionSuccess() {
         DispatchMainThreadSafe {
-            self.shouldCheckForOutage = false
-            self.hasOutage = false
+            self.connectionDidSucceed()
         }
     }
 
     @objc
     public func reportConnectionFailure() {
+        // Only monitor for outages in the main app.
+        guard CurrentAppContext().isMainApp else {
+            return
+        }
+
+        let date = Date()
         DispatchMainThreadSafe {
-            self.shouldCheckForOutage = true
+            let isNetworkReachable = self.reachability?.isReachable() ?? true
+            self.connectionDidFail(date: date, isNetworkReachable: isNetworkReachable)
         }
     }
 }
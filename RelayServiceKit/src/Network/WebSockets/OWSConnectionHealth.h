@@ -0,0 +1,81 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NSTimeInterval (^OWSConnectionHealthClock)(void);
+
+// Tracks the health of a long-lived connection, from which it decides how long to wait before reconnecting and
+// how often to send heartbeats.
+//
+// * Reconnects back off exponentially, with jitter so that clients don't retry in lockstep after an outage.  The
+//   backoff is reset once a connection has answered a heartbeat, rather than as soon as it opens, so that a
+//   server which accepts connections and drops them keeps being backed off from.  It's also reset when the
+//   network changes, which is worth retrying at once.
+// * Round-trip times and losses are estimated from heartbeats, much as TCP estimates them (RFC 6298).  A heartbeat
+//   which isn't answered within the retransmission timeout those estimates give is lost.
+// * Heartbeats are sent less often on a healthy connection and more often on a lossy one, so that a connection
+//   which has died is noticed sooner; a connection is dead once several heartbeats in a row have been lost.
+//
+// Not thread safe; TSSocketManager only uses it from the main thread.
+@interface OWSConnectionHealth : NSObject
+
+// Seconds on a monotonic clock.  Tests replace it to simulate the passage of time.
+@property (nonatomic) OWSConnectionHealthClock clock;
+
+@property (nonatomic) NSTimeInterval minReconnectDelay;
+@property (nonatomic) NSTimeInterval maxReconnectDelay;
+
+@property (nonatomic) NSTimeInterval minHeartbeatInterval;
+@property (nonatomic) NSTimeInterval maxHeartbeatInterval;
+
+@property (nonatomic) NSUInteger maxConsecutiveLostHeartbeats;
+
+#pragma mark - Reconnects
+
+// The number of reconnects since a connection last answered a heartbeat.
+@property (nonatomic, readonly) NSUInteger reconnectAttemptCount;
+
+// How long to wait before the next reconnect, which is counted as an attempt.
+- (NSTimeInterval)nextReconnectDelay;
+
+- (void)resetReconnectBackoff;
+
+#pragma mark - Connections
+
+- (void)connectionDidOpen;
+
+- (void)connectionDidClose;
+
+#pragma mark - Heartbeats
+
+// Returns the heartbeat's sequence number, to be sent with it and returned in its response.
+- (uint64_t)didSendHeartbeat;
+
+// Resets the reconnect backoff, as the connection has stayed up long enough to be answered.
+- (void)didReceiveHeartbeatResponse:(uint64_t)sequenceNumber;
+
+// Called once the heartbeat has had `heartbeatTimeout` to be answered.  Returns YES if the connection is dead.
+- (BOOL)heartbeatDidTimeOut:(uint64_t)sequenceNumber;
+
+#pragma mark - Estimates
+
+// Nil until a heartbeat has been answered.
+@property (nonatomic, readonly, nullable) NSNumber *smoothedRoundTripTime;
+@property (nonatomic, readonly, nullable) NSNumber *roundTripTimeVariation;
+
+// The proportion of recent heartbeats which went unanswered, from 0 to 1.
+@property (nonatomic, readonly) double lossRate;
+
+@property (nonatomic, readonly) NSUInteger consecutiveLostHeartbeatCount;
+
+// How long a heartbeat has to be answered before it's lost.
+- (NSTimeInterval)heartbeatTimeout;
+
+// How long to wait after a heartbeat before sending the next one.
+- (NSTimeInterval)heartbeatInterval;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,178 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSConnectionHealth.h"
+#import <QuartzCore/QuartzCore.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The gains of the round-trip time estimators, from RFC 6298.
+static const double kRoundTripTimeGain = 1 / 8.0;
+static const double kRoundTripTimeVariationGain = 1 / 4.0;
+// Loss is more bursty than latency, so recent heartbeats count for more.
+static const double kLossRateGain = 1 / 4.0;
+// Heartbeats are sent as often as they can be at this loss rate, or higher.
+static const double kHighLossRate = 0.5;
+
+// Before any heartbeat has been answered; the same as the timeout for socket requests.
+static const NSTimeInterval kInitialHeartbeatTimeout = 10;
+static const NSTimeInterval kMinHeartbeatTimeout = 2;
+static const NSTimeInterval kMaxHeartbeatTimeout = 20;
+
+@interface OWSConnectionHealth ()
+
+@property (nonatomic) NSUInteger reconnectAttemptCount;
+
+@property (nonatomic) uint64_t lastSequenceNumber;
+// Send times of the heartbeats which are yet to be answered or time out, keyed by sequence number.
+@property (nonatomic, readonly) NSMutableDictionary<NSNumber *, NSNumber *> *pendingHeartbeats;
+
+@property (nonatomic, nullable) NSNumber *smoothedRoundTripTime;
+@property (nonatomic, nullable) NSNumber *roundTripTimeVariation;
+@property (nonatomic) double lossRate;
+@property (nonatomic) NSUInteger consecutiveLostHeartbeatCount;
+
+@end
+
+#pragma mark -
+
+@implementation OWSConnectionHealth
+
+- (instancetype)init
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _clock = ^{
+        return (NSTimeInterval)CACurrentMediaTime();
+    };
+    _minReconnectDelay = 1;
+    _maxReconnectDelay = 2 * 60;
+    _minHeartbeatInterval = 10;
+    _maxHeartbeatInterval = 30;
+    _maxConsecutiveLostHeartbeats = 2;
+    _pendingHeartbeats = [NSMutableDictionary new];
+
+    return self;
+}
+
+#pragma mark - Reconnects
+
+- (NSTimeInterval)nextReconnectDelay
+{
+    // Capped before it's raised, so that it can't overflow.
+    NSUInteger exponent = MIN(self.reconnectAttemptCount, 30);
+    self.reconnectAttemptCount++;
+
+    NSTimeInterval delay = MIN(self.maxReconnectDelay, self.minReconnectDelay * pow(2, exponent));
+    // Somewhere in the upper half of the delay, so that it still grows with each attempt.
+    return delay * (0.5 + arc4random_uniform(1000) / 2000.0);
+}
+
+- (void)resetReconnectBackoff
+{
+    self.reconnectAttemptCount = 0;
+}
+
+#pragma mark - Connections
+
+- (void)connectionDidOpen
+{
+    [self forgetPendingHeartbeats];
+}
+
+- (void)connectionDidClose
+{
+    [self forgetPendingHeartbeats];
+}
+
+// The estimates are kept, as the network is likely to be no different for the next connection.
+- (void)forgetPendingHeartbeats
+{
+    [self.pendingHeartbeats removeAllObjects];
+    self.consecutiveLostHeartbeatCount = 0;
+}
+
+#pragma mark - Heartbeats
+
+- (uint64_t)didSendHeartbeat
+{
+    self.lastSequenceNumber++;
+    self.pendingHeartbeats[@(self.lastSequenceNumber)] = @(self.clock());
+    return self.lastSequenceNumber;
+}
+
+- (void)didReceiveHeartbeatResponse:(uint64_t)sequenceNumber
+{
+    NSNumber *_Nullable sendTime = self.pendingHeartbeats[@(sequenceNumber)];
+    if (!sendTime) {
+        // Already counted as lost, or from a previous connection.
+        DDLogVerbose(@"%@ Ignoring response to heartbeat: %llu", self.logTag, sequenceNumber);
+        return;
+    }
+    [self.pendingHeartbeats removeObjectForKey:@(sequenceNumber)];
+
+    NSTimeInterval roundTripTime = MAX(0, self.clock() - sendTime.doubleValue);
+    if (!self.smoothedRoundTripTime) {
+        self.smoothedRoundTripTime = @(roundTripTime);
+        self.roundTripTimeVariation = @(roundTripTime / 2);
+    } else {
+        double smoothedRoundTripTime = self.smoothedRoundTripTime.doubleValue;
+        double roundTripTimeVariation = self.roundTripTimeVariation.doubleValue;
+        self.roundTripTimeVariation = @((1 - kRoundTripTimeVariationGain) * roundTripTimeVariation
+            + kRoundTripTimeVariationGain * fabs(smoothedRoundTripTime - roundTripTime));
+        self.smoothedRoundTripTime
+            = @((1 - kRoundTripTimeGain) * smoothedRoundTripTime + kRoundTripTimeGain * roundTripTime);
+    }
+
+    self.lossRate = (1 - kLossRateGain) * self.lossRate;
+    self.consecutiveLostHeartbeatCount = 0;
+    [self resetReconnectBackoff];
+}
+
+- (BOOL)heartbeatDidTimeOut:(uint64_t)sequenceNumber
+{
+    if (!self.pendingHeartbeats[@(sequenceNumber)]) {
+        // Answered in time.
+        return NO;
+    }
+    [self.pendingHeartbeats removeObjectForKey:@(sequenceNumber)];
+
+    self.lossRate = (1 - kLossRateGain) * self.lossRate + kLossRateGain;
+    self.consecutiveLostHeartbeatCount++;
+
+    DDLogWarn(@"%@ Heartbeat %llu lost; %lu in a row, loss rate: %.2f.",
+        self.logTag,
+        sequenceNumber,
+        (unsigned long)self.consecutiveLostHeartbeatCount,
+        self.lossRate);
+
+    return self.consecutiveLostHeartbeatCount >= self.maxConsecutiveLostHeartbeats;
+}
+
+#pragma mark - Estimates
+
+- (NSTimeInterval)heartbeatTimeout
+{
+    if (!self.smoothedRoundTripTime) {
+        return kInitialHeartbeatTimeout;
+    }
+    NSTimeInterval timeout = self.smoothedRoundTripTime.doubleValue + 4 * self.roundTripTimeVariation.doubleValue;
+    return MAX(kMinHeartbeatTimeout, MIN(kMaxHeartbeatTimeout, timeout));
+}
+
+- (NSTimeInterval)heartbeatInterval
+{
+    double lossFactor = MIN(1, self.lossRate / kHighLossRate);
+    NSTimeInterval interval
+        = self.maxHeartbeatInterval - (self.maxHeartbeatInterval - self.minHeartbeatInterval) * lossFactor;
+    // Only ever one heartbeat waiting for an answer.
+    return MAX(interval, self.heartbeatTimeout);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
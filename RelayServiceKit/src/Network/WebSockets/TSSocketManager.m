@@ -9,6 +9,7 @@
 #import "NSTimer+OWS.h"
 #import "NotificationsProtocol.h"
 #import "OWSBackgroundTask.h"
+#import "OWSConnectionHealth.h"
 #import "OWSError.h"
 #import "OWSMessageManager.h"
 #import "OWSMessageReceiver.h"
@@ -26,14 +27,12 @@
 #import "OWSDevice.h"
 #import <RelayServiceKit/RelayServiceKit-Swift.h>
 #import "SSKAsserts.h"
+#import <Reachability/Reachability.h>
 
 @import SignalCoreKit;
 
 NS_ASSUME_NONNULL_BEGIN
 
-static const CGFloat kSocketHeartbeatPeriodSeconds = 30.f;
-static const CGFloat kSocketReconnectDelaySeconds = 5.f;
-
 // If the app is in the background, it should keep the
 // websocket open if:
 //
@@ -160,8 +159,13 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
 // to keep it alive and connected.
 @property (nonatomic, nullable) SRWebSocket *websocket;
 @property (nonatomic, nullable) NSTimer *heartbeatTimer;
+@property (nonatomic, nullable) NSTimer *heartbeatTimeoutTimer;
 @property (nonatomic, nullable) NSTimer *reconnectTimer;
 
+// Decides how long to wait between reconnects and heartbeats.
+@property (nonatomic, readonly) OWSConnectionHealth *connectionHealth;
+@property (nonatomic, nullable) Reachability *reachability;
+
 #pragma mark -
 
 // The second tier is the state property.  We initiate changes
@@ -226,6 +230,7 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
     _messageReceiver = [OWSMessageReceiver sharedInstance];
     _state = SocketManagerStateClosed;
     _socketMessageMap = [NSMutableDictionary new];
+    _connectionHealth = [OWSConnectionHealth new];
 
     OWSSingletonAssert();
 
@@ -235,6 +240,7 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
 - (void)dealloc
 {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [self.reachability stopNotifier];
 }
 
 // We want to observe these notifications lazily to avoid accessing
@@ -260,6 +266,13 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
                                              selector:@selector(registrationStateDidChange:)
                                                  name:RegistrationStateDidChangeNotification
                                                object:nil];
+
+    self.reachability = [Reachability reachabilityForInternetConnection];
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(reachabilityChanged:)
+                                                 name:kReachabilityChangedNotification
+                                               object:self.reachability];
+    [self.reachability startNotifier];
 }
 
 + (instancetype)sharedManager {
@@ -373,14 +386,8 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
         case SocketManagerStateOpen: {
             OWSAssertDebug(self.state == SocketManagerStateConnecting);
 
-            self.heartbeatTimer = [NSTimer timerWithTimeInterval:kSocketHeartbeatPeriodSeconds
-                                                          target:self
-                                                        selector:@selector(webSocketHeartBeat)
-                                                        userInfo:nil
-                                                         repeats:YES];
-
-            // Additionally, we want the ping timer to work in the background too.
-            [[NSRunLoop mainRunLoop] addTimer:self.heartbeatTimer forMode:NSDefaultRunLoopMode];
+            [self.connectionHealth connectionDidOpen];
+            [self scheduleHeartbeat];
 
             // If the socket is open, we don't need to worry about reconnecting.
             [self clearReconnect];
@@ -440,6 +447,9 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
     self.websocket = nil;
     [self.heartbeatTimer invalidate];
     self.heartbeatTimer = nil;
+    [self.heartbeatTimeoutTimer invalidate];
+    self.heartbeatTimeoutTimer = nil;
+    [self.connectionHealth connectionDidClose];
 }
 
 +(void)closeWebSocket
@@ -698,6 +708,11 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
         if (statusCode.unsignedIntegerValue == 403) {
             [TSAccountManager.sharedInstance setIsDeregistered:YES];
         }
+        // The server turned the connection down, so it isn't out.
+        if (statusCode.unsignedIntegerValue > 0 && statusCode.unsignedIntegerValue < 500) {
+            [self handleSocketFailureIsOutage:NO];
+            return;
+        }
     }
 
     [self handleSocketFailure];
@@ -821,6 +836,12 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
 }
 
 - (void)handleSocketFailure
+{
+    [self handleSocketFailureIsOutage:YES];
+}
+
+// Only failures to reach the server count towards an outage.
+- (void)handleSocketFailureIsOutage:(BOOL)isOutage
 {
     OWSAssertIsOnMainThread();
 
@@ -835,7 +856,11 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
         [self applyDesiredSocketState];
     }
 
-    [OutageDetection.sharedManager reportConnectionFailure];
+    if (isOutage) {
+        [OutageDetection.sharedManager reportConnectionFailure];
+    } else {
+        [OutageDetection.sharedManager reportConnectionSuccess];
+    }
 }
 
 - (void)webSocket:(SRWebSocket *)webSocket
@@ -855,16 +880,28 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
     [self handleSocketFailure];
 }
 
+#pragma mark - Heartbeats
+
+// Heartbeats are sent at an interval tuned to the connection's health, rather than on a repeating timer.
+- (void)scheduleHeartbeat
+{
+    OWSAssertIsOnMainThread();
+
+    [self.heartbeatTimer invalidate];
+    self.heartbeatTimer = [NSTimer timerWithTimeInterval:self.connectionHealth.heartbeatInterval
+                                                  target:self
+                                                selector:@selector(webSocketHeartBeat)
+                                                userInfo:nil
+                                                 repeats:NO];
+    // Additionally, we want the ping timer to work in the background too.
+    [[NSRunLoop mainRunLoop] addTimer:self.heartbeatTimer forMode:NSDefaultRunLoopMode];
+}
+
 - (void)webSocketHeartBeat {
     OWSAssertIsOnMainThread();
 
     if ([self shouldSocketBeOpen]) {
-        NSError *error;
-        [self.websocket sendPing:nil error:&error];
-        if (error) {
-            DDLogWarn(@"Error in websocket heartbeat: %@", error.localizedDescription);
-            [self handleSocketFailure];
-        }
+        [self sendHeartbeat];
     } else {
         DDLogWarn(@"webSocketHeartBeat closing web socket");
         [self closeWebSocket];
@@ -872,6 +909,75 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
     }
 }
 
+- (void)sendHeartbeat
+{
+    OWSAssertIsOnMainThread();
+
+    if (self.state != SocketManagerStateOpen) {
+        return;
+    }
+    if (self.heartbeatTimeoutTimer.isValid) {
+        // The heartbeat which is waiting for an answer will do.
+        [self scheduleHeartbeat];
+        return;
+    }
+
+    uint64_t sequenceNumber = [self.connectionHealth didSendHeartbeat];
+    // Echoed back in the pong, which identifies the heartbeat it answers.
+    uint64_t sequenceNumberData = CFSwapInt64HostToBig(sequenceNumber);
+    NSError *error;
+    [self.websocket sendPing:[NSData dataWithBytes:&sequenceNumberData length:sizeof(sequenceNumberData)]
+                       error:&error];
+    if (error) {
+        DDLogWarn(@"Error in websocket heartbeat: %@", error.localizedDescription);
+        [self handleSocketFailure];
+        return;
+    }
+
+    [self.heartbeatTimeoutTimer invalidate];
+    self.heartbeatTimeoutTimer = [NSTimer timerWithTimeInterval:self.connectionHealth.heartbeatTimeout
+                                                         target:self
+                                                       selector:@selector(heartbeatTimeoutFired:)
+                                                       userInfo:@(sequenceNumber)
+                                                        repeats:NO];
+    [[NSRunLoop mainRunLoop] addTimer:self.heartbeatTimeoutTimer forMode:NSDefaultRunLoopMode];
+
+    [self scheduleHeartbeat];
+}
+
+- (void)heartbeatTimeoutFired:(NSTimer *)timer
+{
+    OWSAssertIsOnMainThread();
+
+    uint64_t sequenceNumber = [timer.userInfo unsignedLongLongValue];
+    if ([self.connectionHealth heartbeatDidTimeOut:sequenceNumber]) {
+        DDLogWarn(@"%@ Heartbeats aren't being answered; reconnecting.", self.logTag);
+        [self handleSocketFailure];
+    }
+}
+
+- (void)webSocket:(SRWebSocket *)webSocket didReceivePong:(nullable NSData *)pongData
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(webSocket);
+    if (webSocket != self.websocket) {
+        // Ignore events from obsolete web sockets.
+        return;
+    }
+
+    uint64_t sequenceNumberData;
+    if (pongData.length != sizeof(sequenceNumberData)) {
+        DDLogWarn(@"%@ Unexpected pong of %lu bytes.", self.logTag, (unsigned long)pongData.length);
+        return;
+    }
+    [pongData getBytes:&sequenceNumberData length:sizeof(sequenceNumberData)];
+    [self.connectionHealth didReceiveHeartbeatResponse:CFSwapInt64BigToHost(sequenceNumberData)];
+
+    [OutageDetection.sharedManager reportConnectionSuccess];
+}
+
+#pragma mark -
+
 - (NSString *)webSocketAuthenticationString {
 //    return [NSString stringWithFormat:@"?login=%@&password=%@",
 //                     [[TSAccountManager localUID] stringByReplacingOccurrencesOfString:@"+" withString:@"%2B"],
@@ -1040,17 +1146,31 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
     if (self.reconnectTimer) {
         OWSAssertDebug([self.reconnectTimer isValid]);
     } else {
-        // TODO: It'd be nice to do exponential backoff.
-        self.reconnectTimer = [NSTimer timerWithTimeInterval:kSocketReconnectDelaySeconds
+        // Each attempt waits longer than the last, until a connection opens.
+        NSTimeInterval reconnectDelay = [self.connectionHealth nextReconnectDelay];
+        DDLogInfo(@"%@ Reconnect attempt %lu in %.1fs.",
+            self.logTag,
+            (unsigned long)self.connectionHealth.reconnectAttemptCount,
+            reconnectDelay);
+        self.reconnectTimer = [NSTimer timerWithTimeInterval:reconnectDelay
                                                       target:self
-                                                    selector:@selector(applyDesiredSocketState)
+                                                    selector:@selector(reconnectTimerFired)
                                                     userInfo:nil
-                                                     repeats:YES];
+                                                     repeats:NO];
         // Additionally, we want the reconnect timer to work in the background too.
         [[NSRunLoop mainRunLoop] addTimer:self.reconnectTimer forMode:NSDefaultRunLoopMode];
     }
 }
 
+- (void)reconnectTimerFired
+{
+    OWSAssertIsOnMainThread();
+
+    // Cleared so that, if the socket still isn't open, the next attempt is scheduled.
+    self.reconnectTimer = nil;
+    [self applyDesiredSocketState];
+}
+
 - (void)clearReconnect
 {
     OWSAssertIsOnMainThread();
@@ -1087,6 +1207,30 @@ NSString *const kNSNotification_SocketManagerStateDidChange = @"kNSNotification_
     [self applyDesiredSocketState];
 }
 
+- (void)reachabilityChanged:(NSNotification *)notification
+{
+    OWSAssertIsOnMainThread();
+
+    if (!self.reachability.isReachable) {
+        DDLogInfo(@"%@ Network is unreachable.", self.logTag);
+        return;
+    }
+    DDLogInfo(@"%@ Network is reachable.", self.logTag);
+
+    if (self.state == SocketManagerStateOpen) {
+        // The socket may not have survived the change of network, so check now rather than at the next heartbeat.
+        [self sendHeartbeat];
+        return;
+    }
+
+    // Retry at once, and back off from the start: whatever was failing may have been the old network.
+    [self.connectionHealth resetReconnectBackoff];
+    [self clearReconnect];
+    if ([self shouldSocketBeOpen]) {
+        [self cycleSocket];
+    }
+}
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -5,6 +5,7 @@
 // ObjC classes from which Swift classes inherit must be included in this framework header.
 #import "OWSOperation.h"
 #import "FLCCSMJSONService.h"
+#import "FLMessageBody.h"
 #import "FLTag.h"
 #import "CCSMStorage.h"
 #import "CCSMCommunication.h"
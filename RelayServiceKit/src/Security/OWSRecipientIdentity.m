@@ -5,6 +5,7 @@
 #import "OWSRecipientIdentity.h"
 #import "OWSPrimaryStorage+SessionStore.h"
 #import "OWSPrimaryStorage.h"
+#import "OWSRecipientIdentityCache.h"
 #import <YapDatabase/YapDatabase.h>
 
 NS_ASSUME_NONNULL_BEGIN
@@ -80,6 +81,31 @@ OWSSignalServiceProtosVerifiedState OWSVerificationStateToProtoState(OWSVerifica
     return self;
 }
 
+#pragma mark - Persistence
+
+- (void)saveWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [super saveWithTransaction:transaction];
+
+    [OWSRecipientIdentityCache.sharedCache didSaveRecipientIdentity:self transaction:transaction];
+}
+
+- (void)removeWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [super removeWithTransaction:transaction];
+
+    [OWSRecipientIdentityCache.sharedCache didRemoveRecipientId:self.uniqueId transaction:transaction];
+}
+
++ (void)removeAllObjectsInCollection
+{
+    [super removeAllObjectsInCollection];
+
+    [OWSRecipientIdentityCache.sharedCache removeAllRecipientIdentities];
+}
+
+#pragma mark - Verification State
+
 - (void)updateWithVerificationState:(OWSVerificationState)verificationState
                         transaction:(YapDatabaseReadWriteTransaction *)transaction
 {
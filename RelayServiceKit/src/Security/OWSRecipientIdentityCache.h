@@ -0,0 +1,50 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class OWSRecipientIdentity;
+@class YapDatabaseConnection;
+@class YapDatabaseReadTransaction;
+@class YapDatabaseReadWriteTransaction;
+
+// Keeps every recipient identity which has been looked up in memory, including the absence of one, so that trust
+// checks don't need a database transaction of their own.
+//
+// OWSRecipientIdentity reports its writes, and the cache is written through with them once their transaction has
+// committed.  Until then the recipient is looked up in the database, so that the cache never runs ahead of the
+// database, and a lookup which raced with a write never caches what it read.  Changes made by another process
+// discard the whole cache.
+//
+// The cached identities are shared, so they must not be mutated.
+//
+// Thread safe.
+@interface OWSRecipientIdentityCache : NSObject
+
++ (instancetype)sharedCache;
+
+// When disabled, lookups always read the database.
+@property (atomic) BOOL isEnabled;
+
+// Looks up the recipient in a transaction of its own if it isn't cached.
+- (nullable OWSRecipientIdentity *)recipientIdentityForRecipientId:(NSString *)recipientId
+                                                       dbConnection:(YapDatabaseConnection *)dbConnection;
+
+- (nullable OWSRecipientIdentity *)recipientIdentityForRecipientId:(NSString *)recipientId
+                                                        transaction:(YapDatabaseReadTransaction *)transaction;
+
+- (void)didSaveRecipientIdentity:(OWSRecipientIdentity *)recipientIdentity
+                     transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+- (void)didRemoveRecipientId:(NSString *)recipientId transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+// For writes which remove every recipient identity without going through OWSRecipientIdentity, e.g.
+// -removeAllObjectsInAllCollections.
+- (void)didRemoveAllRecipientIdentitiesWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+- (void)removeAllRecipientIdentities;
+
+@end
+
+NS_ASSUME_NONNULL_END
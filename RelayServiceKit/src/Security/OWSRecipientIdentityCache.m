@@ -0,0 +1,243 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSRecipientIdentityCache.h"
+#import "OWSRecipientIdentity.h"
+#import <YapDatabase/YapDatabase.h>
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSRecipientIdentityCache ()
+
+// OWSRecipientIdentity, or NSNull for recipients without one.
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, id> *entries;
+
+// Recipients written by transactions whose completions haven't run yet; counted, as one transaction can write a
+// recipient more than once.
+@property (nonatomic, readonly) NSCountedSet<NSString *> *pendingRecipientIds;
+
+// Transactions which remove every recipient, and whose completions haven't run yet.  Nothing is cached until
+// they have.
+@property (nonatomic) NSUInteger pendingRemoveAllCount;
+
+// Changes with every write, so that a lookup can tell whether a write has happened since it began.
+@property (nonatomic) uint64_t generation;
+
+// Serial, so that write transactions' completions update the cache in the order they committed.
+@property (nonatomic, readonly) dispatch_queue_t completionQueue;
+
+@end
+
+#pragma mark -
+
+@implementation OWSRecipientIdentityCache
+
++ (instancetype)sharedCache
+{
+    static OWSRecipientIdentityCache *sharedCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [self new];
+    });
+    return sharedCache;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _entries = [NSMutableDictionary new];
+    _pendingRecipientIds = [NSCountedSet new];
+    _completionQueue = dispatch_queue_create("org.whispersystems.recipientIdentityCache", DISPATCH_QUEUE_SERIAL);
+    _isEnabled = YES;
+
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(yapDatabaseModifiedExternally:)
+                                                 name:YapDatabaseModifiedExternallyNotification
+                                               object:nil];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)yapDatabaseModifiedExternally:(NSNotification *)notification
+{
+    DDLogVerbose(@"%@ %s", self.logTag, __PRETTY_FUNCTION__);
+
+    [self removeAllRecipientIdentities];
+}
+
+#pragma mark - Lookups
+
+// Returns NO if the recipient must be looked up in the database, in which case `generation` is the one to cache
+// the result with.
+- (BOOL)getCachedRecipientIdentity:(OWSRecipientIdentity *_Nullable *_Nonnull)recipientIdentityPtr
+                       recipientId:(NSString *)recipientId
+                        generation:(uint64_t *)generationPtr
+{
+    @synchronized(self) {
+        *generationPtr = self.generation;
+        if (!self.isEnabled) {
+            return NO;
+        }
+        id _Nullable entry = self.entries[recipientId];
+        if (!entry) {
+            return NO;
+        }
+        *recipientIdentityPtr = ([entry isKindOfClass:[OWSRecipientIdentity class]] ? entry : nil);
+        return YES;
+    }
+}
+
+- (void)cacheRecipientIdentity:(nullable OWSRecipientIdentity *)recipientIdentity
+                   recipientId:(NSString *)recipientId
+                    generation:(uint64_t)generation
+{
+    @synchronized(self) {
+        if (!self.isEnabled || self.generation != generation || self.pendingRemoveAllCount > 0 ||
+            [self.pendingRecipientIds containsObject:recipientId]) {
+            return;
+        }
+        self.entries[recipientId] = (recipientIdentity ? [recipientIdentity copy] : [NSNull null]);
+    }
+}
+
+- (nullable OWSRecipientIdentity *)fetchRecipientIdentityForRecipientId:(NSString *)recipientId
+                                                            transaction:(YapDatabaseReadTransaction *)transaction
+{
+    id _Nullable recipientIdentity = [OWSRecipientIdentity fetchObjectWithUniqueID:recipientId transaction:transaction];
+    if (recipientIdentity && ![recipientIdentity isKindOfClass:[OWSRecipientIdentity class]]) {
+        OWSFailDebug(@"%@ unexpected object(%@) returned by db fetch!", self.logTag, [recipientIdentity class]);
+        return nil;
+    }
+    return recipientIdentity;
+}
+
+- (nullable OWSRecipientIdentity *)recipientIdentityForRecipientId:(NSString *)recipientId
+                                                       dbConnection:(YapDatabaseConnection *)dbConnection
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(dbConnection);
+
+    OWSRecipientIdentity *_Nullable recipientIdentity = nil;
+    uint64_t generation;
+    if ([self getCachedRecipientIdentity:&recipientIdentity recipientId:recipientId generation:&generation]) {
+        return recipientIdentity;
+    }
+
+    __block OWSRecipientIdentity *_Nullable fetchedRecipientIdentity;
+    [dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        fetchedRecipientIdentity = [self fetchRecipientIdentityForRecipientId:recipientId transaction:transaction];
+    }];
+    [self cacheRecipientIdentity:fetchedRecipientIdentity recipientId:recipientId generation:generation];
+    return fetchedRecipientIdentity;
+}
+
+- (nullable OWSRecipientIdentity *)recipientIdentityForRecipientId:(NSString *)recipientId
+                                                        transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(transaction);
+
+    OWSRecipientIdentity *_Nullable recipientIdentity = nil;
+    uint64_t generation;
+    if ([self getCachedRecipientIdentity:&recipientIdentity recipientId:recipientId generation:&generation]) {
+        return recipientIdentity;
+    }
+
+    recipientIdentity = [self fetchRecipientIdentityForRecipientId:recipientId transaction:transaction];
+    // A read transaction may have begun before writes whose completions have since updated the cache, so only
+    // write transactions, which can't overlap a write, may fill it.
+    if ([transaction isKindOfClass:[YapDatabaseReadWriteTransaction class]]) {
+        [self cacheRecipientIdentity:recipientIdentity recipientId:recipientId generation:generation];
+    }
+    return recipientIdentity;
+}
+
+#pragma mark - Writes
+
+- (void)didChangeRecipientId:(NSString *)recipientId
+           recipientIdentity:(nullable OWSRecipientIdentity *)recipientIdentity
+                 transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    @synchronized(self) {
+        self.generation++;
+        [self.pendingRecipientIds addObject:recipientId];
+        [self.entries removeObjectForKey:recipientId];
+    }
+
+    [transaction addCompletionQueue:self.completionQueue
+                    completionBlock:^{
+                        @synchronized(self) {
+                            self.generation++;
+                            [self.pendingRecipientIds removeObject:recipientId];
+                            // A later write's completion will cache its own copy.
+                            if (!self.isEnabled || self.pendingRemoveAllCount > 0 ||
+                                [self.pendingRecipientIds containsObject:recipientId]) {
+                                return;
+                            }
+                            self.entries[recipientId] = (recipientIdentity ?: [NSNull null]);
+                        }
+                    }];
+}
+
+- (void)didSaveRecipientIdentity:(OWSRecipientIdentity *)recipientIdentity
+                     transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(recipientIdentity.uniqueId.length > 0);
+    OWSAssertDebug(transaction);
+
+    // Copied as it was saved, in case the caller goes on to change it.
+    [self didChangeRecipientId:recipientIdentity.uniqueId
+             recipientIdentity:[recipientIdentity copy]
+                   transaction:transaction];
+}
+
+- (void)didRemoveRecipientId:(NSString *)recipientId transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(transaction);
+
+    [self didChangeRecipientId:recipientId recipientIdentity:nil transaction:transaction];
+}
+
+- (void)didRemoveAllRecipientIdentitiesWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(transaction);
+
+    @synchronized(self) {
+        self.generation++;
+        self.pendingRemoveAllCount++;
+        [self.entries removeAllObjects];
+    }
+
+    [transaction addCompletionQueue:self.completionQueue
+                    completionBlock:^{
+                        @synchronized(self) {
+                            self.generation++;
+                            self.pendingRemoveAllCount--;
+                        }
+                    }];
+}
+
+- (void)removeAllRecipientIdentities
+{
+    @synchronized(self) {
+        self.generation++;
+        [self.entries removeAllObjects];
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -5,10 +5,36 @@
 #import "OWSPrimaryStorage.h"
 #import <AxolotlKit/PreKeyStore.h>
 
+NS_ASSUME_NONNULL_BEGIN
+
 @interface OWSPrimaryStorage (PreKeyStore) <PreKeyStore>
 
 - (NSArray *)generatePreKeyRecords;
 - (PreKeyRecord *)getOrGenerateLastResortKey;
 - (void)storePreKeyRecords:(NSArray *)preKeyRecords;
 
+#pragma mark - Reserve
+
+// One-time prekeys are generated ahead of time into a reserve, so that uploading them doesn't have to wait on key
+// generation.
+
+- (NSUInteger)reservedPreKeyCount;
+
+// Generates enough prekeys to fill the reserve.  Slow; shouldn't be called on the main thread.
+- (void)replenishPreKeyReserve;
+
+// Moves a batch of prekeys out of the reserve and into the prekey store, generating any the reserve is short of.
+- (NSArray<PreKeyRecord *> *)takePreKeyRecordsForUpload;
+
+#pragma mark - Consumption
+
+// Records the batch of one-time prekeys which the service now has, so that their consumption can be tracked.
+- (void)markPreKeyRecordsAsUploaded:(NSArray<PreKeyRecord *> *)preKeyRecords;
+
+// How many of the last uploaded batch haven't been used by an incoming session.  The service may have fewer,
+// since it hands out prekeys to senders which don't use them.  Nil if no batch has been recorded.
+- (nullable NSNumber *)unconsumedUploadedPreKeyCount;
+
 @end
+
+NS_ASSUME_NONNULL_END
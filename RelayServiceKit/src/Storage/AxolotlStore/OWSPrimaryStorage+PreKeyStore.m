@@ -10,7 +10,9 @@
 #import <AxolotlKit/SessionBuilder.h>
 
 #define OWSPrimaryStoragePreKeyStoreCollection @"TSStorageManagerPreKeyStoreCollection"
+#define OWSPrimaryStoragePreKeyReserveCollection @"OWSPrimaryStoragePreKeyReserveCollection"
 #define TSNextPrekeyIdKey @"TSStorageInternalSettingsNextPreKeyId"
+#define OWSUploadedPreKeyIdsKey @"OWSStorageInternalSettingsUploadedPreKeyIds"
 #define BATCH_SIZE 100
 
 @implementation OWSPrimaryStorage (PreKeyStore)
@@ -29,14 +31,21 @@
 
 - (NSArray *)generatePreKeyRecords
 {
+    return [self generatePreKeyRecordsWithCount:BATCH_SIZE];
+}
+
+- (NSArray<PreKeyRecord *> *)generatePreKeyRecordsWithCount:(NSUInteger)count
+{
+    OWSAssertDebug(count <= BATCH_SIZE);
+
     NSMutableArray *preKeyRecords = [NSMutableArray array];
 
     @synchronized(self)
     {
         int preKeyId = [self nextPreKeyId];
 
-        DDLogInfo(@"%@ building %d new preKeys starting from preKeyId: %d", self.logTag, BATCH_SIZE, preKeyId);
-        for (int i = 0; i < BATCH_SIZE; i++) {
+        DDLogInfo(@"%@ building %lu new preKeys starting from preKeyId: %d", self.logTag, (unsigned long)count, preKeyId);
+        for (NSUInteger i = 0; i < count; i++) {
             ECKeyPair *keyPair = [Curve25519 generateKeyPair];
             PreKeyRecord *record = [[PreKeyRecord alloc] initWithId:preKeyId keyPair:keyPair];
 
@@ -53,13 +62,97 @@
 
 - (void)storePreKeyRecords:(NSArray *)preKeyRecords
 {
+    [self.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (PreKeyRecord *record in preKeyRecords) {
+            [transaction setObject:record
+                            forKey:[self keyFromInt:record.Id]
+                      inCollection:OWSPrimaryStoragePreKeyStoreCollection];
+        }
+    }];
+}
+
+#pragma mark - Reserve
+
+- (NSUInteger)reservedPreKeyCount
+{
+    return [self.dbReadConnection numberOfKeysInCollection:OWSPrimaryStoragePreKeyReserveCollection];
+}
+
+- (void)replenishPreKeyReserve
+{
+    NSUInteger reservedPreKeyCount = [self reservedPreKeyCount];
+    if (reservedPreKeyCount >= BATCH_SIZE) {
+        return;
+    }
+
+    NSArray<PreKeyRecord *> *preKeyRecords = [self generatePreKeyRecordsWithCount:BATCH_SIZE - reservedPreKeyCount];
+    [self.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (PreKeyRecord *record in preKeyRecords) {
+            [transaction setObject:record
+                            forKey:[self keyFromInt:record.Id]
+                      inCollection:OWSPrimaryStoragePreKeyReserveCollection];
+        }
+    }];
+}
+
+- (NSArray<PreKeyRecord *> *)takePreKeyRecordsForUpload
+{
+    NSMutableArray<PreKeyRecord *> *preKeyRecords = [NSMutableArray new];
+    [self.dbReadConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        [transaction enumerateKeysAndObjectsInCollection:OWSPrimaryStoragePreKeyReserveCollection
+                                              usingBlock:^(NSString *key, id object, BOOL *stop) {
+                                                  if (![object isKindOfClass:[PreKeyRecord class]]) {
+                                                      OWSFailDebug(@"%@ Unexpected type: %@ in collection.",
+                                                          self.logTag,
+                                                          [object class]);
+                                                      return;
+                                                  }
+                                                  [preKeyRecords addObject:object];
+                                                  *stop = preKeyRecords.count >= BATCH_SIZE;
+                                              }];
+    }];
+    if (preKeyRecords.count < BATCH_SIZE) {
+        DDLogInfo(@"%@ prekey reserve only had %lu preKeys.", self.logTag, (unsigned long)preKeyRecords.count);
+        [preKeyRecords addObjectsFromArray:[self generatePreKeyRecordsWithCount:BATCH_SIZE - preKeyRecords.count]];
+    }
+
+    // Store the one-time keys before they are sent to the service to prevent race conditions and other edge cases.
+    [self.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (PreKeyRecord *record in preKeyRecords) {
+            NSString *key = [self keyFromInt:record.Id];
+            [transaction removeObjectForKey:key inCollection:OWSPrimaryStoragePreKeyReserveCollection];
+            [transaction setObject:record forKey:key inCollection:OWSPrimaryStoragePreKeyStoreCollection];
+        }
+    }];
+    return [preKeyRecords copy];
+}
+
+#pragma mark - Consumption
+
+- (void)markPreKeyRecordsAsUploaded:(NSArray<PreKeyRecord *> *)preKeyRecords
+{
+    NSMutableSet<NSNumber *> *preKeyIds = [NSMutableSet new];
     for (PreKeyRecord *record in preKeyRecords) {
-        [self.dbReadWriteConnection setObject:record
-                                       forKey:[self keyFromInt:record.Id]
-                                 inCollection:OWSPrimaryStoragePreKeyStoreCollection];
+        [preKeyIds addObject:@(record.Id)];
     }
+    // The service replaces its one-time prekeys with each upload.
+    [self.dbReadWriteConnection setObject:[preKeyIds copy]
+                                   forKey:OWSUploadedPreKeyIdsKey
+                             inCollection:TSStorageInternalSettingsCollection];
 }
 
+- (nullable NSNumber *)unconsumedUploadedPreKeyCount
+{
+    NSSet<NSNumber *> *_Nullable preKeyIds =
+        [self.dbReadConnection objectForKey:OWSUploadedPreKeyIdsKey inCollection:TSStorageInternalSettingsCollection];
+    if (![preKeyIds isKindOfClass:[NSSet class]]) {
+        return nil;
+    }
+    return @(preKeyIds.count);
+}
+
+#pragma mark - PreKeyStore
+
 - (void)storePreKey:(int)preKeyId preKeyRecord:(PreKeyRecord *)record
 {
     [self.dbReadWriteConnection setObject:record
@@ -76,8 +169,20 @@
 
 - (void)removePreKey:(int)preKeyId
 {
-    [self.dbReadWriteConnection removeObjectForKey:[self keyFromInt:preKeyId]
-                                      inCollection:OWSPrimaryStoragePreKeyStoreCollection];
+    [self.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeObjectForKey:[self keyFromInt:preKeyId] inCollection:OWSPrimaryStoragePreKeyStoreCollection];
+
+        // Keep count of how many of the uploaded keys are left.
+        NSSet<NSNumber *> *_Nullable uploadedPreKeyIds =
+            [transaction objectForKey:OWSUploadedPreKeyIdsKey inCollection:TSStorageInternalSettingsCollection];
+        if ([uploadedPreKeyIds isKindOfClass:[NSSet class]] && [uploadedPreKeyIds containsObject:@(preKeyId)]) {
+            NSMutableSet<NSNumber *> *remainingPreKeyIds = [uploadedPreKeyIds mutableCopy];
+            [remainingPreKeyIds removeObject:@(preKeyId)];
+            [transaction setObject:[remainingPreKeyIds copy]
+                            forKey:OWSUploadedPreKeyIdsKey
+                      inCollection:TSStorageInternalSettingsCollection];
+        }
+    }];
 }
 
 - (nullable PreKeyRecord *)loadPreKey:(int)preKeyId {
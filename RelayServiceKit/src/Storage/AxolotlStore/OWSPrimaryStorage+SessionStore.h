@@ -11,6 +11,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)archiveAllSessionsForContact:(NSString *)contactIdentifier protocolContext:(nullable id)protocolContext;
 
+// Stored sessions are cached, and only written when the transaction which stored them is flushed, so every
+// transaction which encrypts, decrypts or builds a session must call this before it commits.
+- (void)flushSessionStoreWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
 #pragma mark - Debug
 
 - (void)resetSessionStore:(YapDatabaseReadWriteTransaction *)transaction;
@@ -4,6 +4,7 @@
 
 #import "OWSPrimaryStorage+SessionStore.h"
 #import "OWSFileSystem.h"
+#import "OWSSessionStoreCache.h"
 #import "YapDatabaseConnection+OWS.h"
 #import "YapDatabaseTransaction+OWS.h"
 #import <AxolotlKit/SessionRecord.h>
@@ -14,6 +15,9 @@ NS_ASSUME_NONNULL_BEGIN
 NSString *const OWSPrimaryStorageSessionStoreCollection = @"TSStorageManagerSessionStoreCollection";
 NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 
+// Comfortably more than the members of a large group.
+static const NSUInteger kSessionStoreCacheMaxRecipientCount = 1000;
+
 @implementation OWSPrimaryStorage (SessionStore)
 
 /**
@@ -38,6 +42,30 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
     return [[self class] sessionStoreDBConnection];
 }
 
++ (OWSSessionStoreCache *)sessionStoreCache
+{
+    static dispatch_once_t onceToken;
+    static OWSSessionStoreCache *sessionStoreCache;
+    dispatch_once(&onceToken, ^{
+        sessionStoreCache = [[OWSSessionStoreCache alloc] initWithCollection:OWSPrimaryStorageSessionStoreCollection
+                                                           maxRecipientCount:kSessionStoreCacheMaxRecipientCount];
+    });
+
+    return sessionStoreCache;
+}
+
+- (OWSSessionStoreCache *)sessionStoreCache
+{
+    return [[self class] sessionStoreCache];
+}
+
+- (void)flushSessionStoreWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(transaction);
+
+    [self.sessionStoreCache flushWithTransaction:transaction];
+}
+
 #pragma mark - SessionStore
 
 - (SessionRecord *)loadSession:(NSString *)contactIdentifier
@@ -50,14 +78,8 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 
     YapDatabaseReadWriteTransaction *transaction = protocolContext;
 
-    NSDictionary *_Nullable dictionary =
-        [transaction objectForKey:contactIdentifier inCollection:OWSPrimaryStorageSessionStoreCollection];
-
-    SessionRecord *record;
-
-    if (dictionary) {
-        record = [dictionary objectForKey:@(deviceId)];
-    }
+    SessionRecord *_Nullable record =
+        [self.sessionStoreCache sessionForRecipientId:contactIdentifier deviceId:deviceId transaction:transaction];
 
     if (!record) {
         return [SessionRecord new];
@@ -79,10 +101,7 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 
     YapDatabaseReadWriteTransaction *transaction = protocolContext;
 
-    NSDictionary *_Nullable dictionary =
-        [transaction objectForKey:contactIdentifier inCollection:OWSPrimaryStorageSessionStoreCollection];
-
-    return dictionary ? dictionary.allKeys : @[];
+    return [self.sessionStoreCache deviceIdsForRecipientId:contactIdentifier transaction:transaction];
 }
 #pragma clang diagnostic pop
 
@@ -105,17 +124,11 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
     // NOTE: this may no longer be necessary now that we have a non-caching session db connection.
     [session markAsUnFresh];
 
-    NSDictionary *immutableDictionary =
-        [transaction objectForKey:contactIdentifier inCollection:OWSPrimaryStorageSessionStoreCollection];
-
-    NSMutableDictionary *dictionary
-        = (immutableDictionary ? [immutableDictionary mutableCopy] : [NSMutableDictionary new]);
-
-    [dictionary setObject:session forKey:@(deviceId)];
-
-    [transaction setObject:[dictionary copy]
-                    forKey:contactIdentifier
-              inCollection:OWSPrimaryStorageSessionStoreCollection];
+    // Not written until the transaction is flushed.
+    [self.sessionStoreCache storeSession:session
+                          forRecipientId:contactIdentifier
+                                deviceId:deviceId
+                             transaction:transaction];
 }
 
 - (BOOL)containsSession:(NSString *)contactIdentifier
@@ -143,6 +156,8 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
     DDLogInfo(
         @"[OWSPrimaryStorage (SessionStore)] deleting session for contact: %@ device: %d", contactIdentifier, deviceId);
 
+    [self.sessionStoreCache evictRecipientId:contactIdentifier transaction:transaction];
+
     NSDictionary *immutableDictionary =
         [transaction objectForKey:contactIdentifier inCollection:OWSPrimaryStorageSessionStoreCollection];
 
@@ -165,6 +180,8 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 
     DDLogInfo(@"[OWSPrimaryStorage (SessionStore)] deleting all sessions for contact:%@", contactIdentifier);
 
+    [self.sessionStoreCache evictRecipientId:contactIdentifier transaction:transaction];
+
     [transaction removeObjectForKey:contactIdentifier inCollection:OWSPrimaryStorageSessionStoreCollection];
 }
 
@@ -177,6 +194,8 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 
     DDLogInfo(@"[OWSPrimaryStorage (SessionStore)] archiving all sessions for contact: %@", contactIdentifier);
 
+    [self.sessionStoreCache evictRecipientId:contactIdentifier transaction:transaction];
+
     __block NSDictionary<NSNumber *, SessionRecord *> *sessionRecords =
         [transaction objectForKey:contactIdentifier inCollection:OWSPrimaryStorageSessionStoreCollection];
 
@@ -204,6 +223,8 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 
     DDLogWarn(@"%@ resetting session store", self.logTag);
 
+    [self.sessionStoreCache removeAllRecipients];
+
     [transaction removeAllObjectsInCollection:OWSPrimaryStorageSessionStoreCollection];
 }
 
@@ -261,6 +282,7 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 {
     OWSAssertDebug(transaction);
 
+    [self.sessionStoreCache flushWithTransaction:transaction];
     [transaction snapshotCollection:OWSPrimaryStorageSessionStoreCollection snapshotFilePath:self.snapshotFilePath];
 }
 
@@ -268,6 +290,7 @@ NSString *const kSessionStoreDBConnectionKey = @"kSessionStoreDBConnectionKey";
 {
     OWSAssertDebug(transaction);
 
+    [self.sessionStoreCache removeAllRecipients];
     [transaction restoreSnapshotOfCollection:OWSPrimaryStorageSessionStoreCollection
                             snapshotFilePath:self.snapshotFilePath];
 }
@@ -0,0 +1,57 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SessionRecord;
+@class YapDatabaseReadWriteTransaction;
+
+// Keeps the session records of recently used recipients in memory, and defers writing a recipient's records until
+// the transaction which changed them is flushed, so that a transaction which loads and stores the same sessions
+// several times reads and writes the database at most once.
+//
+// Every write goes out with a new "generation" as its metadata, and a cached recipient is only used while the
+// database still has that generation, so writes which bypass the cache - from another process, from a rolled
+// back transaction or from code which writes the collection directly - are never shadowed by it.
+//
+// Dirty records are only in memory, so every transaction which stores sessions must be flushed before it
+// commits.
+//
+// Thread safe.
+@interface OWSSessionStoreCache : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithCollection:(NSString *)collection
+                 maxRecipientCount:(NSUInteger)maxRecipientCount NS_DESIGNATED_INITIALIZER;
+
+// When disabled, loads always read the database and stores are written immediately.
+@property (atomic) BOOL isEnabled;
+
+// A copy of the record, which the caller may change freely; it only reaches the cache once it's stored.
+- (nullable SessionRecord *)sessionForRecipientId:(NSString *)recipientId
+                                         deviceId:(int)deviceId
+                                      transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+- (NSArray<NSNumber *> *)deviceIdsForRecipientId:(NSString *)recipientId
+                                     transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+- (void)storeSession:(SessionRecord *)session
+      forRecipientId:(NSString *)recipientId
+            deviceId:(int)deviceId
+         transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+// Writes the recipient's records if they're dirty, and stops caching them, so that the caller can change the
+// collection directly.
+- (void)evictRecipientId:(NSString *)recipientId transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+// Discards every cached record, including dirty ones.
+- (void)removeAllRecipients;
+
+// Writes every dirty record.
+- (void)flushWithTransaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+@end
+
+NS_ASSUME_NONNULL_END
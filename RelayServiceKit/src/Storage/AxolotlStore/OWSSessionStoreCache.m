@@ -0,0 +1,314 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSSessionStoreCache.h"
+#import <AxolotlKit/SessionRecord.h>
+#import <YapDatabase/YapDatabase.h>
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSSessionStoreCacheEntry : NSObject
+
+@property (nonatomic, readonly) NSMutableDictionary<NSNumber *, SessionRecord *> *deviceSessions;
+
+// The metadata of the recipient's row when it was last read or written by the cache.
+@property (nonatomic, nullable) NSNumber *generation;
+
+@end
+
+#pragma mark -
+
+@implementation OWSSessionStoreCacheEntry
+
+- (instancetype)initWithDeviceSessions:(nullable NSDictionary<NSNumber *, SessionRecord *> *)deviceSessions
+                            generation:(nullable NSNumber *)generation
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _deviceSessions = (deviceSessions ? [deviceSessions mutableCopy] : [NSMutableDictionary new]);
+    _generation = generation;
+
+    return self;
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSSessionStoreCache ()
+
+@property (nonatomic, readonly) NSString *collection;
+@property (nonatomic, readonly) NSUInteger maxRecipientCount;
+
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, OWSSessionStoreCacheEntry *> *entries;
+
+// Least recently used first.
+@property (nonatomic, readonly) NSMutableOrderedSet<NSString *> *recipientIdsByRecency;
+
+@property (nonatomic, readonly) NSMutableSet<NSString *> *dirtyRecipientIds;
+
+// The transaction which made the dirty records dirty.
+@property (nonatomic, weak, nullable) YapDatabaseReadWriteTransaction *dirtyTransaction;
+
+@end
+
+#pragma mark -
+
+@implementation OWSSessionStoreCache
+
+- (instancetype)initWithCollection:(NSString *)collection maxRecipientCount:(NSUInteger)maxRecipientCount
+{
+    OWSAssertDebug(collection.length > 0);
+    OWSAssertDebug(maxRecipientCount > 0);
+
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _collection = collection;
+    _maxRecipientCount = maxRecipientCount;
+    _entries = [NSMutableDictionary new];
+    _recipientIdsByRecency = [NSMutableOrderedSet new];
+    _dirtyRecipientIds = [NSMutableSet new];
+    _isEnabled = YES;
+
+    return self;
+}
+
++ (NSNumber *)newGeneration
+{
+    uint64_t generation;
+    arc4random_buf(&generation, sizeof(generation));
+    return @(generation);
+}
+
+#pragma mark - Entries
+
+// Dirty records should never outlive their transaction.  If they do, they're written to this one rather than lost.
+- (void)checkForUnflushedRecordsWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (self.dirtyRecipientIds.count < 1 || self.dirtyTransaction == transaction) {
+        return;
+    }
+
+    OWSFailDebug(@"%@ Sessions stored by an earlier transaction were never flushed.", self.logTag);
+    [self writeDirtyRecordsWithTransaction:transaction];
+}
+
+- (nullable OWSSessionStoreCacheEntry *)entryForRecipientId:(NSString *)recipientId
+                                                transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    [self checkForUnflushedRecordsWithTransaction:transaction];
+
+    OWSSessionStoreCacheEntry *_Nullable entry = self.entries[recipientId];
+    if (entry && ![self.dirtyRecipientIds containsObject:recipientId]) {
+        // Something else has written the row since we last did.
+        NSNumber *_Nullable generation = [transaction metadataForKey:recipientId inCollection:self.collection];
+        if (!entry.generation || ![entry.generation isEqual:generation]) {
+            [self removeEntryForRecipientId:recipientId];
+            entry = nil;
+        }
+    }
+
+    if (!entry) {
+        id _Nullable deviceSessions;
+        id _Nullable generation;
+        [transaction getObject:&deviceSessions metadata:&generation forKey:recipientId inCollection:self.collection];
+        if (!deviceSessions) {
+            return nil;
+        }
+        if (![deviceSessions isKindOfClass:[NSDictionary class]]) {
+            OWSFailDebug(@"%@ Unexpected type: %@ in collection.", self.logTag, [deviceSessions class]);
+            return nil;
+        }
+        if (![generation isKindOfClass:[NSNumber class]]) {
+            generation = nil;
+        }
+        entry = [[OWSSessionStoreCacheEntry alloc] initWithDeviceSessions:deviceSessions generation:generation];
+        if (!self.isEnabled) {
+            return entry;
+        }
+        self.entries[recipientId] = entry;
+    }
+
+    [self.recipientIdsByRecency removeObject:recipientId];
+    [self.recipientIdsByRecency addObject:recipientId];
+    [self evictLeastRecentlyUsedRecipientsIfNecessary];
+
+    return entry;
+}
+
+- (void)removeEntryForRecipientId:(NSString *)recipientId
+{
+    [self.entries removeObjectForKey:recipientId];
+    [self.recipientIdsByRecency removeObject:recipientId];
+    [self.dirtyRecipientIds removeObject:recipientId];
+}
+
+// Dirty records stay until they've been written.
+- (void)evictLeastRecentlyUsedRecipientsIfNecessary
+{
+    if (self.entries.count <= self.maxRecipientCount) {
+        return;
+    }
+
+    NSMutableArray<NSString *> *evictedRecipientIds = [NSMutableArray new];
+    for (NSString *recipientId in self.recipientIdsByRecency) {
+        if (self.entries.count - evictedRecipientIds.count <= self.maxRecipientCount) {
+            break;
+        }
+        if (![self.dirtyRecipientIds containsObject:recipientId]) {
+            [evictedRecipientIds addObject:recipientId];
+        }
+    }
+    for (NSString *recipientId in evictedRecipientIds) {
+        [self removeEntryForRecipientId:recipientId];
+    }
+}
+
+- (void)writeEntry:(OWSSessionStoreCacheEntry *)entry
+    forRecipientId:(NSString *)recipientId
+       transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    entry.generation = [OWSSessionStoreCache newGeneration];
+    [transaction setObject:[entry.deviceSessions copy]
+                    forKey:recipientId
+              inCollection:self.collection
+              withMetadata:entry.generation];
+}
+
+- (void)writeDirtyRecordsWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    for (NSString *recipientId in self.dirtyRecipientIds) {
+        OWSSessionStoreCacheEntry *_Nullable entry = self.entries[recipientId];
+        if (!entry) {
+            OWSFailDebug(@"%@ Missing entry for dirty recipient.", self.logTag);
+            continue;
+        }
+        [self writeEntry:entry forRecipientId:recipientId transaction:transaction];
+    }
+    [self.dirtyRecipientIds removeAllObjects];
+    self.dirtyTransaction = nil;
+
+    [self evictLeastRecentlyUsedRecipientsIfNecessary];
+}
+
+#pragma mark - Public
+
+- (nullable SessionRecord *)sessionForRecipientId:(NSString *)recipientId
+                                         deviceId:(int)deviceId
+                                      transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(transaction);
+
+    SessionRecord *_Nullable session;
+    @synchronized(self) {
+        session = [self entryForRecipientId:recipientId transaction:transaction].deviceSessions[@(deviceId)];
+    }
+    if (!session) {
+        return nil;
+    }
+    // SessionCipher changes the record in place as it goes, before it knows whether a message is valid, and only
+    // stores it if it is; so the cached record must never be handed out, as the changes a failed decrypt left in it
+    // would otherwise be written by the next flush.
+    return [OWSSessionStoreCache copyOfSession:session];
+}
+
++ (SessionRecord *)copyOfSession:(SessionRecord *)session
+{
+    NSData *data = [NSKeyedArchiver archivedDataWithRootObject:session];
+    SessionRecord *_Nullable copy = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    if (![copy isKindOfClass:[SessionRecord class]]) {
+        // Callers load sessions within @try, as SessionCipher throws.
+        OWSRaiseException(NSInternalInconsistencyException, @"%@ Couldn't copy session.", self.logTag);
+    }
+    return copy;
+}
+
+- (NSArray<NSNumber *> *)deviceIdsForRecipientId:(NSString *)recipientId
+                                     transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(transaction);
+
+    @synchronized(self) {
+        return [self entryForRecipientId:recipientId transaction:transaction].deviceSessions.allKeys ?: @[];
+    }
+}
+
+- (void)storeSession:(SessionRecord *)session
+      forRecipientId:(NSString *)recipientId
+            deviceId:(int)deviceId
+         transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(session);
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(transaction);
+
+    @synchronized(self) {
+        OWSSessionStoreCacheEntry *_Nullable entry = [self entryForRecipientId:recipientId transaction:transaction];
+        if (!entry) {
+            entry = [[OWSSessionStoreCacheEntry alloc] initWithDeviceSessions:nil generation:nil];
+            if (self.isEnabled) {
+                self.entries[recipientId] = entry;
+                [self.recipientIdsByRecency addObject:recipientId];
+            }
+        }
+        entry.deviceSessions[@(deviceId)] = session;
+
+        if (!self.isEnabled) {
+            [self writeEntry:entry forRecipientId:recipientId transaction:transaction];
+            return;
+        }
+
+        [self.dirtyRecipientIds addObject:recipientId];
+        self.dirtyTransaction = transaction;
+    }
+}
+
+- (void)evictRecipientId:(NSString *)recipientId transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(recipientId.length > 0);
+    OWSAssertDebug(transaction);
+
+    @synchronized(self) {
+        [self checkForUnflushedRecordsWithTransaction:transaction];
+
+        OWSSessionStoreCacheEntry *_Nullable entry = self.entries[recipientId];
+        if (entry && [self.dirtyRecipientIds containsObject:recipientId]) {
+            [self writeEntry:entry forRecipientId:recipientId transaction:transaction];
+        }
+        [self removeEntryForRecipientId:recipientId];
+    }
+}
+
+- (void)removeAllRecipients
+{
+    @synchronized(self) {
+        [self.entries removeAllObjects];
+        [self.recipientIdsByRecency removeAllObjects];
+        [self.dirtyRecipientIds removeAllObjects];
+        self.dirtyTransaction = nil;
+    }
+}
+
+- (void)flushWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    OWSAssertDebug(transaction);
+
+    @synchronized(self) {
+        [self writeDirtyRecordsWithTransaction:transaction];
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -235,6 +235,11 @@ public class FullTextSearchFinder: NSObject {
         return transaction.ext(FullTextSearchFinder.dbExtensionName) as? YapDatabaseFullTextSearchTransaction
     }
 
+    @objc
+    public class func databaseExtensionName() -> String {
+        return dbExtensionName
+    }
+
     @objc
     public class func asyncRegisterDatabaseExtension(storage: OWSStorage) {
         storage.asyncRegister(dbExtensionConfig, withName: dbExtensionName)
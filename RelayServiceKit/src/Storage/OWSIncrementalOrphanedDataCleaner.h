@@ -0,0 +1,37 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class OWSPrimaryStorage;
+
+// Cleans up the same orphaned data as OWSOrphanedDataCleaner - messages without a thread, attachments without
+// a message and attachment files without an attachment - in small chunks spread over many short runs, so its
+// cost doesn't grow with the size of the history.
+//
+// A cleanup cycle visits messages, then attachments, then the attachments folder, saving a cursor for each
+// phase at the end of every run.  Instead of sets of every id and path, it keeps Bloom filters of the
+// attachment ids that messages refer to and of the attachments' file paths; a false positive only means an
+// orphan survives until a later cycle.  Nothing created during the cycle, or shortly before it started, is
+// removed.
+@interface OWSIncrementalOrphanedDataCleaner : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithPrimaryStorage:(OWSPrimaryStorage *)primaryStorage NS_DESIGNATED_INITIALIZER;
+
++ (instancetype)sharedCleaner;
+
+// Spends a short time budget on the current cycle, or starts a new one if the last one completed more than a
+// day ago.
+- (void)startIfNecessary;
+
+// Processes chunks until the current cycle completes or about `timeBudget` has been spent, starting a new
+// cycle if there's no current one.  At least one chunk is processed.  The completion is called on the main
+// thread.
+- (void)runWithTimeBudget:(NSTimeInterval)timeBudget completion:(nullable void (^)(BOOL isCycleComplete))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
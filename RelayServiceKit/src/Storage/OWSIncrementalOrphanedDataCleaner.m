@@ -0,0 +1,533 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSIncrementalOrphanedDataCleaner.h"
+#import "AppContext.h"
+#import "NSDate+OWS.h"
+#import "OWSBackgroundTask.h"
+#import "OWSBloomFilter.h"
+#import "OWSPrimaryStorage.h"
+#import "TSAttachmentStream.h"
+#import "TSDatabaseSecondaryIndexes.h"
+#import "TSInteraction.h"
+#import "TSMessage.h"
+#import "TSQuotedMessage.h"
+#import "TSThread.h"
+#import "SSKAsserts.h"
+#import <YapDatabase/YapDatabase.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+static NSString *const OWSIncrementalOrphanedDataCleanerCollection = @"OWSIncrementalOrphanedDataCleanerCollection";
+static NSString *const OWSIncrementalOrphanedDataCleanerStateKey = @"state";
+
+static NSString *const kStatePhaseKey = @"phase";
+static NSString *const kStateCycleStartDateKey = @"cycleStartDate";
+static NSString *const kStateLastCycleCompletionDateKey = @"lastCycleCompletionDate";
+static NSString *const kStateInteractionCursorKey = @"interactionCursor";
+static NSString *const kStateAttachmentCursorKey = @"attachmentCursor";
+static NSString *const kStateFileCursorKey = @"fileCursor";
+static NSString *const kStateReferencedAttachmentIdsKey = @"referencedAttachmentIds";
+static NSString *const kStateAttachmentFilePathsKey = @"attachmentFilePaths";
+static NSString *const kStateIsAttachmentOrderUnreliableKey = @"isAttachmentOrderUnreliable";
+static NSString *const kStateRemovedCountKey = @"removedCount";
+
+typedef NS_ENUM(NSUInteger, OWSOrphanCleanupPhase) {
+    OWSOrphanCleanupPhaseInteractions = 0,
+    OWSOrphanCleanupPhaseAttachments,
+    OWSOrphanCleanupPhaseFiles,
+    OWSOrphanCleanupPhaseComplete,
+};
+
+static const NSUInteger kOrphanCleanupChunkSize = 200;
+static const NSTimeInterval kOrphanCleanupChunkInterval = 0.05;
+static const NSTimeInterval kOrphanCleanupLaunchTimeBudget = 1.0;
+
+@interface OWSIncrementalOrphanedDataCleaner ()
+
+@property (nonatomic, readonly) YapDatabaseConnection *databaseConnection;
+@property (nonatomic, readonly) dispatch_queue_t serialQueue;
+
+// The most items visited by one chunk.
+@property (nonatomic) NSUInteger chunkSize;
+// The pause between chunks.
+@property (nonatomic) NSTimeInterval chunkInterval;
+// Nothing newer than this, relative to the start of the cycle, is removed; files and attachments can exist
+// for a while before they're referred to.
+@property (nonatomic) NSTimeInterval minimumOrphanAge;
+
+// The following should only be accessed on the serial queue.
+@property (nonatomic) BOOL isRunning;
+@property (nonatomic) OWSOrphanCleanupPhase phase;
+@property (nonatomic, nullable) NSDate *cycleStartDate;
+@property (nonatomic, nullable) NSDate *lastCycleCompletionDate;
+@property (nonatomic) int64_t interactionCursor;
+@property (nonatomic, nullable) NSString *attachmentCursor;
+@property (nonatomic) NSUInteger fileCursor;
+@property (nonatomic, nullable) OWSBloomFilter *referencedAttachmentIds;
+@property (nonatomic, nullable) OWSBloomFilter *attachmentFilePaths;
+// See -processAttachmentsChunk.
+@property (nonatomic) BOOL isAttachmentOrderUnreliable;
+@property (nonatomic) NSUInteger removedCount;
+
+@end
+
+#pragma mark -
+
+@implementation OWSIncrementalOrphanedDataCleaner
+
++ (instancetype)sharedCleaner
+{
+    static OWSIncrementalOrphanedDataCleaner *sharedCleaner = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCleaner = [[self alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]];
+    });
+    return sharedCleaner;
+}
+
+- (instancetype)initWithPrimaryStorage:(OWSPrimaryStorage *)primaryStorage
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _databaseConnection = primaryStorage.newDatabaseConnection;
+    _serialQueue = dispatch_queue_create("org.whispersystems.orphan.cleanup", DISPATCH_QUEUE_SERIAL);
+    _chunkSize = kOrphanCleanupChunkSize;
+    _chunkInterval = kOrphanCleanupChunkInterval;
+    _minimumOrphanAge = CurrentAppContext().isRunningTests ? 0.f : 15 * kMinuteInterval;
+    _phase = OWSOrphanCleanupPhaseComplete;
+
+    return self;
+}
+
+- (void)assertIsOnSerialQueue
+{
+#ifdef DEBUG
+    if (@available(iOS 10.0, *)) {
+        dispatch_assert_queue(self.serialQueue);
+    }
+#endif
+}
+
+#pragma mark - Runs
+
+- (void)startIfNecessary
+{
+    dispatch_async(self.serialQueue, ^{
+        [self loadState];
+
+        if (self.phase == OWSOrphanCleanupPhaseComplete && self.lastCycleCompletionDate
+            && fabs(self.lastCycleCompletionDate.timeIntervalSinceNow) < kDayInterval) {
+            return;
+        }
+        [self runWithTimeBudget:kOrphanCleanupLaunchTimeBudget completion:nil];
+    });
+}
+
+- (void)runWithTimeBudget:(NSTimeInterval)timeBudget completion:(nullable void (^)(BOOL isCycleComplete))completion
+{
+    dispatch_async(self.serialQueue, ^{
+        if (self.isRunning) {
+            DDLogInfo(@"%@ Already running.", self.logTag);
+            if (completion) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completion(NO);
+                });
+            }
+            return;
+        }
+        self.isRunning = YES;
+
+        [self loadState];
+        if (self.phase == OWSOrphanCleanupPhaseComplete) {
+            [self startCycle];
+        }
+
+        __block OWSBackgroundTask *_Nullable backgroundTask =
+            [OWSBackgroundTask backgroundTaskWithLabelStr:__PRETTY_FUNCTION__];
+        [self processNextChunkWithTimeRemaining:timeBudget
+                                     completion:^(BOOL isCycleComplete) {
+                                         [self saveState];
+                                         self.isRunning = NO;
+                                         backgroundTask = nil;
+
+                                         if (completion) {
+                                             dispatch_async(dispatch_get_main_queue(), ^{
+                                                 completion(isCycleComplete);
+                                             });
+                                         }
+                                     }];
+    });
+}
+
+- (void)processNextChunkWithTimeRemaining:(NSTimeInterval)timeRemaining completion:(void (^)(BOOL))completion
+{
+    [self assertIsOnSerialQueue];
+
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    switch (self.phase) {
+        case OWSOrphanCleanupPhaseInteractions:
+            [self processInteractionsChunk];
+            break;
+        case OWSOrphanCleanupPhaseAttachments:
+            [self processAttachmentsChunk];
+            break;
+        case OWSOrphanCleanupPhaseFiles:
+            [self processFilesChunk];
+            break;
+        case OWSOrphanCleanupPhaseComplete:
+            break;
+    }
+    timeRemaining -= CFAbsoluteTimeGetCurrent() - startTime;
+
+    if (self.phase == OWSOrphanCleanupPhaseComplete) {
+        completion(YES);
+        return;
+    }
+    if (timeRemaining <= 0) {
+        DDLogInfo(@"%@ Pausing in phase: %lu.", self.logTag, (unsigned long)self.phase);
+        completion(NO);
+        return;
+    }
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.chunkInterval * NSEC_PER_SEC)),
+        self.serialQueue,
+        ^{
+            [self processNextChunkWithTimeRemaining:timeRemaining completion:completion];
+        });
+}
+
+#pragma mark - Cycles
+
+- (void)startCycle
+{
+    [self assertIsOnSerialQueue];
+
+    __block NSUInteger interactionCount;
+    __block NSUInteger attachmentCount;
+    [self.databaseConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        interactionCount = [transaction numberOfKeysInCollection:[TSInteraction collection]];
+        attachmentCount = [transaction numberOfKeysInCollection:[TSAttachment collection]];
+    }];
+
+    DDLogInfo(@"%@ Starting cycle over %lu interactions and %lu attachments.",
+        self.logTag,
+        (unsigned long)interactionCount,
+        (unsigned long)attachmentCount);
+
+    self.phase = OWSOrphanCleanupPhaseInteractions;
+    self.cycleStartDate = [NSDate new];
+    self.interactionCursor = -1;
+    self.attachmentCursor = nil;
+    self.fileCursor = 0;
+    // Most messages have at most one attachment; each attachment has a file and maybe a thumbnail.
+    self.referencedAttachmentIds = [[OWSBloomFilter alloc] initWithCapacity:interactionCount];
+    self.attachmentFilePaths = [[OWSBloomFilter alloc] initWithCapacity:attachmentCount * 2];
+    self.isAttachmentOrderUnreliable = NO;
+    self.removedCount = 0;
+}
+
+- (void)completeCycle
+{
+    [self assertIsOnSerialQueue];
+
+    DDLogInfo(@"%@ Completed cycle, removed %lu orphans.", self.logTag, (unsigned long)self.removedCount);
+
+    self.phase = OWSOrphanCleanupPhaseComplete;
+    self.lastCycleCompletionDate = [NSDate new];
+    self.referencedAttachmentIds = nil;
+    self.attachmentFilePaths = nil;
+}
+
+- (BOOL)isOldEnoughToRemove:(NSDate *)date
+{
+    OWSAssertDebug(self.cycleStartDate);
+
+    return [date timeIntervalSinceDate:self.cycleStartDate] <= -self.minimumOrphanAge;
+}
+
+#pragma mark - Chunks
+
+// Messages are visited in timestamp order using the timestamp index, so the cursor is the last timestamp
+// visited.  Messages sharing the chunk's last timestamp are all visited in the same chunk.
+//
+// Messages without a thread are removed, along with their attachments.  The other messages' attachments are
+// added to the referenced attachments filter.
+- (void)processInteractionsChunk
+{
+    [self assertIsOnSerialQueue];
+
+    [self.databaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        NSMutableArray<TSInteraction *> *interactions = [NSMutableArray new];
+        __block NSUInteger rowCount = 0;
+        [TSDatabaseSecondaryIndexes
+            enumerateMessagesAfterTimestamp:self.interactionCursor
+                                      limit:self.chunkSize
+                                  withBlock:^(NSString *collection, NSString *key, BOOL *stop) {
+                                      rowCount++;
+                                      TSInteraction *_Nullable interaction =
+                                          [self interactionWithKey:key collection:collection transaction:transaction];
+                                      if (interaction) {
+                                          [interactions addObject:interaction];
+                                      }
+                                  }
+                           usingTransaction:transaction];
+
+        if (rowCount < self.chunkSize || interactions.count < 1) {
+            for (TSInteraction *interaction in interactions) {
+                [self processInteraction:interaction transaction:transaction];
+            }
+            self.phase = OWSOrphanCleanupPhaseAttachments;
+            return;
+        }
+
+        uint64_t lastTimestamp = interactions.lastObject.timestamp;
+        for (TSInteraction *interaction in interactions) {
+            if (interaction.timestamp < lastTimestamp) {
+                [self processInteraction:interaction transaction:transaction];
+            }
+        }
+        NSMutableArray<TSInteraction *> *lastInteractions = [NSMutableArray new];
+        [TSDatabaseSecondaryIndexes
+            enumerateMessagesWithTimestamp:lastTimestamp
+                                 withBlock:^(NSString *collection, NSString *key, BOOL *stop) {
+                                     TSInteraction *_Nullable interaction =
+                                         [self interactionWithKey:key collection:collection transaction:transaction];
+                                     if (interaction) {
+                                         [lastInteractions addObject:interaction];
+                                     }
+                                 }
+                          usingTransaction:transaction];
+        for (TSInteraction *interaction in lastInteractions) {
+            [self processInteraction:interaction transaction:transaction];
+        }
+        self.interactionCursor = (int64_t)lastTimestamp;
+    }];
+}
+
+- (nullable TSInteraction *)interactionWithKey:(NSString *)key
+                                    collection:(NSString *)collection
+                                   transaction:(YapDatabaseReadTransaction *)transaction
+{
+    if (![collection isEqualToString:[TSInteraction collection]]) {
+        return nil;
+    }
+    TSInteraction *_Nullable interaction = [transaction objectForKey:key inCollection:collection];
+    if (![interaction isKindOfClass:[TSInteraction class]]) {
+        OWSFailDebug(@"%@ Unexpected object: %@", self.logTag, [interaction class]);
+        return nil;
+    }
+    return interaction;
+}
+
+- (void)processInteraction:(TSInteraction *)interaction transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (interaction.uniqueThreadId.length < 1
+        || ![transaction hasObjectForKey:interaction.uniqueThreadId inCollection:[TSThread collection]]) {
+        DDLogInfo(@"%@ Removing orphan message: %@", self.logTag, interaction.uniqueId);
+        [interaction removeWithTransaction:transaction];
+        self.removedCount++;
+        return;
+    }
+
+    if (![interaction isKindOfClass:[TSMessage class]]) {
+        return;
+    }
+    TSMessage *message = (TSMessage *)interaction;
+    for (NSString *attachmentId in message.attachmentIds) {
+        [self.referencedAttachmentIds addString:attachmentId];
+    }
+    for (NSString *attachmentId in message.quotedMessage.thumbnailAttachmentStreamIds) {
+        [self.referencedAttachmentIds addString:attachmentId];
+    }
+}
+
+// Attachments are visited in key order, so the cursor is the last key visited.  The collection has no index
+// to seek with, so each chunk skips the keys it has already visited.
+//
+// Attachment streams which no message refers to are removed, along with their files.  The other streams' files
+// are added to the attachment files filter.  A stream missed by this phase would have its file removed by the
+// next, so if the keys ever arrive out of order, no files are removed during this cycle.
+- (void)processAttachmentsChunk
+{
+    [self assertIsOnSerialQueue];
+
+    [self.databaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        NSMutableArray<NSString *> *keys = [NSMutableArray new];
+        __block NSString *_Nullable previousKey = nil;
+        [transaction enumerateKeysInCollection:[TSAttachment collection]
+                                    usingBlock:^(NSString *key, BOOL *stop) {
+                                        if (previousKey && [key compare:previousKey] != NSOrderedDescending) {
+                                            if (!self.isAttachmentOrderUnreliable) {
+                                                OWSFailDebug(@"%@ Attachments aren't in key order.", self.logTag);
+                                                self.isAttachmentOrderUnreliable = YES;
+                                            }
+                                        }
+                                        previousKey = key;
+
+                                        if (self.attachmentCursor
+                                            && [key compare:self.attachmentCursor] != NSOrderedDescending) {
+                                            return;
+                                        }
+                                        [keys addObject:key];
+                                        if (keys.count >= self.chunkSize) {
+                                            *stop = YES;
+                                        }
+                                    }];
+
+        for (NSString *key in keys) {
+            TSAttachment *_Nullable attachment = [TSAttachment fetchObjectWithUniqueID:key transaction:transaction];
+            if (!attachment) {
+                OWSFailDebug(@"%@ Could not load attachment: %@", self.logTag, key);
+                continue;
+            }
+            [self processAttachment:attachment transaction:transaction];
+        }
+
+        if (keys.count < self.chunkSize) {
+            self.phase = OWSOrphanCleanupPhaseFiles;
+        } else {
+            self.attachmentCursor = keys.lastObject;
+        }
+    }];
+}
+
+- (void)processAttachment:(TSAttachment *)attachment transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    if (![attachment isKindOfClass:[TSAttachmentStream class]]) {
+        return;
+    }
+    TSAttachmentStream *attachmentStream = (TSAttachmentStream *)attachment;
+
+    if (![self.referencedAttachmentIds mightContainString:attachmentStream.uniqueId]
+        && [self isOldEnoughToRemove:attachmentStream.creationTimestamp]) {
+        DDLogInfo(@"%@ Removing orphan attachmentStream from DB: %@", self.logTag, attachmentStream.uniqueId);
+        [attachmentStream removeWithTransaction:transaction];
+        self.removedCount++;
+        return;
+    }
+
+    NSString *_Nullable filePath = attachmentStream.filePath;
+    if (filePath) {
+        [self.attachmentFilePaths addString:filePath];
+    }
+    NSString *_Nullable thumbnailPath = attachmentStream.thumbnailPath;
+    if (thumbnailPath.length > 0) {
+        [self.attachmentFilePaths addString:thumbnailPath];
+    }
+}
+
+// Files are visited in directory order, so the cursor is the number of entries visited.  Removing a file
+// shifts the entries after it, so removed files don't count towards the cursor; other changes to the folder
+// can cause files to be skipped, which leaves them for the next cycle.
+- (void)processFilesChunk
+{
+    [self assertIsOnSerialQueue];
+
+    NSString *attachmentsFolder = [TSAttachmentStream attachmentsFolder];
+    NSDirectoryEnumerator<NSString *> *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:attachmentsFolder];
+    for (NSUInteger i = 0; i < self.fileCursor; i++) {
+        if (![enumerator nextObject]) {
+            break;
+        }
+    }
+
+    NSUInteger visitedCount = 0;
+    NSUInteger removedCount = 0;
+    NSString *_Nullable relativePath;
+    while (visitedCount < self.chunkSize && (relativePath = [enumerator nextObject])) {
+        visitedCount++;
+
+        NSDictionary<NSFileAttributeKey, id> *attributes = enumerator.fileAttributes;
+        if (![attributes.fileType isEqualToString:NSFileTypeRegular]) {
+            continue;
+        }
+        NSString *filePath = [attachmentsFolder stringByAppendingPathComponent:relativePath];
+        if (self.isAttachmentOrderUnreliable || [self.attachmentFilePaths mightContainString:filePath]
+            || ![self isOldEnoughToRemove:attributes.fileModificationDate]) {
+            continue;
+        }
+
+        DDLogInfo(@"%@ Deleting orphan attachment file: %@", self.logTag, filePath);
+        NSError *_Nullable error;
+        if (![[NSFileManager defaultManager] removeItemAtPath:filePath error:&error]) {
+            OWSFailDebug(@"%@ Could not remove orphan file at: %@, %@", self.logTag, filePath, error);
+            continue;
+        }
+        removedCount++;
+        self.removedCount++;
+    }
+
+    if (visitedCount < self.chunkSize) {
+        [self completeCycle];
+    } else {
+        self.fileCursor += visitedCount - removedCount;
+    }
+}
+
+#pragma mark - State
+
+- (void)loadState
+{
+    [self assertIsOnSerialQueue];
+
+    __block NSDictionary *_Nullable state;
+    [self.databaseConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        state = [transaction objectForKey:OWSIncrementalOrphanedDataCleanerStateKey
+                             inCollection:OWSIncrementalOrphanedDataCleanerCollection];
+    }];
+    if (!state) {
+        self.phase = OWSOrphanCleanupPhaseComplete;
+        return;
+    }
+
+    self.phase = [state[kStatePhaseKey] unsignedIntegerValue];
+    self.cycleStartDate = state[kStateCycleStartDateKey];
+    self.lastCycleCompletionDate = state[kStateLastCycleCompletionDateKey];
+    self.interactionCursor = [state[kStateInteractionCursorKey] longLongValue];
+    self.attachmentCursor = state[kStateAttachmentCursorKey];
+    self.fileCursor = [state[kStateFileCursorKey] unsignedIntegerValue];
+    NSData *_Nullable referencedAttachmentIds = state[kStateReferencedAttachmentIdsKey];
+    self.referencedAttachmentIds
+        = (referencedAttachmentIds ? [[OWSBloomFilter alloc] initWithData:referencedAttachmentIds] : nil);
+    NSData *_Nullable attachmentFilePaths = state[kStateAttachmentFilePathsKey];
+    self.attachmentFilePaths = (attachmentFilePaths ? [[OWSBloomFilter alloc] initWithData:attachmentFilePaths] : nil);
+    self.isAttachmentOrderUnreliable = [state[kStateIsAttachmentOrderUnreliableKey] boolValue];
+    self.removedCount = [state[kStateRemovedCountKey] unsignedIntegerValue];
+
+    if (self.phase != OWSOrphanCleanupPhaseComplete
+        && (!self.cycleStartDate || !self.referencedAttachmentIds || !self.attachmentFilePaths)) {
+        OWSFailDebug(@"%@ Invalid state; abandoning cycle.", self.logTag);
+        self.phase = OWSOrphanCleanupPhaseComplete;
+    }
+}
+
+- (void)saveState
+{
+    [self assertIsOnSerialQueue];
+
+    NSMutableDictionary *state = [NSMutableDictionary new];
+    state[kStatePhaseKey] = @(self.phase);
+    state[kStateCycleStartDateKey] = self.cycleStartDate;
+    state[kStateLastCycleCompletionDateKey] = self.lastCycleCompletionDate;
+    state[kStateInteractionCursorKey] = @(self.interactionCursor);
+    state[kStateAttachmentCursorKey] = self.attachmentCursor;
+    state[kStateFileCursorKey] = @(self.fileCursor);
+    state[kStateReferencedAttachmentIdsKey] = self.referencedAttachmentIds.data;
+    state[kStateAttachmentFilePathsKey] = self.attachmentFilePaths.data;
+    state[kStateIsAttachmentOrderUnreliableKey] = @(self.isAttachmentOrderUnreliable);
+    state[kStateRemovedCountKey] = @(self.removedCount);
+
+    [self.databaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction setObject:[state copy]
+                        forKey:OWSIncrementalOrphanedDataCleanerStateKey
+                  inCollection:OWSIncrementalOrphanedDataCleanerCollection];
+    }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
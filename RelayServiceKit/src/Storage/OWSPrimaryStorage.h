@@ -14,6 +14,13 @@ extern NSString *const OWSUIDatabaseConnectionNotificationsKey;
 
 extern NSString *const FLICorruptViewExtensionNotification;
 
+// Which database extensions are registered.
+typedef NS_ENUM(NSUInteger, OWSStorageProfile) {
+    // Every extension.
+    OWSStorageProfileMainApp,
+    // Only those which index what app extensions read or write, so that they're quick to open and light on memory.
+    OWSStorageProfileAppExtension,
+};
 
 @interface OWSPrimaryStorage : OWSStorage
 
@@ -25,8 +32,18 @@ extern NSString *const FLICorruptViewExtensionNotification;
 @property (nonatomic, readonly) YapDatabaseConnection *dbReadConnection;
 @property (nonatomic, readonly) YapDatabaseConnection *dbReadWriteConnection;
 
+// Chosen by the current app context.
+@property (nonatomic, readonly) OWSStorageProfile storageProfile;
+
 - (void)updateUIDatabaseConnectionToLatest;
 
+// Storage is ready before some extensions have finished building.  Calls `block` on the main thread once the
+// named extension is ready.
+- (void)runWhenExtensionIsReady:(NSString *)extensionName block:(dispatch_block_t)block;
+
+// Calls `block` on the main thread once the deferred extensions are ready too.
+- (void)runWhenAllExtensionsAreReady:(dispatch_block_t)block;
+
 + (YapDatabaseConnection *)dbReadConnection;
 + (YapDatabaseConnection *)dbReadWriteConnection;
 
@@ -13,7 +13,9 @@
 #import "OWSIncompleteCallsJob.h"
 #import "OWSMediaGalleryFinder.h"
 #import "OWSMessageReceiver.h"
+#import "OWSStartupTimeline.h"
 #import "OWSStorage+Subclass.h"
+#import "OWSStorageStartupOrchestrator.h"
 #import "TSDatabaseSecondaryIndexes.h"
 #import "TSDatabaseView.h"
 #import <RelayServiceKit/RelayServiceKit-Swift.h>
@@ -43,41 +45,124 @@ void RunSyncRegistrationsForStorage(OWSStorage *storage)
     [TSDatabaseView registerCrossProcessNotifier:storage];
 }
 
-void RunAsyncRegistrationsForStorage(OWSStorage *storage, dispatch_block_t completion)
+// Registers the extensions the inbox needs first, in the order they were registered before the registrations
+// were split, and defers those which back features that aren't used at launch.  Deferred extensions are still
+// queued before storage is ready, so they see every write; storage just doesn't wait for them to be built.
+//
+// App extensions skip the extensions which only index what they never write: received messages and their
+// processing queues, calls, linked devices and attachments which are yet to be downloaded or restored.  They
+// don't defer any of the rest, as they have no launch to speed up and little time to wait for stragglers.
+void AddAsyncRegistrationsForStorage(
+    OWSStorage *storage, OWSStorageStartupOrchestrator *orchestrator, OWSStorageProfile profile)
 {
     OWSCAssertDebug(storage);
-    OWSCAssertDebug(completion);
+    OWSCAssertDebug(orchestrator);
 
     // Asynchronously register other extensions.
     //
     // All sync registrations must be done before all async registrations,
     // or the sync registrations will block on the async registrations.
 
-    [TSDatabaseView registerTagDatabaseView:storage];
-    [TSDatabaseView asyncRegisterThreadInteractionsDatabaseView:storage];
-    [TSDatabaseView asyncRegisterThreadDatabaseView:storage];
-    [TSDatabaseView asyncRegisterUnreadDatabaseView:storage];
-    [storage asyncRegisterExtension:[TSDatabaseSecondaryIndexes registerTimeStampIndex]
-                           withName:[TSDatabaseSecondaryIndexes registerTimeStampIndexExtensionName]];
-    [OWSMessageReceiver asyncRegisterDatabaseExtension:storage];
-    [OWSBatchMessageProcessor asyncRegisterDatabaseExtension:storage];
-
-    [TSDatabaseView asyncRegisterUnseenDatabaseView:storage];
-    [TSDatabaseView asyncRegisterThreadOutgoingMessagesDatabaseView:storage];
-    [TSDatabaseView asyncRegisterThreadSpecialMessagesDatabaseView:storage];
-
-    [FullTextSearchFinder asyncRegisterDatabaseExtensionWithStorage:storage];
-    [OWSIncomingMessageFinder asyncRegisterExtensionWithPrimaryStorage:storage];
-    [TSDatabaseView asyncRegisterSecondaryDevicesDatabaseView:storage];
-    [OWSDisappearingMessagesFinder asyncRegisterDatabaseExtensions:storage];
-    [OWSFailedMessagesJob asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
-    [OWSIncompleteCallsJob asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
-    [OWSFailedAttachmentDownloadsJob asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
-    [OWSMediaGalleryFinder asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
-
-    // NOTE: Always pass the completion to the _LAST_ of the async database
-    // view registrations.
-    [TSDatabaseView asyncRegisterLazyRestoreAttachmentsDatabaseView:storage completion:completion];
+    BOOL isAppExtension = (profile == OWSStorageProfileAppExtension);
+    void (^addDeferredRegistration)(NSString *, OWSExtensionRegistrationBlock)
+        = ^(NSString *name, OWSExtensionRegistrationBlock block) {
+              if (isAppExtension) {
+                  [orchestrator addInboxRegistrationWithName:name block:block];
+              } else {
+                  [orchestrator addDeferredRegistrationWithName:name block:block];
+              }
+          };
+
+    [orchestrator addInboxRegistrationWithName:FLTagDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView registerTagDatabaseView:storage];
+                                         }];
+    [orchestrator addInboxRegistrationWithName:TSMessageDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView asyncRegisterThreadInteractionsDatabaseView:storage];
+                                         }];
+    [orchestrator addInboxRegistrationWithName:TSThreadDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView asyncRegisterThreadDatabaseView:storage];
+                                         }];
+    [orchestrator addInboxRegistrationWithName:TSUnreadDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView asyncRegisterUnreadDatabaseView:storage];
+                                         }];
+    [orchestrator addInboxRegistrationWithName:[TSDatabaseSecondaryIndexes registerTimeStampIndexExtensionName]
+                                         block:^(OWSStorage *storage) {
+                                             [storage asyncRegisterExtension:[TSDatabaseSecondaryIndexes
+                                                                                 registerTimeStampIndex]
+                                                                    withName:[TSDatabaseSecondaryIndexes
+                                                                                 registerTimeStampIndexExtensionName]];
+                                         }];
+    if (!isAppExtension) {
+        [orchestrator addInboxRegistrationWithName:@"OWSMessageReceiver"
+                                             block:^(OWSStorage *storage) {
+                                                 [OWSMessageReceiver asyncRegisterDatabaseExtension:storage];
+                                             }];
+        [orchestrator addInboxRegistrationWithName:@"OWSBatchMessageProcessor"
+                                             block:^(OWSStorage *storage) {
+                                                 [OWSBatchMessageProcessor asyncRegisterDatabaseExtension:storage];
+                                             }];
+    }
+    [orchestrator addInboxRegistrationWithName:TSUnseenDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView asyncRegisterUnseenDatabaseView:storage];
+                                         }];
+    [orchestrator addInboxRegistrationWithName:TSThreadOutgoingMessageDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView asyncRegisterThreadOutgoingMessagesDatabaseView:storage];
+                                         }];
+    [orchestrator addInboxRegistrationWithName:TSThreadSpecialMessagesDatabaseViewExtensionName
+                                         block:^(OWSStorage *storage) {
+                                             [TSDatabaseView asyncRegisterThreadSpecialMessagesDatabaseView:storage];
+                                         }];
+    if (!isAppExtension) {
+        [orchestrator addInboxRegistrationWithName:@"OWSIncomingMessageFinder"
+                                             block:^(OWSStorage *storage) {
+                                                 [OWSIncomingMessageFinder
+                                                     asyncRegisterExtensionWithPrimaryStorage:storage];
+                                             }];
+        [orchestrator addInboxRegistrationWithName:TSSecondaryDevicesDatabaseViewExtensionName
+                                             block:^(OWSStorage *storage) {
+                                                 [TSDatabaseView asyncRegisterSecondaryDevicesDatabaseView:storage];
+                                             }];
+    }
+    [orchestrator addInboxRegistrationWithName:@"OWSDisappearingMessagesFinder"
+                                         block:^(OWSStorage *storage) {
+                                             [OWSDisappearingMessagesFinder asyncRegisterDatabaseExtensions:storage];
+                                         }];
+    if (!isAppExtension) {
+        [orchestrator addInboxRegistrationWithName:TSLazyRestoreAttachmentsDatabaseViewExtensionName
+                                             block:^(OWSStorage *storage) {
+                                                 [TSDatabaseView asyncRegisterLazyRestoreAttachmentsDatabaseView:storage
+                                                                                                     completion:nil];
+                                             }];
+    }
+
+    // Search, the media gallery and the launch jobs can wait until the inbox is up.
+    addDeferredRegistration([OWSFailedMessagesJob databaseExtensionName], ^(OWSStorage *storage) {
+        [OWSFailedMessagesJob asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
+    });
+    if (!isAppExtension) {
+        [orchestrator addDeferredRegistrationWithName:[OWSIncompleteCallsJob databaseExtensionName]
+                                                block:^(OWSStorage *storage) {
+                                                    [OWSIncompleteCallsJob
+                                                        asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
+                                                }];
+        [orchestrator addDeferredRegistrationWithName:[OWSFailedAttachmentDownloadsJob databaseExtensionName]
+                                                block:^(OWSStorage *storage) {
+                                                    [OWSFailedAttachmentDownloadsJob
+                                                        asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
+                                                }];
+    }
+    addDeferredRegistration([OWSMediaGalleryFinder databaseExtensionName], ^(OWSStorage *storage) {
+        [OWSMediaGalleryFinder asyncRegisterDatabaseExtensionsWithPrimaryStorage:storage];
+    });
+    addDeferredRegistration([FullTextSearchFinder databaseExtensionName], ^(OWSStorage *storage) {
+        [FullTextSearchFinder asyncRegisterDatabaseExtensionWithStorage:storage];
+    });
 }
 
 void VerifyRegistrationsForPrimaryStorage(OWSStorage *storage)
@@ -104,6 +189,8 @@ void VerifyRegistrationsForPrimaryStorage(OWSStorage *storage)
 @property (atomic) BOOL areAsyncRegistrationsComplete;
 @property (atomic) BOOL areSyncRegistrationsComplete;
 
+@property (nonatomic, nullable) OWSStorageStartupOrchestrator *startupOrchestrator;
+
 @end
 
 #pragma mark -
@@ -131,6 +218,9 @@ void VerifyRegistrationsForPrimaryStorage(OWSStorage *storage)
     self = [super initStorage];
 
     if (self) {
+        _storageProfile
+            = (CurrentAppContext().isMainApp ? OWSStorageProfileMainApp : OWSStorageProfileAppExtension);
+
         [self loadDatabase];
 
         _dbReadConnection = [self newDatabaseConnection];
@@ -240,11 +330,17 @@ void VerifyRegistrationsForPrimaryStorage(OWSStorage *storage)
 
 - (void)runAsyncRegistrationsWithCompletion:(void (^_Nonnull)(void))completion
 {
+    OWSAssertIsOnMainThread();
     OWSAssertDebug(completion);
+    OWSAssertDebug(!self.startupOrchestrator);
 
     DDLogVerbose(@"%@ async registrations enqueuing.", self.logTag);
 
-    RunAsyncRegistrationsForStorage(self, ^{
+    [OWSStartupTimeline.sharedTimeline markEvent:@"storage.syncRegistrationsComplete"];
+
+    self.startupOrchestrator = [[OWSStorageStartupOrchestrator alloc] initWithStorage:self];
+    AddAsyncRegistrationsForStorage(self, self.startupOrchestrator, self.storageProfile);
+    [self.startupOrchestrator runRegistrationsWithInboxCompletion:^{
         OWSAssertIsOnMainThread();
 
         OWSAssertDebug(!self.areAsyncRegistrationsComplete);
@@ -254,9 +350,41 @@ void VerifyRegistrationsForPrimaryStorage(OWSStorage *storage)
         self.areAsyncRegistrationsComplete = YES;
 
         completion();
+    }];
+    [self.startupOrchestrator runWhenAllExtensionsAreReady:^{
+        DDLogVerbose(@"%@ deferred registrations complete.", self.logTag);
 
-        [self verifyDatabaseViews];
-    });
+        [OWSStartupTimeline.sharedTimeline logTimeline];
+
+        // Verification reads every extension, which app extensions can't spare the time or memory for.
+        if (self.storageProfile == OWSStorageProfileMainApp) {
+            [self verifyDatabaseViews];
+        }
+    }];
+}
+
+- (void)runWhenExtensionIsReady:(NSString *)extensionName block:(dispatch_block_t)block
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(block);
+
+    if (!self.startupOrchestrator) {
+        OWSFailDebug(@"%@ registrations haven't started.", self.logTag);
+        return;
+    }
+    [self.startupOrchestrator runWhenExtensionIsReady:extensionName block:block];
+}
+
+- (void)runWhenAllExtensionsAreReady:(dispatch_block_t)block
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(block);
+
+    if (!self.startupOrchestrator) {
+        OWSFailDebug(@"%@ registrations haven't started.", self.logTag);
+        return;
+    }
+    [self.startupOrchestrator runWhenAllExtensionsAreReady:block];
 }
 
 - (void)verifyDatabaseViews
@@ -76,6 +76,10 @@ typedef void (^OWSStorageMigrationBlock)(void);
                       withName:(NSString *)extensionName
                     completion:(nullable dispatch_block_t)completion;
 
+// YapDatabase registers extensions one at a time, in the order they were requested.  The completion is called on
+// the main thread once every registration requested so far has completed.
+- (void)flushExtensionRegistrationsWithCompletion:(dispatch_block_t)completion;
+
 - (nullable id)registeredExtension:(NSString *)extensionName;
 
 - (NSArray<NSString *> *)registeredExtensionNames;
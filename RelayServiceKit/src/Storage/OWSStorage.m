@@ -648,6 +648,13 @@ NSString *const kNSUserDefaults_DatabaseExtensionVersionMap = @"kNSUserDefaults_
                           }];
 }
 
+- (void)flushExtensionRegistrationsWithCompletion:(dispatch_block_t)completion
+{
+    OWSAssertDebug(completion);
+
+    [self.database flushExtensionRequestsWithCompletionQueue:dispatch_get_main_queue() completionBlock:completion];
+}
+
 - (nullable id)registeredExtension:(NSString *)extensionName
 {
     return [self.database registeredExtension:extensionName];
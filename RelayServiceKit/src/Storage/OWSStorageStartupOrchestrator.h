@@ -0,0 +1,47 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class OWSStorage;
+
+typedef void (^OWSExtensionRegistrationBlock)(OWSStorage *storage);
+
+// Registers a storage's database extensions so that launch only waits for the extensions the first screen needs.
+//
+// An extension is only updated by writes made while it's registered, so every registration is queued on the
+// database's write queue up front, before the app can write anything: "inbox" registrations first, in order, then
+// "deferred" ones.  Once the inbox registrations are ready the inbox registrations completion is called; the
+// deferred ones carry on building behind them, and writes queue behind those.  Readers of a deferred extension
+// wait for it with -runWhenExtensionIsReady:block:.
+//
+// Each registration is followed by a flush of the extension requests, so that its readiness can be observed and
+// recorded in the startup timeline.
+//
+// Should only be used from the main thread.  Blocks are called on the main thread.
+@interface OWSStorageStartupOrchestrator : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithStorage:(OWSStorage *)storage NS_DESIGNATED_INITIALIZER;
+
+// `name` identifies the registration (usually the name of the extension it registers) in the timeline and for
+// -runWhenExtensionIsReady:block:.
+- (void)addInboxRegistrationWithName:(NSString *)name block:(OWSExtensionRegistrationBlock)block;
+- (void)addDeferredRegistrationWithName:(NSString *)name block:(OWSExtensionRegistrationBlock)block;
+
+// Queues every registration.  `inboxCompletion` is called once the inbox registrations are ready.
+- (void)runRegistrationsWithInboxCompletion:(dispatch_block_t)inboxCompletion;
+
+- (BOOL)isExtensionReady:(NSString *)name;
+- (BOOL)areAllRegistrationsComplete;
+
+// Calls `block` immediately if the registration is complete.
+- (void)runWhenExtensionIsReady:(NSString *)name block:(dispatch_block_t)block;
+
+- (void)runWhenAllExtensionsAreReady:(dispatch_block_t)block;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,226 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSStorageStartupOrchestrator.h"
+#import "OWSStartupTimeline.h"
+#import "OWSStorage.h"
+#import "SSKAsserts.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSExtensionRegistration : NSObject
+
+@property (nonatomic, readonly) NSString *name;
+@property (nonatomic, readonly) OWSExtensionRegistrationBlock block;
+
+@end
+
+@implementation OWSExtensionRegistration
+
+- (instancetype)initWithName:(NSString *)name block:(OWSExtensionRegistrationBlock)block
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _name = name;
+    _block = [block copy];
+
+    return self;
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSStorageStartupOrchestrator ()
+
+@property (nonatomic, readonly) OWSStorage *storage;
+
+@property (nonatomic, readonly) NSMutableArray<OWSExtensionRegistration *> *inboxRegistrations;
+@property (nonatomic, readonly) NSMutableArray<OWSExtensionRegistration *> *deferredRegistrations;
+@property (nonatomic, readonly) NSMutableSet<NSString *> *readyNames;
+
+@property (nonatomic) BOOL hasStartedRegistrations;
+@property (nonatomic) BOOL areAllRegistrationsComplete;
+
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, NSMutableArray<dispatch_block_t> *> *extensionReadyBlocks;
+@property (nonatomic, readonly) NSMutableArray<dispatch_block_t> *allReadyBlocks;
+
+@end
+
+#pragma mark -
+
+@implementation OWSStorageStartupOrchestrator
+
+- (instancetype)initWithStorage:(OWSStorage *)storage
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    OWSAssertDebug(storage);
+
+    _storage = storage;
+    _inboxRegistrations = [NSMutableArray new];
+    _deferredRegistrations = [NSMutableArray new];
+    _readyNames = [NSMutableSet new];
+    _extensionReadyBlocks = [NSMutableDictionary new];
+    _allReadyBlocks = [NSMutableArray new];
+
+    return self;
+}
+
+- (void)addInboxRegistrationWithName:(NSString *)name block:(OWSExtensionRegistrationBlock)block
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(!self.hasStartedRegistrations);
+
+    [self.inboxRegistrations addObject:[[OWSExtensionRegistration alloc] initWithName:name block:block]];
+}
+
+- (void)addDeferredRegistrationWithName:(NSString *)name block:(OWSExtensionRegistrationBlock)block
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(!self.hasStartedRegistrations);
+
+    [self.deferredRegistrations addObject:[[OWSExtensionRegistration alloc] initWithName:name block:block]];
+}
+
+- (void)runRegistrationsWithInboxCompletion:(dispatch_block_t)inboxCompletion
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(!self.hasStartedRegistrations);
+
+    self.hasStartedRegistrations = YES;
+
+    // YapDatabase runs extension requests in order on its write queue, so each flush completes once the
+    // registrations before it are ready.
+    for (OWSExtensionRegistration *registration in self.inboxRegistrations) {
+        [self queueRegistration:registration];
+    }
+    BOOL hasDeferredRegistrations = self.deferredRegistrations.count > 0;
+    [self.storage flushExtensionRegistrationsWithCompletion:^{
+        [self inboxRegistrationsDidComplete];
+        if (!hasDeferredRegistrations) {
+            [self allRegistrationsDidComplete];
+        }
+        inboxCompletion();
+    }];
+    if (!hasDeferredRegistrations) {
+        return;
+    }
+
+    for (OWSExtensionRegistration *registration in self.deferredRegistrations) {
+        [self queueRegistration:registration];
+    }
+    [self.storage flushExtensionRegistrationsWithCompletion:^{
+        [self allRegistrationsDidComplete];
+    }];
+}
+
+- (void)queueRegistration:(OWSExtensionRegistration *)registration
+{
+    registration.block(self.storage);
+    [self.storage flushExtensionRegistrationsWithCompletion:^{
+        [self registrationDidComplete:registration];
+    }];
+}
+
+#pragma mark - Readiness
+
+- (BOOL)isExtensionReady:(NSString *)name
+{
+    OWSAssertIsOnMainThread();
+
+    return [self.readyNames containsObject:name];
+}
+
+- (void)runWhenExtensionIsReady:(NSString *)name block:(dispatch_block_t)block
+{
+    OWSAssertIsOnMainThread();
+    OWSAssertDebug(name.length > 0);
+
+    if ([self isExtensionReady:name]) {
+        block();
+        return;
+    }
+    if (![self hasRegistrationWithName:name]) {
+        OWSFailDebug(@"%@ Unknown extension: %@", self.logTag, name);
+    }
+
+    NSMutableArray<dispatch_block_t> *blocks = self.extensionReadyBlocks[name];
+    if (!blocks) {
+        blocks = [NSMutableArray new];
+        self.extensionReadyBlocks[name] = blocks;
+    }
+    [blocks addObject:[block copy]];
+}
+
+- (BOOL)hasRegistrationWithName:(NSString *)name
+{
+    for (NSArray<OWSExtensionRegistration *> *registrations in @[ self.inboxRegistrations, self.deferredRegistrations ]) {
+        for (OWSExtensionRegistration *registration in registrations) {
+            if ([registration.name isEqualToString:name]) {
+                return YES;
+            }
+        }
+    }
+    return NO;
+}
+
+- (void)runWhenAllExtensionsAreReady:(dispatch_block_t)block
+{
+    OWSAssertIsOnMainThread();
+
+    if (self.areAllRegistrationsComplete) {
+        block();
+        return;
+    }
+    [self.allReadyBlocks addObject:[block copy]];
+}
+
+#pragma mark - Registration
+
+- (void)registrationDidComplete:(OWSExtensionRegistration *)registration
+{
+    OWSAssertIsOnMainThread();
+
+    [OWSStartupTimeline.sharedTimeline markEvent:[@"storage.extension." stringByAppendingString:registration.name]];
+
+    [self.readyNames addObject:registration.name];
+
+    NSArray<dispatch_block_t> *blocks = self.extensionReadyBlocks[registration.name];
+    [self.extensionReadyBlocks removeObjectForKey:registration.name];
+    for (dispatch_block_t block in blocks) {
+        block();
+    }
+}
+
+- (void)inboxRegistrationsDidComplete
+{
+    OWSAssertIsOnMainThread();
+
+    [OWSStartupTimeline.sharedTimeline markEvent:@"storage.inboxExtensionsReady"];
+}
+
+- (void)allRegistrationsDidComplete
+{
+    OWSAssertIsOnMainThread();
+
+    self.areAllRegistrationsComplete = YES;
+    [OWSStartupTimeline.sharedTimeline markEvent:@"storage.allExtensionsReady"];
+
+    NSArray<dispatch_block_t> *blocks = [self.allReadyBlocks copy];
+    [self.allReadyBlocks removeAllObjects];
+    for (dispatch_block_t block in blocks) {
+        block();
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
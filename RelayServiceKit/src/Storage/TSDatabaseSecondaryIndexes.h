@@ -15,4 +15,11 @@
                              withBlock:(void (^)(NSString *collection, NSString *key, BOOL *stop))block
                       usingTransaction:(YapDatabaseReadTransaction *)transaction;
 
+// Enumerates up to `limit` messages with timestamps after `timestamp`, in timestamp order.  Pass -1 to start
+// from the first message.
++ (void)enumerateMessagesAfterTimestamp:(int64_t)timestamp
+                                  limit:(NSUInteger)limit
+                              withBlock:(void (^)(NSString *collection, NSString *key, BOOL *stop))block
+                       usingTransaction:(YapDatabaseReadTransaction *)transaction;
+
 @end
@@ -47,4 +47,18 @@
     [[transaction ext:[self registerTimeStampIndexExtensionName]] enumerateKeysMatchingQuery:query usingBlock:block];
 }
 
++ (void)enumerateMessagesAfterTimestamp:(int64_t)timestamp
+                                  limit:(NSUInteger)limit
+                              withBlock:(void (^)(NSString *collection, NSString *key, BOOL *stop))block
+                       usingTransaction:(YapDatabaseReadTransaction *)transaction
+{
+    NSString *formattedString = [NSString stringWithFormat:@"WHERE %@ > %lld ORDER BY %@ ASC LIMIT %lu",
+                                          TSTimeStampSQLiteIndex,
+                                          timestamp,
+                                          TSTimeStampSQLiteIndex,
+                                          (unsigned long)limit];
+    YapDatabaseQuery *query = [YapDatabaseQuery queryWithFormat:formattedString];
+    [[transaction ext:[self registerTimeStampIndexExtensionName]] enumerateKeysMatchingQuery:query usingBlock:block];
+}
+
 @end
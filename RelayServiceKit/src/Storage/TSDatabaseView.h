@@ -25,6 +25,8 @@ extern NSString *const TSThreadDatabaseViewExtensionName;
 extern NSString *const TSMessageDatabaseViewExtensionName;
 extern NSString *const TSUnreadDatabaseViewExtensionName;
 extern NSString *const TSUnseenDatabaseViewExtensionName;
+extern NSString *const TSThreadOutgoingMessageDatabaseViewExtensionName;
+extern NSString *const TSThreadSpecialMessagesDatabaseViewExtensionName;
 
 extern NSString *const TSSecondaryDevicesDatabaseViewExtensionName;
 
@@ -60,6 +62,9 @@ extern NSString *const TSLazyRestoreAttachmentsDatabaseViewExtensionName;
 // Should be used for "unread message counts".
 + (void)asyncRegisterUnreadDatabaseView:(nonnull OWSStorage *)storage;
 
+// The unread view's group for `object`, or nil if it isn't unread.  Also used by OWSUnreadCounter.
++ (nullable NSString *)unreadGroupForObject:(nonnull id)object;
+
 // Should be used for "unread indicator".
 //
 // Instances of OWSReadTracking for wasRead is NO.
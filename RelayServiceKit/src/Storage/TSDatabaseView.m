@@ -105,6 +105,19 @@ NSString *const TSLazyRestoreAttachmentsGroup = @"TSLazyRestoreAttachmentsGroup"
     [storage asyncRegisterExtension:view withName:viewName];
 }
 
++ (nullable NSString *)unreadGroupForObject:(id)object
+{
+    if ([object conformsToProtocol:@protocol(OWSReadTracking)]) {
+        id<OWSReadTracking> possiblyRead = (id<OWSReadTracking>)object;
+        if (!possiblyRead.wasRead && possiblyRead.shouldAffectUnreadCounts) {
+            if ([[NSUUID alloc] initWithUUIDString:possiblyRead.uniqueThreadId] != nil) {
+                return possiblyRead.uniqueThreadId.lowercaseString;
+            }
+        }
+    }
+    return nil;
+}
+
 + (void)asyncRegisterUnreadDatabaseView:(nonnull OWSStorage *)storage
 {
     YapDatabaseViewGrouping *viewGrouping = [YapDatabaseViewGrouping withObjectBlock:^NSString *(YapDatabaseReadTransaction *transaction,
@@ -116,15 +129,7 @@ NSString *const TSLazyRestoreAttachmentsGroup = @"TSLazyRestoreAttachmentsGroup"
             OWSFailDebug(@"%@ Invalid entity %@ in collection: %@ with key: %@", self.logTag, [object class], collection, key);
             return nil;
         }
-        if ([object conformsToProtocol:@protocol(OWSReadTracking)]) {
-            id<OWSReadTracking> possiblyRead = (id<OWSReadTracking>)object;
-            if (!possiblyRead.wasRead && possiblyRead.shouldAffectUnreadCounts) {
-                if ([[NSUUID alloc] initWithUUIDString:possiblyRead.uniqueThreadId] != nil) {
-                    return possiblyRead.uniqueThreadId.lowercaseString;
-                }
-            }
-        }
-        return nil;
+        return [self unreadGroupForObject:object];
     }];
 
     [self registerMessageDatabaseViewWithName:TSUnreadDatabaseViewExtensionName
@@ -39,8 +39,15 @@ typedef NS_ENUM(NSInteger, TSWhisperMessageType) {
 #define FLTagsNeedRefreshNotification @"FLTagsNeedRefreshNotification"
 #define FLCCSMUsersUpdated @"FLCCSMUsersUpdated"
 #define FLCCSMTagsUpdated @"FLCCSMTagsUpdated"
+// userInfo keys for FLCCSMUsersUpdated/FLCCSMTagsUpdated.  Changed records are only present for delta syncs, and
+// removed record ids for full syncs.
+#define FLCCSMChangedRecordsKey @"changedRecords"
+#define FLCCSMRemovedRecordIdsKey @"removedRecordIds"
+#define FLCCSMSyncDateKey @"syncDate"
 #define FLRegistrationStatusUpdateNotification @"FLRegistrationStatusUpdateNotification"
 #define FLRecipientNeedsGravatarFetched @"FLRecipientNeedsGravatarFetched"
+// userInfo has the recipient's "recipientId".
+#define FLRecipientAvatarUpdatedNotification @"FLRecipientAvatarUpdatedNotification"
 
 // Superman IDs - used for provisioning.
 #define FLSupermanDevID @"1e1116aa-31b3-4fb2-a4db-21e8136d4f3a"
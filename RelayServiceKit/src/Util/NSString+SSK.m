@@ -39,6 +39,77 @@ NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark -
 
+// rangeOfComposedCharacterSequenceAtIndex: never returns more code units than this for text which isn't
+// "zalgo" style.
+static const NSUInteger kMaxComposedCharacterSequenceLength = 8;
+
+// Whether a UTF-16 code unit might continue the composed character sequence of the code unit before it: combining
+// and spacing marks, joiners, variation selectors, conjoining Hangul jamo, surrogates, and LF (after CR), as well as
+// the © and ® emoji (after ZWJ).  This errs on the side of YES, so a run of code units for which it's NO bounds the
+// length of every composed character sequence in the string.
+static BOOL OWSMayExtendComposedCharacterSequence(unichar c)
+{
+    if (c < 0x300) {
+        return c == 0x0A || c == 0xA9 || c == 0xAE;
+    }
+
+    static NSCharacterSet *characterSet;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableCharacterSet *mutableSet = [NSCharacterSet.nonBaseCharacterSet mutableCopy];
+        // Thai and Lao SARA AM are spacing marks, but not in the "Mark" categories.
+        [mutableSet addCharactersInString:@"\u0E33\u0EB3"];
+        // Zero-width non-joiner and joiner.
+        [mutableSet addCharactersInRange:NSMakeRange(0x200C, 2)];
+        // Conjoining Hangul jamo.
+        [mutableSet addCharactersInRange:NSMakeRange(0x1100, 0x100)];
+        [mutableSet addCharactersInRange:NSMakeRange(0xA960, 0x20)];
+        [mutableSet addCharactersInRange:NSMakeRange(0xD7B0, 0x50)];
+        // Surrogates, which covers emoji modifiers, regional indicators and tags.
+        [mutableSet addCharactersInRange:NSMakeRange(0xD800, 0x800)];
+        // Half-width katakana voiced sound marks.
+        [mutableSet addCharactersInRange:NSMakeRange(0xFF9E, 2)];
+        characterSet = [mutableSet copy];
+    });
+    return [characterSet characterIsMember:c];
+}
+
+// Whether a UTF-16 code unit joins with whatever follows it: ZWJ, "prepended concatenation marks", viramas
+// (which some platforms treat as joining conjuncts) and leading Hangul jamo, which joins with a precomposed
+// syllable.
+static BOOL OWSJoinsNextCharacter(unichar c)
+{
+    if (c < 0x600) {
+        return NO;
+    }
+    switch (c) {
+        case 0x200D:
+        case 0x06DD:
+        case 0x070F:
+        case 0x08E2:
+        case 0x094D:
+        case 0x09CD:
+        case 0x0A4D:
+        case 0x0ACD:
+        case 0x0B4D:
+        case 0x0BCD:
+        case 0x0C4D:
+        case 0x0CCD:
+        case 0x0D4D:
+        case 0x0D4E:
+        case 0x0DCA:
+        case 0x0E3A:
+        case 0x0F84:
+        case 0x1039:
+        case 0x17D2:
+            return YES;
+        default:
+            return ((c >= 0x0600 && c <= 0x0605) || (c >= 0x1100 && c <= 0x115F) || (c >= 0xA960 && c <= 0xA97C));
+    }
+}
+
+#pragma mark -
+
 @implementation NSString (SSK)
 
 - (NSString *)ows_stripped
@@ -100,52 +171,6 @@ NS_ASSUME_NONNULL_BEGIN
     return NO;
 }
 
-+ (NSCharacterSet *)problematicCharacterSetForIndicScript
-{
-    static NSCharacterSet *characterSet;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        characterSet = [NSCharacterSet characterSetWithCharactersInString:@"\u200C"];
-    });
-
-    return characterSet;
-}
-
-// See: https://manishearth.github.io/blog/2018/02/15/picking-apart-the-crashing-ios-string/
-- (NSString *)filterForIndicScripts
-{
-    if (!NSString.shouldFilterIndic) {
-        return self;
-    }
-
-    if ([self rangeOfCharacterFromSet:[[self class] problematicCharacterSetForIndicScript]].location == NSNotFound) {
-        return self;
-    }
-
-    NSMutableString *filteredForIndic = [NSMutableString new];
-    for (NSUInteger index = 0; index < self.length; index++) {
-        unichar c = [self characterAtIndex:index];
-        if (c == 0x200C) {
-            NSUInteger nextIndex = index + 1;
-            if (nextIndex < self.length) {
-                unichar next = [self characterAtIndex:nextIndex];
-                if ([NSString isIndicVowel:next]) {
-                    // Discard ZWNJ (zero-width non-joiner) whenever we find a ZWNJ
-                    // followed by an Indic (Telugu, Bengali, Devanagari) vowel
-                    // and replace it with 0xFFFD, the Unicode "replacement character."
-                    [filteredForIndic appendFormat:@"\uFFFD"];
-                    DDLogError(@"%@ Filtered unsafe Indic script.", self.logTag);
-                    // Then discard the vowel too.
-                    index++;
-                    continue;
-                }
-            }
-        }
-        [filteredForIndic appendFormat:@"%C", c];
-    }
-    return [filteredForIndic copy];
-}
-
 + (NSCharacterSet *)unsafeFilenameCharacterSet
 {
     static NSCharacterSet *characterSet;
@@ -186,12 +211,102 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (NSString *)filterStringForDisplay
 {
-    return self.ows_stripped.filterForIndicScripts.filterForExcessiveDiacriticals;
+    return [self ows_filterWithIndicFiltering:NSString.shouldFilterIndic filenameFiltering:NO];
 }
 
 - (NSString *)filterFilename
 {
-    return self.ows_stripped.filterForIndicScripts.filterForExcessiveDiacriticals.filterUnsafeFilenameCharacters;
+    return [self ows_filterWithIndicFiltering:NSString.shouldFilterIndic filenameFiltering:YES];
+}
+
+// Strips whitespace, filters unsafe Indic script and (optionally) unsafe filename characters, and folds
+// excessive diacriticals, in that order.  One pass over the UTF-16 code units does the stripping and the Indic
+// filtering, notes any unsafe filename characters, and rules out excessive diacriticals for almost all text;
+// the other steps only run when that pass found something for them to do.
+//
+// Returns self if there is nothing to filter.
+- (NSString *)ows_filterWithIndicFiltering:(BOOL)filterIndic filenameFiltering:(BOOL)filterFilename
+{
+    CFStringRef cfString = (__bridge CFStringRef)self;
+    CFIndex length = CFStringGetLength(cfString);
+    if (length < 1) {
+        return self;
+    }
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer(cfString, &buffer, CFRangeMake(0, length));
+
+    NSCharacterSet *whitespaceSet = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    CFIndex start = 0;
+    while (start < length && [whitespaceSet characterIsMember:CFStringGetCharacterFromInlineBuffer(&buffer, start)]) {
+        start++;
+    }
+    CFIndex end = length;
+    while (end > start && [whitespaceSet characterIsMember:CFStringGetCharacterFromInlineBuffer(&buffer, end - 1)]) {
+        end--;
+    }
+
+    // Only allocated once the Indic filter changes something.
+    unichar *_Nullable filtered = NULL;
+    NSUInteger filteredLength = 0;
+    BOOL hasUnsafeFilenameCharacters = NO;
+    BOOL mayHaveExcessiveDiacriticals = NO;
+    NSUInteger clusterLengthBound = 0;
+    BOOL joinsNextCharacter = NO;
+
+    for (CFIndex index = start; index < end; index++) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&buffer, index);
+
+        // See: https://manishearth.github.io/blog/2018/02/15/picking-apart-the-crashing-ios-string/
+        if (filterIndic && c == 0x200C && index + 1 < end
+            && [NSString isIndicVowel:CFStringGetCharacterFromInlineBuffer(&buffer, index + 1)]) {
+            if (!filtered) {
+                filtered = malloc((size_t)(end - start) * sizeof(unichar));
+                CFStringGetCharacters(cfString, CFRangeMake(start, index - start), filtered);
+                filteredLength = (NSUInteger)(index - start);
+            }
+            // Discard ZWNJ (zero-width non-joiner) whenever we find a ZWNJ
+            // followed by an Indic (Telugu, Bengali, Devanagari) vowel
+            // and replace it with 0xFFFD, the Unicode "replacement character."
+            c = 0xFFFD;
+            DDLogError(@"%@ Filtered unsafe Indic script.", self.logTag);
+            // Then discard the vowel too.
+            index++;
+        }
+        if (filtered) {
+            filtered[filteredLength++] = c;
+        }
+
+        if (c == 0x202D || c == 0x202E) {
+            hasUnsafeFilenameCharacters = YES;
+        }
+
+        if (joinsNextCharacter || OWSMayExtendComposedCharacterSequence(c)) {
+            clusterLengthBound++;
+            if (clusterLengthBound > kMaxComposedCharacterSequenceLength) {
+                mayHaveExcessiveDiacriticals = YES;
+            }
+        } else {
+            clusterLengthBound = 1;
+        }
+        joinsNextCharacter = OWSJoinsNextCharacter(c);
+    }
+
+    NSString *result;
+    if (filtered) {
+        result = [[NSString alloc] initWithCharactersNoCopy:filtered length:filteredLength freeWhenDone:YES];
+    } else if (start == 0 && end == length) {
+        result = self;
+    } else {
+        result = [self substringWithRange:NSMakeRange((NSUInteger)start, (NSUInteger)(end - start))];
+    }
+
+    if (mayHaveExcessiveDiacriticals) {
+        result = result.filterForExcessiveDiacriticals;
+    }
+    if (filterFilename && hasUnsafeFilenameCharacters) {
+        result = result.filterUnsafeFilenameCharacters;
+    }
+    return result;
 }
 
 - (NSString *)filterForExcessiveDiacriticals
@@ -225,12 +340,18 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (BOOL)isValidE164
 {
-    NSError *error = nil;
-    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:@"^\\+\\d+$"
-                                                                           options:NSRegularExpressionCaseInsensitive
-                                                                             error:&error];
-    if (error || !regex) {
-        OWSFailDebug(@"%@ could not compile regex: %@", self.logTag, error);
+    static NSRegularExpression *regex;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSError *error = nil;
+        regex = [NSRegularExpression regularExpressionWithPattern:@"^\\+\\d+$"
+                                                          options:NSRegularExpressionCaseInsensitive
+                                                            error:&error];
+        if (error || !regex) {
+            OWSFailDebug(@"%@ could not compile regex: %@", self.logTag, error);
+        }
+    });
+    if (!regex) {
         return NO;
     }
     return [regex rangeOfFirstMatchInString:self options:0 range:NSMakeRange(0, self.length)].location != NSNotFound;
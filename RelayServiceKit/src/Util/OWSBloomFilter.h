@@ -0,0 +1,29 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A fixed-size set of strings which can report false positives, but never false negatives.  It takes about
+// 10 bits per string at the capacity it was created for, with about a 1% false positive rate; more strings
+// raise the false positive rate.
+//
+// Not thread safe.
+@interface OWSBloomFilter : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+
+// `data` should come from -data.
+- (nullable instancetype)initWithData:(NSData *)data;
+
+- (void)addString:(NSString *)string;
+
+- (BOOL)mightContainString:(NSString *)string;
+
+- (NSData *)data;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,117 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSBloomFilter.h"
+#import "SSKAsserts.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const NSUInteger kBitsPerString = 10;
+static const NSUInteger kHashCount = 7;
+static const NSUInteger kMinimumBitCount = 1024;
+
+// FNV-1a.
+static uint64_t OWSBloomFilterHash(const char *bytes, size_t length, uint64_t seed)
+{
+    uint64_t hash = 14695981039346656037ULL ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+@interface OWSBloomFilter ()
+
+@property (nonatomic, readonly) NSMutableData *bits;
+@property (nonatomic, readonly) uint64_t bitCount;
+
+@end
+
+#pragma mark -
+
+@implementation OWSBloomFilter
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    NSUInteger bitCount = MAX(capacity * kBitsPerString, kMinimumBitCount);
+    _bits = [NSMutableData dataWithLength:(bitCount + 7) / 8];
+    _bitCount = _bits.length * 8;
+
+    return self;
+}
+
+- (nullable instancetype)initWithData:(NSData *)data
+{
+    if (data.length < 1) {
+        OWSFailDebug(@"%@ Invalid data.", self.logTag);
+        return nil;
+    }
+
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _bits = [data mutableCopy];
+    _bitCount = _bits.length * 8;
+
+    return self;
+}
+
+- (NSData *)data
+{
+    return [self.bits copy];
+}
+
+// Double hashing: the i-th bit is h1 + i * h2.
+- (void)enumerateBitIndexesForString:(NSString *)string usingBlock:(BOOL (^)(uint64_t bitIndex))block
+{
+    const char *bytes = string.UTF8String;
+    size_t length = strlen(bytes);
+    uint64_t hash1 = OWSBloomFilterHash(bytes, length, 0);
+    uint64_t hash2 = OWSBloomFilterHash(bytes, length, 0x9E3779B97F4A7C15ULL) | 1;
+    for (NSUInteger i = 0; i < kHashCount; i++) {
+        if (!block((hash1 + i * hash2) % self.bitCount)) {
+            return;
+        }
+    }
+}
+
+- (void)addString:(NSString *)string
+{
+    OWSAssertDebug(string);
+
+    uint8_t *bytes = self.bits.mutableBytes;
+    [self enumerateBitIndexesForString:string
+                            usingBlock:^(uint64_t bitIndex) {
+                                bytes[bitIndex / 8] |= (uint8_t)(1 << (bitIndex % 8));
+                                return YES;
+                            }];
+}
+
+- (BOOL)mightContainString:(NSString *)string
+{
+    OWSAssertDebug(string);
+
+    const uint8_t *bytes = self.bits.bytes;
+    __block BOOL result = YES;
+    [self enumerateBitIndexesForString:string
+                            usingBlock:^(uint64_t bitIndex) {
+                                if ((bytes[bitIndex / 8] & (1 << (bitIndex % 8))) == 0) {
+                                    result = NO;
+                                }
+                                return result;
+                            }];
+    return result;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -46,9 +46,12 @@ typedef NS_ENUM(NSInteger, OWSErrorCode) {
     OWSErrorCodeMessageRequestFailed = 777421,
     OWSErrorCodeMessageResponseFailed = 777422,
     OWSErrorCodeInvalidMessage = 777423,
+    OWSErrorCodeDownloadFailed = 777424,
+    OWSErrorCodeUploadFailed = 777425,
 };
 
 extern NSString *const OWSErrorRecipientIdentifierKey;
+extern NSString *const OWSErrorHTTPStatusCodeKey;
 
 extern NSError *OWSErrorWithCodeDescription(OWSErrorCode code, NSString *description);
 extern NSError *OWSErrorMakeUntrustedIdentityError(NSString *description, NSString *recipientId);
@@ -8,6 +8,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 NSString *const OWSRelayServiceKitErrorDomain = @"OWSRelayServiceKitErrorDomain";
 NSString *const OWSErrorRecipientIdentifierKey = @"OWSErrorKeyRecipientIdentifier";
+NSString *const OWSErrorHTTPStatusCodeKey = @"OWSErrorKeyHTTPStatusCode";
 
 NSError *OWSErrorWithCodeDescription(OWSErrorCode code, NSString *description)
 {
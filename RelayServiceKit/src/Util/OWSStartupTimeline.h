@@ -0,0 +1,38 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Records when each phase of a cold start finishes, relative to the start of the process, and the peak memory
+// use by then, so that the phases can be compared across launches in the logs.
+//
+// Only the first occurrence of each event is recorded.  This class is thread safe.
+@interface OWSStartupTimeline : NSObject
+
++ (instancetype)sharedTimeline;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+// Seconds since the process started.
+- (NSTimeInterval)timeSinceLaunch;
+
+- (void)markEvent:(NSString *)event;
+
+// Nil if the event hasn't happened.
+- (nullable NSNumber *)timeOfEvent:(NSString *)event;
+
+// In bytes.  Nil if the event hasn't happened.
+- (nullable NSNumber *)peakResidentMemoryAtEvent:(NSString *)event;
+
+// The most memory the process has had resident so far, in bytes, or zero if it can't be read.
++ (uint64_t)peakResidentMemory;
+
+// One line per event, with the time since launch and since the previous event.
+- (NSString *)timelineDescription;
+
+- (void)logTimeline;
+
+@end
+
+NS_ASSUME_NONNULL_END
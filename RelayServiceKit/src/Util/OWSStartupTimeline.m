@@ -0,0 +1,139 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSStartupTimeline.h"
+#import "SSKAsserts.h"
+#import <mach/mach.h>
+#import <sys/sysctl.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The process's start time, so that time spent before main() is included.  Falls back to "now".
+static CFAbsoluteTime OWSProcessStartTime(void)
+{
+    struct kinfo_proc info;
+    size_t size = sizeof(info);
+    int mib[] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+    if (sysctl(mib, 4, &info, &size, NULL, 0) != 0) {
+        return CFAbsoluteTimeGetCurrent();
+    }
+    struct timeval startTime = info.kp_proc.p_starttime;
+    return (startTime.tv_sec + startTime.tv_usec / (double)USEC_PER_SEC) - kCFAbsoluteTimeIntervalSince1970;
+}
+
+@interface OWSStartupTimeline ()
+
+@property (nonatomic, readonly) CFAbsoluteTime processStartTime;
+
+// The following should only be accessed while synchronized on self.
+@property (nonatomic, readonly) NSMutableArray<NSString *> *events;
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, NSNumber *> *eventTimes;
+@property (nonatomic, readonly) NSMutableDictionary<NSString *, NSNumber *> *eventPeakResidentMemory;
+
+@end
+
+#pragma mark -
+
+@implementation OWSStartupTimeline
+
++ (instancetype)sharedTimeline
+{
+    static OWSStartupTimeline *sharedTimeline = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedTimeline = [[self alloc] initDefault];
+    });
+    return sharedTimeline;
+}
+
+- (instancetype)initDefault
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _processStartTime = OWSProcessStartTime();
+    _events = [NSMutableArray new];
+    _eventTimes = [NSMutableDictionary new];
+    _eventPeakResidentMemory = [NSMutableDictionary new];
+
+    OWSSingletonAssert();
+
+    return self;
+}
+
+- (NSTimeInterval)timeSinceLaunch
+{
+    return CFAbsoluteTimeGetCurrent() - self.processStartTime;
+}
+
++ (uint64_t)peakResidentMemory
+{
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size_max;
+}
+
+- (void)markEvent:(NSString *)event
+{
+    OWSAssertDebug(event.length > 0);
+
+    NSTimeInterval time = self.timeSinceLaunch;
+    uint64_t peakResidentMemory = [OWSStartupTimeline peakResidentMemory];
+    @synchronized(self)
+    {
+        if (self.eventTimes[event]) {
+            return;
+        }
+        self.eventTimes[event] = @(time);
+        self.eventPeakResidentMemory[event] = @(peakResidentMemory);
+        [self.events addObject:event];
+    }
+    DDLogInfo(@"%@ %@ at %.3fs, peak memory %.1fMB.", self.logTag, event, time, peakResidentMemory / (1024.0 * 1024.0));
+}
+
+- (nullable NSNumber *)timeOfEvent:(NSString *)event
+{
+    @synchronized(self)
+    {
+        return self.eventTimes[event];
+    }
+}
+
+- (nullable NSNumber *)peakResidentMemoryAtEvent:(NSString *)event
+{
+    @synchronized(self)
+    {
+        return self.eventPeakResidentMemory[event];
+    }
+}
+
+- (NSString *)timelineDescription
+{
+    NSMutableString *result = [NSMutableString new];
+    @synchronized(self)
+    {
+        NSTimeInterval previousTime = 0;
+        for (NSString *event in self.events) {
+            NSTimeInterval time = self.eventTimes[event].doubleValue;
+            double peakResidentMemory = self.eventPeakResidentMemory[event].doubleValue / (1024.0 * 1024.0);
+            [result appendFormat:@"%8.3fs (+%.3fs) %7.1fMB %@\n", time, time - previousTime, peakResidentMemory, event];
+            previousTime = time;
+        }
+    }
+    return result;
+}
+
+- (void)logTimeline
+{
+    DDLogInfo(@"%@ Startup timeline:\n%@", self.logTag, self.timelineDescription);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
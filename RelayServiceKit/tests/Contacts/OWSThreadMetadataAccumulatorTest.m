@@ -0,0 +1,203 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "CCSMKeys.h"
+#import "NSDate+OWS.h"
+#import "OWSPrimaryStorage.h"
+#import "OWSThreadMetadataAccumulator.h"
+#import "TSIncomingMessage.h"
+#import "TSThread.h"
+#import <XCTest/XCTest.h>
+#import <YapDatabase/YapDatabaseHooks.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+static NSString *const kThreadWriteCounterExtensionName = @"OWSThreadMetadataAccumulatorTestHooks";
+
+@interface OWSThreadMetadataAccumulatorTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+@property (nonatomic) YapDatabaseHooks *hooks;
+@property (atomic) NSUInteger threadWriteCount;
+@property (nonatomic) NSString *threadId;
+
+@end
+
+#pragma mark -
+
+@implementation OWSThreadMetadataAccumulatorTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    [TSInteraction removeAllObjectsInCollection];
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    self.threadId = [NSUUID UUID].UUIDString.lowercaseString;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [TSThread getOrCreateThreadWithId:self.threadId transaction:transaction];
+    }];
+
+    self.hooks = [YapDatabaseHooks new];
+    __weak OWSThreadMetadataAccumulatorTest *weakSelf = self;
+    self.hooks.didModifyRow = ^(YapDatabaseReadWriteTransaction *transaction,
+        NSString *collection,
+        NSString *key,
+        YapProxyObject *proxyObject,
+        YapProxyObject *proxyMetadata,
+        YapDatabaseHooksBitMask flags) {
+        if ([collection isEqualToString:[TSThread collection]]) {
+            weakSelf.threadWriteCount++;
+        }
+    };
+    [[OWSPrimaryStorage sharedManager] registerExtension:self.hooks withName:kThreadWriteCounterExtensionName];
+}
+
+- (void)tearDown
+{
+    [[OWSPrimaryStorage sharedManager] unregisterExtension:self.hooks withName:kThreadWriteCounterExtensionName];
+
+    [super tearDown];
+}
+
+- (NSDictionary *)payloadWithTitle:(NSString *)title members:(nullable NSArray<NSString *> *)members
+{
+    NSMutableDictionary *payload = [@{
+        FLThreadIDKey : self.threadId,
+        FLThreadTitleKey : title,
+        FLThreadTypeKey : FLThreadTypeConversation,
+        FLDistributionKey : @{ FLExpressionKey : @"(<alice>+<bob>)" },
+    } mutableCopy];
+    if (members) {
+        payload[@"data"] = @{ @"members" : members };
+    }
+    return payload;
+}
+
+// What OWSMessageManager does to the thread for each incoming message.
+- (void)ingestMessageWithPayload:(NSDictionary *)payload
+                       timestamp:(uint64_t)timestamp
+                     transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    TSThread *thread = [TSThread getOrCreateThreadWithPayload:payload transaction:transaction];
+    TSIncomingMessage *message = [[TSIncomingMessage alloc] initIncomingMessageWithTimestamp:timestamp
+                                                                                   serverAge:nil
+                                                                                    inThread:thread
+                                                                                    authorId:@"fake-author-id"
+                                                                              sourceDeviceId:1
+                                                                                 messageBody:@"incoming"
+                                                                               attachmentIds:@[]
+                                                                            expiresInSeconds:0
+                                                                               quotedMessage:nil];
+    [message saveWithTransaction:transaction];
+    [thread touchWithTransaction:transaction];
+}
+
+- (void)ingestMessageCount:(NSUInteger)count batched:(BOOL)batched
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        OWSThreadMetadataAccumulator *_Nullable accumulator
+            = (batched ? [OWSThreadMetadataAccumulator beginBatchWithTransaction:transaction] : nil);
+        for (NSUInteger i = 0; i < count; i++) {
+            [self ingestMessageWithPayload:[self payloadWithTitle:@"Burst" members:nil]
+                                 timestamp:i + 1
+                               transaction:transaction];
+        }
+        [accumulator flushWithTransaction:transaction];
+    }];
+}
+
+- (void)testBurstIntoOneThreadWritesItOnce
+{
+    self.threadWriteCount = 0;
+    [self ingestMessageCount:500 batched:YES];
+    XCTAssertEqual(self.threadWriteCount, 1);
+
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        TSThread *thread = [TSThread fetchObjectWithUniqueID:self.threadId transaction:transaction];
+        XCTAssertEqualObjects(thread.title, @"Burst");
+        XCTAssertTrue(thread.hasEverHadMessage);
+    }];
+}
+
+- (void)testUnbatchedMessagesOnlyWriteChanges
+{
+    self.threadWriteCount = 0;
+    [self ingestMessageCount:50 batched:NO];
+    // The first message sets the title; each later message only moves the last message date.
+    XCTAssertLessThanOrEqual(self.threadWriteCount, 51);
+}
+
+- (void)testChangesAreMergedInOrder
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        OWSThreadMetadataAccumulator *accumulator = [OWSThreadMetadataAccumulator beginBatchWithTransaction:transaction];
+        [self ingestMessageWithPayload:[self payloadWithTitle:@"First" members:@[ @"alice" ]]
+                             timestamp:1
+                           transaction:transaction];
+        [self ingestMessageWithPayload:[self payloadWithTitle:@"Second" members:nil] timestamp:2 transaction:transaction];
+
+        // Anything else which changes the thread during the batch sees, and keeps, the batch's changes.
+        TSThread *thread = [TSThread fetchObjectWithUniqueID:self.threadId transaction:transaction];
+        [thread updateParticipants:@[ @"alice", @"bob" ] transaction:transaction];
+
+        [accumulator flushWithTransaction:transaction];
+    }];
+
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        TSThread *thread = [TSThread fetchObjectWithUniqueID:self.threadId transaction:transaction];
+        XCTAssertEqualObjects(thread.title, @"Second");
+        NSArray<NSString *> *expectedParticipantIds = @[ @"alice", @"bob" ];
+        XCTAssertEqualObjects(thread.participantIds, expectedParticipantIds);
+    }];
+}
+
+- (void)testEarlierMessageDoesNotReplaceLastMessage
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        OWSThreadMetadataAccumulator *accumulator = [OWSThreadMetadataAccumulator beginBatchWithTransaction:transaction];
+        [self ingestMessageWithPayload:[self payloadWithTitle:@"Out of order" members:nil]
+                             timestamp:10000
+                           transaction:transaction];
+        [self ingestMessageWithPayload:[self payloadWithTitle:@"Out of order" members:nil]
+                             timestamp:5000
+                           transaction:transaction];
+        [accumulator flushWithTransaction:transaction];
+    }];
+
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        TSThread *thread = [TSThread fetchObjectWithUniqueID:self.threadId transaction:transaction];
+        XCTAssertEqualObjects(thread.lastMessageDate, [NSDate ows_dateWithMillisecondsSince1970:10000]);
+    }];
+}
+
+#pragma mark - Benchmarks
+
+- (void)testBenchmarkBurstIntoOneThread
+{
+    const NSUInteger messageCount = 500;
+
+    self.threadWriteCount = 0;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    [self ingestMessageCount:messageCount batched:NO];
+    NSTimeInterval unbatchedTime = CFAbsoluteTimeGetCurrent() - startTime;
+    NSUInteger unbatchedWriteCount = self.threadWriteCount;
+
+    self.threadWriteCount = 0;
+    startTime = CFAbsoluteTimeGetCurrent();
+    [self ingestMessageCount:messageCount batched:YES];
+    NSTimeInterval batchedTime = CFAbsoluteTimeGetCurrent() - startTime;
+
+    NSLog(@"%@ %lu messages into one thread: %lu thread writes in %.2fs unbatched, %lu in %.2fs batched.",
+        self.logTag,
+        (unsigned long)messageCount,
+        (unsigned long)unbatchedWriteCount,
+        unbatchedTime,
+        (unsigned long)self.threadWriteCount,
+        batchedTime);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,250 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "CCSMKeys.h"
+#import "FLMessageBody.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface FLMessageBodyTest : XCTestCase
+
+@end
+
+#pragma mark -
+
+@implementation FLMessageBodyTest
+
+// Bodies in the shapes sent by the web, desktop and mobile clients.
++ (NSArray<NSString *> *)corpus
+{
+    return @[
+        @"[{\"version\":1,\"messageType\":\"content\",\"messageId\":\"a9f4c6e2-6a4d-4c3e-9d43-0f6a4d6d0b11\","
+        @"\"threadId\":\"0b5e0a3c-8e3a-4d3e-b2b2-5c0a1f5d1e22\",\"threadType\":\"conversation\",\"threadTitle\":\"Lunch\","
+        @"\"sendTime\":\"2018-07-30T18:02:51.081Z\",\"userAgent\":\"Mozilla/5.0\","
+        @"\"sender\":{\"userId\":\"7d3d0b1e-1f1e-4e4f-8f2e-2c0d9b7b6a33\"},"
+        @"\"distribution\":{\"expression\":\"(<7d3d0b1e-1f1e-4e4f-8f2e-2c0d9b7b6a33>+<1c2b3a4d-5e6f-4a1b-9c8d-7e6f5a4b3c44>)\"},"
+        @"\"data\":{\"body\":[{\"type\":\"text/plain\",\"value\":\"Tacos?\"},"
+        @"{\"type\":\"text/html\",\"value\":\"<b>Tacos?</b>\"}]}}]",
+
+        @"[{\"version\":1,\"messageType\":\"content\",\"messageId\":\"c3b1a2d4-0000-4000-8000-000000000001\","
+        @"\"messageRef\":\"a9f4c6e2-6a4d-4c3e-9d43-0f6a4d6d0b11\",\"threadId\":\"0b5e0a3c-8e3a-4d3e-b2b2-5c0a1f5d1e22\","
+        @"\"threadType\":\"announcement\",\"sender\":{\"userId\":\"1c2b3a4d-5e6f-4a1b-9c8d-7e6f5a4b3c44\"},"
+        @"\"distribution\":{\"expression\":\"<1c2b3a4d-5e6f-4a1b-9c8d-7e6f5a4b3c44>\"},"
+        @"\"data\":{\"body\":[{\"type\":\"text/plain\",\"value\":\"Sure \\ud83c\\udf2e\"}],"
+        @"\"attachments\":[{\"name\":\"taco.jpg\",\"size\":1024,\"type\":\"image/jpeg\"}]}}]",
+
+        @"[{\"version\":1,\"messageType\":\"control\",\"messageId\":\"c3b1a2d4-0000-4000-8000-000000000002\","
+        @"\"threadId\":\"0b5e0a3c-8e3a-4d3e-b2b2-5c0a1f5d1e22\",\"sender\":{\"userId\":\"7d3d0b1e-1f1e-4e4f-8f2e-2c0d9b7b6a33\"},"
+        @"\"data\":{\"control\":\"threadUpdate\",\"threadUpdates\":{\"threadTitle\":\"Dinner\"}}}]",
+
+        @"[{\"version\":1,\"messageType\":\"control\",\"messageId\":\"c3b1a2d4-0000-4000-8000-000000000003\","
+        @"\"sender\":{\"userId\":\"7d3d0b1e-1f1e-4e4f-8f2e-2c0d9b7b6a33\"},"
+        @"\"data\":{\"control\":\"readMark\",\"readMark\":1532973771081,\"attachments\":[\"one\",\"two\"]}}]",
+
+        // Older clients sent several versions of the payload; the last one wins.
+        @"[{\"version\":0,\"messageType\":\"content\"},{\"version\":1,\"messageType\":\"content\","
+        @"\"messageId\":\"c3b1a2d4-0000-4000-8000-000000000004\",\"threadId\":\"t\",\"threadType\":\"conversation\","
+        @"\"data\":{\"body\":[]}}]",
+
+        @"[{\"version\":1,\"messageType\":\"content\",\"messageId\":\"c3b1a2d4-0000-4000-8000-000000000005\","
+        @"\"threadId\":\"t\",\"threadType\":\"conversation\",\"data\":{}}]",
+
+        @"[]",
+        @"{}",
+        @"[1, \"two\", null]",
+        @"Plain text from a legacy client",
+        @"",
+    ];
+}
+
+// The parse which FLCCSMJSONService used to do, with the type checks it lacked.
++ (nullable NSDictionary *)referencePayloadFromString:(NSString *)string
+{
+    NSData *_Nullable data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    if (data.length < 1) {
+        return nil;
+    }
+    id _Nullable json = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    if (![json isKindOfClass:[NSArray class]]) {
+        return nil;
+    }
+    id _Nullable payload = [json lastObject];
+    return ([payload isKindOfClass:[NSDictionary class]] ? payload : nil);
+}
+
+- (void)assertTypedPropertiesOfMessageBody:(FLMessageBody *)messageBody
+{
+    for (NSString *_Nullable string in @[
+             messageBody.messageId ?: @"",
+             messageBody.messageType ?: @"",
+             messageBody.messageRef ?: @"",
+             messageBody.threadId ?: @"",
+             messageBody.threadType ?: @"",
+             messageBody.threadTitle ?: @"",
+             messageBody.distributionExpression ?: @"",
+             messageBody.senderUserId ?: @"",
+             messageBody.controlType ?: @"",
+         ]) {
+        XCTAssertTrue([string isKindOfClass:[NSString class]]);
+    }
+    if (messageBody.data) {
+        XCTAssertTrue([messageBody.data isKindOfClass:[NSDictionary class]]);
+        XCTAssertGreaterThan(messageBody.data.count, 0);
+    }
+    for (id attachmentId in messageBody.dataAttachmentIds) {
+        XCTAssertTrue([attachmentId isKindOfClass:[NSString class]]);
+    }
+}
+
+- (void)testTypedProperties
+{
+    NSArray<NSString *> *corpus = self.class.corpus;
+
+    FLMessageBody *_Nullable content = [FLMessageBody messageBodyWithString:corpus[0]];
+    XCTAssertNotNil(content);
+    XCTAssertTrue(content.isContentMessage);
+    XCTAssertFalse(content.isControlMessage);
+    XCTAssertEqualObjects(content.messageId, @"a9f4c6e2-6a4d-4c3e-9d43-0f6a4d6d0b11");
+    XCTAssertEqualObjects(content.threadId, @"0b5e0a3c-8e3a-4d3e-b2b2-5c0a1f5d1e22");
+    XCTAssertEqualObjects(content.threadType, FLThreadTypeConversation);
+    XCTAssertEqualObjects(content.threadTitle, @"Lunch");
+    XCTAssertEqualObjects(content.senderUserId, @"7d3d0b1e-1f1e-4e4f-8f2e-2c0d9b7b6a33");
+    XCTAssertEqualObjects(content.distributionExpression,
+        @"(<7d3d0b1e-1f1e-4e4f-8f2e-2c0d9b7b6a33>+<1c2b3a4d-5e6f-4a1b-9c8d-7e6f5a4b3c44>)");
+    XCTAssertNil(content.messageRef);
+    XCTAssertNil(content.controlType);
+
+    FLMessageBody *_Nullable reply = [FLMessageBody messageBodyWithString:corpus[1]];
+    XCTAssertEqualObjects(reply.messageRef, @"a9f4c6e2-6a4d-4c3e-9d43-0f6a4d6d0b11");
+    XCTAssertEqualObjects(reply.threadType, FLThreadTypeAnnouncement);
+    // Attachment descriptions aren't ids.
+    XCTAssertEqualObjects(reply.dataAttachmentIds, @[]);
+
+    FLMessageBody *_Nullable control = [FLMessageBody messageBodyWithString:corpus[3]];
+    XCTAssertTrue(control.isControlMessage);
+    XCTAssertEqualObjects(control.controlType, FLControlMessageMessageReadKey);
+    XCTAssertEqualObjects(control.dataAttachmentIds, (@[ @"one", @"two" ]));
+    XCTAssertNil(control.threadId);
+
+    FLMessageBody *_Nullable versioned = [FLMessageBody messageBodyWithString:corpus[4]];
+    XCTAssertEqualObjects(versioned.messageId, @"c3b1a2d4-0000-4000-8000-000000000004");
+
+    FLMessageBody *_Nullable emptyData = [FLMessageBody messageBodyWithString:corpus[5]];
+    XCTAssertNotNil(emptyData);
+    XCTAssertNil(emptyData.data);
+
+    for (NSString *string in [corpus subarrayWithRange:NSMakeRange(6, 5)]) {
+        XCTAssertNil([FLMessageBody messageBodyWithString:string], @"%@", string);
+    }
+    XCTAssertNil([FLMessageBody messageBodyWithString:nil]);
+}
+
+- (void)testWrongTypesAreIgnored
+{
+    FLMessageBody *_Nullable messageBody = [FLMessageBody
+        messageBodyWithString:@"[{\"messageType\":7,\"messageId\":[\"x\"],\"threadId\":{},\"sender\":\"someone\","
+                              @"\"distribution\":[],\"data\":{\"control\":false,\"attachments\":\"one\"}}]"];
+    XCTAssertNotNil(messageBody);
+    XCTAssertNil(messageBody.messageType);
+    XCTAssertNil(messageBody.messageId);
+    XCTAssertNil(messageBody.threadId);
+    XCTAssertNil(messageBody.senderUserId);
+    XCTAssertNil(messageBody.distributionExpression);
+    XCTAssertNil(messageBody.controlType);
+    XCTAssertEqualObjects(messageBody.dataAttachmentIds, @[]);
+    XCTAssertFalse(messageBody.isControlMessage);
+    XCTAssertFalse(messageBody.isContentMessage);
+}
+
+// Truncated, spliced and corrupted bodies must never throw, and must parse exactly as the reference does.
+- (void)testFuzzedBodies
+{
+    NSArray<NSString *> *corpus = self.class.corpus;
+    NSArray<NSString *> *replacements = @[ @"", @"\"", @"{", @"}", @"[", @"]", @",", @":", @"null", @"1", @"\\u0000", @"\\" ];
+    srand48(1234);
+    for (NSUInteger i = 0; i < 5000; i++) {
+        NSMutableString *string = [corpus[(NSUInteger)lrand48() % corpus.count] mutableCopy];
+        NSUInteger mutationCount = (NSUInteger)(lrand48() % 3) + 1;
+        for (NSUInteger j = 0; j < mutationCount && string.length > 0; j++) {
+            NSUInteger location = (NSUInteger)lrand48() % string.length;
+            switch (lrand48() % 3) {
+                case 0:
+                    // Truncate.
+                    [string deleteCharactersInRange:NSMakeRange(location, string.length - location)];
+                    break;
+                case 1: {
+                    // Replace a few characters.
+                    NSUInteger length = MIN((NSUInteger)(lrand48() % 4), string.length - location);
+                    [string replaceCharactersInRange:NSMakeRange(location, length)
+                                          withString:replacements[(NSUInteger)lrand48() % replacements.count]];
+                    break;
+                }
+                default: {
+                    // Splice in part of another body.
+                    NSString *other = corpus[(NSUInteger)lrand48() % corpus.count];
+                    if (other.length > 0) {
+                        NSUInteger otherLocation = (NSUInteger)lrand48() % other.length;
+                        [string insertString:[other substringFromIndex:otherLocation] atIndex:location];
+                    }
+                    break;
+                }
+            }
+        }
+
+        NSDictionary *_Nullable expected = [self.class referencePayloadFromString:string];
+        FLMessageBody *_Nullable messageBody;
+        XCTAssertNoThrow(messageBody = [FLMessageBody messageBodyWithString:string], @"%@", string);
+        XCTAssertEqualObjects(messageBody.payload, expected, @"%@", string);
+        if (messageBody) {
+            [self assertTypedPropertiesOfMessageBody:messageBody];
+        }
+    }
+}
+
+#pragma mark - Benchmarks
+
++ (NSArray<NSString *> *)benchmarkCorpus
+{
+    NSMutableArray<NSString *> *result = [NSMutableArray new];
+    NSArray<NSString *> *corpus = [self.corpus subarrayWithRange:NSMakeRange(0, 4)];
+    for (NSUInteger i = 0; i < 500; i++) {
+        [result addObjectsFromArray:corpus];
+    }
+    return result;
+}
+
+// The body of a content message used to be parsed twice, and then probed by key.
+- (void)testBenchmarkReferenceDecoding
+{
+    NSArray<NSString *> *corpus = self.class.benchmarkCorpus;
+    [self measureBlock:^{
+        for (NSString *string in corpus) {
+            NSDictionary *_Nullable payload = [self.class referencePayloadFromString:string];
+            if ([[payload objectForKey:FLMessageTypeKey] isEqualToString:FLMessageTypeContentKey]) {
+                payload = [self.class referencePayloadFromString:string];
+                (void)[payload objectForKey:FLThreadIDKey];
+                (void)[payload objectForKey:FLMessageIdKey];
+            }
+        }
+    }];
+}
+
+- (void)testBenchmarkDecoding
+{
+    NSArray<NSString *> *corpus = self.class.benchmarkCorpus;
+    [self measureBlock:^{
+        for (NSString *string in corpus) {
+            FLMessageBody *_Nullable messageBody = [FLMessageBody messageBodyWithString:string];
+            if (messageBody.isContentMessage) {
+                (void)messageBody.threadId;
+                (void)messageBody.messageId;
+            }
+        }
+    }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,197 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "Cryptography.h"
+#import "OWSAttachmentEncryptor.h"
+#import <CommonCrypto/CommonCrypto.h>
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSAttachmentEncryptorTest : XCTestCase
+
+@property (nonatomic) NSString *directory;
+
+@end
+
+@implementation OWSAttachmentEncryptorTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.directory
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:nil];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.directory error:nil];
+
+    [super tearDown];
+}
+
+- (NSData *)encryptPlaintext:(NSData *)plaintext
+                 chunkLength:(NSUInteger)chunkLength
+                      outKey:(NSData *_Nullable *_Nonnull)outKey
+                   outDigest:(NSData *_Nullable *_Nonnull)outDigest
+{
+    NSString *plaintextPath = [self.directory stringByAppendingPathComponent:@"plaintext"];
+    NSString *ciphertextPath = [self.directory stringByAppendingPathComponent:@"ciphertext"];
+    XCTAssertTrue([plaintext writeToFile:plaintextPath atomically:YES]);
+
+    NSError *error;
+    BOOL success = [OWSAttachmentEncryptor encryptFileAtPath:plaintextPath
+                                                      toPath:ciphertextPath
+                                                 chunkLength:chunkLength
+                                                      outKey:outKey
+                                                   outDigest:outDigest
+                                                       error:&error];
+    XCTAssertTrue(success);
+    XCTAssertNil(error);
+
+    return [NSData dataWithContentsOfFile:ciphertextPath];
+}
+
+- (void)assertDecryptsPlaintext:(NSData *)plaintext chunkLength:(NSUInteger)chunkLength
+{
+    NSData *_Nullable key;
+    NSData *_Nullable digest;
+    NSData *ciphertext = [self encryptPlaintext:plaintext chunkLength:chunkLength outKey:&key outDigest:&digest];
+    XCTAssertEqual(key.length, 64);
+    XCTAssertEqual(digest.length, CC_SHA256_DIGEST_LENGTH);
+
+    // The digest is of the whole file.
+    uint8_t expectedDigest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(ciphertext.bytes, (CC_LONG)ciphertext.length, expectedDigest);
+    XCTAssertEqualObjects(digest, [NSData dataWithBytes:expectedDigest length:sizeof(expectedDigest)]);
+
+    // Recipients decrypt it the same way as attachments encrypted in memory.
+    NSError *error;
+    NSData *_Nullable decrypted = [Cryptography decryptAttachment:ciphertext
+                                                          withKey:key
+                                                           digest:digest
+                                                     unpaddedSize:(UInt32)plaintext.length
+                                                            error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(decrypted, plaintext);
+}
+
+- (void)testRoundTrip
+{
+    // Lengths around the chunk and AES block boundaries.
+    for (NSNumber *length in @[ @0, @1, @15, @16, @17, @1023, @1024, @1025, @(5 * 1024 + 3) ]) {
+        NSData *plaintext = [Cryptography generateRandomBytes:length.unsignedIntegerValue];
+        [self assertDecryptsPlaintext:plaintext chunkLength:1024];
+    }
+}
+
+- (void)testRoundTripWithDefaultChunkLength
+{
+    NSString *plaintextPath = [self.directory stringByAppendingPathComponent:@"plaintext"];
+    NSString *ciphertextPath = [self.directory stringByAppendingPathComponent:@"ciphertext"];
+    NSData *plaintext = [Cryptography generateRandomBytes:300 * 1024 + 5];
+    [plaintext writeToFile:plaintextPath atomically:YES];
+
+    NSData *_Nullable key;
+    NSData *_Nullable digest;
+    NSError *error;
+    XCTAssertTrue([OWSAttachmentEncryptor encryptFileAtPath:plaintextPath
+                                                     toPath:ciphertextPath
+                                                     outKey:&key
+                                                  outDigest:&digest
+                                                      error:&error]);
+
+    NSData *_Nullable decrypted = [Cryptography decryptAttachment:[NSData dataWithContentsOfFile:ciphertextPath]
+                                                          withKey:key
+                                                           digest:digest
+                                                     unpaddedSize:(UInt32)plaintext.length
+                                                            error:&error];
+    XCTAssertEqualObjects(decrypted, plaintext);
+}
+
+- (void)testMatchesInMemoryEncryption
+{
+    for (NSNumber *length in @[ @0, @1, @16, @1025, @(5 * 1024 + 3) ]) {
+        NSData *plaintext = [Cryptography generateRandomBytes:length.unsignedIntegerValue];
+
+        NSData *_Nullable key;
+        NSData *_Nullable digest;
+        NSData *ciphertext = [self encryptPlaintext:plaintext chunkLength:1024 outKey:&key outDigest:&digest];
+
+        NSData *_Nullable inMemoryKey;
+        NSData *_Nullable inMemoryDigest;
+        NSData *_Nullable inMemoryCiphertext =
+            [Cryptography encryptAttachmentData:plaintext outKey:&inMemoryKey outDigest:&inMemoryDigest];
+        XCTAssertNotNil(inMemoryCiphertext);
+
+        // Keys and IVs are random, but the layout, and so any padding, must match.
+        XCTAssertEqual(key.length, inMemoryKey.length);
+        XCTAssertEqual(digest.length, inMemoryDigest.length);
+        XCTAssertEqual(ciphertext.length, inMemoryCiphertext.length);
+
+        // Re-encrypting with the encryptor's key and IV must reproduce its output byte for byte.
+        NSData *iv = [ciphertext subdataWithRange:NSMakeRange(0, kCCBlockSizeAES128)];
+        NSMutableData *expected = [iv mutableCopy];
+        NSMutableData *body = [NSMutableData dataWithLength:plaintext.length + kCCBlockSizeAES128];
+        size_t bodyLength = 0;
+        XCTAssertEqual(CCCrypt(kCCEncrypt,
+                           kCCAlgorithmAES128,
+                           kCCOptionPKCS7Padding,
+                           key.bytes,
+                           kCCKeySizeAES256,
+                           iv.bytes,
+                           plaintext.bytes,
+                           plaintext.length,
+                           body.mutableBytes,
+                           body.length,
+                           &bodyLength),
+            kCCSuccess);
+        [expected appendBytes:body.bytes length:bodyLength];
+        uint8_t mac[CC_SHA256_DIGEST_LENGTH];
+        CCHmac(kCCHmacAlgSHA256,
+            (const uint8_t *)key.bytes + kCCKeySizeAES256,
+            key.length - kCCKeySizeAES256,
+            expected.bytes,
+            expected.length,
+            mac);
+        [expected appendBytes:mac length:sizeof(mac)];
+        XCTAssertEqualObjects(ciphertext, expected);
+
+        // Both decrypt the same way.
+        NSError *error;
+        XCTAssertEqualObjects([Cryptography decryptAttachment:inMemoryCiphertext
+                                                      withKey:inMemoryKey
+                                                       digest:inMemoryDigest
+                                                 unpaddedSize:(UInt32)plaintext.length
+                                                        error:&error],
+            plaintext);
+        XCTAssertNil(error);
+    }
+}
+
+- (void)testMissingInputFails
+{
+    NSData *_Nullable key;
+    NSData *_Nullable digest;
+    NSError *error;
+    BOOL success = [OWSAttachmentEncryptor
+        encryptFileAtPath:[self.directory stringByAppendingPathComponent:@"missing"]
+                   toPath:[self.directory stringByAppendingPathComponent:@"ciphertext"]
+                   outKey:&key
+                outDigest:&digest
+                    error:&error];
+
+    XCTAssertFalse(success);
+    XCTAssertNotNil(error);
+    XCTAssertNil(key);
+    XCTAssertNil(digest);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
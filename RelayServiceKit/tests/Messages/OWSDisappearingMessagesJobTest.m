@@ -7,6 +7,7 @@
 #import "OWSDisappearingMessagesFinder.h"
 #import "OWSDisappearingMessagesJob.h"
 #import "OWSFakeContactsManager.h"
+#import "OWSPrimaryStorage.h"
 #import "TSContactThread.h"
 #import "TSMessage.h"
 #import "TSStorageManager.h"
@@ -16,7 +17,14 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface OWSDisappearingMessagesJob (Testing)
 
+@property (nonatomic) NSUInteger chunkSize;
+@property (nonatomic) NSTimeInterval chunkDuration;
+@property (nonatomic) NSTimeInterval chunkInterval;
+
++ (dispatch_queue_t)serialQueue;
+
 - (void)run;
+- (NSUInteger)runLoop;
 - (void)becomeConsistentWithConfigurationForMessage:(TSMessage *)message
                                     contactsManager:(id<ContactsManagerProtocol>)contactsManager;
 
@@ -129,6 +137,105 @@ NS_ASSUME_NONNULL_BEGIN
     XCTAssertNil([OWSDisappearingMessagesConfiguration fetchObjectWithUniqueID:thread.uniqueId]);
 }
 
+#pragma mark - Chunked expiration
+
+- (void)saveExpiredMessageCount:(NSUInteger)count inThread:(TSThread *)thread
+{
+    uint64_t now = [NSDate ows_millisecondTimeStamp];
+    YapDatabaseConnection *dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    const NSUInteger kBatchSize = 1000;
+    for (NSUInteger batchStart = 0; batchStart < count; batchStart += kBatchSize) {
+        [dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+            for (NSUInteger i = batchStart; i < MIN(count, batchStart + kBatchSize); i++) {
+                TSMessage *message = [[TSMessage alloc] initMessageWithTimestamp:i + 1
+                                                                        inThread:thread
+                                                                     messageBody:@"expired"
+                                                                   attachmentIds:@[]
+                                                                expiresInSeconds:1
+                                                                 expireStartedAt:now - 10000 - i
+                                                                   quotedMessage:nil];
+                [message saveWithTransaction:transaction];
+            }
+        }];
+    }
+}
+
+- (void)waitForMessageCount:(NSUInteger)count timeout:(NSTimeInterval)timeout
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while ([TSMessage numberOfKeysInCollection] != count && deadline.timeIntervalSinceNow > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], count);
+}
+
+- (void)testExpiresBacklogInChunks
+{
+    TSThread *thread = [TSThread getOrCreateThreadWithParticipants:@[ @"fake-participant-id" ]];
+    [self saveExpiredMessageCount:25 inThread:thread];
+
+    OWSDisappearingMessagesJob *job = [OWSDisappearingMessagesJob sharedJob];
+    job.chunkSize = 10;
+    job.chunkInterval = 0.01;
+
+    __block NSUInteger firstChunkCount = 0;
+    dispatch_sync(OWSDisappearingMessagesJob.serialQueue, ^{
+        firstChunkCount = [job runLoop];
+    });
+
+    // Only the first chunk is deleted synchronously; the rest follow.
+    XCTAssertEqual(firstChunkCount, 10);
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], 15);
+    [self waitForMessageCount:0 timeout:5];
+}
+
+// Expires a large backlog while another connection keeps writing, as incoming messages would, and reports the
+// longest any of those writes waited.
+- (void)testExpireLargeBacklogWithConcurrentWrites
+{
+    const NSUInteger kMessageCount = 100 * 1000;
+    TSThread *thread = [TSThread getOrCreateThreadWithParticipants:@[ @"fake-participant-id" ]];
+    [self saveExpiredMessageCount:kMessageCount inThread:thread];
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], kMessageCount);
+
+    OWSDisappearingMessagesJob *job = [OWSDisappearingMessagesJob sharedJob];
+    CFAbsoluteTime startedAt = CFAbsoluteTimeGetCurrent();
+    dispatch_async(OWSDisappearingMessagesJob.serialQueue, ^{
+        [job runLoop];
+    });
+
+    YapDatabaseConnection *dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    CFTimeInterval maxWriteStall = 0;
+    CFTimeInterval maxReadStall = 0;
+    NSUInteger remainingCount = kMessageCount;
+    while (remainingCount > 0 && CFAbsoluteTimeGetCurrent() - startedAt < 600) {
+        CFAbsoluteTime writeStartedAt = CFAbsoluteTimeGetCurrent();
+        [dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+            [thread touchWithTransaction:transaction];
+        }];
+        maxWriteStall = MAX(maxWriteStall, CFAbsoluteTimeGetCurrent() - writeStartedAt);
+
+        CFAbsoluteTime readStartedAt = CFAbsoluteTimeGetCurrent();
+        __block NSUInteger count = 0;
+        [dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+            count = [TSMessage numberOfKeysInCollectionWithTransaction:transaction];
+        }];
+        maxReadStall = MAX(maxReadStall, CFAbsoluteTimeGetCurrent() - readStartedAt);
+        remainingCount = count;
+
+        [NSThread sleepForTimeInterval:0.01];
+    }
+
+    NSLog(@"Expired %lu messages in %.2fs. Longest write stall: %.3fs, longest read stall: %.3fs.",
+        (unsigned long)kMessageCount,
+        CFAbsoluteTimeGetCurrent() - startedAt,
+        maxWriteStall,
+        maxReadStall);
+    XCTAssertEqual(remainingCount, 0);
+    // Each chunk is bounded, so no write should wait on more than a chunk or two.
+    XCTAssertLessThan(maxWriteStall, 0.5);
+}
+
 @end
 
 NS_ASSUME_NONNULL_END
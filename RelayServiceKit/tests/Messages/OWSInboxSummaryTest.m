@@ -0,0 +1,253 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSInboxSummary.h"
+#import "OWSPrimaryStorage.h"
+#import "OWSUnreadCounter.h"
+#import "TSIncomingMessage.h"
+#import "TSInfoMessage.h"
+#import "TSThread.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSInboxSummaryTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+
+@end
+
+#pragma mark -
+
+@implementation OWSInboxSummaryTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    [TSInteraction removeAllObjectsInCollection];
+    [TSThread removeAllObjectsInCollection];
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [OWSUnreadCounter rebuildWithTransaction:transaction];
+        [OWSInboxSummary rebuildWithTransaction:transaction];
+    }];
+}
+
+- (TSThread *)newThreadWithTransaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    return [TSThread getOrCreateThreadWithId:[NSUUID UUID].UUIDString.lowercaseString transaction:transaction];
+}
+
+- (TSIncomingMessage *)saveMessageWithBody:(NSString *)body
+                                 timestamp:(uint64_t)timestamp
+                                  inThread:(TSThread *)thread
+                               transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    TSIncomingMessage *message = [[TSIncomingMessage alloc] initIncomingMessageWithTimestamp:timestamp
+                                                                                   serverAge:nil
+                                                                                    inThread:thread
+                                                                                    authorId:@"fake-author-id"
+                                                                              sourceDeviceId:1
+                                                                                 messageBody:body
+                                                                               attachmentIds:@[]
+                                                                            expiresInSeconds:0
+                                                                               quotedMessage:nil];
+    [message saveWithTransaction:transaction];
+    return message;
+}
+
+- (nullable OWSInboxSummary *)storedSummaryForThread:(TSThread *)thread
+                                         transaction:(YapDatabaseReadTransaction *)transaction
+{
+    return [OWSInboxSummary fetchObjectWithUniqueID:thread.uniqueId transaction:transaction];
+}
+
+// The stored summary must match the one worked out from the thread.
+- (void)assertSummaryIsCurrentForThread:(TSThread *)thread transaction:(YapDatabaseReadTransaction *)transaction
+{
+    OWSInboxSummary *_Nullable summary = [self storedSummaryForThread:thread transaction:transaction];
+    XCTAssertNotNil(summary);
+    TSThread *latestThread = [TSThread fetchObjectWithUniqueID:thread.uniqueId transaction:transaction];
+    TSInteraction *_Nullable lastInteraction = [latestThread lastInteractionForInboxWithTransaction:transaction];
+    XCTAssertEqualObjects(summary.lastInteractionId, lastInteraction.uniqueId);
+    XCTAssertEqual(summary.lastInteractionTimestamp, lastInteraction.timestampForSorting);
+    XCTAssertEqualObjects(summary.previewText, [latestThread lastMessageTextWithTransaction:transaction]);
+    XCTAssertEqual(summary.unreadCount, [latestThread unreadMessageCountWithTransaction:transaction]);
+}
+
+- (void)testSummaryFollowsSavesReadsAndRemovals
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        TSThread *thread = [self newThreadWithTransaction:transaction];
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+
+        TSIncomingMessage *first = [self saveMessageWithBody:@"first" timestamp:1 inThread:thread transaction:transaction];
+        TSIncomingMessage *second =
+            [self saveMessageWithBody:@"second" timestamp:2 inThread:thread transaction:transaction];
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+        OWSInboxSummary *summary = [self storedSummaryForThread:thread transaction:transaction];
+        XCTAssertEqualObjects(summary.lastInteractionId, second.uniqueId);
+        XCTAssertEqualObjects(summary.previewText, @"second");
+        XCTAssertEqual(summary.unreadCount, 2);
+
+        [first markAsReadAtTimestamp:3 sendReadReceipt:NO transaction:transaction];
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+        XCTAssertEqual([self storedSummaryForThread:thread transaction:transaction].unreadCount, 1);
+
+        [second removeWithTransaction:transaction];
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+        XCTAssertEqualObjects([self storedSummaryForThread:thread transaction:transaction].previewText, @"first");
+
+        [first removeWithTransaction:transaction];
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+        XCTAssertNil([self storedSummaryForThread:thread transaction:transaction].lastInteractionId);
+    }];
+}
+
+- (void)testInteractionsWhichDontAppearInInboxAreSkipped
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        TSThread *thread = [self newThreadWithTransaction:transaction];
+        TSIncomingMessage *message =
+            [self saveMessageWithBody:@"hello" timestamp:1 inThread:thread transaction:transaction];
+        [[[TSInfoMessage alloc] initWithTimestamp:2
+                                         inThread:thread
+                                  infoMessageType:TSInfoMessageVerificationStateChange]
+            saveWithTransaction:transaction];
+
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+        XCTAssertEqualObjects(
+            [self storedSummaryForThread:thread transaction:transaction].lastInteractionId, message.uniqueId);
+    }];
+}
+
+- (void)testSummaryFollowsThreadChanges
+{
+    __block TSThread *thread;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        thread = [self newThreadWithTransaction:transaction];
+        [self saveMessageWithBody:@"hello" timestamp:1 inThread:thread transaction:transaction];
+
+        thread.title = @"Book club";
+        [thread saveWithTransaction:transaction];
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+
+        [thread removeWithTransaction:transaction];
+        XCTAssertNil([self storedSummaryForThread:thread transaction:transaction]);
+    }];
+}
+
+- (void)testSummariesAreWorkedOutUntilBuilt
+{
+    __block TSThread *thread;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeAllObjectsInCollection:@"OWSInboxSummaryStateCollection"];
+        [transaction removeAllObjectsInCollection:[OWSInboxSummary collection]];
+
+        thread = [self newThreadWithTransaction:transaction];
+        [self saveMessageWithBody:@"hello" timestamp:1 inThread:thread transaction:transaction];
+        XCTAssertNil([self storedSummaryForThread:thread transaction:transaction]);
+        XCTAssertEqualObjects([OWSInboxSummary summaryForThread:thread transaction:transaction].previewText, @"hello");
+
+        XCTAssertTrue([OWSInboxSummary buildIfNecessaryWithTransaction:transaction]);
+        XCTAssertFalse([OWSInboxSummary buildIfNecessaryWithTransaction:transaction]);
+        [self assertSummaryIsCurrentForThread:thread transaction:transaction];
+    }];
+}
+
+#pragma mark - Benchmarks
+
+- (NSArray<TSThread *> *)populateThreadCount:(NSUInteger)threadCount
+{
+    NSMutableArray<TSThread *> *threads = [NSMutableArray new];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < threadCount; i++) {
+            TSThread *thread = [self newThreadWithTransaction:transaction];
+            for (uint64_t j = 1; j <= 3; j++) {
+                [self saveMessageWithBody:@"Are we still on for tomorrow?" timestamp:j inThread:thread transaction:transaction];
+            }
+            // Non-inbox interactions at the end of a thread have to be skipped by the old lookup.
+            for (uint64_t j = 4; j <= 8; j++) {
+                [[[TSInfoMessage alloc] initWithTimestamp:j
+                                                 inThread:thread
+                                          infoMessageType:TSInfoMessageVerificationStateChange]
+                    saveWithTransaction:transaction];
+            }
+            [threads addObject:thread];
+        }
+    }];
+    return threads;
+}
+
+// What ThreadViewModel used to read for each row.
+- (void)readRowWithOldLookupForThread:(TSThread *)thread transaction:(YapDatabaseReadTransaction *)transaction
+{
+    (void)thread.displayName;
+    (void)[thread lastMessageTextWithTransaction:transaction];
+    (void)[thread lastInteractionForInboxWithTransaction:transaction];
+    (void)[thread unreadMessageCountWithTransaction:transaction];
+}
+
+- (void)readRowWithSummaryForThread:(TSThread *)thread transaction:(YapDatabaseReadTransaction *)transaction
+{
+    (void)thread.displayName;
+    OWSInboxSummary *summary = [OWSInboxSummary summaryForThread:thread transaction:transaction];
+    (void)[summary lastInteractionWithTransaction:transaction];
+}
+
+// Cold load: every row read on a new connection, whose caches are empty.  Scroll: a read transaction per row, as
+// HomeViewController does for each row that isn't cached.
+- (void)testBenchmarkInboxWith5000Threads
+{
+    const NSUInteger threadCount = 5000;
+    NSArray<TSThread *> *threads = [self populateThreadCount:threadCount];
+    OWSPrimaryStorage *primaryStorage = [OWSPrimaryStorage sharedManager];
+
+    NSTimeInterval (^timeColdLoad)(BOOL) = ^(BOOL useSummaries) {
+        YapDatabaseConnection *connection = primaryStorage.newDatabaseConnection;
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        [connection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+            for (TSThread *thread in threads) {
+                if (useSummaries) {
+                    [self readRowWithSummaryForThread:thread transaction:transaction];
+                } else {
+                    [self readRowWithOldLookupForThread:thread transaction:transaction];
+                }
+            }
+        }];
+        return CFAbsoluteTimeGetCurrent() - startTime;
+    };
+    NSTimeInterval (^timeScroll)(BOOL) = ^(BOOL useSummaries) {
+        YapDatabaseConnection *connection = primaryStorage.newDatabaseConnection;
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        for (TSThread *thread in threads) {
+            [connection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+                if (useSummaries) {
+                    [self readRowWithSummaryForThread:thread transaction:transaction];
+                } else {
+                    [self readRowWithOldLookupForThread:thread transaction:transaction];
+                }
+            }];
+        }
+        return CFAbsoluteTimeGetCurrent() - startTime;
+    };
+
+    NSTimeInterval oldColdLoadTime = timeColdLoad(NO);
+    NSTimeInterval summaryColdLoadTime = timeColdLoad(YES);
+    NSTimeInterval oldScrollTime = timeScroll(NO);
+    NSTimeInterval summaryScrollTime = timeScroll(YES);
+
+    NSLog(@"%@ inbox of %lu threads: cold load %.2fs -> %.2fs, scroll %.2fs -> %.2fs.",
+        self.logTag,
+        (unsigned long)threadCount,
+        oldColdLoadTime,
+        summaryColdLoadTime,
+        oldScrollTime,
+        summaryScrollTime);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
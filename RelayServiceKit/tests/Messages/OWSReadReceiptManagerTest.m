@@ -0,0 +1,210 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "NSDate+OWS.h"
+#import "OWSPrimaryStorage.h"
+#import "OWSReadReceiptManager.h"
+#import "TSDatabaseView.h"
+#import "TSOutgoingMessage.h"
+#import "TSThread.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface TSMessage (Testing)
+
+@property (nonatomic) uint64_t receivedAtTimestamp;
+
+@end
+
+#pragma mark -
+
+@interface OWSReadReceiptManagerTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+@property (nonatomic) TSThread *thread;
+@property (nonatomic) uint64_t baseTimestamp;
+
+@end
+
+#pragma mark -
+
+@implementation OWSReadReceiptManagerTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    [TSInteraction removeAllObjectsInCollection];
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        self.thread =
+            [TSThread getOrCreateThreadWithId:[NSUUID UUID].UUIDString.lowercaseString transaction:transaction];
+    }];
+    self.baseTimestamp = [NSDate ows_millisecondTimeStamp] - 1000 * kDayInMs;
+}
+
+// One message a second, each saved shortly after it was sent.
+- (uint64_t)timestampForMessageAtIndex:(NSUInteger)index
+{
+    return self.baseTimestamp + index * 1000;
+}
+
+- (NSArray<TSOutgoingMessage *> *)saveOutgoingMessageCount:(NSUInteger)count
+{
+    NSMutableArray<TSOutgoingMessage *> *messages = [NSMutableArray new];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < count; i++) {
+            uint64_t timestamp = [self timestampForMessageAtIndex:i];
+            TSOutgoingMessage *message = [[TSOutgoingMessage alloc] initOutgoingMessageWithTimestamp:timestamp
+                                                                                            inThread:self.thread
+                                                                                         messageBody:@"outgoing"
+                                                                                       attachmentIds:[NSMutableArray new]
+                                                                                    expiresInSeconds:0
+                                                                                     expireStartedAt:0
+                                                                                      isVoiceMessage:NO
+                                                                                       quotedMessage:nil];
+            message.receivedAtTimestamp = timestamp + 5;
+            [message saveWithTransaction:transaction];
+            [messages addObject:message];
+        }
+    }];
+    return messages;
+}
+
+- (NSUInteger)countOfMessagesReadByRecipientId:(NSString *)recipientId
+{
+    __block NSUInteger count = 0;
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        [[TSDatabaseView threadOutgoingMessageDatabaseView:transaction]
+            enumerateKeysAndObjectsInGroup:self.thread.uniqueId
+                                usingBlock:^(NSString *collection, NSString *key, id object, NSUInteger index, BOOL *stop) {
+                                    TSOutgoingMessage *message = (TSOutgoingMessage *)object;
+                                    if ([message.readRecipientIds containsObject:recipientId]) {
+                                        count++;
+                                    }
+                                }];
+    }];
+    return count;
+}
+
+- (void)applyReadMarkFromRecipientId:(NSString *)recipientId beforeTimestamp:(uint64_t)timestamp
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [[OWSReadReceiptManager sharedManager] markAsReadByRecipientId:recipientId
+                                                       beforeTimestamp:timestamp
+                                                                thread:self.thread
+                                                              wasLocal:NO
+                                                           transaction:transaction];
+    }];
+}
+
+- (void)testReadMarksOnlyMoveForward
+{
+    [self saveOutgoingMessageCount:10];
+
+    [self applyReadMarkFromRecipientId:@"alice" beforeTimestamp:[self timestampForMessageAtIndex:4]];
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"alice"], 5);
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"bob"], 0);
+
+    [self applyReadMarkFromRecipientId:@"alice" beforeTimestamp:[self timestampForMessageAtIndex:2]];
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        XCTAssertEqual([[OWSReadReceiptManager sharedManager] readWatermarkForRecipientId:@"alice"
+                                                                                   thread:self.thread
+                                                                              transaction:transaction],
+            [self timestampForMessageAtIndex:4]);
+    }];
+
+    [self applyReadMarkFromRecipientId:@"bob" beforeTimestamp:[self timestampForMessageAtIndex:2]];
+    [self applyReadMarkFromRecipientId:@"alice" beforeTimestamp:[self timestampForMessageAtIndex:7]];
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"alice"], 8);
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"bob"], 3);
+}
+
+- (void)testReadMarksCoverMessagesSavedLate
+{
+    [self saveOutgoingMessageCount:10];
+    [self applyReadMarkFromRecipientId:@"alice" beforeTimestamp:[self timestampForMessageAtIndex:5]];
+
+    // e.g. a transcript of a message sent from a linked device, which arrives after the read mark.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        TSOutgoingMessage *message =
+            [[TSOutgoingMessage alloc] initOutgoingMessageWithTimestamp:[self timestampForMessageAtIndex:3] + 1
+                                                               inThread:self.thread
+                                                            messageBody:@"late"
+                                                          attachmentIds:[NSMutableArray new]
+                                                       expiresInSeconds:0
+                                                        expireStartedAt:0
+                                                         isVoiceMessage:NO
+                                                          quotedMessage:nil];
+        message.receivedAtTimestamp = [self timestampForMessageAtIndex:20];
+        [message saveWithTransaction:transaction];
+    }];
+    // It's read as it's saved; the next read mark doesn't reach back that far.
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"alice"], 7);
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"bob"], 0);
+
+    [self applyReadMarkFromRecipientId:@"alice" beforeTimestamp:[self timestampForMessageAtIndex:6]];
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"alice"], 8);
+}
+
+#pragma mark - Benchmarks
+
+// The read mark handling which the watermarks replaced.
+- (void)applyReferenceReadMarkFromRecipientId:(NSString *)recipientId beforeTimestamp:(uint64_t)timestamp
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        NSMutableArray<TSOutgoingMessage *> *newlyReadList = [NSMutableArray new];
+        [[TSDatabaseView threadOutgoingMessageDatabaseView:transaction]
+            enumerateKeysAndObjectsInGroup:self.thread.uniqueId
+                                usingBlock:^(NSString *collection, NSString *key, id object, NSUInteger index, BOOL *stop) {
+                                    TSOutgoingMessage *possiblyRead = (TSOutgoingMessage *)object;
+                                    if (possiblyRead.timestamp <= timestamp) {
+                                        [newlyReadList addObject:possiblyRead];
+                                    }
+                                }];
+        for (TSOutgoingMessage *readMessage in newlyReadList) {
+            [readMessage updateWithReadRecipientId:recipientId readTimestamp:timestamp transaction:transaction];
+        }
+    }];
+}
+
+- (void)testBenchmarkReadMarksInLongThread
+{
+    const NSUInteger messageCount = 20000;
+    const NSUInteger readMarkCount = 1000;
+    const NSUInteger messagesPerReadMark = messageCount / readMarkCount;
+    [self saveOutgoingMessageCount:messageCount];
+
+    // Scanning the whole thread for every read mark is too slow to run all of them.
+    const NSUInteger referenceReadMarkCount = 10;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < referenceReadMarkCount; i++) {
+        [self applyReferenceReadMarkFromRecipientId:@"reference"
+                                    beforeTimestamp:[self timestampForMessageAtIndex:(i + 1) * messagesPerReadMark - 1]];
+    }
+    NSTimeInterval referenceTime = CFAbsoluteTimeGetCurrent() - startTime;
+
+    startTime = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < readMarkCount; i++) {
+        [self applyReadMarkFromRecipientId:@"alice"
+                           beforeTimestamp:[self timestampForMessageAtIndex:(i + 1) * messagesPerReadMark - 1]];
+    }
+    NSTimeInterval watermarkTime = CFAbsoluteTimeGetCurrent() - startTime;
+
+    XCTAssertEqual([self countOfMessagesReadByRecipientId:@"alice"], messageCount);
+
+    NSLog(@"%@ read marks in a %lu message thread: %.2fms each scanning the thread, %.2fms each with watermarks "
+          @"(%lu read marks in %.2fs).",
+        self.logTag,
+        (unsigned long)messageCount,
+        referenceTime * 1000 / referenceReadMarkCount,
+        watermarkTime * 1000 / readMarkCount,
+        (unsigned long)readMarkCount,
+        watermarkTime);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
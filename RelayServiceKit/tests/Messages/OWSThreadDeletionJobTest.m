@@ -0,0 +1,152 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSInboxSummary.h"
+#import "OWSPrimaryStorage.h"
+#import "OWSThreadDeletionJob.h"
+#import "TSMessage.h"
+#import "TSThread.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSThreadDeletionJob (Testing)
+
+@property (nonatomic) NSUInteger chunkSize;
+@property (nonatomic) NSTimeInterval chunkInterval;
+@property (nonatomic, readonly) dispatch_queue_t serialQueue;
+
+- (nullable NSDictionary *)saveTombstoneForThread:(TSThread *)thread
+                                      transaction:(YapDatabaseReadWriteTransaction *)transaction;
+
+@end
+
+@interface OWSThreadDeletionJobTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+
+@end
+
+@implementation OWSThreadDeletionJobTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    [TSMessage removeAllObjectsInCollection];
+    [TSThread removeAllObjectsInCollection];
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+
+    OWSThreadDeletionJob *job = [OWSThreadDeletionJob sharedJob];
+    job.chunkSize = 10;
+    job.chunkInterval = 0.01;
+}
+
+- (void)saveMessageCount:(NSUInteger)count inThread:(TSThread *)thread firstTimestamp:(uint64_t)firstTimestamp
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < count; i++) {
+            TSMessage *message = [[TSMessage alloc] initMessageWithTimestamp:firstTimestamp + i
+                                                                    inThread:thread
+                                                                 messageBody:@"message"
+                                                               attachmentIds:@[]
+                                                            expiresInSeconds:0
+                                                             expireStartedAt:0
+                                                               quotedMessage:nil];
+            [message saveWithTransaction:transaction];
+        }
+    }];
+}
+
+- (void)waitForMessageCount:(NSUInteger)count timeout:(NSTimeInterval)timeout
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while ([TSMessage numberOfKeysInCollection] != count && deadline.timeIntervalSinceNow > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], count);
+}
+
+- (void)testDeletesThreadInChunks
+{
+    TSThread *thread = [TSThread getOrCreateThreadWithParticipants:@[ @"fake-participant-id" ]];
+    [self saveMessageCount:25 inThread:thread firstTimestamp:1];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [OWSInboxSummary rebuildWithTransaction:transaction];
+    }];
+    XCTAssertNotNil([OWSInboxSummary fetchObjectWithUniqueID:thread.uniqueId]);
+
+    NSMutableArray<NSNumber *> *deletedCounts = [NSMutableArray new];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion"];
+    [[OWSThreadDeletionJob sharedJob] deleteThread:thread
+        progress:^(NSUInteger deletedCount, NSUInteger totalCount) {
+            XCTAssertEqual(totalCount, 25);
+            if (deletedCounts.count == 0) {
+                // The thread, and its summary, are gone before any of its messages are.
+                XCTAssertNil([TSThread fetchObjectWithUniqueID:thread.uniqueId]);
+                XCTAssertNil([OWSInboxSummary fetchObjectWithUniqueID:thread.uniqueId]);
+            }
+            [deletedCounts addObject:@(deletedCount)];
+        }
+        completion:^{
+            [expectation fulfill];
+        }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertEqualObjects(deletedCounts, (@[ @0, @10, @20, @25 ]));
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], 0);
+    XCTAssertNil([TSThread fetchObjectWithUniqueID:thread.uniqueId]);
+}
+
+- (void)testKeepsMessagesReceivedAfterDeletion
+{
+    TSThread *thread = [TSThread getOrCreateThreadWithParticipants:@[ @"fake-participant-id" ]];
+    [self saveMessageCount:25 inThread:thread firstTimestamp:1];
+
+    OWSThreadDeletionJob *job = [OWSThreadDeletionJob sharedJob];
+    job.chunkInterval = 0.5;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completion"];
+    __block BOOL didReceiveMessage = NO;
+    [job deleteThread:thread
+        progress:^(NSUInteger deletedCount, NSUInteger totalCount) {
+            if (deletedCount > 0 && !didReceiveMessage) {
+                // A new message recreates the thread part way through the deletion.
+                didReceiveMessage = YES;
+                [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+                    [thread saveWithTransaction:transaction];
+                }];
+                [self saveMessageCount:1 inThread:thread firstTimestamp:1000];
+            }
+        }
+        completion:^{
+            [expectation fulfill];
+        }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertTrue(didReceiveMessage);
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], 1);
+    XCTAssertNotNil([TSThread fetchObjectWithUniqueID:thread.uniqueId]);
+}
+
+- (void)testResumesInterruptedDeletion
+{
+    TSThread *thread = [TSThread getOrCreateThreadWithParticipants:@[ @"fake-participant-id" ]];
+    [self saveMessageCount:25 inThread:thread firstTimestamp:1];
+
+    // As if the app was terminated right after the thread was tombstoned.
+    OWSThreadDeletionJob *job = [OWSThreadDeletionJob sharedJob];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        XCTAssertNotNil([job saveTombstoneForThread:thread transaction:transaction]);
+        [transaction removeObjectForKey:thread.uniqueId inCollection:[TSThread collection]];
+    }];
+    XCTAssertEqual([TSMessage numberOfKeysInCollection], 25);
+
+    [job startIfNecessary];
+    [self waitForMessageCount:0 timeout:5];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
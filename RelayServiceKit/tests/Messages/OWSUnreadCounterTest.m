@@ -0,0 +1,166 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSPrimaryStorage.h"
+#import "OWSUnreadCounter.h"
+#import "TSDatabaseView.h"
+#import "TSIncomingMessage.h"
+#import "TSThread.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSUnreadCounterTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+
+@end
+
+@implementation OWSUnreadCounterTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    [TSInteraction removeAllObjectsInCollection];
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [OWSUnreadCounter rebuildWithTransaction:transaction];
+    }];
+}
+
+- (TSThread *)newThread
+{
+    __block TSThread *thread;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        thread = [TSThread getOrCreateThreadWithId:[NSUUID UUID].UUIDString.lowercaseString transaction:transaction];
+    }];
+    return thread;
+}
+
+- (NSArray<TSIncomingMessage *> *)saveUnreadMessageCount:(NSUInteger)count inThread:(TSThread *)thread
+{
+    NSMutableArray<TSIncomingMessage *> *messages = [NSMutableArray new];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < count; i++) {
+            TSIncomingMessage *message = [[TSIncomingMessage alloc] initIncomingMessageWithTimestamp:i + 1
+                                                                                           serverAge:nil
+                                                                                            inThread:thread
+                                                                                            authorId:@"fake-author-id"
+                                                                                      sourceDeviceId:1
+                                                                                         messageBody:@"unread"
+                                                                                       attachmentIds:@[]
+                                                                                    expiresInSeconds:0
+                                                                                       quotedMessage:nil];
+            [message saveWithTransaction:transaction];
+            [messages addObject:message];
+        }
+    }];
+    return messages;
+}
+
+// Checks the counts against the unread view.
+- (void)assertCountsForThreads:(NSArray<TSThread *> *)threads
+{
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        YapDatabaseViewTransaction *unreadView = [transaction ext:TSUnreadDatabaseViewExtensionName];
+        for (TSThread *thread in threads) {
+            XCTAssertEqual([OWSUnreadCounter unreadCountForThreadId:thread.uniqueId transaction:transaction],
+                [unreadView numberOfItemsInGroup:thread.uniqueId]);
+        }
+        XCTAssertEqual(
+            [OWSUnreadCounter totalUnreadCountWithTransaction:transaction], [unreadView numberOfItemsInAllGroups]);
+    }];
+}
+
+- (void)testCountsFollowSavesReadsAndRemovals
+{
+    TSThread *thread1 = [self newThread];
+    TSThread *thread2 = [self newThread];
+    NSArray<TSIncomingMessage *> *messages1 = [self saveUnreadMessageCount:5 inThread:thread1];
+    NSArray<TSIncomingMessage *> *messages2 = [self saveUnreadMessageCount:3 inThread:thread2];
+    [self assertCountsForThreads:@[ thread1, thread2 ]];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [messages1[0] markAsReadAtTimestamp:1 sendReadReceipt:NO transaction:transaction];
+        [messages1[1] markAsReadAtTimestamp:1 sendReadReceipt:NO transaction:transaction];
+        // Saving again doesn't count twice.
+        [messages2[0] saveWithTransaction:transaction];
+    }];
+    [self assertCountsForThreads:@[ thread1, thread2 ]];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        // One read, one unread.
+        [messages1[0] removeWithTransaction:transaction];
+        [messages2[0] removeWithTransaction:transaction];
+    }];
+    [self assertCountsForThreads:@[ thread1, thread2 ]];
+
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        XCTAssertEqual([OWSUnreadCounter unreadCountForThreadId:thread1.uniqueId transaction:transaction], 3);
+        XCTAssertEqual([OWSUnreadCounter unreadCountForThreadId:thread2.uniqueId transaction:transaction], 2);
+        XCTAssertEqual([OWSUnreadCounter totalUnreadCountWithTransaction:transaction], 5);
+    }];
+}
+
+- (void)testRepairsDrift
+{
+    TSThread *thread = [self newThread];
+    [self saveUnreadMessageCount:5 inThread:thread];
+
+    __block BOOL didRepair = YES;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        didRepair = [OWSUnreadCounter repairIfNecessaryWithTransaction:transaction];
+    }];
+    XCTAssertFalse(didRepair);
+
+    // Bypasses -[TSInteraction removeWithTransaction:].
+    [TSInteraction removeAllObjectsInCollection];
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        XCTAssertEqual([OWSUnreadCounter totalUnreadCountWithTransaction:transaction], 5);
+    }];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        didRepair = [OWSUnreadCounter repairIfNecessaryWithTransaction:transaction];
+    }];
+    XCTAssertTrue(didRepair);
+    [self assertCountsForThreads:@[ thread ]];
+}
+
+#pragma mark - Benchmarks
+
+- (void)saveUnreadBacklog
+{
+    for (NSUInteger i = 0; i < 500; i++) {
+        [self saveUnreadMessageCount:10 inThread:[self newThread]];
+    }
+}
+
+- (void)testViewTotalPerformance
+{
+    [self saveUnreadBacklog];
+    [self measureBlock:^{
+        [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+            for (NSUInteger i = 0; i < 1000; i++) {
+                [[transaction ext:TSUnreadDatabaseViewExtensionName] numberOfItemsInAllGroups];
+            }
+        }];
+    }];
+}
+
+- (void)testCounterTotalPerformance
+{
+    [self saveUnreadBacklog];
+    [self measureBlock:^{
+        [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+            for (NSUInteger i = 0; i < 1000; i++) {
+                [OWSUnreadCounter totalUnreadCountWithTransaction:transaction];
+            }
+        }];
+    }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,380 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSConnectionHealth.h"
+#import <RelayServiceKit/RelayServiceKit-Swift.h>
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A network with a given round-trip time and loss rate, which can be taken down for a while.  Seeded, so that
+// each run sees the same packets lost.
+@interface OWSSimulatedNetwork : NSObject
+
+@property (nonatomic) NSTimeInterval now;
+@property (nonatomic) NSTimeInterval roundTripTime;
+@property (nonatomic) NSTimeInterval roundTripTimeJitter;
+@property (nonatomic) double lossRate;
+@property (nonatomic) NSTimeInterval outageStart;
+@property (nonatomic) NSTimeInterval outageEnd;
+@property (nonatomic) uint64_t seed;
+
+@end
+
+#pragma mark -
+
+@implementation OWSSimulatedNetwork
+
+- (instancetype)init
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _roundTripTime = 0.1;
+    _outageStart = DBL_MAX;
+    _outageEnd = DBL_MAX;
+    _seed = 88172645463325252ULL;
+
+    return self;
+}
+
+// From 0 to 1; xorshift64.
+- (double)nextRandom
+{
+    self.seed ^= self.seed << 13;
+    self.seed ^= self.seed >> 7;
+    self.seed ^= self.seed << 17;
+    return (self.seed % 1000000) / 1000000.0;
+}
+
+- (BOOL)isDown
+{
+    return self.now >= self.outageStart && self.now < self.outageEnd;
+}
+
+// Nil if the packet or its answer is lost.
+- (nullable NSNumber *)roundTripTimeOfPacket
+{
+    if (self.isDown || [self nextRandom] < self.lossRate) {
+        return nil;
+    }
+    return @(MAX(0, self.roundTripTime + self.roundTripTimeJitter * (2 * [self nextRandom] - 1)));
+}
+
+@end
+
+#pragma mark -
+
+// Drives an OWSConnectionHealth the way TSSocketManager does, over a simulated network.
+@interface OWSConnectionSimulation : NSObject
+
+@property (nonatomic, readonly) OWSSimulatedNetwork *network;
+@property (nonatomic, readonly) OWSConnectionHealth *connectionHealth;
+
+@property (nonatomic) BOOL isConnected;
+@property (nonatomic) NSUInteger reconnectAttemptCount;
+@property (nonatomic) NSUInteger heartbeatCount;
+@property (nonatomic) NSTimeInterval nextHeartbeatTime;
+@property (nonatomic) NSUInteger deadConnectionCount;
+// When the connection was last found to be dead, or last opened.
+@property (nonatomic) NSTimeInterval lastDeathTime;
+@property (nonatomic) NSTimeInterval lastOpenTime;
+
+@end
+
+#pragma mark -
+
+@implementation OWSConnectionSimulation
+
+- (instancetype)init
+{
+    self = [super init];
+    if (!self) {
+        return self;
+    }
+
+    _network = [OWSSimulatedNetwork new];
+    _connectionHealth = [OWSConnectionHealth new];
+    OWSSimulatedNetwork *network = _network;
+    _connectionHealth.clock = ^{
+        return network.now;
+    };
+
+    return self;
+}
+
+- (void)runUntil:(NSTimeInterval)endTime
+{
+    while (self.network.now < endTime) {
+        if (self.isConnected) {
+            [self heartbeat];
+        } else {
+            [self reconnect];
+        }
+    }
+}
+
+- (void)reconnect
+{
+    self.network.now += [self.connectionHealth nextReconnectDelay];
+    self.reconnectAttemptCount++;
+    if (!self.network.isDown) {
+        self.isConnected = YES;
+        self.lastOpenTime = self.network.now;
+        [self.connectionHealth connectionDidOpen];
+        self.nextHeartbeatTime = self.network.now + self.connectionHealth.heartbeatInterval;
+    }
+}
+
+// Waits for the next heartbeat to be sent, then for its answer or timeout.
+- (void)heartbeat
+{
+    self.network.now = self.nextHeartbeatTime;
+    uint64_t sequenceNumber = [self.connectionHealth didSendHeartbeat];
+    self.heartbeatCount++;
+    NSTimeInterval heartbeatTimeout = self.connectionHealth.heartbeatTimeout;
+    self.nextHeartbeatTime = self.network.now + self.connectionHealth.heartbeatInterval;
+
+    NSNumber *_Nullable roundTripTime = [self.network roundTripTimeOfPacket];
+    if (roundTripTime && roundTripTime.doubleValue < heartbeatTimeout) {
+        self.network.now += roundTripTime.doubleValue;
+        [self.connectionHealth didReceiveHeartbeatResponse:sequenceNumber];
+        return;
+    }
+
+    self.network.now += heartbeatTimeout;
+    if ([self.connectionHealth heartbeatDidTimeOut:sequenceNumber]) {
+        self.isConnected = NO;
+        self.deadConnectionCount++;
+        self.lastDeathTime = self.network.now;
+        [self.connectionHealth connectionDidClose];
+    }
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSConnectionHealthTest : XCTestCase
+
+@end
+
+#pragma mark -
+
+@implementation OWSConnectionHealthTest
+
+#pragma mark - Reconnects
+
+- (void)testReconnectDelayBacksOffWithJitter
+{
+    OWSConnectionHealth *connectionHealth = [OWSConnectionHealth new];
+    for (NSUInteger attempt = 0; attempt < 40; attempt++) {
+        NSTimeInterval expectedDelay
+            = MIN(connectionHealth.maxReconnectDelay, connectionHealth.minReconnectDelay * pow(2, MIN(attempt, 30)));
+        NSTimeInterval delay = [connectionHealth nextReconnectDelay];
+        XCTAssertGreaterThanOrEqual(delay, expectedDelay / 2);
+        XCTAssertLessThanOrEqual(delay, expectedDelay);
+    }
+    XCTAssertEqual(connectionHealth.reconnectAttemptCount, 40);
+
+    [connectionHealth resetReconnectBackoff];
+    XCTAssertLessThanOrEqual([connectionHealth nextReconnectDelay], connectionHealth.minReconnectDelay);
+
+    // Clients which lost their connections together don't all retry together.
+    NSMutableSet<NSNumber *> *delays = [NSMutableSet new];
+    for (int i = 0; i < 20; i++) {
+        OWSConnectionHealth *otherConnectionHealth = [OWSConnectionHealth new];
+        for (int attempt = 0; attempt < 5; attempt++) {
+            [otherConnectionHealth nextReconnectDelay];
+        }
+        [delays addObject:@([otherConnectionHealth nextReconnectDelay])];
+    }
+    XCTAssertGreaterThan(delays.count, 1);
+}
+
+- (void)testAnsweredHeartbeatResetsBackoff
+{
+    OWSConnectionSimulation *simulation = [OWSConnectionSimulation new];
+    simulation.network.outageStart = 0;
+    simulation.network.outageEnd = 60;
+    [simulation runUntil:5 * 60];
+
+    XCTAssertTrue(simulation.isConnected);
+    XCTAssertGreaterThan(simulation.reconnectAttemptCount, 1);
+    XCTAssertEqual(simulation.connectionHealth.reconnectAttemptCount, 0);
+}
+
+// e.g. a server which accepts connections and then drops them.
+- (void)testOpenConnectionDoesNotResetBackoff
+{
+    OWSConnectionHealth *connectionHealth = [OWSConnectionHealth new];
+    for (int attempt = 0; attempt < 5; attempt++) {
+        [connectionHealth nextReconnectDelay];
+    }
+    [connectionHealth connectionDidOpen];
+    [connectionHealth connectionDidClose];
+    XCTAssertEqual(connectionHealth.reconnectAttemptCount, 5);
+
+    [connectionHealth connectionDidOpen];
+    [connectionHealth didReceiveHeartbeatResponse:[connectionHealth didSendHeartbeat]];
+    XCTAssertEqual(connectionHealth.reconnectAttemptCount, 0);
+}
+
+// The old socket manager retried every 5 seconds for as long as the server was down.
+- (void)testBackoffDuringOutage
+{
+    OWSConnectionSimulation *simulation = [OWSConnectionSimulation new];
+    [simulation runUntil:60];
+    XCTAssertTrue(simulation.isConnected);
+
+    simulation.network.outageStart = simulation.network.now;
+    simulation.network.outageEnd = simulation.network.now + 10 * 60;
+    [simulation runUntil:simulation.network.outageEnd + 5 * 60];
+
+    const NSUInteger fixedDelayAttemptCount = 10 * 60 / 5;
+    NSLog(@"%@ reconnect attempts over a 10 minute outage: %lu, against %lu with a fixed delay.",
+        self.logTag,
+        (unsigned long)simulation.reconnectAttemptCount,
+        (unsigned long)fixedDelayAttemptCount);
+    XCTAssertLessThan(simulation.reconnectAttemptCount, fixedDelayAttemptCount / 4);
+
+    // Back within the longest delay of the server's return.
+    XCTAssertTrue(simulation.isConnected);
+    XCTAssertGreaterThanOrEqual(simulation.lastOpenTime, simulation.network.outageEnd);
+    XCTAssertLessThanOrEqual(simulation.lastOpenTime - simulation.network.outageEnd,
+        simulation.connectionHealth.maxReconnectDelay);
+}
+
+#pragma mark - Heartbeats
+
+- (void)testRoundTripTimeEstimate
+{
+    OWSConnectionSimulation *simulation = [OWSConnectionSimulation new];
+    simulation.network.roundTripTime = 0.3;
+    simulation.network.roundTripTimeJitter = 0.1;
+    XCTAssertNil(simulation.connectionHealth.smoothedRoundTripTime);
+    [simulation runUntil:30 * 60];
+
+    OWSConnectionHealth *connectionHealth = simulation.connectionHealth;
+    XCTAssertEqualWithAccuracy(connectionHealth.smoothedRoundTripTime.doubleValue, 0.3, 0.1);
+    XCTAssertLessThan(connectionHealth.roundTripTimeVariation.doubleValue, 0.2);
+    XCTAssertEqual(connectionHealth.lossRate, 0);
+    XCTAssertEqual(simulation.deadConnectionCount, 0);
+
+    // A healthy connection is left alone as long as possible.
+    XCTAssertEqual(connectionHealth.heartbeatInterval, connectionHealth.maxHeartbeatInterval);
+    XCTAssertLessThan(connectionHealth.heartbeatTimeout, 10);
+}
+
+- (void)testLossShortensHeartbeatInterval
+{
+    OWSConnectionSimulation *simulation = [OWSConnectionSimulation new];
+    simulation.network.lossRate = 0.3;
+    [simulation runUntil:30 * 60];
+
+    OWSConnectionHealth *connectionHealth = simulation.connectionHealth;
+    XCTAssertGreaterThan(connectionHealth.lossRate, 0);
+    XCTAssertLessThan(connectionHealth.heartbeatInterval, connectionHealth.maxHeartbeatInterval);
+    XCTAssertGreaterThanOrEqual(connectionHealth.heartbeatInterval, connectionHealth.minHeartbeatInterval);
+    // Over a healthy connection, a heartbeat every 30s.
+    XCTAssertGreaterThan(simulation.heartbeatCount, 30 * 60 / connectionHealth.maxHeartbeatInterval);
+
+    // It recovers once the connection does.
+    simulation.network.lossRate = 0;
+    [simulation runUntil:simulation.network.now + 30 * 60];
+    XCTAssertEqualWithAccuracy(connectionHealth.heartbeatInterval, connectionHealth.maxHeartbeatInterval, 0.01);
+}
+
+- (void)testDeadConnectionIsDetected
+{
+    OWSConnectionSimulation *simulation = [OWSConnectionSimulation new];
+    [simulation runUntil:5 * 60];
+    XCTAssertTrue(simulation.isConnected);
+
+    // The connection silently stops carrying anything, as it can after a change of network.
+    NSTimeInterval outageStart = simulation.network.now;
+    simulation.network.outageStart = outageStart;
+    while (simulation.isConnected) {
+        [simulation heartbeat];
+    }
+
+    OWSConnectionHealth *connectionHealth = simulation.connectionHealth;
+    XCTAssertEqual(simulation.deadConnectionCount, 1);
+    // A heartbeat is due within the longest interval; the lost ones each take a timeout to notice, and the
+    // interval shortens between them.
+    NSTimeInterval detectionTime = simulation.lastDeathTime - outageStart;
+    NSLog(@"%@ dead connection detected after %.1fs.", self.logTag, detectionTime);
+    XCTAssertLessThanOrEqual(detectionTime,
+        connectionHealth.maxConsecutiveLostHeartbeats
+            * (connectionHealth.maxHeartbeatInterval + connectionHealth.heartbeatTimeout));
+}
+
+- (void)testLateResponseIsIgnored
+{
+    __block NSTimeInterval now = 0;
+    OWSConnectionHealth *connectionHealth = [OWSConnectionHealth new];
+    connectionHealth.clock = ^{
+        return now;
+    };
+
+    uint64_t sequenceNumber = [connectionHealth didSendHeartbeat];
+    now += connectionHealth.heartbeatTimeout;
+    XCTAssertFalse([connectionHealth heartbeatDidTimeOut:sequenceNumber]);
+    XCTAssertEqual(connectionHealth.consecutiveLostHeartbeatCount, 1);
+
+    [connectionHealth didReceiveHeartbeatResponse:sequenceNumber];
+    XCTAssertNil(connectionHealth.smoothedRoundTripTime);
+    XCTAssertEqual(connectionHealth.consecutiveLostHeartbeatCount, 1);
+
+    // Nor do heartbeats from a closed connection count against the next.
+    sequenceNumber = [connectionHealth didSendHeartbeat];
+    [connectionHealth connectionDidClose];
+    XCTAssertFalse([connectionHealth heartbeatDidTimeOut:sequenceNumber]);
+    XCTAssertEqual(connectionHealth.consecutiveLostHeartbeatCount, 0);
+}
+
+#pragma mark - Outage Detection
+
+- (void)testOutageDetection
+{
+    OutageDetection *outageDetection = [OutageDetection new];
+    NSDate *startDate = [NSDate new];
+
+    // Failing for a short while isn't an outage.
+    for (int i = 0; i < 5; i++) {
+        [outageDetection connectionDidFailWithDate:[startDate dateByAddingTimeInterval:i * 10] isNetworkReachable:YES];
+    }
+    XCTAssertFalse(outageDetection.hasOutage);
+
+    [outageDetection connectionDidFailWithDate:[startDate dateByAddingTimeInterval:OutageDetection.outageDuration]
+                            isNetworkReachable:YES];
+    XCTAssertTrue(outageDetection.hasOutage);
+
+    [outageDetection connectionDidSucceed];
+    XCTAssertFalse(outageDetection.hasOutage);
+}
+
+- (void)testNoOutageWhileOffline
+{
+    OutageDetection *outageDetection = [OutageDetection new];
+    NSDate *startDate = [NSDate new];
+
+    for (int i = 0; i < 10; i++) {
+        [outageDetection connectionDidFailWithDate:[startDate dateByAddingTimeInterval:i * 60] isNetworkReachable:NO];
+    }
+    XCTAssertFalse(outageDetection.hasOutage);
+
+    // Failures from before the network was lost don't count towards an outage after it returns.
+    [outageDetection connectionDidFailWithDate:startDate isNetworkReachable:YES];
+    [outageDetection connectionDidFailWithDate:[startDate dateByAddingTimeInterval:30] isNetworkReachable:NO];
+    [outageDetection connectionDidFailWithDate:[startDate dateByAddingTimeInterval:90] isNetworkReachable:YES];
+    [outageDetection connectionDidFailWithDate:[startDate dateByAddingTimeInterval:100] isNetworkReachable:YES];
+    XCTAssertFalse(outageDetection.hasOutage);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,353 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "Cryptography.h"
+#import "OWSError.h"
+#import "OWSResumableUpload.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+static NSString *const kStubHost = @"upload-stub.local";
+
+// A local HTTP stub for an upload location.
+//
+// When resumable, it understands Content-Range: "bytes */<length>" queries are answered with 308 and the
+// acknowledged Range, and chunks are appended.  Otherwise every PUT replaces the stored object, as a plain
+// object store would.
+@interface OWSUploadStubProtocol : NSURLProtocol
+
+@end
+
+static BOOL gStubIsResumable;
+// If non-zero, the next upload request stores only this many bytes and then fails as if the connection dropped.
+static NSUInteger gStubDropAfterLength;
+static NSInteger gStubFailureStatusCode;
+static NSMutableData *gStubStoredData;
+static NSMutableArray<NSString *> *gStubContentRanges;
+static NSUInteger gStubReceivedBodyLength;
+
+@implementation OWSUploadStubProtocol
+
++ (void)resetWithResumable:(BOOL)isResumable
+{
+    @synchronized(self) {
+        gStubIsResumable = isResumable;
+        gStubDropAfterLength = 0;
+        gStubFailureStatusCode = 0;
+        gStubStoredData = [NSMutableData new];
+        gStubContentRanges = [NSMutableArray new];
+        gStubReceivedBodyLength = 0;
+    }
+}
+
++ (NSData *)storedData
+{
+    @synchronized(self) {
+        return [gStubStoredData copy];
+    }
+}
+
+// The Content-Range of each request, or "" for requests without one.
++ (NSArray<NSString *> *)contentRanges
+{
+    @synchronized(self) {
+        return [gStubContentRanges copy];
+    }
+}
+
++ (NSUInteger)receivedBodyLength
+{
+    @synchronized(self) {
+        return gStubReceivedBodyLength;
+    }
+}
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return [request.URL.host isEqualToString:kStubHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (NSData *)requestBody
+{
+    if (self.request.HTTPBody) {
+        return self.request.HTTPBody;
+    }
+
+    NSMutableData *body = [NSMutableData new];
+    NSInputStream *_Nullable stream = self.request.HTTPBodyStream;
+    [stream open];
+    uint8_t buffer[4096];
+    NSInteger length;
+    while ((length = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+        [body appendBytes:buffer length:(NSUInteger)length];
+    }
+    [stream close];
+    return body;
+}
+
+- (void)startLoading
+{
+    NSString *contentRange = [self.request valueForHTTPHeaderField:@"Content-Range"] ?: @"";
+    NSData *body = [self requestBody];
+
+    NSInteger statusCode;
+    NSDictionary<NSString *, NSString *> *headers = @{};
+    BOOL shouldDrop = NO;
+    @synchronized([self class]) {
+        [gStubContentRanges addObject:contentRange];
+        gStubReceivedBodyLength += body.length;
+
+        if (gStubFailureStatusCode != 0) {
+            statusCode = gStubFailureStatusCode;
+        } else if (gStubDropAfterLength > 0 && body.length > gStubDropAfterLength) {
+            body = [body subdataWithRange:NSMakeRange(0, gStubDropAfterLength)];
+            gStubDropAfterLength = 0;
+            shouldDrop = YES;
+            statusCode = 0;
+        } else {
+            statusCode = 200;
+        }
+
+        if (statusCode == 200 || shouldDrop) {
+            unsigned long long start = 0;
+            unsigned long long total = 0;
+            NSScanner *scanner = [NSScanner scannerWithString:contentRange];
+            BOOL isQuery = [contentRange hasPrefix:@"bytes */"];
+            BOOL isChunk = !isQuery && [scanner scanString:@"bytes " intoString:NULL]
+                && [scanner scanUnsignedLongLong:&start] && [scanner scanString:@"-" intoString:NULL];
+            if (isChunk) {
+                [scanner scanUpToString:@"/" intoString:NULL];
+                [scanner scanString:@"/" intoString:NULL];
+                [scanner scanUnsignedLongLong:&total];
+            } else if (isQuery) {
+                NSScanner *queryScanner = [NSScanner scannerWithString:[contentRange substringFromIndex:8]];
+                [queryScanner scanUnsignedLongLong:&total];
+            }
+
+            if (!gStubIsResumable) {
+                [gStubStoredData setData:body];
+            } else if (isQuery) {
+                statusCode = gStubStoredData.length < total ? 308 : 200;
+            } else if (isChunk && start != gStubStoredData.length) {
+                statusCode = 416;
+            } else {
+                if (!isChunk) {
+                    [gStubStoredData setLength:0];
+                    total = body.length;
+                }
+                [gStubStoredData appendData:body];
+                statusCode = (isChunk && gStubStoredData.length < total) ? 308 : 200;
+            }
+
+            if (statusCode == 308 && gStubStoredData.length > 0) {
+                headers = @{
+                    @"Range" : [NSString stringWithFormat:@"bytes=0-%lu", (unsigned long)gStubStoredData.length - 1],
+                };
+            }
+        }
+    }
+
+    if (shouldDrop) {
+        [self.client URLProtocol:self
+                didFailWithError:[NSError errorWithDomain:NSURLErrorDomain
+                                                     code:NSURLErrorNetworkConnectionLost
+                                                 userInfo:nil]];
+        return;
+    }
+
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL
+                                                              statusCode:statusCode
+                                                             HTTPVersion:@"HTTP/1.1"
+                                                            headerFields:headers];
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    [self.client URLProtocol:self didLoadData:[NSData new]];
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading
+{
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSResumableUploadTest : XCTestCase
+
+@property (nonatomic) NSString *filePath;
+@property (nonatomic) NSData *payload;
+@property (nonatomic) NSURL *url;
+
+@end
+
+@implementation OWSResumableUploadTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.filePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    // Deliberately not a multiple of the chunk length.
+    self.payload = [Cryptography generateRandomBytes:100 * 1024 + 17];
+    [self.payload writeToFile:self.filePath atomically:YES];
+    self.url = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@/attachment", kStubHost]];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.filePath error:nil];
+
+    [super tearDown];
+}
+
+- (OWSResumableUpload *)newUpload
+{
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[ [OWSUploadStubProtocol class] ];
+    OWSResumableUpload *upload =
+        [[OWSResumableUpload alloc] initWithFilePath:self.filePath url:self.url sessionConfiguration:configuration];
+    upload.chunkLength = 16 * 1024;
+    return upload;
+}
+
+- (OWSResumableUpload *)newResumableUpload
+{
+    OWSResumableUpload *upload = [self newUpload];
+    upload.allowsResumption = YES;
+    return upload;
+}
+
+// Returns the error, or nil on success.
+- (nullable NSError *)runAttemptOfUpload:(OWSResumableUpload *)upload
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"upload attempt"];
+    __block NSError *_Nullable result;
+    [upload uploadWithProgress:nil
+        success:^{
+            [expectation fulfill];
+        }
+        failure:^(NSError *error) {
+            result = error;
+            [expectation fulfill];
+        }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    return result;
+}
+
+- (void)testUploadsWholeFileInOneRequest
+{
+    [OWSUploadStubProtocol resetWithResumable:YES];
+    OWSResumableUpload *upload = [self newUpload];
+
+    __block double lastProgress = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"upload"];
+    [upload uploadWithProgress:^(double fractionCompleted) {
+        XCTAssertGreaterThanOrEqual(fractionCompleted, lastProgress);
+        lastProgress = fractionCompleted;
+    }
+        success:^{
+            [expectation fulfill];
+        }
+        failure:^(NSError *error) {
+            XCTFail(@"unexpected error: %@", error);
+        }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects([OWSUploadStubProtocol storedData], self.payload);
+    XCTAssertEqualObjects([OWSUploadStubProtocol contentRanges], @[ @"" ]);
+    XCTAssertEqual(upload.acknowledgedOffset, self.payload.length);
+}
+
+- (void)testResumesFromAcknowledgedOffset
+{
+    [OWSUploadStubProtocol resetWithResumable:YES];
+    gStubDropAfterLength = 40 * 1024;
+    OWSResumableUpload *upload = [self newResumableUpload];
+
+    NSError *_Nullable error = [self runAttemptOfUpload:upload];
+    XCTAssertNotNil(error);
+    XCTAssertEqual([OWSUploadStubProtocol storedData].length, 40 * 1024);
+
+    error = [self runAttemptOfUpload:upload];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([OWSUploadStubProtocol storedData], self.payload);
+    XCTAssertTrue(upload.serverSupportsResumption);
+
+    // The retry asks where to resume and then sends only the remainder, in chunks.
+    NSArray<NSString *> *contentRanges = [OWSUploadStubProtocol contentRanges];
+    NSString *expectedQuery = [NSString stringWithFormat:@"bytes */%lu", (unsigned long)self.payload.length];
+    XCTAssertEqualObjects(contentRanges[1], expectedQuery);
+    XCTAssertTrue([contentRanges[2] hasPrefix:@"bytes 40960-57343/"]);
+    XCTAssertEqual(contentRanges.count, 2 + 4);
+    XCTAssertEqual([OWSUploadStubProtocol receivedBodyLength], self.payload.length * 2 - 40 * 1024);
+}
+
+- (void)testResumesAfterInterruptedChunk
+{
+    [OWSUploadStubProtocol resetWithResumable:YES];
+    gStubDropAfterLength = 40 * 1024;
+    OWSResumableUpload *upload = [self newResumableUpload];
+    XCTAssertNotNil([self runAttemptOfUpload:upload]);
+
+    // Drop part of the first resumed chunk too.  The server keeps what it received.
+    gStubDropAfterLength = 1000;
+    XCTAssertNotNil([self runAttemptOfUpload:upload]);
+    XCTAssertEqual([OWSUploadStubProtocol storedData].length, 40 * 1024 + 1000);
+
+    XCTAssertNil([self runAttemptOfUpload:upload]);
+    XCTAssertEqualObjects([OWSUploadStubProtocol storedData], self.payload);
+    XCTAssertTrue([[OWSUploadStubProtocol contentRanges] containsObject:@"bytes 41960-58343/102417"]);
+}
+
+- (void)testReuploadsWholeFileToServerWhichCantResume
+{
+    [OWSUploadStubProtocol resetWithResumable:NO];
+    gStubDropAfterLength = 40 * 1024;
+    OWSResumableUpload *upload = [self newResumableUpload];
+
+    XCTAssertNotNil([self runAttemptOfUpload:upload]);
+    XCTAssertNil([self runAttemptOfUpload:upload]);
+
+    XCTAssertEqualObjects([OWSUploadStubProtocol storedData], self.payload);
+    XCTAssertFalse(upload.serverSupportsResumption);
+    NSArray<NSString *> *contentRanges = [OWSUploadStubProtocol contentRanges];
+    XCTAssertEqual(contentRanges.count, 3);
+    XCTAssertEqualObjects(contentRanges.lastObject, @"");
+}
+
+- (void)testRetriesWholeFileUnlessResumptionAllowed
+{
+    // A plain object store would replace the upload with an empty query PUT, so none may be sent.
+    [OWSUploadStubProtocol resetWithResumable:NO];
+    gStubDropAfterLength = 40 * 1024;
+    OWSResumableUpload *upload = [self newUpload];
+
+    XCTAssertNotNil([self runAttemptOfUpload:upload]);
+    XCTAssertNil([self runAttemptOfUpload:upload]);
+
+    XCTAssertEqualObjects([OWSUploadStubProtocol storedData], self.payload);
+    XCTAssertEqualObjects([OWSUploadStubProtocol contentRanges], (@[ @"", @"" ]));
+}
+
+- (void)testFailureCarriesStatusCode
+{
+    [OWSUploadStubProtocol resetWithResumable:YES];
+    gStubFailureStatusCode = 403;
+    OWSResumableUpload *upload = [self newUpload];
+
+    NSError *_Nullable error = [self runAttemptOfUpload:upload];
+    XCTAssertEqualObjects(error.domain, OWSRelayServiceKitErrorDomain);
+    XCTAssertEqual(error.code, OWSErrorCodeUploadFailed);
+    XCTAssertEqualObjects(error.userInfo[OWSErrorHTTPStatusCodeKey], @403);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,385 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "Cryptography.h"
+#import "OWSSegmentedDownloader.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+static NSString *const kStubHost = @"download-stub.local";
+
+// Returns a status code to fail the request with, or 0 to serve it normally.
+typedef NSInteger (^OWSDownloadStubFailureBlock)(NSString *_Nullable range, NSUInteger attempt);
+
+// A local HTTP stub which serves a single resource, honoring Range requests.
+@interface OWSDownloadStubProtocol : NSURLProtocol
+
+@property (atomic) BOOL isCancelled;
+
+@end
+
+static NSData *gStubPayload;
+static BOOL gStubHonorsRanges;
+static NSTimeInterval gStubResponseDelay;
+static OWSDownloadStubFailureBlock _Nullable gStubFailureBlock;
+static NSMutableArray<NSString *> *gStubServedRanges;
+static NSMutableDictionary<NSString *, NSNumber *> *gStubAttemptsByRange;
+static NSUInteger gStubRequestsInFlight;
+static NSUInteger gStubMaxRequestsInFlight;
+
+@implementation OWSDownloadStubProtocol
+
++ (void)resetWithPayload:(NSData *)payload
+{
+    @synchronized(self) {
+        gStubPayload = payload;
+        gStubHonorsRanges = YES;
+        gStubResponseDelay = 0;
+        gStubFailureBlock = nil;
+        gStubServedRanges = [NSMutableArray new];
+        gStubAttemptsByRange = [NSMutableDictionary new];
+        gStubRequestsInFlight = 0;
+        gStubMaxRequestsInFlight = 0;
+    }
+}
+
++ (NSArray<NSString *> *)servedRanges
+{
+    @synchronized(self) {
+        return [gStubServedRanges copy];
+    }
+}
+
++ (NSUInteger)maxRequestsInFlight
+{
+    @synchronized(self) {
+        return gStubMaxRequestsInFlight;
+    }
+}
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return [request.URL.host isEqualToString:kStubHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    NSString *_Nullable range = [self.request valueForHTTPHeaderField:@"Range"];
+    NSUInteger attempt;
+    OWSDownloadStubFailureBlock _Nullable failureBlock;
+    @synchronized([self class]) {
+        NSString *rangeKey = range ?: @"";
+        attempt = gStubAttemptsByRange[rangeKey].unsignedIntegerValue + 1;
+        gStubAttemptsByRange[rangeKey] = @(attempt);
+        gStubRequestsInFlight++;
+        gStubMaxRequestsInFlight = MAX(gStubMaxRequestsInFlight, gStubRequestsInFlight);
+        failureBlock = gStubFailureBlock;
+    }
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(gStubResponseDelay * NSEC_PER_SEC)),
+        dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+        ^{
+            @synchronized([self class]) {
+                gStubRequestsInFlight--;
+            }
+            if (self.isCancelled) {
+                return;
+            }
+
+            NSInteger failureStatusCode = failureBlock ? failureBlock(range, attempt) : 0;
+            if (failureStatusCode != 0) {
+                [self respondWithStatusCode:failureStatusCode headers:@{} data:[NSData new]];
+                return;
+            }
+
+            NSData *payload = gStubPayload;
+            unsigned long long start = 0;
+            unsigned long long end = 0;
+            NSScanner *scanner = range ? [NSScanner scannerWithString:range] : nil;
+            if (!gStubHonorsRanges || !scanner || ![scanner scanString:@"bytes=" intoString:NULL]
+                || ![scanner scanUnsignedLongLong:&start] || ![scanner scanString:@"-" intoString:NULL]
+                || ![scanner scanUnsignedLongLong:&end]) {
+                @synchronized([self class]) {
+                    [gStubServedRanges addObject:@""];
+                }
+                [self respondWithStatusCode:200
+                                    headers:@{
+                                        @"ETag" : @"\"v1\"",
+                                        @"Content-Length" : [NSString stringWithFormat:@"%lu", (unsigned long)payload.length],
+                                    }
+                                       data:payload];
+                return;
+            }
+
+            end = MIN(end, payload.length - 1);
+            @synchronized([self class]) {
+                [gStubServedRanges addObject:range];
+            }
+            NSData *data = [payload subdataWithRange:NSMakeRange((NSUInteger)start, (NSUInteger)(end - start + 1))];
+            [self respondWithStatusCode:206
+                                headers:@{
+                                    @"ETag" : @"\"v1\"",
+                                    @"Content-Range" : [NSString
+                                        stringWithFormat:@"bytes %llu-%llu/%lu", start, end, (unsigned long)payload.length],
+                                    @"Content-Length" : [NSString stringWithFormat:@"%lu", (unsigned long)data.length],
+                                }
+                                   data:data];
+        });
+}
+
+- (void)respondWithStatusCode:(NSInteger)statusCode headers:(NSDictionary<NSString *, NSString *> *)headers data:(NSData *)data
+{
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL
+                                                              statusCode:statusCode
+                                                             HTTPVersion:@"HTTP/1.1"
+                                                            headerFields:headers];
+    [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    [self.client URLProtocol:self didLoadData:data];
+    [self.client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading
+{
+    self.isCancelled = YES;
+}
+
+@end
+
+#pragma mark -
+
+@interface OWSSegmentedDownloaderTest : XCTestCase
+
+@property (nonatomic) NSString *storageDirectory;
+@property (nonatomic) NSData *payload;
+@property (nonatomic) NSURL *url;
+@property (nonatomic) NSMutableArray<OWSSegmentedDownloader *> *downloaders;
+
+@end
+
+@implementation OWSSegmentedDownloaderTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.storageDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    // Deliberately not a multiple of the segment length.
+    self.payload = [Cryptography generateRandomBytes:100 * 1024 + 17];
+    self.url = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@/attachment", kStubHost]];
+    self.downloaders = [NSMutableArray new];
+
+    [OWSDownloadStubProtocol resetWithPayload:self.payload];
+}
+
+- (void)tearDown
+{
+    for (OWSSegmentedDownloader *downloader in self.downloaders) {
+        [downloader invalidate];
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:self.storageDirectory error:nil];
+
+    [super tearDown];
+}
+
+// Each downloader stands in for a separate launch of the app.
+- (OWSSegmentedDownloader *)newDownloader
+{
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[ [OWSDownloadStubProtocol class] ];
+    OWSSegmentedDownloader *downloader =
+        [[OWSSegmentedDownloader alloc] initWithSessionConfiguration:configuration
+                                                    storageDirectory:self.storageDirectory];
+    downloader.segmentLength = 16 * 1024;
+    downloader.retryBaseInterval = 0.01;
+    [self.downloaders addObject:downloader];
+    return downloader;
+}
+
+- (nullable NSString *)downloadWithDownloader:(OWSSegmentedDownloader *)downloader
+                                   identifier:(NSString *)identifier
+                                        error:(NSError *_Nullable *_Nullable)errorOut
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:identifier];
+    __block NSString *_Nullable result;
+    __block NSError *_Nullable failure;
+    [downloader downloadWithIdentifier:identifier
+        url:self.url
+        progress:nil
+        success:^(NSString *filePath) {
+            result = filePath;
+            [expectation fulfill];
+        }
+        failure:^(NSError *error) {
+            failure = error;
+            [expectation fulfill];
+        }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    if (errorOut) {
+        *errorOut = failure;
+    }
+    return result;
+}
+
+- (void)testSegmentsForContentLength
+{
+    NSArray<OWSDownloadSegment *> *segments = [OWSSegmentedDownloader segmentsForContentLength:10 segmentLength:4];
+    XCTAssertEqual(3, segments.count);
+    XCTAssertEqual(0, segments[0].start);
+    XCTAssertEqual(4, segments[1].start);
+    XCTAssertEqual(8, segments[2].start);
+    XCTAssertEqual(2, segments[2].length);
+    XCTAssertEqualObjects(@"bytes=8-9", segments[2].rangeHeaderValue);
+
+    XCTAssertEqual(1024 * 1024, [OWSSegmentedDownloader segmentLengthForContentLength:5 * 1024 * 1024]);
+    XCTAssertEqual(10 * 1024, [OWSSegmentedDownloader segmentLengthForContentLength:20 * 1024]);
+    XCTAssertEqual(100, [OWSSegmentedDownloader segmentLengthForContentLength:100]);
+}
+
+- (void)testDownloadsInRangedSegments
+{
+    NSString *_Nullable filePath = [self downloadWithDownloader:[self newDownloader] identifier:@"a" error:NULL];
+
+    XCTAssertNotNil(filePath);
+    XCTAssertEqualObjects(self.payload, [NSData dataWithContentsOfFile:filePath]);
+    // 100KB + 17 bytes in 16KB segments.
+    XCTAssertEqual(7, [OWSDownloadStubProtocol servedRanges].count);
+}
+
+- (void)testServerIgnoringRanges
+{
+    gStubHonorsRanges = NO;
+
+    NSString *_Nullable filePath = [self downloadWithDownloader:[self newDownloader] identifier:@"a" error:NULL];
+
+    XCTAssertNotNil(filePath);
+    XCTAssertEqualObjects(self.payload, [NSData dataWithContentsOfFile:filePath]);
+    XCTAssertEqual(1, [OWSDownloadStubProtocol servedRanges].count);
+}
+
+- (void)testRetriesTransientFailures
+{
+    // Every segment fails on its first attempt.
+    gStubFailureBlock = ^NSInteger(NSString *_Nullable range, NSUInteger attempt) {
+        return attempt == 1 ? 503 : 0;
+    };
+
+    NSString *_Nullable filePath = [self downloadWithDownloader:[self newDownloader] identifier:@"a" error:NULL];
+
+    XCTAssertNotNil(filePath);
+    XCTAssertEqualObjects(self.payload, [NSData dataWithContentsOfFile:filePath]);
+}
+
+- (void)testGivesUpAfterMaxAttempts
+{
+    gStubFailureBlock = ^NSInteger(NSString *_Nullable range, NSUInteger attempt) {
+        return 500;
+    };
+
+    OWSSegmentedDownloader *downloader = [self newDownloader];
+    downloader.maxAttemptsPerSegment = 3;
+    NSError *_Nullable error;
+    NSString *_Nullable filePath = [self downloadWithDownloader:downloader identifier:@"a" error:&error];
+
+    XCTAssertNil(filePath);
+    XCTAssertNotNil(error);
+    XCTAssertEqual(3, [gStubAttemptsByRange[@"bytes=0-16383"] unsignedIntegerValue]);
+}
+
+- (void)testClientErrorsAreNotRetried
+{
+    gStubFailureBlock = ^NSInteger(NSString *_Nullable range, NSUInteger attempt) {
+        return 403;
+    };
+
+    NSError *_Nullable error;
+    NSString *_Nullable filePath = [self downloadWithDownloader:[self newDownloader] identifier:@"a" error:&error];
+
+    XCTAssertNil(filePath);
+    XCTAssertNotNil(error);
+    XCTAssertEqual(1, [gStubAttemptsByRange[@"bytes=0-16383"] unsignedIntegerValue]);
+}
+
+- (void)testResumesAfterRelaunch
+{
+    // The first "launch" loses its connection (e.g. the signed URL expires) after three segments.
+    __block NSUInteger servedCount = 0;
+    gStubFailureBlock = ^NSInteger(NSString *_Nullable range, NSUInteger attempt) {
+        @synchronized([OWSDownloadStubProtocol class]) {
+            servedCount++;
+            return servedCount > 3 ? 403 : 0;
+        }
+    };
+    OWSSegmentedDownloader *firstDownloader = [self newDownloader];
+    firstDownloader.maxConcurrentRequests = 1;
+    NSError *_Nullable error;
+    XCTAssertNil([self downloadWithDownloader:firstDownloader identifier:@"a" error:&error]);
+    XCTAssertNotNil(error);
+    [firstDownloader invalidate];
+
+    NSArray<NSString *> *rangesBeforeRelaunch = [OWSDownloadStubProtocol servedRanges];
+    XCTAssertEqual(3, rangesBeforeRelaunch.count);
+
+    gStubFailureBlock = nil;
+    NSString *_Nullable filePath = [self downloadWithDownloader:[self newDownloader] identifier:@"a" error:NULL];
+
+    XCTAssertNotNil(filePath);
+    XCTAssertEqualObjects(self.payload, [NSData dataWithContentsOfFile:filePath]);
+    NSArray<NSString *> *rangesAfterRelaunch = [[OWSDownloadStubProtocol servedRanges]
+        subarrayWithRange:NSMakeRange(rangesBeforeRelaunch.count,
+                              [OWSDownloadStubProtocol servedRanges].count - rangesBeforeRelaunch.count)];
+    // Only the missing segments were requested.
+    XCTAssertEqual(4, rangesAfterRelaunch.count);
+    for (NSString *range in rangesBeforeRelaunch) {
+        XCTAssertFalse([rangesAfterRelaunch containsObject:range]);
+    }
+}
+
+- (void)testRemoveDownloadDiscardsProgress
+{
+    OWSSegmentedDownloader *downloader = [self newDownloader];
+    XCTAssertNotNil([self downloadWithDownloader:downloader identifier:@"a" error:NULL]);
+    [downloader removeDownloadWithIdentifier:@"a"];
+
+    XCTAssertNotNil([self downloadWithDownloader:downloader identifier:@"a" error:NULL]);
+    XCTAssertEqual(14, [OWSDownloadStubProtocol servedRanges].count);
+}
+
+- (void)testBoundsConcurrentRequests
+{
+    gStubResponseDelay = 0.02;
+    OWSSegmentedDownloader *downloader = [self newDownloader];
+    downloader.maxConcurrentRequests = 3;
+    downloader.maxConcurrentRequestsPerDownload = 2;
+
+    for (NSString *identifier in @[ @"a", @"b", @"c" ]) {
+        XCTestExpectation *expectation = [self expectationWithDescription:identifier];
+        [downloader downloadWithIdentifier:identifier
+            url:self.url
+            progress:nil
+            success:^(NSString *filePath) {
+                XCTAssertEqualObjects(self.payload, [NSData dataWithContentsOfFile:filePath]);
+                [expectation fulfill];
+            }
+            failure:^(NSError *error) {
+                XCTFail(@"Unexpected failure: %@", error);
+                [expectation fulfill];
+            }];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertLessThanOrEqual([OWSDownloadStubProtocol maxRequestsInFlight], 3);
+    // Parallelism should actually have been used.
+    XCTAssertGreaterThan([OWSDownloadStubProtocol maxRequestsInFlight], 1);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
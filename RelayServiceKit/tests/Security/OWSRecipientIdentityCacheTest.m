@@ -0,0 +1,273 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSIdentityManager.h"
+#import "OWSPrimaryStorage.h"
+#import "OWSRecipientIdentity.h"
+#import "OWSRecipientIdentityCache.h"
+#import "TSAccountManager.h"
+#import <XCTest/XCTest.h>
+#import <YapDatabase/YapDatabase.h>
+
+@import SignalCoreKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSRecipientIdentityCache (Testing)
+
+@property (nonatomic, readonly) dispatch_queue_t completionQueue;
+
+@end
+
+#pragma mark -
+
+@interface TSAccountManager (Testing)
+
+- (void)storeLocalUID:(NSString *)localUID;
+
+@end
+
+#pragma mark -
+
+@interface OWSIdentityManager (Testing)
+
+- (nullable NSData *)identityKeyForRecipientId:(NSString *)recipientId protocolContext:(nullable id)protocolContext;
+
+- (BOOL)saveRemoteIdentity:(NSData *)identityKey
+               recipientId:(NSString *)recipientId
+           protocolContext:(nullable id)protocolContext;
+
+- (BOOL)isTrustedIdentityKey:(NSData *)identityKey
+                 recipientId:(NSString *)recipientId
+                   direction:(TSMessageDirection)direction
+             protocolContext:(nullable id)protocolContext;
+
+@end
+
+#pragma mark -
+
+@interface OWSRecipientIdentityCacheTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+@property (nonatomic) OWSRecipientIdentityCache *cache;
+
+@end
+
+#pragma mark -
+
+@implementation OWSRecipientIdentityCacheTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    // Key changes are recorded in the thread with the local user.
+    [[TSAccountManager sharedInstance] storeLocalUID:@"local-recipient"];
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    self.cache = OWSRecipientIdentityCache.sharedCache;
+    self.cache.isEnabled = YES;
+    [OWSRecipientIdentity removeAllObjectsInCollection];
+}
+
+- (void)tearDown
+{
+    self.cache.isEnabled = YES;
+    [self.cache removeAllRecipientIdentities];
+
+    [super tearDown];
+}
+
+- (NSData *)newIdentityKey
+{
+    return [Randomness generateRandomBytes:32];
+}
+
+// Waits for the completions of the transactions so far to write through to the cache.
+- (void)waitForWriteThrough
+{
+    dispatch_sync(self.cache.completionQueue, ^{
+    });
+}
+
+#pragma mark - Coherence
+
+- (void)testSavedIdentityIsSeenAtOnce
+{
+    OWSIdentityManager *identityManager = [OWSIdentityManager sharedManager];
+    XCTAssertNil([identityManager identityKeyForRecipientId:@"recipient"]);
+
+    NSData *identityKey = [self newIdentityKey];
+    [identityManager saveRemoteIdentity:identityKey recipientId:@"recipient"];
+    // Whether or not the write has reached the cache yet.
+    XCTAssertEqualObjects([identityManager identityKeyForRecipientId:@"recipient"], identityKey);
+
+    [self waitForWriteThrough];
+    XCTAssertEqualObjects([identityManager identityKeyForRecipientId:@"recipient"], identityKey);
+
+    NSData *otherIdentityKey = [self newIdentityKey];
+    [identityManager saveRemoteIdentity:otherIdentityKey recipientId:@"recipient"];
+    XCTAssertEqualObjects([identityManager identityKeyForRecipientId:@"recipient"], otherIdentityKey);
+}
+
+- (void)testVerificationStateIsSeenAtOnce
+{
+    OWSIdentityManager *identityManager = [OWSIdentityManager sharedManager];
+    NSData *identityKey = [self newIdentityKey];
+    [identityManager saveRemoteIdentity:identityKey recipientId:@"recipient"];
+    [self waitForWriteThrough];
+    XCTAssertEqual([identityManager verificationStateForRecipientId:@"recipient"], OWSVerificationStateDefault);
+
+    [identityManager setVerificationState:OWSVerificationStateVerified
+                              identityKey:identityKey
+                              recipientId:@"recipient"
+                    isUserInitiatedChange:NO];
+    XCTAssertEqual([identityManager verificationStateForRecipientId:@"recipient"], OWSVerificationStateVerified);
+
+    // A new key for a verified recipient isn't trusted for sending.
+    [identityManager saveRemoteIdentity:[self newIdentityKey] recipientId:@"recipient"];
+    XCTAssertEqual(
+        [identityManager verificationStateForRecipientId:@"recipient"], OWSVerificationStateNoLongerVerified);
+    XCTAssertNotNil([identityManager untrustedIdentityForSendingToRecipientId:@"recipient"]);
+}
+
+- (void)testWritesAreCachedOnceCommitted
+{
+    OWSRecipientIdentity *recipientIdentity = [[OWSRecipientIdentity alloc] initWithRecipientId:@"recipient"
+                                                                                   identityKey:[self newIdentityKey]
+                                                                               isFirstKnownKey:YES
+                                                                                     createdAt:[NSDate new]
+                                                                             verificationState:OWSVerificationStateDefault];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [recipientIdentity saveWithTransaction:transaction];
+    }];
+    [self waitForWriteThrough];
+
+    // Removed behind the cache's back, so the cached copy is still found.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeObjectForKey:@"recipient" inCollection:[OWSRecipientIdentity collection]];
+    }];
+    OWSRecipientIdentity *_Nullable cachedIdentity =
+        [self.cache recipientIdentityForRecipientId:@"recipient" dbConnection:self.dbConnection];
+    XCTAssertEqualObjects(cachedIdentity.identityKey, recipientIdentity.identityKey);
+    // Not the instance which was saved, which its owner may go on to change.
+    XCTAssertNotEqual(cachedIdentity, recipientIdentity);
+
+    self.cache.isEnabled = NO;
+    XCTAssertNil([self.cache recipientIdentityForRecipientId:@"recipient" dbConnection:self.dbConnection]);
+}
+
+- (void)testRemovalIsSeen
+{
+    OWSIdentityManager *identityManager = [OWSIdentityManager sharedManager];
+    [identityManager saveRemoteIdentity:[self newIdentityKey] recipientId:@"recipient"];
+    [self waitForWriteThrough];
+    XCTAssertNotNil([identityManager recipientIdentityForRecipientId:@"recipient"]);
+
+    [OWSRecipientIdentity removeAllObjectsInCollection];
+    XCTAssertNil([identityManager recipientIdentityForRecipientId:@"recipient"]);
+
+    [identityManager saveRemoteIdentity:[self newIdentityKey] recipientId:@"recipient"];
+    [self waitForWriteThrough];
+    [[identityManager recipientIdentityForRecipientId:@"recipient"] remove];
+    XCTAssertNil([identityManager recipientIdentityForRecipientId:@"recipient"]);
+}
+
+// e.g. resetting the app's data with -removeAllObjectsInAllCollections.
+- (void)testRemovalOfEveryIdentityIsSeen
+{
+    OWSIdentityManager *identityManager = [OWSIdentityManager sharedManager];
+    [identityManager saveRemoteIdentity:[self newIdentityKey] recipientId:@"recipient"];
+    [self waitForWriteThrough];
+    XCTAssertNotNil([identityManager recipientIdentityForRecipientId:@"recipient"]);
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeAllObjectsInCollection:[OWSRecipientIdentity collection]];
+        [self.cache didRemoveAllRecipientIdentitiesWithTransaction:transaction];
+        XCTAssertNil([self.cache recipientIdentityForRecipientId:@"recipient" transaction:transaction]);
+    }];
+    XCTAssertNil([identityManager recipientIdentityForRecipientId:@"recipient"]);
+
+    [self waitForWriteThrough];
+    XCTAssertNil([identityManager recipientIdentityForRecipientId:@"recipient"]);
+    XCTAssertEqual([identityManager verificationStateForRecipientId:@"recipient"], OWSVerificationStateDefault);
+}
+
+- (void)testLookupsInWriteTransactionSeeItsWrites
+{
+    OWSIdentityManager *identityManager = [OWSIdentityManager sharedManager];
+    NSData *identityKey = [self newIdentityKey];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        XCTAssertNil([identityManager identityKeyForRecipientId:@"recipient" protocolContext:transaction]);
+        [identityManager saveRemoteIdentity:identityKey recipientId:@"recipient" protocolContext:transaction];
+        XCTAssertEqualObjects(
+            [identityManager identityKeyForRecipientId:@"recipient" protocolContext:transaction], identityKey);
+    }];
+}
+
+#pragma mark - Benchmarks
+
+// Checks trust for every device of every recipient, with a transaction per device, like a group send; and for
+// every recipient beforehand, like MessageSender.
+- (NSTimeInterval)timeToCheckTrustWithRecipientIds:(NSArray<NSString *> *)recipientIds
+                                      identityKeys:(NSArray<NSData *> *)identityKeys
+                                       deviceCount:(int)deviceCount
+{
+    OWSIdentityManager *identityManager = [OWSIdentityManager sharedManager];
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < recipientIds.count; i++) {
+        XCTAssertNil([identityManager untrustedIdentityForSendingToRecipientId:recipientIds[i]]);
+        for (int deviceId = 1; deviceId <= deviceCount; deviceId++) {
+            [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+                XCTAssertTrue([identityManager isTrustedIdentityKey:identityKeys[i]
+                                                        recipientId:recipientIds[i]
+                                                          direction:TSMessageDirectionOutgoing
+                                                    protocolContext:transaction]);
+            }];
+        }
+    }
+    return CFAbsoluteTimeGetCurrent() - startTime;
+}
+
+- (void)testBenchmarkTrustChecksForLargeGroup
+{
+    const NSUInteger recipientCount = 500;
+    const int deviceCount = 3;
+
+    NSMutableArray<NSString *> *recipientIds = [NSMutableArray new];
+    NSMutableArray<NSData *> *identityKeys = [NSMutableArray new];
+    for (NSUInteger i = 0; i < recipientCount; i++) {
+        [recipientIds addObject:[NSString stringWithFormat:@"recipient-%lu", (unsigned long)i]];
+        [identityKeys addObject:[self newIdentityKey]];
+    }
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < recipientCount; i++) {
+            [[OWSIdentityManager sharedManager] saveRemoteIdentity:identityKeys[i]
+                                                       recipientId:recipientIds[i]
+                                                   protocolContext:transaction];
+        }
+    }];
+    [self waitForWriteThrough];
+
+    self.cache.isEnabled = NO;
+    NSTimeInterval uncachedTime =
+        [self timeToCheckTrustWithRecipientIds:recipientIds identityKeys:identityKeys deviceCount:deviceCount];
+
+    self.cache.isEnabled = YES;
+    [self.cache removeAllRecipientIdentities];
+    // Warm the cache, as the first of several sends to a group would.
+    [self timeToCheckTrustWithRecipientIds:recipientIds identityKeys:identityKeys deviceCount:deviceCount];
+    NSTimeInterval cachedTime =
+        [self timeToCheckTrustWithRecipientIds:recipientIds identityKeys:identityKeys deviceCount:deviceCount];
+
+    NSLog(@"%@ checking trust for %lu recipients x %d devices: uncached %.2fs, cached %.2fs.",
+        self.logTag,
+        (unsigned long)recipientCount,
+        deviceCount,
+        uncachedTime,
+        cachedTime);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,243 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSIncrementalOrphanedDataCleaner.h"
+#import "OWSOrphanedDataCleaner.h"
+#import "OWSPrimaryStorage.h"
+#import "TSAttachmentStream.h"
+#import "TSIncomingMessage.h"
+#import "TSThread.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSIncrementalOrphanedDataCleaner (Testing)
+
+@property (nonatomic) NSUInteger chunkSize;
+@property (nonatomic) NSTimeInterval chunkInterval;
+@property (nonatomic) NSTimeInterval minimumOrphanAge;
+
+@end
+
+#pragma mark -
+
+@interface OWSIncrementalOrphanedDataCleanerTest : XCTestCase
+
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+
+// Labels of everything the fixture created: message bodies, attachment source filenames and file paths.
+@property (nonatomic) NSMutableDictionary<NSString *, NSString *> *fileLabels;
+
+@end
+
+#pragma mark -
+
+@implementation OWSIncrementalOrphanedDataCleanerTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.dbConnection = [OWSPrimaryStorage sharedManager].newDatabaseConnection;
+    [self removeEverything];
+}
+
+- (void)removeEverything
+{
+    [TSAttachmentStream deleteAttachments];
+    [TSAttachmentStream removeAllObjectsInCollection];
+    [TSInteraction removeAllObjectsInCollection];
+    [TSThread removeAllObjectsInCollection];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeAllObjectsInCollection:@"OWSIncrementalOrphanedDataCleanerCollection"];
+    }];
+    self.fileLabels = [NSMutableDictionary new];
+}
+
+- (TSAttachmentStream *)saveAttachmentWithLabel:(NSString *)label transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    TSAttachmentStream *attachmentStream =
+        [[TSAttachmentStream alloc] initWithContentType:@"image/jpeg" byteCount:0 sourceFilename:label];
+    NSError *error;
+    [attachmentStream writeData:[NSData new] error:&error];
+    XCTAssertNil(error);
+    self.fileLabels[attachmentStream.filePath] = label;
+    [attachmentStream saveWithTransaction:transaction];
+    return attachmentStream;
+}
+
+- (void)saveMessageWithLabel:(NSString *)label
+                   timestamp:(uint64_t)timestamp
+                    inThread:(TSThread *)thread
+               attachmentIds:(NSArray<NSString *> *)attachmentIds
+                 transaction:(YapDatabaseReadWriteTransaction *)transaction
+{
+    TSIncomingMessage *message = [[TSIncomingMessage alloc] initIncomingMessageWithTimestamp:timestamp
+                                                                                   serverAge:nil
+                                                                                    inThread:thread
+                                                                                    authorId:@"fake-author-id"
+                                                                              sourceDeviceId:1
+                                                                                 messageBody:label
+                                                                               attachmentIds:attachmentIds
+                                                                            expiresInSeconds:0
+                                                                               quotedMessage:nil];
+    [message saveWithTransaction:transaction];
+}
+
+// Messages with and without threads, with and without attachments, some sharing timestamps; attachments with
+// and without messages; and files without attachments.
+- (void)populateFixture
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        TSThread *thread = [TSThread getOrCreateThreadWithId:@"live-thread" transaction:transaction];
+        TSThread *deletedThread = [[TSThread alloc] initWithUniqueId:@"deleted-thread"];
+
+        for (NSUInteger i = 0; i < 20; i++) {
+            NSArray<NSString *> *attachmentIds = @[];
+            if (i % 2 == 0) {
+                NSString *label = [NSString stringWithFormat:@"live-attachment-%lu", (unsigned long)i];
+                attachmentIds = @[ [self saveAttachmentWithLabel:label transaction:transaction].uniqueId ];
+            }
+            [self saveMessageWithLabel:[NSString stringWithFormat:@"live-message-%lu", (unsigned long)i]
+                             timestamp:i / 3
+                              inThread:thread
+                         attachmentIds:attachmentIds
+                           transaction:transaction];
+        }
+        for (NSUInteger i = 0; i < 7; i++) {
+            NSString *label = [NSString stringWithFormat:@"orphan-message-attachment-%lu", (unsigned long)i];
+            TSAttachmentStream *attachmentStream = [self saveAttachmentWithLabel:label transaction:transaction];
+            [self saveMessageWithLabel:[NSString stringWithFormat:@"orphan-message-%lu", (unsigned long)i]
+                             timestamp:i
+                              inThread:deletedThread
+                         attachmentIds:@[ attachmentStream.uniqueId ]
+                           transaction:transaction];
+        }
+        for (NSUInteger i = 0; i < 9; i++) {
+            [self saveAttachmentWithLabel:[NSString stringWithFormat:@"orphan-attachment-%lu", (unsigned long)i]
+                              transaction:transaction];
+        }
+    }];
+
+    for (NSUInteger i = 0; i < 5; i++) {
+        // Intentionally not saved, because we want lingering files.
+        TSAttachmentStream *attachmentStream =
+            [[TSAttachmentStream alloc] initWithContentType:@"image/jpeg" byteCount:0 sourceFilename:nil];
+        NSError *error;
+        [attachmentStream writeData:[NSData new] error:&error];
+        XCTAssertNil(error);
+        self.fileLabels[attachmentStream.filePath] = [NSString stringWithFormat:@"orphan-file-%lu", (unsigned long)i];
+    }
+}
+
+- (NSSet<NSString *> *)survivingLabels
+{
+    NSMutableSet<NSString *> *labels = [NSMutableSet new];
+    [self.dbConnection readWithBlock:^(YapDatabaseReadTransaction *transaction) {
+        [transaction enumerateKeysAndObjectsInCollection:[TSInteraction collection]
+                                              usingBlock:^(NSString *key, TSIncomingMessage *message, BOOL *stop) {
+                                                  [labels addObject:message.body];
+                                              }];
+        [transaction enumerateKeysAndObjectsInCollection:[TSAttachment collection]
+                                              usingBlock:^(NSString *key, TSAttachment *attachment, BOOL *stop) {
+                                                  [labels addObject:[@"db:" stringByAppendingString:attachment.sourceFilename]];
+                                              }];
+    }];
+    for (NSString *filePath in [OWSOrphanedDataCleaner filePathsInAttachmentsFolder]) {
+        NSString *_Nullable label = self.fileLabels[filePath];
+        XCTAssertNotNil(label);
+        [labels addObject:[@"file:" stringByAppendingString:label ?: filePath]];
+    }
+    return labels;
+}
+
+- (void)runFullScan
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Cleanup"];
+    [OWSOrphanedDataCleaner auditAndCleanupAsync:^{
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+// Each run uses a new cleaner, so the cycle only makes progress through the state it saves.
+- (NSUInteger)runIncrementalCleanupWithChunkSize:(NSUInteger)chunkSize minimumOrphanAge:(NSTimeInterval)minimumOrphanAge
+{
+    NSUInteger runCount = 0;
+    __block BOOL isCycleComplete = NO;
+    while (!isCycleComplete && runCount < 1000) {
+        OWSIncrementalOrphanedDataCleaner *cleaner =
+            [[OWSIncrementalOrphanedDataCleaner alloc] initWithPrimaryStorage:[OWSPrimaryStorage sharedManager]];
+        cleaner.chunkSize = chunkSize;
+        cleaner.chunkInterval = 0;
+        cleaner.minimumOrphanAge = minimumOrphanAge;
+
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Run"];
+        // Only one chunk per run.
+        [cleaner runWithTimeBudget:0
+                        completion:^(BOOL complete) {
+                            isCycleComplete = complete;
+                            [expectation fulfill];
+                        }];
+        [self waitForExpectationsWithTimeout:5.0 handler:nil];
+        runCount++;
+    }
+    XCTAssertTrue(isCycleComplete);
+    return runCount;
+}
+
+- (void)testShortRunsMatchFullScan
+{
+    [self populateFixture];
+    // The full scan may leave an orphan message's attachments, and their files, to later passes.
+    [self runFullScan];
+    [self runFullScan];
+    [self runFullScan];
+    NSSet<NSString *> *fullScanLabels = [self survivingLabels];
+
+    [self removeEverything];
+    [self populateFixture];
+    NSUInteger runCount = [self runIncrementalCleanupWithChunkSize:3 minimumOrphanAge:0];
+    NSSet<NSString *> *incrementalLabels = [self survivingLabels];
+
+    XCTAssertGreaterThan(runCount, 10);
+    XCTAssertEqualObjects(incrementalLabels, fullScanLabels);
+
+    for (NSString *label in incrementalLabels) {
+        XCTAssertFalse([label containsString:@"orphan"], @"%@", label);
+    }
+    // 20 messages, 10 attachments and their files.
+    XCTAssertEqual(incrementalLabels.count, 40);
+}
+
+- (void)testChunkSizeDoesNotChangeResult
+{
+    [self populateFixture];
+    [self runIncrementalCleanupWithChunkSize:1000 minimumOrphanAge:0];
+    NSSet<NSString *> *oneChunkLabels = [self survivingLabels];
+
+    for (NSUInteger chunkSize = 1; chunkSize <= 4; chunkSize++) {
+        [self removeEverything];
+        [self populateFixture];
+        [self runIncrementalCleanupWithChunkSize:chunkSize minimumOrphanAge:0];
+        XCTAssertEqualObjects([self survivingLabels], oneChunkLabels, @"chunkSize: %lu", (unsigned long)chunkSize);
+    }
+}
+
+- (void)testRecentOrphansAreKept
+{
+    [self populateFixture];
+    [self runIncrementalCleanupWithChunkSize:3 minimumOrphanAge:60];
+    NSSet<NSString *> *labels = [self survivingLabels];
+
+    // Messages without threads don't depend on age.
+    XCTAssertFalse([labels containsObject:@"orphan-message-0"]);
+    XCTAssertTrue([labels containsObject:@"db:orphan-attachment-0"]);
+    XCTAssertTrue([labels containsObject:@"file:orphan-attachment-0"]);
+    XCTAssertTrue([labels containsObject:@"file:orphan-file-0"]);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,70 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSPrimaryStorage+PreKeyStore.h"
+#import <AxolotlKit/PreKeyRecord.h>
+#import <XCTest/XCTest.h>
+#import <YapDatabase/YapDatabase.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface OWSPrimaryStoragePreKeyReserveTest : XCTestCase
+
+@property (nonatomic) OWSPrimaryStorage *primaryStorage;
+
+@end
+
+#pragma mark -
+
+@implementation OWSPrimaryStoragePreKeyReserveTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.primaryStorage = [OWSPrimaryStorage sharedManager];
+    [self.primaryStorage.dbReadWriteConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction removeAllObjectsInCollection:@"OWSPrimaryStoragePreKeyReserveCollection"];
+    }];
+}
+
+- (void)testTakingPreKeysEmptiesTheReserve
+{
+    [self.primaryStorage replenishPreKeyReserve];
+    NSUInteger reservedPreKeyCount = [self.primaryStorage reservedPreKeyCount];
+    XCTAssertGreaterThan(reservedPreKeyCount, 0);
+
+    NSArray<PreKeyRecord *> *preKeys = [self.primaryStorage takePreKeyRecordsForUpload];
+    XCTAssertEqual(preKeys.count, reservedPreKeyCount);
+    XCTAssertEqual([self.primaryStorage reservedPreKeyCount], 0);
+    for (PreKeyRecord *preKey in preKeys) {
+        XCTAssertNotNil([self.primaryStorage loadPreKey:preKey.Id]);
+    }
+}
+
+- (void)testTakingPreKeysWithoutAReserve
+{
+    NSArray<PreKeyRecord *> *preKeys = [self.primaryStorage takePreKeyRecordsForUpload];
+    XCTAssertGreaterThan(preKeys.count, 0);
+    XCTAssertEqual([self.primaryStorage reservedPreKeyCount], 0);
+}
+
+- (void)testUsingPreKeysIsCounted
+{
+    NSArray<PreKeyRecord *> *preKeys = [self.primaryStorage takePreKeyRecordsForUpload];
+    [self.primaryStorage markPreKeyRecordsAsUploaded:preKeys];
+    XCTAssertEqualObjects([self.primaryStorage unconsumedUploadedPreKeyCount], @(preKeys.count));
+
+    [self.primaryStorage removePreKey:preKeys.firstObject.Id];
+    [self.primaryStorage removePreKey:preKeys.lastObject.Id];
+    XCTAssertEqualObjects([self.primaryStorage unconsumedUploadedPreKeyCount], @(preKeys.count - 2));
+
+    // Removing a prekey which wasn't uploaded doesn't change the count.
+    [self.primaryStorage removePreKey:preKeys.lastObject.Id];
+    XCTAssertEqualObjects([self.primaryStorage unconsumedUploadedPreKeyCount], @(preKeys.count - 2));
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,320 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSIdentityManager.h"
+#import "OWSPrimaryStorage+SessionStore.h"
+#import "OWSSessionStoreCache.h"
+#import <AxolotlKit/NSData+keyVersionByte.h>
+#import <AxolotlKit/PreKeyBundle.h>
+#import <AxolotlKit/PreKeyWhisperMessage.h>
+#import <AxolotlKit/SessionBuilder.h>
+#import <AxolotlKit/SessionCipher.h>
+#import <AxolotlKit/SessionRecord.h>
+#import <AxolotlKit/WhisperMessage.h>
+#import <Curve25519Kit/Curve25519.h>
+#import <Curve25519Kit/Ed25519.h>
+#import <XCTest/XCTest.h>
+#import <YapDatabase/YapDatabase.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern NSString *const OWSPrimaryStorageSessionStoreCollection;
+
+@interface OWSPrimaryStorage (SessionStoreTesting)
+
++ (OWSSessionStoreCache *)sessionStoreCache;
+
+@end
+
+#pragma mark -
+
+@interface OWSSessionStoreCache (Testing)
+
+@property (nonatomic, readonly) NSMutableOrderedSet<NSString *> *recipientIdsByRecency;
+
+@end
+
+#pragma mark -
+
+@interface OWSSessionStoreCacheTest : XCTestCase
+
+@property (nonatomic) OWSPrimaryStorage *primaryStorage;
+@property (nonatomic) YapDatabaseConnection *dbConnection;
+
+@end
+
+#pragma mark -
+
+@implementation OWSSessionStoreCacheTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.primaryStorage = [OWSPrimaryStorage sharedManager];
+    self.dbConnection = self.primaryStorage.newDatabaseConnection;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [self.primaryStorage resetSessionStore:transaction];
+    }];
+    OWSPrimaryStorage.sessionStoreCache.isEnabled = YES;
+}
+
+- (void)tearDown
+{
+    OWSPrimaryStorage.sessionStoreCache.isEnabled = YES;
+    [OWSPrimaryStorage.sessionStoreCache removeAllRecipients];
+
+    [super tearDown];
+}
+
+- (NSData *)dataForSession:(nullable SessionRecord *)session
+{
+    XCTAssertNotNil(session);
+    return [NSKeyedArchiver archivedDataWithRootObject:session];
+}
+
+- (void)testStoredSessionsAreWrittenWhenFlushed
+{
+    SessionRecord *session = [SessionRecord new];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [self.primaryStorage storeSession:@"recipient" deviceId:1 session:session protocolContext:transaction];
+
+        XCTAssertNil([transaction objectForKey:@"recipient" inCollection:OWSPrimaryStorageSessionStoreCollection]);
+        SessionRecord *loadedSession =
+            [self.primaryStorage loadSession:@"recipient" deviceId:1 protocolContext:transaction];
+        // A copy, so that changes the caller doesn't store never reach the cache.
+        XCTAssertNotEqual(loadedSession, session);
+        XCTAssertEqualObjects([self dataForSession:loadedSession], [self dataForSession:session]);
+
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+
+        NSDictionary *deviceSessions =
+            [transaction objectForKey:@"recipient" inCollection:OWSPrimaryStorageSessionStoreCollection];
+        XCTAssertEqualObjects(deviceSessions.allKeys, @[ @(1) ]);
+    }];
+
+    // Later transactions use the cached record.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        XCTAssertEqualObjects(
+            [self dataForSession:[self.primaryStorage loadSession:@"recipient" deviceId:1 protocolContext:transaction]],
+            [self dataForSession:session]);
+    }];
+}
+
+- (void)testWritesWhichBypassTheCacheAreSeen
+{
+    SessionRecord *session = [SessionRecord new];
+    SessionRecord *otherSession = [SessionRecord new];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [self.primaryStorage storeSession:@"recipient" deviceId:1 session:session protocolContext:transaction];
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+    }];
+
+    // e.g. from another process.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [transaction setObject:@{ @(1) : otherSession }
+                        forKey:@"recipient"
+                  inCollection:OWSPrimaryStorageSessionStoreCollection];
+    }];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        SessionRecord *loadedSession =
+            [self.primaryStorage loadSession:@"recipient" deviceId:1 protocolContext:transaction];
+        XCTAssertEqualObjects([self dataForSession:loadedSession], [self dataForSession:otherSession]);
+    }];
+}
+
+- (void)testDeletingFlushesFirst
+{
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        [self.primaryStorage storeSession:@"recipient"
+                                 deviceId:1
+                                  session:[SessionRecord new]
+                          protocolContext:transaction];
+        [self.primaryStorage storeSession:@"recipient"
+                                 deviceId:2
+                                  session:[SessionRecord new]
+                          protocolContext:transaction];
+        [self.primaryStorage deleteSessionForContact:@"recipient" deviceId:1 protocolContext:transaction];
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+    }];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        NSDictionary *deviceSessions =
+            [transaction objectForKey:@"recipient" inCollection:OWSPrimaryStorageSessionStoreCollection];
+        XCTAssertEqualObjects(deviceSessions.allKeys, @[ @(2) ]);
+    }];
+}
+
+- (void)testCacheIsBoundedByRecipientCount
+{
+    OWSSessionStoreCache *cache = [[OWSSessionStoreCache alloc] initWithCollection:OWSPrimaryStorageSessionStoreCollection
+                                                                 maxRecipientCount:2];
+    NSMutableDictionary<NSString *, SessionRecord *> *sessions = [NSMutableDictionary new];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSString *recipientId in @[ @"a", @"b", @"c" ]) {
+            sessions[recipientId] = [SessionRecord new];
+            [cache storeSession:sessions[recipientId] forRecipientId:recipientId deviceId:1 transaction:transaction];
+        }
+        [cache flushWithTransaction:transaction];
+    }];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        // Only the two most recently used recipients are still cached.
+        XCTAssertEqualObjects(cache.recipientIdsByRecency.array, (@[ @"b", @"c" ]));
+        // The least recently used recipient's record is read from the database again.
+        XCTAssertNotNil([cache sessionForRecipientId:@"a" deviceId:1 transaction:transaction]);
+        XCTAssertEqualObjects(cache.recipientIdsByRecency.array, (@[ @"c", @"a" ]));
+        XCTAssertEqualObjects([self dataForSession:[cache sessionForRecipientId:@"c" deviceId:1 transaction:transaction]],
+            [self dataForSession:sessions[@"c"]]);
+    }];
+}
+
+- (void)testFailedDecryptLeavesSessionUnchanged
+{
+    [self buildSessionsWithRecipientCount:1 deviceCount:1];
+    NSString *recipientId = @"recipient-0";
+
+    __block NSData *sessionData;
+    __block WhisperMessage *message;
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        id<CipherMessage> cipherMessage =
+            [[self cipherForRecipientId:recipientId deviceId:1] throws_encryptMessage:[NSData dataWithLength:32]
+                                                                      protocolContext:transaction];
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+
+        WhisperMessage *whisperMessage = ([cipherMessage isKindOfClass:[PreKeyWhisperMessage class]]
+                ? ((PreKeyWhisperMessage *)cipherMessage).message
+                : (WhisperMessage *)cipherMessage);
+        // The MAC is at the end of the message.
+        NSMutableData *serialized = [whisperMessage.serialized mutableCopy];
+        ((uint8_t *)serialized.mutableBytes)[serialized.length - 1] ^= 0xff;
+        message = [[WhisperMessage alloc] init_throws_withData:serialized];
+
+        sessionData = [self
+            dataForSession:[self.primaryStorage loadSession:recipientId deviceId:1 protocolContext:transaction]];
+    }];
+
+    // SessionCipher ratchets the session before it finds the MAC is bad.
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        XCTAssertThrows(
+            [[self cipherForRecipientId:recipientId deviceId:1] throws_decrypt:message protocolContext:transaction]);
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+    }];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        XCTAssertEqualObjects(
+            [self dataForSession:[self.primaryStorage loadSession:recipientId deviceId:1 protocolContext:transaction]],
+            sessionData);
+        // Nor does the next write to the recipient's row carry the changes.
+        [self.primaryStorage storeSession:recipientId deviceId:2 session:[SessionRecord new] protocolContext:transaction];
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+    }];
+
+    [OWSPrimaryStorage.sessionStoreCache removeAllRecipients];
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        XCTAssertEqualObjects(
+            [self dataForSession:[self.primaryStorage loadSession:recipientId deviceId:1 protocolContext:transaction]],
+            sessionData);
+    }];
+}
+
+#pragma mark - Sessions
+
+- (SessionCipher *)cipherForRecipientId:(NSString *)recipientId deviceId:(int)deviceId
+{
+    return [[SessionCipher alloc] initWithSessionStore:self.primaryStorage
+                                           preKeyStore:self.primaryStorage
+                                     signedPreKeyStore:self.primaryStorage
+                                      identityKeyStore:[OWSIdentityManager sharedManager]
+                                           recipientId:recipientId
+                                              deviceId:deviceId];
+}
+
+- (void)buildSessionsWithRecipientCount:(NSUInteger)recipientCount deviceCount:(int)deviceCount
+{
+    [[OWSIdentityManager sharedManager] generateNewIdentityKey];
+
+    [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < recipientCount; i++) {
+            NSString *recipientId = [NSString stringWithFormat:@"recipient-%lu", (unsigned long)i];
+            ECKeyPair *identityKeyPair = [Curve25519 generateKeyPair];
+            for (int deviceId = 1; deviceId <= deviceCount; deviceId++) {
+                ECKeyPair *signedPreKeyPair = [Curve25519 generateKeyPair];
+                ECKeyPair *preKeyPair = [Curve25519 generateKeyPair];
+                NSData *signature =
+                    [Ed25519 throws_sign:signedPreKeyPair.publicKey.prependKeyType withKeyPair:identityKeyPair];
+                PreKeyBundle *bundle =
+                    [[PreKeyBundle alloc] initWithRegistrationId:1234
+                                                        deviceId:deviceId
+                                                        preKeyId:1
+                                                    preKeyPublic:preKeyPair.publicKey.prependKeyType
+                                              signedPreKeyPublic:signedPreKeyPair.publicKey.prependKeyType
+                                                  signedPreKeyId:1
+                                           signedPreKeySignature:signature
+                                                     identityKey:identityKeyPair.publicKey.prependKeyType];
+                SessionBuilder *builder =
+                    [[SessionBuilder alloc] initWithSessionStore:self.primaryStorage
+                                                     preKeyStore:self.primaryStorage
+                                               signedPreKeyStore:self.primaryStorage
+                                                identityKeyStore:[OWSIdentityManager sharedManager]
+                                                     recipientId:recipientId
+                                                        deviceId:deviceId];
+                [builder throws_processPrekeyBundle:bundle protocolContext:transaction];
+            }
+        }
+        [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+    }];
+}
+
+#pragma mark - Benchmarks
+
+// Encrypts one message to every device, with a transaction per device, like MessageSender.
+- (NSTimeInterval)timeToEncryptWithRecipientCount:(NSUInteger)recipientCount deviceCount:(int)deviceCount
+{
+    NSData *plaintext = [@"Hello, world" dataUsingEncoding:NSUTF8StringEncoding];
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < recipientCount; i++) {
+        NSString *recipientId = [NSString stringWithFormat:@"recipient-%lu", (unsigned long)i];
+        for (int deviceId = 1; deviceId <= deviceCount; deviceId++) {
+            [self.dbConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+                XCTAssertTrue(
+                    [self.primaryStorage containsSession:recipientId deviceId:deviceId protocolContext:transaction]);
+                SessionCipher *cipher = [self cipherForRecipientId:recipientId deviceId:deviceId];
+                [cipher throws_encryptMessage:plaintext protocolContext:transaction];
+                [cipher throws_remoteRegistrationId:transaction];
+                [self.primaryStorage flushSessionStoreWithTransaction:transaction];
+            }];
+        }
+    }
+    return CFAbsoluteTimeGetCurrent() - startTime;
+}
+
+- (void)testBenchmarkEncryptingToLargeGroup
+{
+    const NSUInteger recipientCount = 500;
+    const int deviceCount = 3;
+    [self buildSessionsWithRecipientCount:recipientCount deviceCount:deviceCount];
+
+    OWSSessionStoreCache *cache = OWSPrimaryStorage.sessionStoreCache;
+    cache.isEnabled = NO;
+    [cache removeAllRecipients];
+    NSTimeInterval uncachedTime = [self timeToEncryptWithRecipientCount:recipientCount deviceCount:deviceCount];
+
+    cache.isEnabled = YES;
+    // Warm the cache, as the first of several sends to a group would.
+    [self timeToEncryptWithRecipientCount:recipientCount deviceCount:deviceCount];
+    NSTimeInterval cachedTime = [self timeToEncryptWithRecipientCount:recipientCount deviceCount:deviceCount];
+
+    NSLog(@"%@ encrypting to %lu recipients x %d devices: uncached %.2fs, cached %.2fs.",
+        self.logTag,
+        (unsigned long)recipientCount,
+        deviceCount,
+        uncachedTime,
+        cachedTime);
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,312 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "OWSFailedMessagesJob.h"
+#import "OWSIncompleteCallsJob.h"
+#import "OWSMediaGalleryFinder.h"
+#import "OWSPrimaryStorage.h"
+#import "OWSStartupTimeline.h"
+#import "OWSStorageStartupOrchestrator.h"
+#import "TSDatabaseView.h"
+#import "TSIncomingMessage.h"
+#import "TSThread.h"
+#import <RelayServiceKit/RelayServiceKit-Swift.h>
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern void AddAsyncRegistrationsForStorage(
+    OWSStorage *storage, OWSStorageStartupOrchestrator *orchestrator, OWSStorageProfile profile);
+
+@interface OWSStorageStartupOrchestratorTest : XCTestCase
+
+@property (nonatomic) OWSPrimaryStorage *storage;
+
+@end
+
+#pragma mark -
+
+@implementation OWSStorageStartupOrchestratorTest
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.storage = [OWSPrimaryStorage sharedManager];
+    [TSInteraction removeAllObjectsInCollection];
+}
+
+- (void)saveInteractionCount:(NSUInteger)count
+{
+    NSUInteger threadCount = MAX(count / 100, 1);
+    NSMutableArray<TSThread *> *threads = [NSMutableArray new];
+    [self.storage.newDatabaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+        for (NSUInteger i = 0; i < threadCount; i++) {
+            [threads addObject:[TSThread getOrCreateThreadWithId:[NSUUID UUID].UUIDString.lowercaseString
+                                                     transaction:transaction]];
+        }
+    }];
+
+    // Large transactions are slow to commit.
+    const NSUInteger kBatchSize = 10000;
+    for (NSUInteger batchStart = 0; batchStart < count; batchStart += kBatchSize) {
+        [self.storage.newDatabaseConnection readWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+            for (NSUInteger i = batchStart; i < MIN(batchStart + kBatchSize, count); i++) {
+                TSIncomingMessage *message =
+                    [[TSIncomingMessage alloc] initIncomingMessageWithTimestamp:i + 1
+                                                                      serverAge:nil
+                                                                       inThread:threads[i % threadCount]
+                                                                       authorId:@"fake-author-id"
+                                                                 sourceDeviceId:1
+                                                                    messageBody:@"Where's the remote?"
+                                                                  attachmentIds:@[]
+                                                               expiresInSeconds:0
+                                                                  quotedMessage:nil];
+                [message saveWithTransaction:transaction];
+            }
+        }];
+    }
+}
+
+// Unregistering drops the extensions' tables, so registering them again rebuilds them from scratch, as after a
+// version bump or a restore.
+- (void)unregisterAsyncExtensions
+{
+    for (NSString *extensionName in self.storage.registeredExtensionNames) {
+        id _Nullable extension = [self.storage registeredExtension:extensionName];
+        if (!extension || [extensionName isEqualToString:@"SignalCrossProcessNotifier"]) {
+            continue;
+        }
+        [self.storage unregisterExtension:extension withName:extensionName];
+    }
+}
+
+- (OWSStorageStartupOrchestrator *)newOrchestrator
+{
+    return [self newOrchestratorWithProfile:OWSStorageProfileMainApp];
+}
+
+- (OWSStorageStartupOrchestrator *)newOrchestratorWithProfile:(OWSStorageProfile)profile
+{
+    OWSStorageStartupOrchestrator *orchestrator = [[OWSStorageStartupOrchestrator alloc] initWithStorage:self.storage];
+    AddAsyncRegistrationsForStorage(self.storage, orchestrator, profile);
+    return orchestrator;
+}
+
+- (void)waitForAllRegistrationsWithOrchestrator:(OWSStorageStartupOrchestrator *)orchestrator
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"all"];
+    [orchestrator runWhenAllExtensionsAreReady:^{
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60 * 60 handler:nil];
+}
+
+// Other tests need the extensions which the app extension profile leaves out.
+- (void)registerAllExtensions
+{
+    OWSStorageStartupOrchestrator *orchestrator = [self newOrchestrator];
+    [orchestrator runRegistrationsWithInboxCompletion:^{
+    }];
+    [self waitForAllRegistrationsWithOrchestrator:orchestrator];
+}
+
+- (void)testDeferredExtensionsAreQueuedBeforeWrites
+{
+    [self unregisterAsyncExtensions];
+
+    OWSStorageStartupOrchestrator *orchestrator = [self newOrchestrator];
+    NSArray<NSString *> *deferredNames = @[
+        [FullTextSearchFinder databaseExtensionName],
+        [OWSMediaGalleryFinder databaseExtensionName],
+        [OWSFailedMessagesJob databaseExtensionName],
+    ];
+
+    XCTestExpectation *writeExpectation = [self expectationWithDescription:@"write"];
+    [orchestrator runRegistrationsWithInboxCompletion:^{
+        // Storage is ready, but the deferred extensions needn't be yet.  They must already be queued though, or
+        // they'd miss this write.
+        for (NSString *name in deferredNames) {
+            XCTAssertTrue([self.storage.registeredExtensionNames containsObject:name]);
+        }
+
+        [self.storage.newDatabaseConnection
+            asyncReadWriteWithBlock:^(YapDatabaseReadWriteTransaction *transaction) {
+                [TSThread getOrCreateThreadWithId:[NSUUID UUID].UUIDString.lowercaseString transaction:transaction];
+            }
+            completionBlock:^{
+                for (NSString *name in deferredNames) {
+                    XCTAssertTrue([orchestrator isExtensionReady:name]);
+                }
+                [writeExpectation fulfill];
+            }];
+    }];
+
+    XCTestExpectation *allExpectation = [self expectationWithDescription:@"all"];
+    [orchestrator runWhenAllExtensionsAreReady:^{
+        XCTAssertTrue([orchestrator areAllRegistrationsComplete]);
+        [allExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+- (void)testWaitsForDeferredExtension
+{
+    [self unregisterAsyncExtensions];
+
+    OWSStorageStartupOrchestrator *orchestrator = [self newOrchestrator];
+    NSString *searchExtensionName = [FullTextSearchFinder databaseExtensionName];
+    XCTestExpectation *searchExpectation = [self expectationWithDescription:@"search"];
+    [orchestrator runWhenExtensionIsReady:searchExtensionName
+                                    block:^{
+                                        XCTAssertNotNil([self.storage registeredExtension:searchExtensionName]);
+                                        [searchExpectation fulfill];
+                                    }];
+    [orchestrator runRegistrationsWithInboxCompletion:^{
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    // Once it's ready, blocks run immediately.
+    __block BOOL didRun = NO;
+    [orchestrator runWhenExtensionIsReady:searchExtensionName
+                                    block:^{
+                                        didRun = YES;
+                                    }];
+    XCTAssertTrue(didRun);
+
+    [self waitForAllRegistrationsWithOrchestrator:orchestrator];
+}
+
+- (void)testAppExtensionProfileRegistersSendPathExtensionsBeforeReady
+{
+    [self unregisterAsyncExtensions];
+
+    OWSStorageStartupOrchestrator *orchestrator = [self newOrchestratorWithProfile:OWSStorageProfileAppExtension];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"inbox"];
+    [orchestrator runRegistrationsWithInboxCompletion:^{
+        // Sending writes messages, which these index, so they mustn't wait.
+        XCTAssertTrue([orchestrator isExtensionReady:[FullTextSearchFinder databaseExtensionName]]);
+        XCTAssertTrue([orchestrator isExtensionReady:[OWSFailedMessagesJob databaseExtensionName]]);
+        XCTAssertTrue([orchestrator areAllRegistrationsComplete]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    XCTAssertNil([self.storage registeredExtension:[OWSIncompleteCallsJob databaseExtensionName]]);
+    XCTAssertNil([self.storage registeredExtension:TSSecondaryDevicesDatabaseViewExtensionName]);
+    XCTAssertNotNil([self.storage registeredExtension:TSThreadDatabaseViewExtensionName]);
+
+    [self registerAllExtensions];
+}
+
+#pragma mark - Benchmarks
+
+// Time until storage is ready, and how much the peak memory grew by then.
+- (void)benchmarkOpenWithProfile:(OWSStorageProfile)profile
+                    inboxTime:(CFAbsoluteTime *)inboxTimePtr
+             peakMemoryGrowth:(uint64_t *)peakMemoryGrowthPtr
+{
+    [self unregisterAsyncExtensions];
+
+    OWSStorageStartupOrchestrator *orchestrator = [self newOrchestratorWithProfile:profile];
+
+    uint64_t startPeakMemory = [OWSStartupTimeline peakResidentMemory];
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    XCTestExpectation *expectation = [self expectationWithDescription:@"inbox"];
+    [orchestrator runRegistrationsWithInboxCompletion:^{
+        *inboxTimePtr = CFAbsoluteTimeGetCurrent() - startTime;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60 * 60 handler:nil];
+    *peakMemoryGrowthPtr = [OWSStartupTimeline peakResidentMemory] - startPeakMemory;
+
+    // Leave nothing running while the next profile is measured.
+    [self waitForAllRegistrationsWithOrchestrator:orchestrator];
+}
+
+// Compares how long storage takes to be ready for the share extension against the main app, having to rebuild
+// the extensions as after an update which bumps their versions.  The peak memory only ever grows, so the share
+// extension's profile is measured first.
+- (void)testAppExtensionProfilePerformance10k
+{
+    [self saveInteractionCount:10 * 1000];
+
+    CFAbsoluteTime appExtensionTime = 0;
+    uint64_t appExtensionMemory = 0;
+    [self benchmarkOpenWithProfile:OWSStorageProfileAppExtension
+                         inboxTime:&appExtensionTime
+                  peakMemoryGrowth:&appExtensionMemory];
+    CFAbsoluteTime mainAppTime = 0;
+    uint64_t mainAppMemory = 0;
+    [self benchmarkOpenWithProfile:OWSStorageProfileMainApp inboxTime:&mainAppTime peakMemoryGrowth:&mainAppMemory];
+
+    NSLog(@"%@ storage ready for the share extension after %.2fs, peak memory up %.1fMB; for the main app after "
+          @"%.2fs, peak memory up %.1fMB.",
+        self.logTag,
+        appExtensionTime,
+        appExtensionMemory / (1024.0 * 1024.0),
+        mainAppTime,
+        mainAppMemory / (1024.0 * 1024.0));
+}
+
+// Compares how long it takes to rebuild the extensions the inbox needs against rebuilding all of them.
+- (void)benchmarkRebuildWithInteractionCount:(NSUInteger)count
+{
+    [self saveInteractionCount:count];
+    [self unregisterAsyncExtensions];
+
+    OWSStorageStartupOrchestrator *orchestrator = [self newOrchestrator];
+
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    __block CFAbsoluteTime inboxTime = 0;
+    __block CFAbsoluteTime allTime = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"registrations"];
+    [orchestrator runRegistrationsWithInboxCompletion:^{
+        inboxTime = CFAbsoluteTimeGetCurrent() - startTime;
+    }];
+    [orchestrator runWhenAllExtensionsAreReady:^{
+        allTime = CFAbsoluteTimeGetCurrent() - startTime;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60 * 60 handler:nil];
+
+    NSLog(@"%@ %lu interactions: inbox extensions ready after %.2fs, all extensions after %.2fs.",
+        self.logTag,
+        (unsigned long)count,
+        inboxTime,
+        allTime);
+    XCTAssertLessThanOrEqual(inboxTime, allTime);
+}
+
+- (void)testRebuildPerformance10k
+{
+    [self benchmarkRebuildWithInteractionCount:10 * 1000];
+}
+
+// These take minutes, so they only run when asked for.
+- (BOOL)shouldRunLargeBenchmarks
+{
+    return NSProcessInfo.processInfo.environment[@"OWS_RUN_LARGE_BENCHMARKS"] != nil;
+}
+
+- (void)testRebuildPerformance100k
+{
+    if (!self.shouldRunLargeBenchmarks) {
+        return;
+    }
+    [self benchmarkRebuildWithInteractionCount:100 * 1000];
+}
+
+- (void)testRebuildPerformance1M
+{
+    if (!self.shouldRunLargeBenchmarks) {
+        return;
+    }
+    [self benchmarkRebuildWithInteractionCount:1000 * 1000];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,265 @@
+//
+//  Copyright (c) 2018 Open Whisper Systems. All rights reserved.
+//
+
+#import "NSString+SSK.h"
+#import <XCTest/XCTest.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface NSString (SSKTesting)
+
++ (BOOL)isIndicVowel:(unichar)c;
+
+- (BOOL)hasExcessiveDiacriticals;
+
+- (NSString *)filterUnsafeFilenameCharacters;
+
+- (NSString *)ows_filterWithIndicFiltering:(BOOL)filterIndic filenameFiltering:(BOOL)filterFilename;
+
+@end
+
+#pragma mark -
+
+// The step-by-step filtering which the single pass replaced.
+@interface NSString (SSKReference)
+
+- (NSString *)reference_filterForIndicScripts;
+
+- (NSString *)reference_filterWithIndicFiltering:(BOOL)filterIndic filenameFiltering:(BOOL)filterFilename;
+
+@end
+
+@implementation NSString (SSKReference)
+
+- (NSString *)reference_filterForIndicScripts
+{
+    if ([self rangeOfString:@"\u200C"].location == NSNotFound) {
+        return self;
+    }
+
+    NSMutableString *filteredForIndic = [NSMutableString new];
+    for (NSUInteger index = 0; index < self.length; index++) {
+        unichar c = [self characterAtIndex:index];
+        if (c == 0x200C) {
+            NSUInteger nextIndex = index + 1;
+            if (nextIndex < self.length) {
+                unichar next = [self characterAtIndex:nextIndex];
+                if ([NSString isIndicVowel:next]) {
+                    [filteredForIndic appendFormat:@"\uFFFD"];
+                    index++;
+                    continue;
+                }
+            }
+        }
+        [filteredForIndic appendFormat:@"%C", c];
+    }
+    return [filteredForIndic copy];
+}
+
+- (NSString *)reference_filterWithIndicFiltering:(BOOL)filterIndic filenameFiltering:(BOOL)filterFilename
+{
+    NSString *result = self.ows_stripped;
+    if (filterIndic) {
+        result = result.reference_filterForIndicScripts;
+    }
+    if (result.hasExcessiveDiacriticals) {
+        result = [result stringByFoldingWithOptions:NSDiacriticInsensitiveSearch locale:[NSLocale currentLocale]];
+    }
+    if (filterFilename) {
+        result = result.filterUnsafeFilenameCharacters;
+    }
+    return result;
+}
+
+@end
+
+#pragma mark -
+
+@interface NSStringSSKTest : XCTestCase
+
+@end
+
+#pragma mark -
+
+@implementation NSStringSSKTest
+
++ (NSArray<NSString *> *)corpus
+{
+    return @[
+        @"",
+        @" ",
+        @"\n\t  \u3000",
+        @"boring text",
+        @"  padded text \n",
+        @"Příliš žluťoučký kůň úpěl ďábelské ódy.",
+        @"Съешь же ещё этих мягких французских булок, да выпей чаю.",
+        @"Ξεσκεπάζω τὴν ψυχοφθόρα βδελυγμία.",
+        @"صِف خَلقَ خَودِ كَمِثلِ الشَمسِ إِذ بَزَغَت",
+        @"עטלף אבק נס דרך מזגן שהתפוצץ כי חם",
+        @"ऋषियों को सताने वाले दुष्ट राक्षसों के राजा रावण का सर्वनाश करने वाले विष्णुवतार भगवान श्रीराम",
+        @"क्ष्म्य्र्व्ल्य्",
+        @"আমি বাংলায় গান গাই",
+        @"తెలుగు భాష",
+        @"స\u200Cా ক\u200Cা स\u200Cा",
+        @"\u200Cా\u200C",
+        @"\u200C",
+        @"เป็นมนุษย์สุดประเสริฐเลิศคุณค่า กำ",
+        @"天地玄黄，宇宙洪荒。日月盈昃，辰宿列张。",
+        @"いろはにほへと ちりぬるを わかよたれそ つねならむ",
+        @"ｶﾞｷﾞｸﾞｹﾞｺﾞ",
+        @"키스의 고유조건은 입술끼리 만나야 하고 특별한 기술은 필요치 않다.",
+        @"각각각각",
+        @"ᄀᄀᄀᄀᄀᄀᄀᄀ가",
+        @"🇹🇹🌼🇹🇹🌼🇹🇹",
+        @"👨\u200D👩\u200D👧\u200D👦 👩🏽\u200D💻 🏳️\u200D🌈 🏴󠁧󠁢󠁳󠁣󠁴󠁿",
+        @"0️⃣1️⃣2️⃣3️⃣4️⃣5️⃣6️⃣7️⃣8️⃣9️⃣🔟",
+        @"\u200D©\u200D®\u200D©\u200D®\u200D©",
+        @"\r\n\r\n\r\n\r\n\r\n",
+        @"a\r\nb",
+        @"\u0600\u0600\u0600\u0600\u0600\u0600\u0600\u0600\u0600a",
+        @"H҉̸̧͘͠A͢͞V̛̛I̴̸N͏̕͏G҉̵͜͏͢ ̧̧́T̶̛͘͡R̸̵̨̢̀O̷̡U͡҉B̶̛͢͞L̸̸͘͢͟É̸ ̸̛͘͏R͟È͠͞A̸͝Ḑ̕͘͜I̵͘҉͜͞N̷̡̢͠G̴͘͠ ͟͞T͏̢́͡È̀X̕҉̢̀T̢͠?̕͏̢͘͢",
+        @"L̷̳͔̲͝Ģ̵̮̯̤̩̙͍̬̟͉̹̘̹͍͈̮̦̰̣͟͝O̶̴̮̻̮̗͘͡!̴̷̟͓͓",
+        @"é́́́́́́",
+        @"é́́́́́́́",
+        @"report\u202Efdp.exe",
+        @"\u202Dinvoice\u202E.txt ",
+        @"Z̷a̶l̵g̴o\u202E.jpg",
+        [NSString stringWithFormat:@"lone %C surrogates %C", (unichar)0xD83D, (unichar)0xDE00],
+    ];
+}
+
+// Random concatenations of fragments of the corpus, so that the interesting sequences also appear at the edges
+// of strings and next to each other.
++ (NSArray<NSString *> *)fuzzedCorpusWithCount:(NSUInteger)count
+{
+    NSArray<NSString *> *corpus = self.corpus;
+    NSMutableArray<NSString *> *result = [NSMutableArray new];
+    srand48(1234);
+    for (NSUInteger i = 0; i < count; i++) {
+        NSMutableString *string = [NSMutableString new];
+        NSUInteger fragmentCount = (NSUInteger)(lrand48() % 4) + 1;
+        for (NSUInteger j = 0; j < fragmentCount; j++) {
+            NSString *source = corpus[(NSUInteger)lrand48() % corpus.count];
+            if (source.length < 1) {
+                continue;
+            }
+            NSUInteger location = (NSUInteger)lrand48() % source.length;
+            NSUInteger length = (NSUInteger)lrand48() % (source.length - location + 1);
+            [string appendString:[source substringWithRange:NSMakeRange(location, length)]];
+        }
+        [result addObject:[string copy]];
+    }
+    return result;
+}
+
+- (void)assertFilteringMatchesReferenceForStrings:(NSArray<NSString *> *)strings
+{
+    for (NSString *string in strings) {
+        for (NSNumber *filterIndic in @[ @(NO), @(YES) ]) {
+            for (NSNumber *filterFilename in @[ @(NO), @(YES) ]) {
+                NSString *expected = [string reference_filterWithIndicFiltering:filterIndic.boolValue
+                                                              filenameFiltering:filterFilename.boolValue];
+                NSString *actual = [string ows_filterWithIndicFiltering:filterIndic.boolValue
+                                                      filenameFiltering:filterFilename.boolValue];
+                XCTAssertEqualObjects(actual,
+                    expected,
+                    @"string: %@, filterIndic: %@, filterFilename: %@",
+                    string,
+                    filterIndic,
+                    filterFilename);
+            }
+        }
+    }
+}
+
+- (void)testFilteringMatchesReference
+{
+    [self assertFilteringMatchesReferenceForStrings:self.class.corpus];
+}
+
+- (void)testFilteringMatchesReferenceForFuzzedStrings
+{
+    [self assertFilteringMatchesReferenceForStrings:[self.class fuzzedCorpusWithCount:5000]];
+}
+
+- (void)testFilteringReturnsSelfWhenNothingApplies
+{
+    for (NSString *string in @[ @"boring text", @"天地玄黄", @"👨\u200D👩\u200D👧\u200D👦", @"Příliš žluťoučký kůň" ]) {
+        NSString *mutableCopy = [string mutableCopy];
+        XCTAssertTrue([mutableCopy filterStringForDisplay] == mutableCopy);
+        XCTAssertTrue([mutableCopy filterFilename] == mutableCopy);
+    }
+}
+
+- (void)testFilterFilename
+{
+    XCTAssertEqualObjects(@" report\u202Efdp.exe ".filterFilename, @"report\uFFFDfdp.exe");
+    XCTAssertEqualObjects(@"report\u202Efdp.exe".filterStringForDisplay, @"report\u202Efdp.exe");
+    XCTAssertEqualObjects(@"\u202D\u202E".filterFilename, @"\uFFFD\uFFFD");
+}
+
+- (void)testFilterIndic
+{
+    XCTAssertEqualObjects([@"స\u200Cా" ows_filterWithIndicFiltering:YES filenameFiltering:NO], @"స\uFFFD");
+    XCTAssertEqualObjects([@"స\u200Cా" ows_filterWithIndicFiltering:NO filenameFiltering:NO], @"స\u200Cా");
+    XCTAssertEqualObjects([@"స\u200C" ows_filterWithIndicFiltering:YES filenameFiltering:NO], @"స\u200C");
+}
+
+- (void)testIsValidE164
+{
+    XCTAssertTrue(@"+13213214321".isValidE164);
+    XCTAssertTrue(@"+1".isValidE164);
+    XCTAssertFalse(@"13213214321".isValidE164);
+    XCTAssertFalse(@"+".isValidE164);
+    XCTAssertFalse(@"+1321321432a".isValidE164);
+    XCTAssertFalse(@"".isValidE164);
+    XCTAssertFalse(@" +13213214321".isValidE164);
+}
+
+#pragma mark - Benchmarks
+
+// A multilingual corpus in which, like real messages, only a few strings need any filtering.
++ (NSArray<NSString *> *)benchmarkCorpus
+{
+    NSMutableArray<NSString *> *result = [NSMutableArray new];
+    NSArray<NSString *> *corpus = self.corpus;
+    for (NSUInteger i = 0; i < 200; i++) {
+        [result addObjectsFromArray:[corpus subarrayWithRange:NSMakeRange(3, 23)]];
+    }
+    [result addObjectsFromArray:corpus];
+    return result;
+}
+
+- (void)testBenchmarkReferenceFilterForDisplay
+{
+    NSArray<NSString *> *corpus = self.class.benchmarkCorpus;
+    [self measureBlock:^{
+        for (NSString *string in corpus) {
+            [string reference_filterWithIndicFiltering:YES filenameFiltering:NO];
+        }
+    }];
+}
+
+- (void)testBenchmarkFilterForDisplay
+{
+    NSArray<NSString *> *corpus = self.class.benchmarkCorpus;
+    [self measureBlock:^{
+        for (NSString *string in corpus) {
+            [string ows_filterWithIndicFiltering:YES filenameFiltering:NO];
+        }
+    }];
+}
+
+- (void)testBenchmarkIsValidE164
+{
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10000; i++) {
+            (void)@"+13213214321".isValidE164;
+        }
+    }];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -39,6 +39,8 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
         let appContext = ShareAppExtensionContext(rootViewController: self)
         SetCurrentAppContext(appContext)
 
+        OWSStartupTimeline.shared().markEvent("shareExtension.loadView")
+
         DebugLogger.shared().enableTTYLogging()
         if _isDebugAssertConfiguration() {
             DebugLogger.shared().enableFileLogging()
@@ -156,6 +158,7 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
             self.dismiss(animated: false) { [weak self] in
                 AssertIsOnMainThread(file: #function)
                 guard let strongSelf = self else { return }
+                ShareViewController.removeSharedFiles()
                 strongSelf.extensionContext!.completeRequest(returningItems: [], completionHandler: nil)
             }
         }
@@ -485,6 +488,7 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
         self.dismiss(animated: true) { [weak self] in
             AssertIsOnMainThread(file: #function)
             guard let strongSelf = self else { return }
+            ShareViewController.removeSharedFiles()
             strongSelf.extensionContext!.completeRequest(returningItems: [], completionHandler: nil)
         }
     }
@@ -495,6 +499,7 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
         self.dismiss(animated: true) { [weak self] in
             AssertIsOnMainThread(file: #function)
             guard let strongSelf = self else { return }
+            ShareViewController.removeSharedFiles()
             strongSelf.extensionContext!.completeRequest(returningItems: [], completionHandler: nil)
         }
     }
@@ -505,6 +510,7 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
         self.dismiss(animated: true) { [weak self] in
             AssertIsOnMainThread(file: #function)
             guard let strongSelf = self else { return }
+            ShareViewController.removeSharedFiles()
             strongSelf.extensionContext!.cancelRequest(withError: error)
         }
     }
@@ -546,6 +552,10 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
             conversationPicker.attachment = attachment
             strongSelf.showPrimaryViewController(conversationPicker)
             Logger.info("\(strongSelf.logTag) showing picker with attachment: \(attachment)")
+
+            // Time-to-picker and the peak memory use by then.
+            OWSStartupTimeline.shared().markEvent("shareExtension.pickerPresented")
+            OWSStartupTimeline.shared().logTimeline()
         }.catch { [weak self] error in
             AssertIsOnMainThread(file: #function)
             guard let strongSelf = self else { return }
@@ -608,6 +618,46 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
         return matchingUtiType
     }
 
+    // Files, as opposed to textual shares, URLs and contacts, which are small and rely on loadItem's coercions.
+    private class func isFileItem(itemProvider: NSItemProvider, utiType: String) -> Bool {
+        guard utiType != (kUTTypeURL as String) else {
+            return false
+        }
+        guard !UTTypeConformsTo(utiType as CFString, kUTTypeText) else {
+            return false
+        }
+        guard !isContactItem(itemProvider: itemProvider) else {
+            return false
+        }
+        return UTTypeConformsTo(utiType as CFString, kUTTypeData)
+    }
+
+    private class var sharedFilesDirectory: URL {
+        return URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("share", isDirectory: true)
+    }
+
+    // The files have been sent, or won't be, by the time the share is completed or cancelled.
+    private class func removeSharedFiles() {
+        OWSFileSystem.deleteFileIfExists(sharedFilesDirectory.path)
+    }
+
+    // The file must be copied before the item provider's completion handler returns, after which it's deleted.
+    private class func copyToTemporaryDirectory(url fromUrl: URL) throws -> URL {
+        let baseDir = sharedFilesDirectory.appendingPathComponent(UUID().uuidString, isDirectory: true)
+        OWSFileSystem.ensureDirectoryExists(baseDir.path)
+        let toUrl = baseDir.appendingPathComponent(fromUrl.lastPathComponent)
+
+        Logger.debug("\(self.logTag) linking \(fromUrl) -> \(toUrl)")
+        // Neither a hard link nor a copy (which APFS clones) reads the file into memory.
+        do {
+            try FileManager.default.linkItem(at: fromUrl, to: toUrl)
+        } catch {
+            Logger.info("\(self.logTag) couldn't link file, copying it: \(error)")
+            try FileManager.default.copyItem(at: fromUrl, to: toUrl)
+        }
+        return toUrl
+    }
+
     private class func preferredItemProvider(inputItem: NSExtensionItem) -> NSItemProvider? {
         guard let attachments = inputItem.attachments else {
             return nil
@@ -793,7 +843,31 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
             }
         }
 
-        itemProvider.loadItem(forTypeIdentifier: srcUtiType, options: nil, completionHandler: loadCompletion)
+        // loadItem may hand over a shared file as Data or a UIImage, holding all of it in memory, which large videos
+        // and photos exceed the extension's limit with.  Instead, files are streamed to a temporary file of ours.
+        var isStreamedToTemporaryFile = false
+        if #available(iOS 11.0, *), ShareViewController.isFileItem(itemProvider: itemProvider, utiType: srcUtiType) {
+            isStreamedToTemporaryFile = true
+            itemProvider.loadFileRepresentation(forTypeIdentifier: srcUtiType) { (fileUrl, error) in
+                guard error == nil else {
+                    resolver.reject(error!)
+                    return
+                }
+                guard let fileUrl = fileUrl else {
+                    let missingFileError = ShareViewControllerError.assertionError(description: "missing file url")
+                    resolver.reject(missingFileError)
+                    return
+                }
+                do {
+                    let temporaryUrl = try ShareViewController.copyToTemporaryDirectory(url: fileUrl)
+                    resolver.fulfill((itemUrl: temporaryUrl, utiType: srcUtiType))
+                } catch {
+                    resolver.reject(ShareViewControllerError.assertionError(description: "couldn't copy file: \(String(describing: error))"))
+                }
+            }
+        } else {
+            itemProvider.loadItem(forTypeIdentifier: srcUtiType, options: nil, completionHandler: loadCompletion)
+        }
 
         return promise.then { [weak self] (itemUrl: URL, utiType: String) -> Promise<SignalAttachment> in
             guard let strongSelf = self else {
@@ -802,7 +876,8 @@ public class ShareViewController: UIViewController, ShareViewDelegate, SAEFailed
             }
 
             let url: URL = try {
-                if strongSelf.isVideoNeedingRelocation(itemProvider: itemProvider, itemUrl: itemUrl) {
+                // A streamed file is already in our container.
+                if !isStreamedToTemporaryFile && strongSelf.isVideoNeedingRelocation(itemProvider: itemProvider, itemUrl: itemUrl) {
                     return try SignalAttachment.copyToVideoTempDir(url: itemUrl)
                 } else {
                     return itemUrl